@@ -38,6 +38,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <grp.h>
+#include <poll.h>
 #include <pwd.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -47,6 +48,10 @@
 #include <sys/time.h>
 #include <unistd.h>
 
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #include <apti18n.h>
 									/*}}}*/
 
@@ -416,6 +421,31 @@ string pkgAcquire::QueueName(string Uri,MethodConfig const *&Config)
    if (Config->SingleInstance == true)
       return U.Access;
 
+   // find the queue with the least to do among those matching the filter
+   auto const LeastBusyQueue = [this](auto const &Filter) -> Queue const * {
+      Queue const *selected = nullptr;
+      auto selected_backlog = std::numeric_limits<decltype(HashStringList().FileSize())>::max();
+      for (Queue const *Q = Queues; Q != nullptr; Q = Q->Next)
+	 if (Filter(Q))
+	 {
+	    decltype(selected_backlog) current_backlog = 0;
+	    for (auto const *I = Q->Items; I != nullptr; I = I->Next)
+	    {
+	       auto const hashes = I->Owner->GetExpectedHashes();
+	       if (not hashes.empty())
+		  current_backlog += hashes.FileSize();
+	       else
+		  current_backlog += I->Owner->FileSize;
+	    }
+	    if (current_backlog < selected_backlog)
+	    {
+	       selected = Q;
+	       selected_backlog = current_backlog;
+	    }
+	 }
+      return selected;
+   };
+
    // Host-less methods like rred, store, …
    if (U.Host.empty())
    {
@@ -444,27 +474,9 @@ string pkgAcquire::QueueName(string Uri,MethodConfig const *&Config)
 
       // find the worker with the least to do
       // we already established that there are no empty and we can't spawn new
-      Queue const *selected = nullptr;
-      auto selected_backlog = std::numeric_limits<decltype(HashStringList().FileSize())>::max();
-      for (Queue const *Q = Queues; Q != nullptr; Q = Q->Next)
-	 if (APT::String::Startswith(Q->Name, AccessSchema))
-	 {
-	    decltype(selected_backlog) current_backlog = 0;
-	    for (auto const *I = Q->Items; I != nullptr; I = I->Next)
-	    {
-	       auto const hashes = I->Owner->GetExpectedHashes();
-	       if (not hashes.empty())
-		  current_backlog += hashes.FileSize();
-	       else
-		  current_backlog += I->Owner->FileSize;
-	    }
-	    if (current_backlog < selected_backlog)
-	    {
-	       selected = Q;
-	       selected_backlog = current_backlog;
-	    }
-	 }
-
+      auto const selected = LeastBusyQueue([&](Queue const * const Q) {
+	 return APT::String::Startswith(Q->Name, AccessSchema);
+      });
       if (unlikely(selected == nullptr))
 	 return AccessSchema + "0";
       return selected->Name;
@@ -473,10 +485,25 @@ string pkgAcquire::QueueName(string Uri,MethodConfig const *&Config)
    else
    {
       auto const FullQueueName = U.Access + ':' + U.Host;
-      // if the queue already exists, re-use it
+      std::string const ConnectionsOption = "Acquire::" + U.Access + "::MaxConnectionsPerHost";
+      int const Connections = _config->Exists(ConnectionsOption + "::" + U.Host) ?
+	    _config->FindI(ConnectionsOption + "::" + U.Host) : _config->FindI(ConnectionsOption, 1);
+      // each queue has its own method and hence connection, so with multiple
+      // connections allowed the items are spread over the queues of the host
+      // named FullQueueName, FullQueueName/1, FullQueueName/2, …
+      auto const HostQueuePrefix = FullQueueName + '/';
+      auto const IsHostQueue = [&](Queue const * const Q) {
+	 return Q->Name == FullQueueName || (Connections > 1 && APT::String::Startswith(Q->Name, HostQueuePrefix));
+      };
+      int hostQueues = 0;
+      // if the queue already exists, re-use it preferring an empty one
       for (Queue const *Q = Queues; Q != nullptr; Q = Q->Next)
-	 if (Q->Name == FullQueueName)
-	    return FullQueueName;
+	 if (IsHostQueue(Q))
+	 {
+	    if (Connections <= 1 || Q->Items == nullptr)
+	       return Q->Name;
+	    ++hostQueues;
+	 }
 
       int existing = 0;
       // check how many queues exist already and reuse empty ones
@@ -486,6 +513,14 @@ string pkgAcquire::QueueName(string Uri,MethodConfig const *&Config)
 	    ++existing;
 
       int const Limit = _config->FindI("Acquire::QueueHost::Limit", DEFAULT_HOST_LIMIT);
+      if (hostQueues != 0)
+      {
+	 // open another connection to the host if we are allowed to
+	 if (hostQueues < Connections && existing < Limit)
+	    return HostQueuePrefix + std::to_string(hostQueues);
+	 return LeastBusyQueue(IsHostQueue)->Name;
+      }
+
       // if we have too many hosts open use a single generic for the rest
       if (existing >= Limit)
 	 return U.Access;
@@ -695,6 +730,176 @@ static void CheckDropPrivsMustBeDisabled(pkgAcquire const &Fetcher)
    if (setgroups(old_gidlist_nr, old_gidlist.get()))
       _error->FatalE("setgroups", "setgroups %u failed", 0);
 }
+// WorkerPoll - Wait for activity on the FDs of the workers		/*{{{*/
+/* select() needs the sets of all FDs rebuilt for each wait, can't handle
+   FDs above FD_SETSIZE and leaves it to the caller to find the active ones.
+   Instead the FDs of the workers stay registered for the whole run: Before
+   each wait the registrations are brought in sync with the workers, which
+   only involves a syscall for FDs which actually changed, and afterwards
+   only the workers with activity are dispatched to. If epoll isn't
+   available poll() is used with the same registrations. */
+class APT_HIDDEN WorkerPoll
+{
+   struct Registration
+   {
+      pkgAcquire::Worker *Owner = nullptr;
+      short Events = 0;
+      unsigned long Generation = 0;
+   };
+   // indexed by the FD
+   std::vector<Registration> Fds;
+   std::vector<int> Registered;
+   unsigned long Generation = 0;
+   int EpollFd = -1;
+#ifdef HAVE_EPOLL
+   std::vector<struct epoll_event> EpollActive;
+#endif
+   std::vector<struct pollfd> PollActive;
+   int Ready = 0;
+
+   bool Control(int const Fd, short const Events, bool const Known)
+   {
+#ifdef HAVE_EPOLL
+      if (EpollFd == -1)
+	 return true;
+      struct epoll_event Event;
+      memset(&Event, 0, sizeof(Event));
+      if ((Events & POLLIN) != 0)
+	 Event.events |= EPOLLIN;
+      if ((Events & POLLOUT) != 0)
+	 Event.events |= EPOLLOUT;
+      Event.data.fd = Fd;
+      if (epoll_ctl(EpollFd, Known ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, Fd, &Event) == 0)
+	 return true;
+      // closed FDs are dropped by the kernel, so a reused number might be new to it
+      if (errno == ENOENT && epoll_ctl(EpollFd, EPOLL_CTL_ADD, Fd, &Event) == 0)
+	 return true;
+      if (errno == EEXIST && epoll_ctl(EpollFd, EPOLL_CTL_MOD, Fd, &Event) == 0)
+	 return true;
+      return _error->Errno("epoll_ctl", "Failed to watch file descriptor %d", Fd);
+#else
+      return true;
+#endif
+   }
+   void Unwatch(int const Fd)
+   {
+#ifdef HAVE_EPOLL
+      // fails if the FD was closed already, which is fine
+      if (EpollFd != -1)
+	 epoll_ctl(EpollFd, EPOLL_CTL_DEL, Fd, nullptr);
+#endif
+      Fds[Fd] = Registration();
+   }
+
+   public:
+   /** \brief registers the FD as watched by the worker for the given events
+    *
+    *  Only valid while Sync() runs. */
+   bool Watch(pkgAcquire::Worker * const Owner, int const Fd, short const Events)
+   {
+      if (static_cast<size_t>(Fd) >= Fds.size())
+	 Fds.resize(Fd + 1);
+      auto &R = Fds[Fd];
+      bool const Known = R.Events != 0;
+      // the FD might have been closed and its number reused by another worker
+      if (Known == false || R.Events != Events || R.Owner != Owner)
+      {
+	 if (Control(Fd, Events, Known) == false)
+	    return false;
+	 if (Known == false)
+	    Registered.push_back(Fd);
+      }
+      R.Owner = Owner;
+      R.Events = Events;
+      R.Generation = Generation;
+      return true;
+   }
+   /** \brief updates the registrations with the FDs passed to Watch() by WatchAll
+    *
+    *  FDs which were registered before, but are not watched anymore are
+    *  removed from the registrations. */
+   template <class Callback>
+   bool Sync(Callback const &WatchAll)
+   {
+      ++Generation;
+      if (WatchAll() == false)
+	 return false;
+      Registered.erase(std::remove_if(Registered.begin(), Registered.end(), [&](int const Fd) {
+	 if (Fds[Fd].Generation == Generation)
+	    return false;
+	 Unwatch(Fd);
+	 return true;
+      }), Registered.end());
+      return true;
+   }
+   /** \brief waits for activity on the registered FDs
+    *
+    *  \return the number of active FDs, 0 on timeout or -1 on error */
+   int Wait(std::chrono::steady_clock::duration const Timeout)
+   {
+      // round up, so that we don't wake up just before the timeout
+      auto const Milliseconds = std::chrono::ceil<std::chrono::milliseconds>(Timeout).count();
+      int const Ms = Milliseconds <= 0 ? 0 : std::min<decltype(Milliseconds)>(Milliseconds, std::numeric_limits<int>::max());
+#ifdef HAVE_EPOLL
+      if (EpollFd != -1)
+      {
+	 EpollActive.resize(std::max<size_t>(Registered.size(), 1));
+	 do
+	    Ready = epoll_wait(EpollFd, EpollActive.data(), EpollActive.size(), Ms);
+	 while (Ready < 0 && errno == EINTR);
+	 if (Ready < 0)
+	    _error->Errno("epoll_wait", "Waiting for the acquire methods has failed");
+	 return Ready;
+      }
+#endif
+      PollActive.clear();
+      for (int const Fd : Registered)
+	 PollActive.push_back(pollfd{Fd, Fds[Fd].Events, 0});
+      do
+	 Ready = poll(PollActive.data(), PollActive.size(), Ms);
+      while (Ready < 0 && errno == EINTR);
+      if (Ready < 0)
+	 _error->Errno("poll", "Waiting for the acquire methods has failed");
+      return Ready;
+   }
+   /** \brief calls Handle with the worker, FD and events of each registration
+    *  with activity found by Wait() */
+   template <class Callback>
+   bool Dispatch(Callback const &Handle)
+   {
+      bool Res = true;
+      auto const Active = [&](int const Fd) {
+	 auto const &R = Fds[Fd];
+	 Res &= Handle(R.Owner, Fd, R.Events);
+      };
+#ifdef HAVE_EPOLL
+      if (EpollFd != -1)
+      {
+	 for (int I = 0; I < Ready; ++I)
+	    Active(EpollActive[I].data.fd);
+	 return Res;
+      }
+#endif
+      for (auto const &P : PollActive)
+	 if (P.revents != 0)
+	    Active(P.fd);
+      return Res;
+   }
+
+   WorkerPoll()
+   {
+#ifdef HAVE_EPOLL
+      // fallback to poll() if e.g. a seccomp filter denies epoll
+      EpollFd = epoll_create1(EPOLL_CLOEXEC);
+#endif
+   }
+   ~WorkerPoll()
+   {
+      if (EpollFd != -1)
+	 close(EpollFd);
+   }
+};
+									/*}}}*/
 pkgAcquire::RunResult pkgAcquire::Run(int PulseInterval)
 {
    _error->PushToStack();
@@ -711,17 +916,25 @@ pkgAcquire::RunResult pkgAcquire::Run(int PulseInterval)
    bool WasCancelled = false;
 
    // Run till all things have been acquired
-   struct timeval tv = SteadyDurationToTimeVal(std::chrono::microseconds(PulseInterval));
+   WorkerPoll Poll;
+   auto const PulseTime = std::chrono::microseconds(PulseInterval);
+   auto NextPulse = clock::now() + PulseTime;
    while (ToFetch > 0)
    {
-      fd_set RFds;
-      fd_set WFds;
-      int Highest = 0;
-      FD_ZERO(&RFds);
-      FD_ZERO(&WFds);
-      SetFds(Highest,&RFds,&WFds);
-
-      // Shorten the select() cycle in case we have items about to become ready
+      bool const Watched = Poll.Sync([&]() {
+	 for (Worker *I = Workers; I != 0; I = I->NextAcquire)
+	 {
+	    if (I->InReady == true && I->InFd >= 0 && Poll.Watch(I, I->InFd, POLLIN) == false)
+	       return false;
+	    if (I->OutReady == true && I->OutFd >= 0 && Poll.Watch(I, I->OutFd, POLLOUT) == false)
+	       return false;
+	 }
+	 return true;
+      });
+      if (Watched == false)
+	 break;
+
+      // Shorten the wait in case we have items about to become ready
       auto now = clock::now();
       auto fetchAfter = time_point{};
       for (Queue *I = Queues; I != nullptr; I = I->Next)
@@ -738,7 +951,7 @@ pkgAcquire::RunResult pkgAcquire::Run(int PulseInterval)
 	 {
 	    if (not I->Cycle()) // Queue got stuck, unstuck it.
 	       goto stop;
-	    fetchAfter = now; // need to time out in select() below
+	    fetchAfter = now; // need to time out in the wait below
 	    if (I->Items->Owner->Status == pkgAcquire::Item::StatIdle)
 	    {
 	       _error->Warning("Tried to start delayed item %s, but failed", I->Items->Description.c_str());
@@ -750,31 +963,30 @@ pkgAcquire::RunResult pkgAcquire::Run(int PulseInterval)
 	 }
       }
 
-      if (fetchAfter != time_point{} && (fetchAfter - now) < std::chrono::seconds(tv.tv_sec) + std::chrono::microseconds(tv.tv_usec))
-      {
-	 tv = SteadyDurationToTimeVal(fetchAfter - now);
-      }
+      auto WakeUp = NextPulse;
+      if (fetchAfter != time_point{} && fetchAfter < WakeUp)
+	 WakeUp = fetchAfter;
 
-      int Res;
-      do
-      {
-	 Res = select(Highest+1,&RFds,&WFds,0,&tv);
-      }
-      while (Res < 0 && errno == EINTR);
-      
-      if (Res < 0)
-      {
-	 _error->Errno("select","Select has failed");
+      if (Poll.Wait(WakeUp - now) < 0)
 	 break;
-      }
 
-      if(RunFds(&RFds,&WFds) == false)
+      bool const Dispatched = Poll.Dispatch([](Worker * const I, int const Fd, short const Events) {
+	 // the FD might have been closed by a worker dispatched to before
+	 bool Res = true;
+	 if ((Events & POLLIN) != 0 && I->InFd == Fd)
+	    Res &= I->InFdReady();
+	 if ((Events & POLLOUT) != 0 && I->OutFd == Fd)
+	    Res &= I->OutFdReady();
+	 return Res;
+      });
+      if (Dispatched == false)
          break;
 
       // Timeout, notify the log class
-      if (Res == 0 || (Log != 0 && Log->Update == true))
+      now = clock::now();
+      if (now >= NextPulse || (Log != 0 && Log->Update == true))
       {
-	 tv = SteadyDurationToTimeVal(std::chrono::microseconds(PulseInterval));
+	 NextPulse = now + PulseTime;
 
 	 for (Worker *I = Workers; I != 0; I = I->NextAcquire)
 	    I->Pulse();
@@ -223,6 +223,8 @@ class APT_PUBLIC pkgAcquire
     *
     *  \param[out] WSet The set of file descriptors that should be
     *  watched for output.
+    *
+    *  \note Run() doesn't use select() anymore, so this isn't called.
     */
    virtual void SetFds(int &Fd,fd_set *RSet,fd_set *WSet);
 
@@ -237,6 +239,8 @@ class APT_PUBLIC pkgAcquire
     *  output.
     *
     * \return false if there is an error condition on one of the fds
+    *
+    *  \note Run() doesn't use select() anymore, so this isn't called.
     */
    virtual bool RunFds(fd_set *RSet,fd_set *WSet);
 
@@ -314,6 +314,12 @@ void pkgCacheFile::RemoveCaches()
    SetCacheStartBeforeRemovingCache(pkgcache);
    std::string const srcpkgcache = _config->FindFile("Dir::cache::srcpkgcache");
    SetCacheStartBeforeRemovingCache(srcpkgcache);
+   std::string const searchindex = _config->FindFile("Dir::cache::searchindex");
+   if (searchindex.empty() == false && RealFileExists(searchindex))
+      RemoveFile("RemoveCaches", searchindex);
+   std::string const depcache = _config->FindFile("Dir::cache::depcache");
+   if (depcache.empty() == false && RealFileExists(depcache))
+      RemoveFile("RemoveCaches", depcache);
 
    if (pkgcache.empty() == false)
    {
@@ -9,6 +9,10 @@
 #include <config.h>
 
 #include <apt-pkg/cachefilter-patterns.h>
+#include <apt-pkg/configuration.h>
+
+#include <algorithm>
+#include <unordered_map>
 
 #include <apti18n.h>
 
@@ -65,6 +69,24 @@ static const constexpr struct
    {"v"_sv, "?virtual"_sv, false},
 };
 
+// The patterns on dependencies of a version and their reverse
+static const constexpr struct
+{
+   APT::StringView name;
+   APT::StringView reverseName;
+   pkgCache::Dep::DepType type;
+} dependsPatterns[] = {
+   {"?depends"_sv, "?reverse-depends"_sv, pkgCache::Dep::Depends},
+   {"?predepends"_sv, "?reverse-predepends"_sv, pkgCache::Dep::PreDepends},
+   {"?suggests"_sv, "?reverse-suggests"_sv, pkgCache::Dep::Suggests},
+   {"?recommends"_sv, "?reverse-recommends"_sv, pkgCache::Dep::Recommends},
+   {"?conflicts"_sv, "?reverse-conflicts"_sv, pkgCache::Dep::Conflicts},
+   {"?replaces"_sv, "?reverse-replaces"_sv, pkgCache::Dep::Replaces},
+   {"?obsoletes"_sv, "?reverse-obsoletes"_sv, pkgCache::Dep::Obsoletes},
+   {"?breaks"_sv, "?reverse-breaks"_sv, pkgCache::Dep::DpkgBreaks},
+   {"?enhances"_sv, "?reverse-enhances"_sv, pkgCache::Dep::Enhances},
+};
+
 template <class... Args>
 std::string rstrprintf(Args... args)
 {
@@ -442,42 +464,13 @@ std::unique_ptr<APT::CacheFilter::Matcher> PatternParser::aPattern(std::unique_p
       return std::make_unique<Patterns::PackageIsBroken>(file);
    if (node->matches("?config-files", 0, 0))
       return std::make_unique<Patterns::PackageIsConfigFiles>();
-   if (node->matches("?depends", 1, 1))
-      return std::make_unique<Patterns::VersionDepends>(aPattern(node->arguments[0]));
-   if (node->matches("?predepends", 1, 1))
-      return std::make_unique<Patterns::VersionDepends>(aPattern(node->arguments[0]), pkgCache::Dep::PreDepends);
-   if (node->matches("?suggests", 1, 1))
-      return std::make_unique<Patterns::VersionDepends>(aPattern(node->arguments[0]), pkgCache::Dep::Suggests);
-   if (node->matches("?recommends", 1, 1))
-      return std::make_unique<Patterns::VersionDepends>(aPattern(node->arguments[0]), pkgCache::Dep::Recommends);
-   if (node->matches("?conflicts", 1, 1))
-      return std::make_unique<Patterns::VersionDepends>(aPattern(node->arguments[0]), pkgCache::Dep::Conflicts);
-   if (node->matches("?replaces", 1, 1))
-      return std::make_unique<Patterns::VersionDepends>(aPattern(node->arguments[0]), pkgCache::Dep::Replaces);
-   if (node->matches("?obsoletes", 1, 1))
-      return std::make_unique<Patterns::VersionDepends>(aPattern(node->arguments[0]), pkgCache::Dep::Obsoletes);
-   if (node->matches("?breaks", 1, 1))
-      return std::make_unique<Patterns::VersionDepends>(aPattern(node->arguments[0]), pkgCache::Dep::DpkgBreaks);
-   if (node->matches("?enhances", 1, 1))
-      return std::make_unique<Patterns::VersionDepends>(aPattern(node->arguments[0]), pkgCache::Dep::Enhances);
-   if (node->matches("?reverse-depends", 1, 1))
-      return std::make_unique<Patterns::PackageReverseDepends>(aPattern(node->arguments[0]));
-   if (node->matches("?reverse-predepends", 1, 1))
-      return std::make_unique<Patterns::PackageReverseDepends>(aPattern(node->arguments[0]), pkgCache::Dep::PreDepends);
-   if (node->matches("?reverse-suggests", 1, 1))
-      return std::make_unique<Patterns::PackageReverseDepends>(aPattern(node->arguments[0]), pkgCache::Dep::Suggests);
-   if (node->matches("?reverse-recommends", 1, 1))
-      return std::make_unique<Patterns::PackageReverseDepends>(aPattern(node->arguments[0]), pkgCache::Dep::Recommends);
-   if (node->matches("?reverse-conflicts", 1, 1))
-      return std::make_unique<Patterns::PackageReverseDepends>(aPattern(node->arguments[0]), pkgCache::Dep::Conflicts);
-   if (node->matches("?reverse-replaces", 1, 1))
-      return std::make_unique<Patterns::PackageReverseDepends>(aPattern(node->arguments[0]), pkgCache::Dep::Replaces);
-   if (node->matches("?reverse-obsoletes", 1, 1))
-      return std::make_unique<Patterns::PackageReverseDepends>(aPattern(node->arguments[0]), pkgCache::Dep::Obsoletes);
-   if (node->matches("?reverse-breaks", 1, 1))
-      return std::make_unique<Patterns::PackageReverseDepends>(aPattern(node->arguments[0]), pkgCache::Dep::DpkgBreaks);
-   if (node->matches("?reverse-enhances", 1, 1))
-      return std::make_unique<Patterns::PackageReverseDepends>(aPattern(node->arguments[0]), pkgCache::Dep::Enhances);
+   for (auto const &dp : dependsPatterns)
+   {
+      if (node->matches(dp.name, 1, 1))
+	 return std::make_unique<Patterns::VersionDepends>(aPattern(node->arguments[0]), dp.type);
+      if (node->matches(dp.reverseName, 1, 1))
+	 return std::make_unique<Patterns::PackageReverseDepends>(aPattern(node->arguments[0]), dp.type);
+   }
    if (node->matches("?essential", 0, 0))
       return std::make_unique<Patterns::PackageIsEssential>();
    if (node->matches("?priority", 1, 1))
@@ -548,6 +541,69 @@ std::string PatternParser::aWord(std::unique_ptr<PatternTreeParser::Node> &nodeP
    return node->word.to_string();
 }
 
+std::unique_ptr<Patterns::SetNode> PatternCompiler::aPattern(std::unique_ptr<PatternTreeParser::Node> &nodeP)
+{
+   assert(nodeP != nullptr);
+   auto node = dynamic_cast<PatternTreeParser::PatternNode *>(nodeP.get());
+   if (node == nullptr)
+      nodeP->error("Expected a pattern");
+   PatternParser parser{file};
+
+   if (node->matches("?all-versions", 1, 1))
+      return std::make_unique<Patterns::SetAllVersions>(aPattern(node->arguments[0]));
+   if (node->matches("?any-version", 1, 1))
+      return std::make_unique<Patterns::SetAnyVersion>(aPattern(node->arguments[0]));
+   for (auto const &dp : dependsPatterns)
+   {
+      if (node->matches(dp.name, 1, 1))
+	 return std::make_unique<Patterns::SetDepends>(aPattern(node->arguments[0]), dp.type);
+      if (node->matches(dp.reverseName, 1, 1))
+	 return std::make_unique<Patterns::SetReverseDepends>(aPattern(node->arguments[0]), dp.type);
+   }
+   if (node->matches("?not", 1, 1))
+      return std::make_unique<Patterns::SetNot>(aPattern(node->arguments[0]));
+   if (node->matches("?and", 0, -1) || node->matches("?narrow", 0, -1))
+   {
+      auto pattern = std::make_unique<Patterns::SetAnd>();
+      for (auto &arg : node->arguments)
+	 pattern->bases.push_back(aPattern(arg));
+      if (node->term == "?narrow")
+	 return std::make_unique<Patterns::SetAnyVersion>(std::move(pattern));
+      return pattern;
+   }
+   if (node->matches("?or", 0, -1))
+   {
+      auto pattern = std::make_unique<Patterns::SetOr>();
+      for (auto &arg : node->arguments)
+	 pattern->bases.push_back(aPattern(arg));
+      return pattern;
+   }
+
+   // Patterns on the package files of a version
+   if (node->matches("?archive", 1, 1))
+      return std::make_unique<Patterns::SetFileMatcher>(parser.aWord(node->arguments[0]), &pkgCache::PkgFileIterator::Archive);
+   if (node->matches("?codename", 1, 1))
+      return std::make_unique<Patterns::SetFileMatcher>(parser.aWord(node->arguments[0]), &pkgCache::PkgFileIterator::Codename);
+   if (node->matches("?origin", 1, 1))
+      return std::make_unique<Patterns::SetFileMatcher>(parser.aWord(node->arguments[0]), &pkgCache::PkgFileIterator::Origin);
+
+   // Patterns on strings shared by many packages or versions
+   if (node->term == "?architecture")
+      return std::make_unique<Patterns::SetArchitectureMatcher>(parser.aPattern(nodeP));
+   if (node->term == "?name" || node->term == "?exact-name" || node->term == "?x-name-fnmatch")
+      return std::make_unique<Patterns::SetNameMatcher>(parser.aPattern(nodeP));
+   if (node->term == "?section")
+      return std::make_unique<Patterns::SetVersionStringMatcher>(parser.aPattern(nodeP), [](pkgCache::VerIterator const &Ver) { return Ver.Section(); });
+   if (node->term == "?source-package")
+      return std::make_unique<Patterns::SetVersionStringMatcher>(parser.aPattern(nodeP), [](pkgCache::VerIterator const &Ver) { return Ver.SourcePkgName(); });
+   if (node->term == "?source-version")
+      return std::make_unique<Patterns::SetVersionStringMatcher>(parser.aPattern(nodeP), [](pkgCache::VerIterator const &Ver) { return Ver.SourceVerStr(); });
+   if (node->term == "?version")
+      return std::make_unique<Patterns::SetVersionStringMatcher>(parser.aPattern(nodeP), [](pkgCache::VerIterator const &Ver) { return Ver.VerStr(); });
+
+   return std::make_unique<Patterns::SetMatcher>(parser.aPattern(nodeP));
+}
+
 namespace Patterns
 {
 
@@ -578,6 +634,288 @@ BaseRegexMatcher::~BaseRegexMatcher()
    regfree(pattern);
    delete pattern;
 }
+
+IDSet::IDSet(size_t count, bool value) : words((count + 63) / 64, value ? ~uint64_t(0) : 0), count(count)
+{
+   if (value && count % 64 != 0)
+      words.back() &= (uint64_t(1) << (count % 64)) - 1;
+}
+void IDSet::flip()
+{
+   for (auto &w : words)
+      w = ~w;
+   if (count % 64 != 0)
+      words.back() &= (uint64_t(1) << (count % 64)) - 1;
+}
+bool IDSet::none() const
+{
+   return std::all_of(words.begin(), words.end(), [](uint64_t w) { return w == 0; });
+}
+IDSet &IDSet::operator&=(IDSet const &other)
+{
+   for (size_t i = 0; i < words.size(); ++i)
+      words[i] &= other.words[i];
+   return *this;
+}
+IDSet &IDSet::operator|=(IDSet const &other)
+{
+   for (size_t i = 0; i < words.size(); ++i)
+      words[i] |= other.words[i];
+   return *this;
+}
+
+SetContext::SetContext(pkgCacheFile *file) : file(file), cache(file->GetPkgCache())
+{
+   versions.resize(cache->Head().VersionCount, nullptr);
+   parent.resize(cache->Head().VersionCount, 0);
+   for (auto Pkg = cache->PkgBegin(); not Pkg.end(); ++Pkg)
+      for (auto Ver = Pkg.VersionList(); not Ver.end(); ++Ver)
+      {
+	 versions[Ver->ID] = Ver;
+	 parent[Ver->ID] = Pkg->ID;
+      }
+}
+
+IDSet const &SetNode::packages(SetContext &ctx)
+{
+   if (packageSet == nullptr)
+   {
+      packageSet = std::make_unique<IDSet>(ctx.packageCount());
+      evalPackages(ctx, *packageSet);
+   }
+   return *packageSet;
+}
+IDSet const &SetNode::versions(SetContext &ctx)
+{
+   if (versionSet == nullptr)
+   {
+      versionSet = std::make_unique<IDSet>(ctx.versionCount());
+      evalVersions(ctx, *versionSet);
+   }
+   return *versionSet;
+}
+void SetNode::evalPackages(SetContext &ctx, IDSet &out)
+{
+   auto const &vers = versions(ctx);
+   for (size_t v = 0; v < ctx.versionCount(); ++v)
+      if (vers[v])
+	 out.set(ctx.parent[v]);
+}
+void SetNode::evalVersions(SetContext &ctx, IDSet &out)
+{
+   auto const &pkgs = packages(ctx);
+   for (size_t v = 0; v < ctx.versionCount(); ++v)
+      if (ctx.versions[v] != nullptr && pkgs[ctx.parent[v]])
+	 out.set(v);
+}
+
+void SetMatcher::evalPackages(SetContext &ctx, IDSet &out)
+{
+   // versions are matched one by one anyhow, so do it only once
+   if (dynamic_cast<VersionAnyMatcher *>(matcher.get()) != nullptr)
+      return SetNode::evalPackages(ctx, out);
+   for (auto Pkg = ctx.cache->PkgBegin(); not Pkg.end(); ++Pkg)
+      if ((*matcher)(Pkg))
+	 out.set(Pkg->ID);
+}
+void SetMatcher::evalVersions(SetContext &ctx, IDSet &out)
+{
+   for (size_t v = 0; v < ctx.versionCount(); ++v)
+      if (ctx.versions[v] != nullptr && (*matcher)(pkgCache::VerIterator(*ctx.cache, ctx.versions[v])))
+	 out.set(v);
+}
+
+void SetVersionStringMatcher::evalVersions(SetContext &ctx, IDSet &out)
+{
+   // the cache stores equal strings only once, so they are easy to remember
+   std::unordered_map<char const *, bool> results;
+   for (size_t v = 0; v < ctx.versionCount(); ++v)
+   {
+      if (ctx.versions[v] == nullptr)
+	 continue;
+      pkgCache::VerIterator Ver(*ctx.cache, ctx.versions[v]);
+      auto result = results.emplace(field(Ver), false);
+      if (result.second)
+	 result.first->second = (*matcher)(Ver);
+      if (result.first->second)
+	 out.set(v);
+   }
+}
+
+void SetArchitectureMatcher::evalPackages(SetContext &ctx, IDSet &out)
+{
+   std::unordered_map<char const *, bool> results;
+   for (auto Pkg = ctx.cache->PkgBegin(); not Pkg.end(); ++Pkg)
+   {
+      auto result = results.emplace(Pkg.Arch(), false);
+      if (result.second)
+	 result.first->second = (*matcher)(Pkg);
+      if (result.first->second)
+	 out.set(Pkg->ID);
+   }
+}
+
+void SetNameMatcher::evalPackages(SetContext &ctx, IDSet &out)
+{
+   // all packages of a group share the name
+   for (auto Grp = ctx.cache->GrpBegin(); not Grp.end(); ++Grp)
+   {
+      auto Pkg = Grp.PackageList();
+      if (Pkg.end() || not(*matcher)(Pkg))
+	 continue;
+      for (; not Pkg.end(); Pkg = Grp.NextPkg(Pkg))
+	 out.set(Pkg->ID);
+   }
+}
+
+void SetFileMatcher::evalVersions(SetContext &ctx, IDSet &out)
+{
+   std::vector<bool> files(ctx.cache->Head().PackageFileCount, false);
+   for (auto File = ctx.cache->FileBegin(); File != ctx.cache->FileEnd(); ++File)
+      files[File->ID] = (File.*field)() != nullptr && matcher((File.*field)());
+   if (std::find(files.begin(), files.end(), true) == files.end())
+      return;
+   for (size_t v = 0; v < ctx.versionCount(); ++v)
+   {
+      if (ctx.versions[v] == nullptr)
+	 continue;
+      for (auto VF = pkgCache::VerIterator(*ctx.cache, ctx.versions[v]).FileList(); not VF.end(); ++VF)
+	 if (files[VF.File()->ID])
+	 {
+	    out.set(v);
+	    break;
+	 }
+   }
+}
+
+void SetNot::evalPackages(SetContext &ctx, IDSet &out)
+{
+   out = base->packages(ctx);
+   out.flip();
+}
+void SetNot::evalVersions(SetContext &ctx, IDSet &out)
+{
+   out = base->versions(ctx);
+   out.flip();
+}
+
+bool SetAnd::operator()(pkgCache::GrpIterator const &Grp)
+{
+   for (auto const &base : bases)
+      if (not(*base)(Grp))
+	 return false;
+   return true;
+}
+void SetAnd::evalPackages(SetContext &ctx, IDSet &out)
+{
+   out = IDSet(ctx.packageCount(), true);
+   for (auto const &base : bases)
+   {
+      out &= base->packages(ctx);
+      // the remaining patterns need not be evaluated at all
+      if (out.none())
+	 break;
+   }
+}
+void SetAnd::evalVersions(SetContext &ctx, IDSet &out)
+{
+   out = IDSet(ctx.versionCount(), true);
+   for (auto const &base : bases)
+   {
+      out &= base->versions(ctx);
+      if (out.none())
+	 break;
+   }
+}
+
+bool SetOr::operator()(pkgCache::GrpIterator const &Grp)
+{
+   for (auto const &base : bases)
+      if ((*base)(Grp))
+	 return true;
+   return false;
+}
+void SetOr::evalPackages(SetContext &ctx, IDSet &out)
+{
+   for (auto const &base : bases)
+      out |= base->packages(ctx);
+}
+void SetOr::evalVersions(SetContext &ctx, IDSet &out)
+{
+   for (auto const &base : bases)
+      out |= base->versions(ctx);
+}
+
+void SetAnyVersion::evalVersions(SetContext &ctx, IDSet &out)
+{
+   out = base->versions(ctx);
+}
+
+void SetAllVersions::evalPackages(SetContext &ctx, IDSet &out)
+{
+   auto const &vers = base->versions(ctx);
+   for (size_t v = 0; v < ctx.versionCount(); ++v)
+      if (ctx.versions[v] != nullptr && not vers[v])
+	 out.set(ctx.parent[v]);
+   // packages without versions match as well
+   out.flip();
+}
+void SetAllVersions::evalVersions(SetContext &ctx, IDSet &out)
+{
+   out = base->versions(ctx);
+}
+
+void SetDepends::evalVersions(SetContext &ctx, IDSet &out)
+{
+   auto const &targets = base->packages(ctx);
+   for (size_t v = 0; v < ctx.versionCount(); ++v)
+   {
+      if (ctx.versions[v] == nullptr)
+	 continue;
+      for (auto D = pkgCache::VerIterator(*ctx.cache, ctx.versions[v]).DependsList(); not D.end(); ++D)
+      {
+	 if (D->Type != type || D.IsImplicit())
+	    continue;
+	 if (targets[D.TargetPkg()->ID])
+	 {
+	    out.set(v);
+	    break;
+	 }
+      }
+   }
+}
+
+void SetReverseDepends::evalPackages(SetContext &ctx, IDSet &out)
+{
+   // walk the dependencies of the matching versions instead of the
+   // reverse dependencies of every package
+   auto const &sources = base->versions(ctx);
+   for (size_t v = 0; v < ctx.versionCount(); ++v)
+   {
+      if (ctx.versions[v] == nullptr || not sources[v])
+	 continue;
+      for (auto D = pkgCache::VerIterator(*ctx.cache, ctx.versions[v]).DependsList(); not D.end(); ++D)
+	 if (D->Type == type && not D.IsImplicit())
+	    out.set(D.TargetPkg()->ID);
+   }
+}
+
+bool CompiledPattern::operator()(pkgCache::PkgIterator const &Pkg)
+{
+   if (ctx == nullptr)
+      ctx = std::make_unique<SetContext>(file);
+   return root->packages(*ctx)[Pkg->ID];
+}
+bool CompiledPattern::operator()(pkgCache::GrpIterator const &Grp)
+{
+   return (*root)(Grp);
+}
+bool CompiledPattern::operator()(pkgCache::VerIterator const &Ver)
+{
+   if (ctx == nullptr)
+      ctx = std::make_unique<SetContext>(file);
+   return root->versions(*ctx)[Ver->ID];
+}
 } // namespace Patterns
 
 } // namespace Internal
@@ -591,6 +929,11 @@ std::unique_ptr<APT::CacheFilter::Matcher> APT::CacheFilter::ParsePattern(APT::S
    try
    {
       auto top = APT::Internal::PatternTreeParser(pattern).parseTop();
+      if (file != nullptr && _config->FindB("APT::Patterns::Compile", true))
+      {
+	 APT::Internal::PatternCompiler compiler{file};
+	 return std::make_unique<APT::Internal::Patterns::CompiledPattern>(file, compiler.aPattern(top));
+      }
       APT::Internal::PatternParser parser{file};
       return parser.aPattern(top);
    }
@@ -20,6 +20,7 @@
 #include <string>
 #include <vector>
 #include <assert.h>
+#include <stdint.h>
 
 namespace APT
 {
@@ -450,7 +451,225 @@ struct APT_HIDDEN VersionIsPriority : public VersionAnyMatcher
    }
 };
 
+/** \brief Package or version IDs as a dense bitset */
+class APT_HIDDEN IDSet
+{
+   std::vector<uint64_t> words;
+   size_t count = 0;
+
+   public:
+   explicit IDSet(size_t count = 0, bool value = false);
+   bool operator[](size_t id) const { return (words[id / 64] >> (id % 64)) & 1; }
+   void set(size_t id) { words[id / 64] |= uint64_t(1) << (id % 64); }
+   bool none() const;
+   void flip();
+   IDSet &operator&=(IDSet const &other);
+   IDSet &operator|=(IDSet const &other);
+};
+
+/** \brief Columns of the cache shared by all nodes of a compiled pattern */
+struct APT_HIDDEN SetContext
+{
+   pkgCacheFile *file;
+   pkgCache *cache;
+   /// version by ID
+   std::vector<pkgCache::Version *> versions;
+   /// ID of the parent package by version ID
+   std::vector<map_id_t> parent;
+
+   explicit SetContext(pkgCacheFile *file);
+   size_t packageCount() const { return cache->Head().PackageCount; }
+   size_t versionCount() const { return versions.size(); }
+};
+
+/**
+ * \brief A node of a compiled pattern
+ *
+ * The node computes its result for all packages or for all versions at
+ * once and keeps it, so each node is evaluated at most twice regardless of
+ * how often its parents need it. Nodes have to implement at least one of
+ * evalPackages and evalVersions: by default a package matches if any of
+ * its versions does and a version matches if its package does.
+ */
+struct APT_HIDDEN SetNode
+{
+   IDSet const &packages(SetContext &ctx);
+   IDSet const &versions(SetContext &ctx);
+   virtual bool operator()(pkgCache::GrpIterator const &) { return false; }
+   virtual ~SetNode() = default;
+
+   protected:
+   virtual void evalPackages(SetContext &ctx, IDSet &out);
+   virtual void evalVersions(SetContext &ctx, IDSet &out);
+
+   private:
+   std::unique_ptr<IDSet> packageSet;
+   std::unique_ptr<IDSet> versionSet;
+};
+
+/** \brief Evaluates a matcher one package and version at a time */
+struct APT_HIDDEN SetMatcher : public SetNode
+{
+   std::unique_ptr<APT::CacheFilter::Matcher> matcher;
+   explicit SetMatcher(std::unique_ptr<APT::CacheFilter::Matcher> matcher) : matcher(std::move(matcher)) {}
+   bool operator()(pkgCache::GrpIterator const &Grp) override { return (*matcher)(Grp); }
+
+   protected:
+   void evalPackages(SetContext &ctx, IDSet &out) override;
+   void evalVersions(SetContext &ctx, IDSet &out) override;
+};
+
+/** \brief Evaluates a version matcher once per distinct string of a field */
+struct APT_HIDDEN SetVersionStringMatcher : public SetNode
+{
+   typedef char const *(*Field)(pkgCache::VerIterator const &);
+   std::unique_ptr<APT::CacheFilter::Matcher> matcher;
+   Field field;
+   SetVersionStringMatcher(std::unique_ptr<APT::CacheFilter::Matcher> matcher, Field field) : matcher(std::move(matcher)), field(field) {}
+
+   protected:
+   void evalVersions(SetContext &ctx, IDSet &out) override;
+};
+
+/** \brief Evaluates a package matcher once per distinct architecture */
+struct APT_HIDDEN SetArchitectureMatcher : public SetNode
+{
+   std::unique_ptr<APT::CacheFilter::Matcher> matcher;
+   explicit SetArchitectureMatcher(std::unique_ptr<APT::CacheFilter::Matcher> matcher) : matcher(std::move(matcher)) {}
+   bool operator()(pkgCache::GrpIterator const &Grp) override { return (*matcher)(Grp); }
+
+   protected:
+   void evalPackages(SetContext &ctx, IDSet &out) override;
+};
+
+/** \brief Evaluates a package name matcher once per group */
+struct APT_HIDDEN SetNameMatcher : public SetNode
+{
+   std::unique_ptr<APT::CacheFilter::Matcher> matcher;
+   explicit SetNameMatcher(std::unique_ptr<APT::CacheFilter::Matcher> matcher) : matcher(std::move(matcher)) {}
+   bool operator()(pkgCache::GrpIterator const &Grp) override { return (*matcher)(Grp); }
+
+   protected:
+   void evalPackages(SetContext &ctx, IDSet &out) override;
+};
+
+/** \brief Matches the versions in a package file with a matching field */
+struct APT_HIDDEN SetFileMatcher : public SetNode
+{
+   typedef char const *(pkgCache::PkgFileIterator::*Field)() const;
+   BaseRegexMatcher matcher;
+   Field field;
+   SetFileMatcher(std::string const &pattern, Field field) : matcher(pattern), field(field) {}
+
+   protected:
+   void evalVersions(SetContext &ctx, IDSet &out) override;
+};
+
+struct APT_HIDDEN SetNot : public SetNode
+{
+   std::unique_ptr<SetNode> base;
+   explicit SetNot(std::unique_ptr<SetNode> base) : base(std::move(base)) {}
+   bool operator()(pkgCache::GrpIterator const &Grp) override { return not(*base)(Grp); }
+
+   protected:
+   void evalPackages(SetContext &ctx, IDSet &out) override;
+   void evalVersions(SetContext &ctx, IDSet &out) override;
+};
+
+struct APT_HIDDEN SetAnd : public SetNode
+{
+   std::vector<std::unique_ptr<SetNode>> bases;
+   bool operator()(pkgCache::GrpIterator const &Grp) override;
+
+   protected:
+   void evalPackages(SetContext &ctx, IDSet &out) override;
+   void evalVersions(SetContext &ctx, IDSet &out) override;
+};
+
+struct APT_HIDDEN SetOr : public SetNode
+{
+   std::vector<std::unique_ptr<SetNode>> bases;
+   bool operator()(pkgCache::GrpIterator const &Grp) override;
+
+   protected:
+   void evalPackages(SetContext &ctx, IDSet &out) override;
+   void evalVersions(SetContext &ctx, IDSet &out) override;
+};
+
+struct APT_HIDDEN SetAnyVersion : public SetNode
+{
+   std::unique_ptr<SetNode> base;
+   explicit SetAnyVersion(std::unique_ptr<SetNode> base) : base(std::move(base)) {}
+
+   protected:
+   void evalVersions(SetContext &ctx, IDSet &out) override;
+};
+
+struct APT_HIDDEN SetAllVersions : public SetNode
+{
+   std::unique_ptr<SetNode> base;
+   explicit SetAllVersions(std::unique_ptr<SetNode> base) : base(std::move(base)) {}
+
+   protected:
+   void evalPackages(SetContext &ctx, IDSet &out) override;
+   void evalVersions(SetContext &ctx, IDSet &out) override;
+};
+
+struct APT_HIDDEN SetDepends : public SetNode
+{
+   std::unique_ptr<SetNode> base;
+   pkgCache::Dep::DepType type;
+   SetDepends(std::unique_ptr<SetNode> base, pkgCache::Dep::DepType type) : base(std::move(base)), type(type) {}
+
+   protected:
+   void evalVersions(SetContext &ctx, IDSet &out) override;
+};
+
+struct APT_HIDDEN SetReverseDepends : public SetNode
+{
+   std::unique_ptr<SetNode> base;
+   pkgCache::Dep::DepType type;
+   SetReverseDepends(std::unique_ptr<SetNode> base, pkgCache::Dep::DepType type) : base(std::move(base)), type(type) {}
+
+   protected:
+   void evalPackages(SetContext &ctx, IDSet &out) override;
+};
+
+/**
+ * \brief A pattern compiled into operations on sets
+ *
+ * The sets are computed the first time the matcher is asked about a
+ * package or a version, so the state of the depcache the pattern refers
+ * to is the one at that time.
+ */
+struct APT_HIDDEN CompiledPattern : public APT::CacheFilter::Matcher
+{
+   pkgCacheFile *file;
+   std::unique_ptr<SetContext> ctx;
+   std::unique_ptr<SetNode> root;
+
+   CompiledPattern(pkgCacheFile *file, std::unique_ptr<SetNode> root) : file(file), root(std::move(root)) {}
+   bool operator()(pkgCache::PkgIterator const &Pkg) override;
+   bool operator()(pkgCache::GrpIterator const &Grp) override;
+   bool operator()(pkgCache::VerIterator const &Ver) override;
+};
+
 } // namespace Patterns
+
+/**
+ * \brief PatternCompiler compiles the parse tree into operations on sets.
+ *
+ * Patterns combining and nesting other patterns become operations on the
+ * sets of their arguments. Patterns on strings shared by many packages or
+ * versions match each distinct string only once, the others are evaluated
+ * by the matchers of the PatternParser.
+ */
+struct APT_HIDDEN PatternCompiler
+{
+   pkgCacheFile *file;
+
+   std::unique_ptr<Patterns::SetNode> aPattern(std::unique_ptr<PatternTreeParser::Node> &nodeP);
+};
 } // namespace Internal
 } // namespace APT
 #endif
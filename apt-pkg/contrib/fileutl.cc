@@ -1789,6 +1789,97 @@ class APT_HIDDEN ZstdFileFdPrivate : public FileFdPrivate		/*{{{*/
    // Count of bytes that the decompressor expects to read next, or buffer size.
    size_t next_to_load = APT_BUFFER_SIZE;
 
+   /* Seekable files consist of independently compressed frames followed by
+      a skippable frame with a table of the compressed and uncompressed size
+      of each frame (as in the zstd seekable format), so that we can start
+      decompressing at the frame containing the requested offset. */
+   static constexpr uint32_t SkippableMagic = 0x184D2A5E;
+   static constexpr uint32_t SeekableMagic = 0x8F92EAB1;
+   // compressed and uncompressed offset of each frame and of the end
+   std::vector<std::pair<unsigned long long, unsigned long long>> frames;
+   // uncompressed size after which a new frame is started, 0 for one frame
+   unsigned long long frame_size = 0;
+   unsigned long long frame_in = 0;
+   unsigned long long frame_out = 0;
+   std::vector<std::pair<uint32_t, uint32_t>> written_frames;
+   // uncompressed bytes produced so far, including those still buffered
+   unsigned long long decompressed = 0;
+
+   static uint32_t get32(unsigned char const *const Buf)
+   {
+      return Buf[0] | (Buf[1] << 8) | (Buf[2] << 16) | (static_cast<uint32_t>(Buf[3]) << 24);
+   }
+   void LoadSeekTable(int const iFd)
+   {
+      struct stat Buf;
+      if (fstat(iFd, &Buf) != 0 || S_ISREG(Buf.st_mode) == false || lseek(iFd, 0, SEEK_CUR) != 0)
+	 return;
+      unsigned long long const FileSize = Buf.st_size;
+      unsigned char footer[9];
+      if (FileSize < 8 + sizeof(footer) || pread(iFd, footer, sizeof(footer), FileSize - sizeof(footer)) != sizeof(footer) ||
+	  get32(footer + 5) != SeekableMagic || (footer[4] & 0x7c) != 0)
+	 return;
+      uint32_t const count = get32(footer);
+      unsigned long long const entrysize = (footer[4] & 0x80) != 0 ? 12 : 8;
+      unsigned long long const tablesize = count * entrysize + sizeof(footer);
+      if (count == 0 || tablesize + 8 > FileSize)
+	 return;
+      std::vector<unsigned char> table(tablesize + 8);
+      if (pread(iFd, table.data(), table.size(), FileSize - table.size()) != static_cast<ssize_t>(table.size()) ||
+	  get32(table.data()) != SkippableMagic || get32(table.data() + 4) != tablesize)
+	 return;
+      std::vector<std::pair<unsigned long long, unsigned long long>> offsets;
+      offsets.reserve(count + 1);
+      unsigned long long compressed = 0, uncompressed = 0;
+      for (auto entry = table.data() + 8; offsets.size() < count; entry += entrysize)
+      {
+	 offsets.emplace_back(compressed, uncompressed);
+	 compressed += get32(entry);
+	 uncompressed += get32(entry + 4);
+      }
+      if (compressed != FileSize - table.size())
+	 return;
+      offsets.emplace_back(compressed, uncompressed);
+      frames = std::move(offsets);
+   }
+   bool EndFrame()
+   {
+      do
+      {
+	 ZSTD_outBuffer out = {
+	    .dst = zstd_buffer.buffer,
+	    .size = zstd_buffer.buffersize_max,
+	    .pos = 0,
+	 };
+	 res = ZSTD_endStream(cctx, &out);
+	 if (ZSTD_isError(res) || backend.Write(zstd_buffer.buffer, out.pos) == false)
+	    return false;
+	 frame_out += out.pos;
+      } while (res > 0);
+      written_frames.emplace_back(frame_out, frame_in);
+      frame_in = frame_out = 0;
+      return true;
+   }
+   bool WriteSeekTable()
+   {
+      std::string table;
+      auto const put32 = [&](uint32_t const Value) {
+	 for (unsigned int i = 0; i < 4; ++i)
+	    table.push_back(static_cast<char>((Value >> (8 * i)) & 0xff));
+      };
+      put32(SkippableMagic);
+      put32(written_frames.size() * 8 + 9);
+      for (auto const &frame : written_frames)
+      {
+	 put32(frame.first);
+	 put32(frame.second);
+      }
+      put32(written_frames.size());
+      table.push_back('\0');
+      put32(SeekableMagic);
+      return backend.Write(table.data(), table.size());
+   }
+
    public:
    virtual bool InternalOpen(int const iFd, unsigned int const Mode) APT_OVERRIDE
    {
@@ -1799,13 +1890,20 @@ class APT_HIDDEN ZstdFileFdPrivate : public FileFdPrivate		/*{{{*/
       {
 	 cctx = ZSTD_createCStream();
 	 res = ZSTD_initCStream(cctx, findLevel(compressor.CompressArgs));
+	 // only honoured by a libzstd built with multithreading support
+	 int const threads = _config->FindI("APT::Compressor::zstd::Threads", 1);
+	 if (ZSTD_isError(res) == false && threads > 1)
+	    ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, threads);
 	 zstd_buffer.reset(APT_BUFFER_SIZE);
+	 // frame sizes are stored as 32bit values in the seek table
+	 frame_size = std::min(_config->FindI("APT::Compressor::zstd::FrameSize", 0), 1 << 30);
       }
       else
       {
 	 dctx = ZSTD_createDStream();
 	 res = ZSTD_initDStream(dctx);
 	 zstd_buffer.reset(APT_BUFFER_SIZE);
+	 LoadSeekTable(iFd);
       }
 
       filefd->Flags |= FileFd::Compressed;
@@ -1872,7 +1970,10 @@ class APT_HIDDEN ZstdFileFdPrivate : public FileFdPrivate		/*{{{*/
 	 zstd_buffer.bufferstart += in.pos;
 
 	 if (out.pos != 0)
+	 {
+	    decompressed += out.pos;
 	    return out.pos;
+	 }
       }
 
       return 0;
@@ -1893,7 +1994,7 @@ class APT_HIDDEN ZstdFileFdPrivate : public FileFdPrivate		/*{{{*/
       };
       ZSTD_inBuffer in = {
 	 .src = From,
-	 .size = Size,
+	 .size = frame_size == 0 ? Size : std::min(Size, frame_size - frame_in),
 	 .pos = 0,
       };
 
@@ -1901,6 +2002,10 @@ class APT_HIDDEN ZstdFileFdPrivate : public FileFdPrivate		/*{{{*/
 
       if (ZSTD_isError(res) || backend.Write(zstd_buffer.buffer, out.pos) == false)
 	 return -1;
+      frame_in += in.pos;
+      frame_out += out.pos;
+      if (frame_size != 0 && frame_in == frame_size && EndFrame() == false)
+	 return -1;
 
       return in.pos;
    }
@@ -1913,6 +2018,61 @@ class APT_HIDDEN ZstdFileFdPrivate : public FileFdPrivate		/*{{{*/
    }
    virtual bool InternalStream() const APT_OVERRIDE { return true; }
 
+   virtual bool InternalSeek(unsigned long long const To) APT_OVERRIDE
+   {
+      if (frames.empty() || dctx == nullptr)
+	 return FileFdPrivate::InternalSeek(To);
+
+      auto const FrameOf = [&](unsigned long long const Pos) {
+	 return std::upper_bound(frames.begin(), frames.end() - 1, Pos, [](unsigned long long const P, auto const &F) {
+		   return P < F.second;
+		}) - 1;
+      };
+      unsigned long long const iseekpos = InternalTell();
+      if (iseekpos <= To && To <= decompressed)
+      {
+	 // still in the buffer filled by ReadLine
+	 buffer.bufferstart += To - iseekpos;
+	 if (buffer.empty())
+	    buffer.reset();
+	 set_seekpos(To + buffer.size());
+	 return true;
+      }
+      buffer.reset();
+      set_seekpos(decompressed);
+      auto const frame = FrameOf(To);
+      // reading ahead in the current frame is cheaper than starting over
+      if (decompressed < To && FrameOf(decompressed) == frame)
+	 return filefd->Skip(To - decompressed);
+
+      if (backend.Seek(frame->first) == false)
+	 return false;
+      res = ZSTD_initDStream(dctx);
+      if (ZSTD_isError(res))
+	 return InternalReadError();
+      zstd_buffer.reset();
+      next_to_load = APT_BUFFER_SIZE;
+      decompressed = frame->second;
+      set_seekpos(frame->second);
+      if (To != frame->second)
+	 return filefd->Skip(To - frame->second);
+      return true;
+   }
+
+   virtual unsigned long long InternalTell() APT_OVERRIDE
+   {
+      if (dctx == nullptr)
+	 return FileFdPrivate::InternalTell();
+      return decompressed - buffer.size();
+   }
+
+   virtual unsigned long long InternalSize() APT_OVERRIDE
+   {
+      if (frames.empty() || dctx == nullptr)
+	 return FileFdPrivate::InternalSize();
+      return frames.back().second;
+   }
+
    virtual bool InternalFlush() APT_OVERRIDE
    {
       return backend.Flush();
@@ -1923,22 +2083,18 @@ class APT_HIDDEN ZstdFileFdPrivate : public FileFdPrivate		/*{{{*/
       /* Reset variables */
       res = 0;
       next_to_load = APT_BUFFER_SIZE;
+      frames.clear();
+      decompressed = 0;
 
       if (cctx != nullptr)
       {
 	 if (filefd->Failed() == false)
 	 {
-	    do
-	    {
-	       ZSTD_outBuffer out = {
-		  .dst = zstd_buffer.buffer,
-		  .size = zstd_buffer.buffersize_max,
-		  .pos = 0,
-	       };
-	       res = ZSTD_endStream(cctx, &out);
-	       if (ZSTD_isError(res) || backend.Write(zstd_buffer.buffer, out.pos) == false)
-		  return false;
-	    } while (res > 0);
+	    // a seekable file has no empty frames (unless the file is empty)
+	    if ((frame_in != 0 || written_frames.empty()) && EndFrame() == false)
+	       return false;
+	    if (frame_size != 0 && WriteSeekTable() == false)
+	       return false;
 
 	    if (!backend.Flush())
 	       return false;
@@ -1948,6 +2104,8 @@ class APT_HIDDEN ZstdFileFdPrivate : public FileFdPrivate		/*{{{*/
 
 	 res = ZSTD_freeCStream(cctx);
 	 cctx = nullptr;
+	 frame_size = frame_in = frame_out = 0;
+	 written_frames.clear();
       }
 
       if (dctx != nullptr)
@@ -2079,7 +2237,18 @@ public:
       if ((Mode & FileFd::WriteOnly) == FileFd::WriteOnly)
       {
 	 uint32_t const xzlevel = findXZlevel(compressor.CompressArgs);
-	 if (compressor.Name == "xz")
+	 int const threads = _config->FindI("APT::Compressor::xz::Threads", 1);
+	 if (compressor.Name == "xz" && threads > 1)
+	 {
+	    // the file is split into independently compressed blocks
+	    lzma_mt mt = {};
+	    mt.threads = threads;
+	    mt.preset = xzlevel;
+	    mt.check = LZMA_CHECK_CRC64;
+	    if (lzma_stream_encoder_mt(&lzma->stream, &mt) != LZMA_OK)
+	       return false;
+	 }
+	 else if (compressor.Name == "xz")
 	 {
 	    if (lzma_easy_encoder(&lzma->stream, xzlevel, LZMA_CHECK_CRC64) != LZMA_OK)
 	       return false;
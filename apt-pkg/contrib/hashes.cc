@@ -21,8 +21,14 @@
 #include <apt-pkg/tagfile.h>
 
 #include <algorithm>
+#include <condition_variable>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
 #include <assert.h>
 #include <stddef.h>
 #include <stdlib.h>
@@ -308,10 +314,32 @@ bool HashStringList::operator!=(HashStringList const &other) const
 									/*}}}*/
 
 // PrivateHashes							/*{{{*/
+/* Each algorithm has a handle of its own, so that they can be calculated in
+   parallel: for big enough blocks every algorithm is run by a worker thread
+   of its own over the same read-only data. The threads are only started on
+   the first such block and are kept around for the lifetime of the object. */
 class PrivateHashes {
 public:
    unsigned long long FileSize;
-   gcry_md_hd_t hd;
+   struct Digest
+   {
+      int algo;
+      gcry_md_hd_t hd;
+   };
+   std::vector<Digest> Digests;
+
+   // blocks smaller than this are not worth the synchronisation
+   static constexpr unsigned long long ParallelMinSize = APT_BUFFER_SIZE;
+   bool Parallel = false;
+   std::vector<std::thread> Workers;
+   std::mutex Lock;
+   std::condition_variable WorkAvailable;
+   std::condition_variable WorkDone;
+   unsigned char const *Data = nullptr;
+   unsigned long long Size = 0;
+   unsigned long Generation = 0;
+   size_t Pending = 0;
+   bool Stop = false;
 
    void maybeInit()
    {
@@ -333,30 +361,133 @@ public:
 	 gcry_control(GCRYCTL_INITIALIZATION_FINISHED, 0);
       }
    }
+   void enable(int const algo)
+   {
+      Digest D{algo, nullptr};
+      gcry_md_open(&D.hd, algo, 0);
+      Digests.push_back(D);
+   }
+   void setupParallel()
+   {
+      Parallel = Digests.size() > 1 &&
+	 _config->FindB("APT::Hashes::Parallel", std::thread::hardware_concurrency() > 1);
+   }
+
+   void Worker(size_t const Idx)
+   {
+      unsigned long Seen = 0;
+      std::unique_lock<std::mutex> Guard(Lock);
+      while (true)
+      {
+	 WorkAvailable.wait(Guard, [&] { return Stop || Generation != Seen; });
+	 if (Stop)
+	    return;
+	 Seen = Generation;
+	 auto const D = Data;
+	 auto const S = Size;
+	 Guard.unlock();
+	 gcry_md_write(Digests[Idx].hd, D, S);
+	 Guard.lock();
+	 if (--Pending == 0)
+	    WorkDone.notify_one();
+      }
+   }
+   bool Spawn()
+   {
+      if (Workers.empty() == false)
+	 return true;
+      try
+      {
+	 for (size_t I = 0; I < Digests.size(); ++I)
+	    Workers.emplace_back(&PrivateHashes::Worker, this, I);
+      }
+      catch (std::system_error const &)
+      {
+	 // no threads for us, so stay serial
+	 StopWorkers();
+	 Parallel = false;
+      }
+      return Parallel;
+   }
+   void StopWorkers()
+   {
+      {
+	 std::lock_guard<std::mutex> Guard(Lock);
+	 Stop = true;
+      }
+      WorkAvailable.notify_all();
+      for (auto &W : Workers)
+	 W.join();
+      Workers.clear();
+      Stop = false;
+   }
+   /** hand a block to the workers, it must stay valid until Wait() */
+   void Start(unsigned char const * const D, unsigned long long const S)
+   {
+      std::unique_lock<std::mutex> Guard(Lock);
+      WorkDone.wait(Guard, [&] { return Pending == 0; });
+      Data = D;
+      Size = S;
+      Pending = Digests.size();
+      ++Generation;
+      FileSize += S;
+      WorkAvailable.notify_all();
+   }
+   void Wait()
+   {
+      if (Workers.empty())
+	 return;
+      std::unique_lock<std::mutex> Guard(Lock);
+      WorkDone.wait(Guard, [&] { return Pending == 0; });
+   }
+   void Write(unsigned char const * const D, unsigned long long const S)
+   {
+      if (Parallel && S >= ParallelMinSize && Spawn())
+      {
+	 Start(D, S);
+	 Wait();
+	 return;
+      }
+      Wait();
+      for (auto const &Digest : Digests)
+	 gcry_md_write(Digest.hd, D, S);
+      FileSize += S;
+   }
+   gcry_md_hd_t find(int const algo)
+   {
+      Wait();
+      for (auto const &Digest : Digests)
+	 if (Digest.algo == algo)
+	    return Digest.hd;
+      return nullptr;
+   }
 
    explicit PrivateHashes(unsigned int const CalcHashes) : FileSize(0)
    {
       maybeInit();
-      gcry_md_open(&hd, 0, 0);
       for (auto & Algo : Algorithms)
       {
 	 if ((CalcHashes & Algo.ourAlgo) == Algo.ourAlgo)
-	    gcry_md_enable(hd, Algo.gcryAlgo);
+	    enable(Algo.gcryAlgo);
       }
+      setupParallel();
    }
 
    explicit PrivateHashes(HashStringList const &Hashes) : FileSize(0) {
       maybeInit();
-      gcry_md_open(&hd, 0, 0);
       for (auto & Algo : Algorithms)
       {
 	 if (not Hashes.usable() || Hashes.find(Algo.name) != NULL)
-	    gcry_md_enable(hd, Algo.gcryAlgo);
+	    enable(Algo.gcryAlgo);
       }
+      setupParallel();
    }
    ~PrivateHashes()
    {
-      gcry_md_close(hd);
+      if (not Workers.empty())
+	 StopWorkers();
+      for (auto const &Digest : Digests)
+	 gcry_md_close(Digest.hd);
    }
 };
 									/*}}}*/
@@ -364,10 +495,7 @@ public:
 bool Hashes::Add(const unsigned char * const Data, unsigned long long const Size)
 {
    if (Size != 0)
-   {
-      gcry_md_write(d->hd, Data, Size);
-      d->FileSize += Size;
-   }
+      d->Write(Data, Size);
    return true;
 }
 bool Hashes::AddFD(int const Fd,unsigned long long Size)
@@ -391,6 +519,33 @@ bool Hashes::AddFD(int const Fd,unsigned long long Size)
 }
 bool Hashes::AddFD(FileFd &Fd,unsigned long long Size)
 {
+   if (d->Parallel && d->Spawn())
+   {
+      /* the next block is read while the workers hash the previous one */
+      constexpr unsigned long long BlockSize = 16 * APT_BUFFER_SIZE;
+      std::unique_ptr<unsigned char[]> Buf(new unsigned char[2 * BlockSize]);
+      bool const ToEOF = (Size == 0);
+      bool Okay = true;
+      for (size_t Block = 0; Size != 0 || ToEOF; Block ^= 1)
+      {
+	 unsigned char * const B = Buf.get() + Block * BlockSize;
+	 decltype(Size) n = BlockSize;
+	 if (!ToEOF) n = std::min(Size, n);
+	 decltype(Size) a = 0;
+	 if (Fd.Read(B, n, &a) == false || (ToEOF == false && a != n)) // error or short read
+	 {
+	    Okay = false;
+	    break;
+	 }
+	 if (a == 0) // EOF
+	    break;
+	 Size -= a;
+	 d->Start(B, a);
+      }
+      d->Wait();
+      return Okay;
+   }
+
    unsigned char Buf[APT_BUFFER_SIZE];
    bool const ToEOF = (Size == 0);
    while (Size != 0 || ToEOF)
@@ -443,8 +598,11 @@ HashStringList Hashes::GetHashStringList()
 {
    HashStringList hashes;
    for (auto & Algo : Algorithms)
-      if (gcry_md_is_enabled(d->hd, Algo.gcryAlgo))
-	 hashes.push_back(HashString(Algo.name, HexDigest(d->hd, Algo.gcryAlgo)));
+   {
+      auto const hd = d->find(Algo.gcryAlgo);
+      if (hd != nullptr)
+	 hashes.push_back(HashString(Algo.name, HexDigest(hd, Algo.gcryAlgo)));
+   }
    hashes.FileSize(d->FileSize);
 
    return hashes;
@@ -454,7 +612,7 @@ HashString Hashes::GetHashString(SupportedHashes hash)
 {
    for (auto & Algo : Algorithms)
       if (hash == Algo.ourAlgo)
-	 return HashString(Algo.name, HexDigest(d->hd, Algo.gcryAlgo));
+	 return HashString(Algo.name, HexDigest(d->find(Algo.gcryAlgo), Algo.gcryAlgo));
 
    abort();
 }
@@ -1003,6 +1003,13 @@ bool debListParser::Step()
    return Tags.Step(Section);
 }
 									/*}}}*/
+// ListParser::UseBuffer - Parse the file content from memory		/*{{{*/
+bool debListParser::UseBuffer(char * const Buffer, unsigned long long const Size)
+{
+   Tags.InitFromBuffer(Buffer, Size);
+   return true;
+}
+									/*}}}*/
 // ListParser::GetPrio - Convert the priority from a string		/*{{{*/
 // ---------------------------------------------------------------------
 /* */
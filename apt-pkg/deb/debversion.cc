@@ -14,6 +14,10 @@
 #include <apt-pkg/debversion.h>
 #include <apt-pkg/pkgcache.h>
 
+#include <algorithm>
+#include <string>
+#include <vector>
+
 #include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
@@ -200,6 +204,101 @@ int debVersioningSystem::DoCmpVersion(const char *A,const char *AEnd,
       return 0;
 }
 									/*}}}*/
+// debVS::SortKey - Key which sorts like the version			/*{{{*/
+// ---------------------------------------------------------------------
+/* The version is split into the E:V-R triple exactly like DoCmpVersion
+   does it and each fragment is encoded so that strcmp on the encodings
+   gives the same result as CmpFragment: The non-digit portions are stored
+   as the rank of each character in order() followed by the rank of the
+   end of a portion; the numeric portions are stored without leading zeros
+   behind their length, so that longer numbers sort higher. The fragments
+   are separated by a byte lower than all others, so that a fragment which
+   is a prefix of another one sorts lower as the comparison does. */
+namespace {
+struct SortKeyRanks
+{
+   unsigned char Rank[256];
+   unsigned char End;
+
+   SortKeyRanks()
+   {
+      // the ranks depend on the signedness of char, so derive them from order()
+      std::vector<int> Orders;
+      for (int c = 0; c < 256; ++c)
+	 Orders.push_back(order(static_cast<char>(c)));
+      std::sort(Orders.begin(), Orders.end());
+      Orders.erase(std::unique(Orders.begin(), Orders.end()), Orders.end());
+      auto const RankOf = [&](int const o) {
+	 return static_cast<unsigned char>(2 + (std::lower_bound(Orders.begin(), Orders.end(), o) - Orders.begin()));
+      };
+      for (int c = 0; c < 256; ++c)
+	 Rank[c] = RankOf(order(static_cast<char>(c)));
+      End = RankOf(0);
+   }
+};
+}
+static void SortKeyFragment(std::string &Key, SortKeyRanks const &Ranks,
+			    const char *A, const char *AEnd)
+{
+   while (A != AEnd)
+   {
+      for (; A != AEnd && isdigit(*A) == false; ++A)
+	 Key.push_back(Ranks.Rank[static_cast<unsigned char>(*A)]);
+      Key.push_back(Ranks.End);
+
+      for (; A != AEnd && *A == '0'; ++A);
+      const char * const Digits = A;
+      for (; A != AEnd && isdigit(*A); ++A);
+      size_t Length = A - Digits;
+      for (; Length >= 253; Length -= 253)
+	 Key.push_back('\xff');
+      Key.push_back(2 + Length);
+      Key.append(Digits, A - Digits);
+   }
+   Key.push_back(Ranks.End);
+}
+std::string debVersioningSystem::SortKey(const char *A, const char *AEnd)
+{
+   static SortKeyRanks const Ranks;
+   std::string Key;
+   Key.reserve(2 * (AEnd - A) + 8);
+
+   // Split off the epoch, a zero epoch is the same as no epoch
+   const char *lhs = (const char*) memchr(A, ':', AEnd - A);
+   if (lhs == NULL)
+      lhs = A;
+   if (lhs != A)
+   {
+      for (; *A == '0'; ++A);
+      if (A == lhs)
+      {
+	 ++A;
+	 ++lhs;
+      }
+   }
+   SortKeyFragment(Key, Ranks, A, lhs);
+   Key.push_back('\x01');
+   if (lhs != A)
+      lhs++;
+
+   // the main version ends at the last -
+   const char *dlhs = (const char*) memrchr(lhs, '-', AEnd - lhs);
+   if (dlhs == NULL)
+      dlhs = AEnd;
+   SortKeyFragment(Key, Ranks, lhs, dlhs);
+   Key.push_back('\x01');
+
+   // no debian revision need to be treated like -0
+   if (dlhs != AEnd && dlhs != lhs)
+      SortKeyFragment(Key, Ranks, dlhs + 1, AEnd);
+   else
+   {
+      const char* null = "0";
+      SortKeyFragment(Key, Ranks, null, null + 1);
+   }
+   return Key;
+}
+									/*}}}*/
 // debVS::CheckDep - Check a single dependency				/*{{{*/
 // ---------------------------------------------------------------------
 /* This simply performs the version comparison and switch based on 
@@ -33,6 +33,9 @@ class APT_PUBLIC debVersioningSystem : public pkgVersioningSystem
    }
    virtual std::string UpstreamVersion(const char *A) APT_OVERRIDE;
 
+   // Key without \0 bytes which sorts with strcmp like the version with CmpVersion
+   static std::string SortKey(const char *A, const char *AEnd);
+
    debVersioningSystem();
 };
 
@@ -9,6 +9,8 @@
 // Includes								/*{{{*/
 #include <config.h>
 
+#include <apt-pkg/aptconfiguration.h>
+#include <apt-pkg/arfile.h>
 #include <apt-pkg/cachefile.h>
 #include <apt-pkg/configuration.h>
 #include <apt-pkg/debsystem.h>
@@ -18,6 +20,7 @@
 #include <apt-pkg/fileutl.h>
 #include <apt-pkg/install-progress.h>
 #include <apt-pkg/macros.h>
+#include <apt-pkg/orderlist.h>
 #include <apt-pkg/packagemanager.h>
 #include <apt-pkg/pkgcache.h>
 #include <apt-pkg/statechanges.h>
@@ -45,14 +48,21 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
+#include <condition_variable>
 #include <cstring>
+#include <iomanip>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <numeric>
 #include <set>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <type_traits>
+#include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
@@ -1443,6 +1453,331 @@ bool pkgDPkgPM::ExpandPendingCalls(std::vector<Item> &List, pkgDepCache &Cache)
    }
    return true;
 }
+// UnpackAhead - Decompress the data.tar of debs ahead of dpkg		/*{{{*/
+/* dpkg unpacks one deb after the other and spends much of that time
+   decompressing the data.tar member. With DPkg::Unpack-Ahead worker threads
+   rewrite the debs in the order dpkg will need them into a staging
+   directory, with the data.tar stored uncompressed, so that dpkg only has to
+   extract the tar. A deb which isn't staged in time is given to dpkg as it
+   is, staged copies are removed once the dpkg call using them is done. */
+static bool WriteARHeader(FileFd &Out, std::string const &Name, ARArchive::Member const &Member,
+			  unsigned long long const Size)
+{
+   if (Name.length() > 16 || Size > 9999999999ull)
+      return _error->Error("Member %s can't be stored in an ar archive", Name.c_str());
+   char Header[61];
+   snprintf(Header, sizeof(Header), "%-16s%-12lu%-6lu%-6lu%-8lo%-10llu`\n", Name.c_str(),
+	    Member.MTime, Member.UID, Member.GID, Member.Mode, Size);
+   return Out.Write(Header, 60);
+}
+static bool StageDeb(std::string const &Source, std::string const &Target,
+		     unsigned long long &SourceSize, unsigned long long &Size)
+{
+   FileFd In(Source, FileFd::ReadOnly);
+   if (In.IsOpen() == false)
+      return false;
+   SourceSize = In.FileSize();
+   ARArchive AR(In);
+   if (_error->PendingError() == true)
+      return false;
+
+   auto const Compressors = APT::Configuration::getCompressors();
+   auto const CompressorOf = [&](std::string const &Name) {
+      return std::find_if(Compressors.cbegin(), Compressors.cend(), [&](auto const &c) {
+	 return c.Extension.empty() == false && Name == "data.tar" + c.Extension;
+      });
+   };
+   // the archive keeps its members in no particular order, dpkg needs the original one
+   std::vector<ARArchive::Member const *> Members;
+   for (auto M = AR.Members(); M != nullptr; M = M->Next)
+      Members.push_back(M);
+   std::sort(Members.begin(), Members.end(), [](auto const A, auto const B) { return A->Start < B->Start; });
+   // nothing dpkg would have to decompress
+   if (std::none_of(Members.cbegin(), Members.cend(), [&](auto const M) { return CompressorOf(M->Name) != Compressors.cend(); }))
+      return false;
+
+   FileFd Out(Target, FileFd::WriteOnly | FileFd::Create | FileFd::Exclusive, 0644);
+   if (Out.IsOpen() == false || Out.Write("!<arch>\n", 8) == false)
+      return false;
+   std::unique_ptr<char[]> Buffer(new char[APT_BUFFER_SIZE]);
+   Size = 8;
+   for (auto const M : Members)
+   {
+      if (In.Seek(M->Start) == false)
+	 return false;
+      unsigned long long const HeaderAt = Out.Tell();
+      unsigned long long MemberSize = 0;
+      auto const Compressor = CompressorOf(M->Name);
+      if (Compressor == Compressors.cend())
+      {
+	 if (WriteARHeader(Out, M->Name, *M, M->Size) == false)
+	    return false;
+	 for (MemberSize = 0; MemberSize < M->Size;)
+	 {
+	    unsigned long long const ToRead = std::min<unsigned long long>(APT_BUFFER_SIZE, M->Size - MemberSize);
+	    if (In.Read(Buffer.get(), ToRead) == false || Out.Write(Buffer.get(), ToRead) == false)
+	       return false;
+	    MemberSize += ToRead;
+	 }
+      }
+      else
+      {
+	 // the size is only known after decompressing, so the header is written twice
+	 if (WriteARHeader(Out, "data.tar", *M, 0) == false)
+	    return false;
+	 FileFd Data;
+	 if (Data.OpenDescriptor(In.Fd(), FileFd::ReadOnly, *Compressor, false) == false)
+	    return false;
+	 while (true)
+	 {
+	    unsigned long long Actual = 0;
+	    if (Data.Read(Buffer.get(), APT_BUFFER_SIZE, &Actual) == false)
+	       return false;
+	    if (Actual == 0)
+	       break;
+	    if (Out.Write(Buffer.get(), Actual) == false)
+	       return false;
+	    MemberSize += Actual;
+	 }
+	 if (Data.Close() == false || Out.Seek(HeaderAt) == false ||
+	     WriteARHeader(Out, "data.tar", *M, MemberSize) == false ||
+	     Out.Seek(HeaderAt + 60 + MemberSize) == false)
+	    return false;
+      }
+      if (MemberSize % 2 != 0 && Out.Write("\n", 1) == false)
+	 return false;
+      Size += 60 + MemberSize + (MemberSize % 2);
+   }
+   return Out.Close();
+}
+class APT_HIDDEN UnpackAhead
+{
+   struct Job
+   {
+      std::string File;
+      std::string Source;
+      std::string Staged;
+      enum { Pending, Working, Ready, Failed, InUse, Done } State;
+      unsigned long long Size;
+      Job(std::string const &File, std::string const &Source) : File(File), Source(Source), State(Pending), Size(0) {}
+   };
+   std::vector<Job> Jobs;
+   std::unordered_map<std::string, size_t> Index;
+   std::string Dir;
+   std::function<bool(std::string &)> const Fetched;
+   bool const Debug;
+   unsigned long long const Limit;
+   unsigned long long Staged = 0;
+   size_t Next = 0;
+   bool Stop = false;
+   std::mutex Lock;
+   std::condition_variable Changed;
+   std::vector<std::thread> Workers;
+
+   // for the report
+   std::chrono::duration<double> WorkTime{0};
+   std::chrono::duration<double> WaitTime{0};
+   unsigned long long BytesIn = 0;
+   unsigned long long BytesOut = 0;
+   size_t Used = 0;
+   size_t Unstaged = 0;
+
+   void Work()
+   {
+      std::unique_lock<std::mutex> Guard(Lock);
+      while (true)
+      {
+	 while (Next < Jobs.size() && Jobs[Next].State != Job::Pending)
+	    ++Next;
+	 if (Stop == true || Next == Jobs.size())
+	    return;
+	 if (Staged != 0 && Staged >= Limit)
+	 {
+	    Changed.wait(Guard);
+	    continue;
+	 }
+	 // archives which are still being fetched are checked for again later
+	 std::string Source = Jobs[Next].Source;
+	 if (Fetched(Source) == false)
+	 {
+	    Changed.wait_for(Guard, std::chrono::milliseconds(100));
+	    continue;
+	 }
+	 Job &J = Jobs[Next++];
+	 J.State = Job::Working;
+	 J.Staged = flCombine(Dir, std::to_string(&J - Jobs.data()) + "_" + flNotDir(J.Source));
+	 Guard.unlock();
+
+	 auto const Start = std::chrono::steady_clock::now();
+	 unsigned long long SourceSize = 0, Size = 0;
+	 // dpkg will be given a different file if it wasn't fetched to where it was expected
+	 bool const Okay = Source == J.Source && StageDeb(J.Source, J.Staged, SourceSize, Size);
+	 if (Okay == false)
+	 {
+	    if (Debug == true)
+	    {
+	       std::clog << "Unpack-Ahead: not staging " << J.Source << std::endl;
+	       _error->DumpErrors(std::clog, GlobalError::DEBUG, false);
+	    }
+	    _error->Discard();
+	    unlink(J.Staged.c_str());
+	 }
+	 auto const Took = std::chrono::steady_clock::now() - Start;
+
+	 Guard.lock();
+	 WorkTime += Took;
+	 if (Okay == true)
+	 {
+	    J.State = Job::Ready;
+	    J.Size = Size;
+	    Staged += Size;
+	    BytesIn += SourceSize;
+	    BytesOut += Size;
+	 }
+	 else
+	    J.State = Job::Failed;
+	 Changed.notify_all();
+      }
+   }
+
+   public:
+   /* Returns the file to hand to dpkg instead of File. As dpkg is usually
+      called with many debs at once this waits for the workers to get to it
+      unless the staging area is full already. */
+   std::string Take(std::string const &File)
+   {
+      auto const Idx = Index.find(File);
+      if (Idx == Index.end())
+	 return File;
+      std::unique_lock<std::mutex> Guard(Lock);
+      Job &J = Jobs[Idx->second];
+      auto const Waiting = [&] {
+	 return J.State == Job::Working || (J.State == Job::Pending && (Staged == 0 || Staged < Limit));
+      };
+      if (Workers.empty() == false && Waiting())
+      {
+	 auto const Start = std::chrono::steady_clock::now();
+	 Changed.wait(Guard, [&] { return Waiting() == false; });
+	 WaitTime += std::chrono::steady_clock::now() - Start;
+      }
+      if (J.State != Job::Ready)
+      {
+	 if (J.State == Job::Pending)
+	    J.State = Job::Failed;
+	 ++Unstaged;
+	 return File;
+      }
+      J.State = Job::InUse;
+      ++Used;
+      return debSystem::StripDpkgChrootDirectory(J.Staged);
+   }
+   // The dpkg call File was taken for is done
+   void Release(std::string const &File)
+   {
+      auto const Idx = Index.find(File);
+      if (Idx == Index.end())
+	 return;
+      std::unique_lock<std::mutex> Guard(Lock);
+      Job &J = Jobs[Idx->second];
+      if (J.State != Job::InUse)
+	 return;
+      unlink(J.Staged.c_str());
+      J.State = Job::Done;
+      Staged -= J.Size;
+      Changed.notify_all();
+   }
+
+   void Report(std::ostream &Out)
+   {
+      std::unique_lock<std::mutex> Guard(Lock);
+      Out << "Unpack-Ahead: " << Used << " staged debs used, " << Unstaged << " unpacked from the original deb, "
+	  << SizeToStr(BytesIn) << "B decompressed to " << SizeToStr(BytesOut) << "B in "
+	  << WorkTime.count() << "s on " << Workers.size() << " threads, dpkg waited "
+	  << WaitTime.count() << "s" << std::endl;
+   }
+
+   UnpackAhead(std::vector<std::pair<std::string, std::string>> const &Files, std::string const &Dir,
+	       std::function<bool(std::string &)> Fetched, unsigned int const Threads, unsigned long long const Limit)
+      : Dir(Dir), Fetched(std::move(Fetched)), Debug(_config->FindB("Debug::pkgDPkgPM::Unpack-Ahead", false)), Limit(Limit)
+   {
+      Jobs.reserve(Files.size());
+      for (auto const &F : Files)
+	 if (Index.emplace(F.first, Jobs.size()).second == true)
+	    Jobs.emplace_back(F.first, F.second);
+      for (unsigned int I = 0; I < Threads; ++I)
+	 Workers.emplace_back(&UnpackAhead::Work, this);
+   }
+   UnpackAhead(UnpackAhead const &) = delete;
+   UnpackAhead& operator=(UnpackAhead const &) = delete;
+   ~UnpackAhead()
+   {
+      {
+	 std::unique_lock<std::mutex> Guard(Lock);
+	 Stop = true;
+	 Changed.notify_all();
+      }
+      for (auto &W : Workers)
+	 W.join();
+      for (auto const &J : Jobs)
+	 if (J.State == Job::Ready || J.State == Job::InUse)
+	    unlink(J.Staged.c_str());
+      rmdir(Dir.c_str());
+   }
+};
+static UnpackAhead *StartUnpackAhead(std::vector<pkgDPkgPM::Item> const &List, pkgOrderList * const Order,
+				     std::function<bool(std::string &)> Fetched, bool const ReportLayers)
+{
+   std::string const Chroot = _config->FindDir("DPkg::Chroot-Directory", "/");
+   std::string const Base = _config->FindDir("DPkg::Unpack-Ahead::Directory",
+					      _config->FindDir("Dir::Cache::Archives").c_str());
+   // dpkg has to be able to see the staged debs
+   if (Chroot != "/" && debSystem::StripDpkgChrootDirectory(Base) == Base)
+   {
+      _error->Warning("Not unpacking ahead as %s is outside of the DPkg::Chroot-Directory", Base.c_str());
+      return nullptr;
+   }
+
+   std::vector<std::pair<std::string, std::string>> Files;
+   std::vector<pkgCache::Package *> Pkgs;
+   for (auto const &I : List)
+   {
+      if (I.Op != pkgDPkgPM::Item::Install)
+	 continue;
+      Files.emplace_back(I.File, Chroot == "/" ? I.File : flCombine(Chroot, I.File));
+      pkgCache::PkgIterator Pkg = I.Pkg;
+      if (Pkg.end() == false)
+	 Pkgs.push_back(Pkg);
+   }
+   if (Files.empty() == true)
+      return nullptr;
+   if (ReportLayers == true && Order != nullptr)
+   {
+      auto const Layers = Order->Layers(Pkgs.data(), Pkgs.data() + Pkgs.size());
+      std::map<unsigned int, size_t> Widths;
+      for (auto const L : Layers)
+	 ++Widths[L];
+      size_t Widest = 0;
+      for (auto const &W : Widths)
+	 Widest = std::max(Widest, W.second);
+      clog << "Unpack-Ahead: " << Pkgs.size() << " packages in " << Widths.size()
+	   << " independent layers, the widest has " << Widest << " packages" << endl;
+   }
+
+   std::string Dir = flCombine(Base, "apt-unpack-ahead-XXXXXX");
+   if (mkdtemp(&Dir[0]) == nullptr)
+   {
+      _error->WarningE("mkdtemp", "Not unpacking ahead as a staging directory in %s couldn't be created", Base.c_str());
+      return nullptr;
+   }
+   int Threads = _config->FindI("DPkg::Unpack-Ahead::Threads", std::thread::hardware_concurrency());
+   if (Threads <= 0)
+      Threads = 1;
+   unsigned long long const Limit = _config->FindI("DPkg::Unpack-Ahead::MaxSize", 1024) * 1024ull * 1024ull;
+   // ensure the compressor list is cached before the workers need it
+   APT::Configuration::getCompressors();
+   return new UnpackAhead(Files, Dir, std::move(Fetched), std::min<size_t>(Threads, Files.size()), Limit);
+}
+									/*}}}*/
 class APT_HIDDEN BuildDpkgCall {
    std::vector<char*> args;
    std::vector<bool> to_free;
@@ -1544,14 +1879,53 @@ bool pkgDPkgPM::Go(APT::Progress::PackageManager *progress)
    OSArgMax -= EnvironmentSize() - 2*1024;
    unsigned int const MaxArgBytes = _config->FindI("Dpkg::MaxArgBytes", OSArgMax);
    bool const NoTriggers = _config->FindB("DPkg::NoTriggers", true);
+   auto const noopDPkgInvocation = _config->FindB("Debug::pkgDPkgPM",false);
+
+   bool const ReportTiming = _config->FindB("DPkg::Report-Timing", false);
+   auto PhaseStart = std::chrono::steady_clock::now();
+   auto const ReportPhase = [&](std::string const &Phase) {
+      auto const Now = std::chrono::steady_clock::now();
+      if (ReportTiming == true)
+	 clog << "Timing: " << Phase << " took " << std::fixed << std::setprecision(3)
+	      << std::chrono::duration<double>(Now - PhaseStart).count() << "s" << std::defaultfloat << endl;
+      PhaseStart = Now;
+   };
+
+   // start decompressing the debs while the scripts run and dpkg is busy with earlier ones
+   std::unique_ptr<UnpackAhead> unpackAhead;
+   if (noopDPkgInvocation == false && _config->FindB("DPkg::Unpack-Ahead", false) == true)
+      unpackAhead.reset(StartUnpackAhead(List, pkgPackageManager::List,
+	 [this](std::string &File) { return ArchiveReady(File, false); }, ReportTiming));
 
    if (RunScripts("DPkg::Pre-Invoke") == false)
       return false;
 
+   /* Archives which are still being fetched are handed to dpkg as they become
+      complete, but the hooks are promised all of them */
+   auto const dpkgChrootDir = _config->FindDir("DPkg::Chroot-Directory", "/");
+   auto const FetchArchive = [&](vector<Item>::iterator const &Inst, bool const Wait) {
+      std::string File = dpkgChrootDir == "/" ? Inst->File : flCombine(dpkgChrootDir, Inst->File);
+      std::string const Queued = File;
+      if (ArchiveReady(File, Wait) == false)
+	 return false;
+      if (File != Queued)
+	 Inst->File = debSystem::StripDpkgChrootDirectory(File);
+      return true;
+   };
+   auto const ArchiveMissing = [&](vector<Item>::iterator const &Inst) {
+      strprintf(d->dpkg_error, _("Archive %s couldn't be fetched"), Inst->File.c_str());
+      return _error->Error("%s", d->dpkg_error.c_str());
+   };
+   Configuration::Item const * const PreInstallPkgs = _config->Tree("DPkg::Pre-Install-Pkgs");
+   if (PreInstallPkgs != nullptr && PreInstallPkgs->Child != nullptr)
+      for (auto Inst = List.begin(); Inst != List.end(); ++Inst)
+	 if (Inst->Op == Item::Install && FetchArchive(Inst, true) == false)
+	    return ArchiveMissing(Inst);
+
    if (RunScriptsWithPkgs("DPkg::Pre-Install-Pkgs") == false)
       return false;
+   ReportPhase("Pre-Invoke scripts");
 
-   auto const noopDPkgInvocation = _config->FindB("Debug::pkgDPkgPM",false);
    // store auto-bits as they are supposed to be after dpkg is run
    if (noopDPkgInvocation == false)
       Cache.writeStateFile(NULL);
@@ -1784,6 +2158,24 @@ bool pkgDPkgPM::Go(APT::Progress::PackageManager *progress)
       else
 	 J = std::find_if(J, List.cend(), [&J](Item const &I) { return I.Op != J->Op; });
 
+      // only the archives which are complete already are handed to this dpkg call
+      if (I->Op == Item::Install)
+      {
+	 auto Inst = std::next(List.begin(), I - List.cbegin());
+	 if (FetchArchive(Inst, false) == false)
+	 {
+	    if (FetchArchive(Inst, true) == false)
+	    {
+	       ArchiveMissing(Inst);
+	       break;
+	    }
+	    ReportPhase("waiting for the archive download");
+	 }
+	 for (++Inst; Inst != J && FetchArchive(Inst, false) == true; ++Inst)
+	    ;
+	 J = Inst;
+      }
+
       Args.clearCallArguments();
       Args.reserve((J - I) + 10);
 
@@ -1843,6 +2235,8 @@ bool pkgDPkgPM::Go(APT::Progress::PackageManager *progress)
       }
 
       std::unique_ptr<char, decltype(&cleanUpTmpDir)> tmpdir_for_dpkg_recursive{nullptr, &cleanUpTmpDir};
+      std::vector<std::string> unpackAheadTaken;
+      auto const CallBegin = I;
       std::string const dpkg_chroot_dir = _config->FindDir("DPkg::Chroot-Directory", "/");
 
       // Write in the file or package names
@@ -1875,13 +2269,18 @@ bool pkgDPkgPM::Go(APT::Progress::PackageManager *progress)
 	       else
 		  strprintf(linkpath, "%s/%s", tmpdir_for_dpkg_recursive.get(), file.c_str());
 	       std::string linktarget = I->File;
+	       if (unpackAhead != nullptr)
+	       {
+		  linktarget = unpackAhead->Take(I->File);
+		  unpackAheadTaken.push_back(I->File);
+	       }
 	       if (dpkg_chroot_dir != "/") {
 		  char * fakechroot = getenv("FAKECHROOT");
 		  if (fakechroot != nullptr && strcmp(fakechroot, "true") == 0) {
 		     // if apt is run with DPkg::Chroot-Directory under
 		     // fakechroot, absolulte symbolic links must be prefixed
 		     // with the chroot path to be valid inside fakechroot
-		     strprintf(linktarget, "%s/%s", dpkg_chroot_dir.c_str(), I->File.c_str());
+		     strprintf(linktarget, "%s/%s", dpkg_chroot_dir.c_str(), linktarget.c_str());
 		  }
 	       }
 	       if (symlink(linktarget.c_str(), linkpath.c_str()) != 0)
@@ -1896,7 +2295,13 @@ bool pkgDPkgPM::Go(APT::Progress::PackageManager *progress)
 	    {
 	       if (I->File[0] != '/')
 		  return _error->Error("Internal Error, Pathname to install is not absolute '%s'",I->File.c_str());
-	       Args.push_back(I->File.c_str());
+	       if (unpackAhead != nullptr)
+	       {
+		  Args.push_back(unpackAhead->Take(I->File));
+		  unpackAheadTaken.push_back(I->File);
+	       }
+	       else
+		  Args.push_back(I->File.c_str());
 	    }
 	 }
       }
@@ -2116,6 +2521,18 @@ bool pkgDPkgPM::Go(APT::Progress::PackageManager *progress)
       } while (true);
       close(_dpkgin);
 
+      for (auto const &File : unpackAheadTaken)
+	 unpackAhead->Release(File);
+      if (ReportTiming == true)
+      {
+	 static char const * const OpNames[] = { "unpack", "configure", "remove", "purge",
+	    "configure pending", "triggers pending", "remove pending", "purge pending" };
+	 std::string Phase = std::string("dpkg ") + OpNames[Op];
+	 if (Op <= Item::Purge)
+	    Phase.append(" of ").append(std::to_string(I - CallBegin)).append(" packages");
+	 ReportPhase(Phase);
+      }
+
       // Restore sig int/quit
       signal(SIGQUIT,old_SIGQUIT);
       signal(SIGINT,old_SIGINT);
@@ -2151,6 +2568,12 @@ bool pkgDPkgPM::Go(APT::Progress::PackageManager *progress)
    // dpkg is done at this point
    StopPtyMagic();
    CloseLog();
+   if (unpackAhead != nullptr)
+   {
+      if (ReportTiming == true)
+	 unpackAhead->Report(clog);
+      unpackAhead.reset();
+   }
 
    if (d->dpkg_error.empty() == false)
    {
@@ -2216,8 +2639,10 @@ bool pkgDPkgPM::Go(APT::Progress::PackageManager *progress)
 
    d->progress->Stop();
 
+   PhaseStart = std::chrono::steady_clock::now();
    if (RunScripts("DPkg::Post-Invoke") == false)
       return false;
+   ReportPhase("Post-Invoke scripts");
 
    return d->dpkg_error.empty();
 }
@@ -20,6 +20,7 @@
 #include <apt-pkg/fileutl.h>
 #include <apt-pkg/macros.h>
 #include <apt-pkg/pkgcache.h>
+#include <apt-pkg/policy.h>
 #include <apt-pkg/prettyprinters.h>
 #include <apt-pkg/progress.h>
 #include <apt-pkg/strutl.h>
@@ -29,6 +30,7 @@
 #include <apt-pkg/versionmatch.h>
 
 #include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <memory>
 #include <sstream>
@@ -36,13 +38,20 @@
 #include <list>
 #include <set>
 #include <string>
+#include <thread>
+#include <typeinfo>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
+
+#include <xxhash.h>
 
 #include <apti18n.h>
 									/*}}}*/
@@ -137,11 +146,57 @@ int pkgDepCache::DecreaseActionGroupLevel()
 // ---------------------------------------------------------------------
 /* */
 
+/* The parts of the state of a package MarkRequired and Sweep depend on */
+struct MarkInput
+{
+   pkgCache::Version *InstallVer;
+   unsigned short Flags;
+   unsigned char Mode;
+   bool Protected;
+
+   explicit MarkInput(pkgDepCache::StateCache const &State) : InstallVer(State.InstallVer), Flags(State.Flags),
+							       Mode(State.Mode), Protected(State.Protect()) {}
+   bool operator!=(MarkInput const &Other) const
+   {
+      return InstallVer != Other.InstallVer || Flags != Other.Flags || Mode != Other.Mode || Protected != Other.Protected;
+   }
+};
 struct pkgDepCache::Private
 {
    std::unique_ptr<InRootSetFunc> inRootSetFunc;
    std::unique_ptr<APT::CacheFilter::Matcher> IsAVersionedKernelPackage, IsProtectedKernelPackage;
+   // what the last MarkRequired run with the cached root set saw, see ReuseMarks
+   bool MarksValid = false;
+   std::vector<MarkInput> MarkInputs;
+   // the packages whose state it looked at while following dependencies
+   std::vector<bool> MarkVisited;
+   std::string MarkConfig;
+};
+/* Changes of the size and count totals, so that threads can collect them
+   on their own. The unsigned totals wrap around just like if the changes
+   were applied to them one by one. */
+struct pkgDepCache::StateCounters
+{
+   signed long long UsrSize = 0;
+   signed long long DownloadSize = 0;
+   signed long InstCount = 0;
+   signed long DelCount = 0;
+   signed long KeepCount = 0;
+   signed long BrokenCount = 0;
+   signed long PolicyBrokenCount = 0;
+   signed long BadCount = 0;
 };
+void pkgDepCache::AddCounters(StateCounters const &Counters)
+{
+   iUsrSize += Counters.UsrSize;
+   iDownloadSize += Counters.DownloadSize;
+   iInstCount += Counters.InstCount;
+   iDelCount += Counters.DelCount;
+   iKeepCount += Counters.KeepCount;
+   iBrokenCount += Counters.BrokenCount;
+   iPolicyBrokenCount += Counters.PolicyBrokenCount;
+   iBadCount += Counters.BadCount;
+}
 pkgDepCache::pkgDepCache(pkgCache *const pCache, Policy *const Plcy) : group_level(0), Cache(pCache), PkgState(0), DepState(0),
 								       iUsrSize(0), iDownloadSize(0), iInstCount(0), iDelCount(0), iKeepCount(0),
 								       iBrokenCount(0), iPolicyBrokenCount(0), iBadCount(0), d(new Private)
@@ -263,6 +318,23 @@ bool pkgDepCache::Init(OpProgress * const Prog)
    memset(PkgState,0,sizeof(*PkgState)*Head().PackageCount);
    memset(DepState,0,sizeof(*DepState)*Head().DependsCount);
 
+   // Reuse the states of an earlier run if nothing they depend on changed
+   std::string const SnapshotFile = StateSnapshotFile();
+   uint64_t const SnapshotEnvironment = SnapshotFile.empty() ? 0 : StateSnapshotEnvironment();
+   if (SnapshotFile.empty() == false)
+   {
+      _error->PushToStack();
+      bool const Loaded = LoadStateSnapshot(SnapshotFile, SnapshotEnvironment, Prog);
+      if (_config->FindB("Debug::pkgDepCache::Snapshot", false))
+      {
+	 std::clog << (Loaded ? "Loaded dependency states from " : "Dependency state snapshot is not usable: ") << SnapshotFile << std::endl;
+	 _error->DumpErrors(std::clog, GlobalError::DEBUG, false);
+      }
+      _error->RevertToStack();
+      if (Loaded)
+	 return true;
+   }
+
    if (Prog != 0)
    {
       Prog->OverallProgress(0,2*Head().PackageCount,Head().PackageCount,
@@ -300,12 +372,216 @@ bool pkgDepCache::Init(OpProgress * const Prog)
 
    Update(Prog);
 
+   if (SnapshotFile.empty() == false && access(flNotFile(SnapshotFile).c_str(), W_OK) == 0)
+   {
+      _error->PushToStack();
+      bool const Written = WriteStateSnapshot(SnapshotFile, SnapshotEnvironment);
+      if (_config->FindB("Debug::pkgDepCache::Snapshot", false))
+      {
+	 std::clog << (Written ? "Wrote dependency states to " : "Failed to write dependency states to ") << SnapshotFile << std::endl;
+	 _error->DumpErrors(std::clog, GlobalError::DEBUG, false);
+      }
+      _error->RevertToStack();
+   }
+
    if(Prog != 0)
       Prog->Done();
 
    return true;
 }
 									/*}}}*/
+// DepCache::StateSnapshot - the initial states stored on disk		/*{{{*/
+// ---------------------------------------------------------------------
+/* The snapshot consists of the header, an entry for each package in the
+   order of their IDs and the states of all dependencies. It is taken at
+   the end of Init, so it is only valid for the cache, the policy and the
+   extended_states it was taken with. The marks of MarkAndSweep are not
+   part of it as they depend on a lot more settings. */
+struct DepCacheSnapshotHeader
+{
+   char Signature[8];
+   uint32_t Version;
+   uint32_t CacheHash;
+   uint64_t Environment;
+   uint32_t PackageCount;
+   uint32_t VersionCount;
+   uint32_t DependsCount;
+   uint32_t Padding;
+   int64_t UsrSize;
+   uint64_t DownloadSize;
+   uint64_t InstCount;
+   uint64_t DelCount;
+   uint64_t KeepCount;
+   uint64_t BrokenCount;
+   uint64_t PolicyBrokenCount;
+   uint64_t BadCount;
+   uint64_t Checksum;
+};
+struct DepCacheSnapshotPackage
+{
+   uint32_t CandidateVer;
+   uint16_t Flags;
+   int8_t Status;
+   uint8_t DepState;
+};
+static char const DepCacheSnapshotSignature[8] = "APTDEPS";
+static uint32_t const DepCacheSnapshotVersion = 1;
+
+static uint64_t DepCacheSnapshotChecksum(void const * const Packages, size_t const PackagesSize,
+					 void const * const DepStates, size_t const DepStatesSize)
+{
+   XXH3_state_t * const State = XXH3_createState();
+   XXH3_64bits_reset(State);
+   XXH3_64bits_update(State, Packages, PackagesSize);
+   XXH3_64bits_update(State, DepStates, DepStatesSize);
+   auto const Digest = XXH3_64bits_digest(State);
+   XXH3_freeState(State);
+   return Digest;
+}
+std::string pkgDepCache::StateSnapshotFile() const
+{
+   // other policies and the debug output of readStateFile need the real run
+   if (typeid(*LocalPolicy) != typeid(pkgPolicy) ||
+       _config->FindB("Debug::pkgAutoRemove", false) ||
+       _config->FindFile("Dir::Cache::pkgcache").empty())
+      return "";
+   return _config->FindFile("Dir::Cache::depcache");
+}
+uint64_t pkgDepCache::StateSnapshotEnvironment() const
+{
+   std::string Env = static_cast<pkgPolicy const *>(LocalPolicy)->Fingerprint();
+   std::string const State = _config->FindFile("Dir::State::extended_states");
+   Env.append(State);
+   struct stat Buf;
+   if (stat(State.c_str(), &Buf) == 0)
+      Env.append(":").append(std::to_string(Buf.st_dev))
+	 .append(":").append(std::to_string(Buf.st_ino))
+	 .append(":").append(std::to_string(Buf.st_size))
+	 .append(":").append(std::to_string(Buf.st_mtim.tv_sec))
+	 .append(".").append(std::to_string(Buf.st_mtim.tv_nsec))
+	 .append(":").append(std::to_string(Buf.st_ctim.tv_sec))
+	 .append(".").append(std::to_string(Buf.st_ctim.tv_nsec));
+   return XXH3_64bits(Env.data(), Env.size());
+}
+bool pkgDepCache::LoadStateSnapshot(std::string const &FileName, uint64_t const Environment, OpProgress * const Prog)
+{
+   if (RealFileExists(FileName) == false)
+      return false;
+   FileFd File(FileName, FileFd::ReadOnly);
+   if (File.IsOpen() == false || File.Size() < sizeof(DepCacheSnapshotHeader))
+      return false;
+   size_t const Size = File.Size();
+   void * const Mapped = mmap(nullptr, Size, PROT_READ, MAP_SHARED, File.Fd(), 0);
+   if (Mapped == MAP_FAILED)
+      return _error->Errno("mmap", _("Couldn't make mmap of %llu bytes"), static_cast<unsigned long long>(Size));
+   auto const Unmap = [Size](void * const M) { munmap(M, Size); };
+   std::unique_ptr<void, decltype(Unmap)> const Guard(Mapped, Unmap);
+
+   auto const Header = static_cast<DepCacheSnapshotHeader const *>(Mapped);
+   auto const Packages = reinterpret_cast<DepCacheSnapshotPackage const *>(Header + 1);
+   auto const DepStates = reinterpret_cast<unsigned char const *>(Packages + Head().PackageCount);
+   if (memcmp(Header->Signature, DepCacheSnapshotSignature, sizeof(Header->Signature)) != 0 ||
+       Header->Version != DepCacheSnapshotVersion ||
+       Header->CacheHash != Head().CacheFileSize ||
+       Header->Environment != Environment ||
+       Header->PackageCount != Head().PackageCount ||
+       Header->VersionCount != Head().VersionCount ||
+       Header->DependsCount != Head().DependsCount ||
+       Size != sizeof(*Header) + Header->PackageCount * sizeof(*Packages) + Header->DependsCount ||
+       Header->Checksum != DepCacheSnapshotChecksum(Packages, Header->PackageCount * sizeof(*Packages),
+						    DepStates, Header->DependsCount))
+      return false;
+
+   auto const VersionLimit = Cache->GetMap().Size() / sizeof(pkgCache::Version);
+   for (PkgIterator I = PkgBegin(); I.end() != true; ++I)
+   {
+      auto const &Entry = Packages[I->ID];
+      StateCache &State = PkgState[I->ID];
+      if (Entry.CandidateVer != 0)
+      {
+	 if (Entry.CandidateVer >= VersionLimit ||
+	     VerIterator(*Cache, Cache->VerP + Entry.CandidateVer).ParentPkg() != I)
+	 {
+	    memset(PkgState, 0, sizeof(*PkgState) * Head().PackageCount);
+	    return false;
+	 }
+	 State.CandidateVer = Cache->VerP + Entry.CandidateVer;
+	 State.CandVersion = State.CandidateVerIter(*Cache).VerStr();
+      }
+      else
+	 State.CandVersion = "";
+      State.InstallVer = I.CurrentVer();
+      State.CurVersion = I->CurrentVer == 0 ? "" : I.CurrentVer().VerStr();
+      State.Mode = ModeKeep;
+      State.Flags = Entry.Flags;
+      State.Status = Entry.Status;
+      State.DepState = Entry.DepState;
+   }
+   memcpy(DepState, DepStates, Header->DependsCount);
+   iUsrSize = Header->UsrSize;
+   iDownloadSize = Header->DownloadSize;
+   iInstCount = Header->InstCount;
+   iDelCount = Header->DelCount;
+   iKeepCount = Header->KeepCount;
+   iBrokenCount = Header->BrokenCount;
+   iPolicyBrokenCount = Header->PolicyBrokenCount;
+   iBadCount = Header->BadCount;
+
+   // the progress looks the same as if the states were computed
+   if (Prog != 0)
+   {
+      Prog->OverallProgress(0, 2 * Head().PackageCount, Head().PackageCount,
+			    _("Building dependency tree"));
+      if (RealFileExists(_config->FindFile("Dir::State::extended_states")))
+      {
+	 Prog->Done();
+	 Prog->OverallProgress(1, 1, 1, _("Reading state information"));
+      }
+      Prog->Done();
+   }
+   return true;
+}
+bool pkgDepCache::WriteStateSnapshot(std::string const &FileName, uint64_t const Environment) const
+{
+   std::vector<DepCacheSnapshotPackage> Packages(Cache->Head().PackageCount);
+   for (map_id_t I = 0; I != Cache->Head().PackageCount; ++I)
+   {
+      StateCache const &State = PkgState[I];
+      auto &Entry = Packages[I];
+      Entry.CandidateVer = State.CandidateVer == nullptr ? 0 : State.CandidateVer - Cache->VerP;
+      Entry.Flags = State.Flags;
+      Entry.Status = State.Status;
+      Entry.DepState = State.DepState;
+   }
+
+   DepCacheSnapshotHeader Header;
+   memset(&Header, 0, sizeof(Header));
+   memcpy(Header.Signature, DepCacheSnapshotSignature, sizeof(Header.Signature));
+   Header.Version = DepCacheSnapshotVersion;
+   Header.CacheHash = Cache->Head().CacheFileSize;
+   Header.Environment = Environment;
+   Header.PackageCount = Cache->Head().PackageCount;
+   Header.VersionCount = Cache->Head().VersionCount;
+   Header.DependsCount = Cache->Head().DependsCount;
+   Header.UsrSize = iUsrSize;
+   Header.DownloadSize = iDownloadSize;
+   Header.InstCount = iInstCount;
+   Header.DelCount = iDelCount;
+   Header.KeepCount = iKeepCount;
+   Header.BrokenCount = iBrokenCount;
+   Header.PolicyBrokenCount = iPolicyBrokenCount;
+   Header.BadCount = iBadCount;
+   Header.Checksum = DepCacheSnapshotChecksum(Packages.data(), Packages.size() * sizeof(Packages[0]),
+					      DepState, Cache->Head().DependsCount);
+
+   FileFd Fd(FileName, FileFd::WriteAtomic, 0644);
+   return Fd.IsOpen() &&
+	  Fd.Write(&Header, sizeof(Header)) &&
+	  Fd.Write(Packages.data(), Packages.size() * sizeof(Packages[0])) &&
+	  Fd.Write(DepState, Cache->Head().DependsCount) &&
+	  Fd.Close();
+}
+									/*}}}*/
 bool pkgDepCache::readStateFile(OpProgress * const Prog)		/*{{{*/
 {
    FileFd state_file;
@@ -548,6 +824,12 @@ bool pkgDepCache::CheckDep(DepIterator const &Dep,int const Type,PkgIterator &Re
 // ---------------------------------------------------------------------
 /* Call with Inverse = true to perform the inverse operation */
 void pkgDepCache::AddSizes(const PkgIterator &Pkg, bool const Inverse)
+{
+   StateCounters Counters;
+   AddSizes(Pkg, Inverse, Counters);
+   AddCounters(Counters);
+}
+void pkgDepCache::AddSizes(PkgIterator const &Pkg, bool const Inverse, StateCounters &Counters)
 {
    StateCache &P = PkgState[Pkg->ID];
    
@@ -562,11 +844,11 @@ void pkgDepCache::AddSizes(const PkgIterator &Pkg, bool const Inverse)
    if (P.NewInstall() == true)
    {
       if (Inverse == false) {
-	 iUsrSize += P.InstVerIter(*this)->InstalledSize;
-	 iDownloadSize += P.InstVerIter(*this)->Size;
+	 Counters.UsrSize += P.InstVerIter(*this)->InstalledSize;
+	 Counters.DownloadSize += P.InstVerIter(*this)->Size;
       } else {
-	 iUsrSize -= P.InstVerIter(*this)->InstalledSize;
-	 iDownloadSize -= P.InstVerIter(*this)->Size;
+	 Counters.UsrSize -= P.InstVerIter(*this)->InstalledSize;
+	 Counters.DownloadSize -= P.InstVerIter(*this)->Size;
       }
       return;
    }
@@ -577,13 +859,13 @@ void pkgDepCache::AddSizes(const PkgIterator &Pkg, bool const Inverse)
 	(P.iFlags & ReInstall) == ReInstall) && P.InstallVer != 0)
    {
       if (Inverse == false) {
-	 iUsrSize -= Pkg.CurrentVer()->InstalledSize;
-	 iUsrSize += P.InstVerIter(*this)->InstalledSize;
-	 iDownloadSize += P.InstVerIter(*this)->Size;
+	 Counters.UsrSize -= Pkg.CurrentVer()->InstalledSize;
+	 Counters.UsrSize += P.InstVerIter(*this)->InstalledSize;
+	 Counters.DownloadSize += P.InstVerIter(*this)->Size;
       } else {
-	 iUsrSize -= P.InstVerIter(*this)->InstalledSize;
-	 iUsrSize += Pkg.CurrentVer()->InstalledSize;
-	 iDownloadSize -= P.InstVerIter(*this)->Size;
+	 Counters.UsrSize -= P.InstVerIter(*this)->InstalledSize;
+	 Counters.UsrSize += Pkg.CurrentVer()->InstalledSize;
+	 Counters.DownloadSize -= P.InstVerIter(*this)->Size;
       }
       return;
    }
@@ -593,9 +875,9 @@ void pkgDepCache::AddSizes(const PkgIterator &Pkg, bool const Inverse)
        P.Delete() == false)
    {
       if (Inverse == false)
-	 iDownloadSize += P.InstVerIter(*this)->Size;
+	 Counters.DownloadSize += P.InstVerIter(*this)->Size;
       else
-	 iDownloadSize -= P.InstVerIter(*this)->Size;
+	 Counters.DownloadSize -= P.InstVerIter(*this)->Size;
       return;
    }
    
@@ -603,9 +885,9 @@ void pkgDepCache::AddSizes(const PkgIterator &Pkg, bool const Inverse)
    if (Pkg->CurrentVer != 0 && P.InstallVer == 0)
    {
       if (Inverse == false)
-	 iUsrSize -= Pkg.CurrentVer()->InstalledSize;
+	 Counters.UsrSize -= Pkg.CurrentVer()->InstalledSize;
       else
-	 iUsrSize += Pkg.CurrentVer()->InstalledSize;
+	 Counters.UsrSize += Pkg.CurrentVer()->InstalledSize;
       return;
    }   
 }
@@ -619,29 +901,35 @@ void pkgDepCache::AddSizes(const PkgIterator &Pkg, bool const Inverse)
    while processing a dep for Pkg it is possible that Add/Remove
    will be called on Pkg */
 void pkgDepCache::AddStates(const PkgIterator &Pkg, bool const Invert)
+{
+   StateCounters Counters;
+   AddStates(Pkg, Invert, Counters);
+   AddCounters(Counters);
+}
+void pkgDepCache::AddStates(PkgIterator const &Pkg, bool const Invert, StateCounters &Counters) const
 {
    signed char const Add = (Invert == false) ? 1 : -1;
-   StateCache &State = PkgState[Pkg->ID];
+   StateCache const &State = PkgState[Pkg->ID];
 
    // The Package is broken (either minimal dep or policy dep)
    if ((State.DepState & DepInstMin) != DepInstMin)
-      iBrokenCount += Add;
+      Counters.BrokenCount += Add;
    if ((State.DepState & DepInstPolicy) != DepInstPolicy)
-      iPolicyBrokenCount += Add;
+      Counters.PolicyBrokenCount += Add;
 
    // Bad state
    if (Pkg.State() != PkgIterator::NeedsNothing)
-      iBadCount += Add;
+      Counters.BadCount += Add;
 
    // Not installed
    if (Pkg->CurrentVer == 0)
    {
       if (State.Mode == ModeDelete &&
 	  (State.iFlags & Purge) == Purge && Pkg.Purge() == false)
-	 iDelCount += Add;
+	 Counters.DelCount += Add;
 
       if (State.Mode == ModeInstall)
-	 iInstCount += Add;
+	 Counters.InstCount += Add;
       return;
    }
 
@@ -649,20 +937,20 @@ void pkgDepCache::AddStates(const PkgIterator &Pkg, bool const Invert)
    if (State.Status == 0)
    {
       if (State.Mode == ModeDelete)
-	 iDelCount += Add;
+	 Counters.DelCount += Add;
       else
 	 if ((State.iFlags & ReInstall) == ReInstall)
-	    iInstCount += Add;
+	    Counters.InstCount += Add;
       return;
    }
 
    // Alll 3 are possible
    if (State.Mode == ModeDelete)
-      iDelCount += Add;
+      Counters.DelCount += Add;
    else if (State.Mode == ModeKeep)
-      iKeepCount += Add;
+      Counters.KeepCount += Add;
    else if (State.Mode == ModeInstall)
-      iInstCount += Add;
+      Counters.InstCount += Add;
 }
 									/*}}}*/
 // DepCache::BuildGroupOrs - Generate the Or group dep data		/*{{{*/
@@ -786,7 +1074,10 @@ void pkgDepCache::UpdateVerState(PkgIterator const &Pkg)
 // DepCache::Update - Figure out all the state information		/*{{{*/
 // ---------------------------------------------------------------------
 /* This will figure out the state of all the packages and all the 
-   dependencies based on the current policy. */
+   dependencies based on the current policy. A package only writes the
+   states of its own dependencies and its own DepState while it reads the
+   install and candidate versions of others, so with APT::Cache-Dependency-Threads
+   blocks of package IDs are handled by threads, each with its own counters. */
 void pkgDepCache::PerformDependencyPass(OpProgress * const Prog)
 {
    iUsrSize = 0;
@@ -798,40 +1089,82 @@ void pkgDepCache::PerformDependencyPass(OpProgress * const Prog)
    iPolicyBrokenCount = 0;
    iBadCount = 0;
 
-   int Done = 0;
-   for (PkgIterator I = PkgBegin(); I.end() != true; ++I, ++Done)
+   map_id_t const BlockSize = 1024;
+   map_id_t const PackageCount = Head().PackageCount;
+   unsigned int Threads = std::max(0, _config->FindI("APT::Cache-Dependency-Threads", 0));
+   Threads = std::min(Threads, (PackageCount + BlockSize - 1) / BlockSize);
+   if (Threads <= 1)
    {
-      if (Prog != 0 && Done%20 == 0)
-	 Prog->Progress(Done);
-      for (VerIterator V = I.VersionList(); V.end() != true; ++V)
+      StateCounters Counters;
+      int Done = 0;
+      for (PkgIterator I = PkgBegin(); I.end() != true; ++I, ++Done)
       {
-	 unsigned char Group = 0;
+	 if (Prog != 0 && Done%20 == 0)
+	    Prog->Progress(Done);
+	 PerformDependencyPass(I, Counters);
+      }
+      AddCounters(Counters);
+      if (Prog != 0)
+	 Prog->Progress(Done);
+      return;
+   }
 
-	 for (DepIterator D = V.DependsList(); D.end() != true; ++D)
-	 {
-	    // Build the dependency state.
-	    unsigned char &State = DepState[D->ID];
-	    State = DependencyState(D);
-
-	    // Add to the group if we are within an or..
-	    Group |= State;
-	    State |= Group << 3;
-	    if ((D->CompareOp & Dep::Or) != Dep::Or)
-	       Group = 0;
-
-	    // Invert for Conflicts
-	    if (D.IsNegative() == true)
-	       State = ~State;
-	 }
+   std::vector<Package *> Packages(PackageCount, nullptr);
+   for (PkgIterator I = PkgBegin(); I.end() != true; ++I)
+      Packages[I->ID] = I;
+
+   std::atomic<map_id_t> NextBlock{0};
+   std::vector<StateCounters> Counters(Threads);
+   auto const Worker = [&](StateCounters &Totals) {
+      for (map_id_t Block = NextBlock++; Block * BlockSize < PackageCount; Block = NextBlock++)
+      {
+	 auto const End = std::min(PackageCount, (Block + 1) * BlockSize);
+	 for (map_id_t ID = Block * BlockSize; ID != End; ++ID)
+	    if (Packages[ID] != nullptr)
+	       PerformDependencyPass(PkgIterator(*Cache, Packages[ID]), Totals);
       }
+   };
+   std::vector<std::thread> Workers;
+   Workers.reserve(Threads - 1);
+   for (unsigned int I = 1; I < Threads; ++I)
+      Workers.emplace_back(Worker, std::ref(Counters[I]));
+   Worker(Counters[0]);
+   for (auto &W : Workers)
+      W.join();
+
+   for (auto const &C : Counters)
+      AddCounters(C);
+   if (Prog != 0)
+      Prog->Progress(PackageCount);
+}
+void pkgDepCache::PerformDependencyPass(PkgIterator const &Pkg, StateCounters &Counters)
+{
+   for (VerIterator V = Pkg.VersionList(); V.end() != true; ++V)
+   {
+      unsigned char Group = 0;
 
-      // Compute the package dependency state and size additions
-      AddSizes(I);
-      UpdateVerState(I);
-      AddStates(I);
+      for (DepIterator D = V.DependsList(); D.end() != true; ++D)
+      {
+	 // Build the dependency state.
+	 unsigned char &State = DepState[D->ID];
+	 State = DependencyState(D);
+
+	 // Add to the group if we are within an or..
+	 Group |= State;
+	 State |= Group << 3;
+	 if ((D->CompareOp & Dep::Or) != Dep::Or)
+	    Group = 0;
+
+	 // Invert for Conflicts
+	 if (D.IsNegative() == true)
+	    State = ~State;
+      }
    }
-   if (Prog != 0)
-      Prog->Progress(Done);
+
+   // Compute the package dependency state and size additions
+   AddSizes(Pkg, false, Counters);
+   UpdateVerState(Pkg);
+   AddStates(Pkg, false, Counters);
 }
 void pkgDepCache::Update(OpProgress * const Prog)
 {
@@ -2277,6 +2610,16 @@ bool pkgDepCache::Policy::IsImportantDep(DepIterator const &Dep) const
    return false;
 }
 									/*}}}*/
+// Policy::Fingerprint - Describe the settings of IsImportantDep	/*{{{*/
+std::string pkgDepCache::Policy::Fingerprint() const
+{
+   std::string Print = InstallRecommends ? "recommends" : "-";
+   Print.append(InstallSuggests ? ",suggests" : ",-");
+   for (auto const &Section : _config->FindVector("APT::Install-Recommends-Sections"))
+      Print.append(",").append(Section);
+   return Print.append(";");
+}
+									/*}}}*/
 // Policy::GetPriority - Get the priority of the package pin		/*{{{*/
 APT_PURE signed short pkgDepCache::Policy::GetPriority(pkgCache::PkgIterator const &/*Pkg*/)
 { return 0; }
@@ -2329,6 +2672,16 @@ static bool IsPkgInBoringState(pkgCache::PkgIterator const &Pkg, pkgDepCache::St
    return false;
 }
 									/*}}}*/
+// MarkConfigOf - the configuration Mark-and-Sweep depends on		/*{{{*/
+static std::string MarkConfigOf(pkgDepCache &Cache)
+{
+   std::string Config;
+   Config.push_back(Cache.MarkFollowsRecommends() ? '1' : '0');
+   Config.push_back(Cache.MarkFollowsSuggests() ? '1' : '0');
+   Config.push_back(_config->FindB("APT::Ignore-Hold", false) ? '1' : '0');
+   return Config;
+}
+									/*}}}*/
 // MarkPackage - mark a single package in Mark-and-Sweep		/*{{{*/
 static bool MarkPackage(pkgCache::PkgIterator const &Pkg,
 			pkgCache::VerIterator const &Ver,
@@ -2341,12 +2694,14 @@ static bool MarkPackage(pkgCache::PkgIterator const &Pkg,
 			pkgDepCache &DepCache,
 			pkgDepCache::StateCache *const PkgState,
 			std::vector<bool> &fullyExplored,
+			std::vector<bool> &visited,
 			std::unique_ptr<APT::CacheFilter::Matcher> &IsAVersionedKernelPackage,
 			std::unique_ptr<APT::CacheFilter::Matcher> &IsProtectedKernelPackage)
 {
    if (Ver.end() || PkgState[Pkg->ID].Marked)
       return true;
 
+   visited[Pkg->ID] = true;
    if (IsPkgInBoringState(Pkg, PkgState))
    {
       fullyExplored[Pkg->ID] = true;
@@ -2363,7 +2718,7 @@ static bool MarkPackage(pkgCache::PkgIterator const &Pkg,
 		<< " (" << reason << ")" << std::endl;
 
    auto const sort_by_source_version = [](pkgCache::VerIterator const &A, pkgCache::VerIterator const &B) {
-      auto const verret = A.Cache()->VS->CmpVersion(A.SourceVerStr(), B.SourceVerStr());
+      auto const verret = A.Cache()->CmpVersion(A->SourceVerStr, B->SourceVerStr);
       if (verret != 0)
 	 return verret < 0;
       return A->ID < B->ID;
@@ -2384,6 +2739,7 @@ static bool MarkPackage(pkgCache::PkgIterator const &Pkg,
       bool unsatisfied_choice = false;
       std::unordered_map<std::string, APT::VersionVector> providers_by_source;
       // collect real part
+      visited[T->ID] = true;
       if (not IsPkgInBoringState(T, PkgState))
       {
 	 auto const TV = (PkgState[T->ID].Install()) ? PkgState[T->ID].InstVerIter(DepCache) : T.CurrentVer();
@@ -2401,6 +2757,7 @@ static bool MarkPackage(pkgCache::PkgIterator const &Pkg,
       for (auto Prv = T.ProvidesList(); not Prv.end(); ++Prv)
       {
 	 auto const PP = Prv.OwnerPkg();
+	 visited[PP->ID] = true;
 	 if (IsPkgInBoringState(PP, PkgState))
 	    continue;
 
@@ -2458,7 +2815,7 @@ static bool MarkPackage(pkgCache::PkgIterator const &Pkg,
 			 << ", provided by " << PP.FullName() << " " << PV.VerStr()
 			 << " (" << providers_by_source.size() << "/" << providers.second.size() << ")\n";
 	    if (not MarkPackage(PP, PV, follow_recommends, follow_suggests, debug_autoremove,
-				"Dependency", Depth + 1, Cache, DepCache, PkgState, fullyExplored,
+				"Dependency", Depth + 1, Cache, DepCache, PkgState, fullyExplored, visited,
 				IsAVersionedKernelPackage, IsProtectedKernelPackage))
 	       return false;
 	 }
@@ -2467,11 +2824,33 @@ static bool MarkPackage(pkgCache::PkgIterator const &Pkg,
    return true;
 }
 									/*}}}*/
+// RootSetReason - why a package is in the root set of Mark-and-Sweep	/*{{{*/
+static std::string_view RootSetReason(pkgDepCache &Cache, pkgCache::PkgIterator const &P,
+				      pkgDepCache::InRootSetFunc &userFunc, bool const DebugMarker)
+{
+   if ((Cache[P].Flags & pkgCache::Flag::Auto) == 0)
+      return "Manual-Installed";
+   else if (P->Flags & pkgCache::Flag::Essential)
+      return "Essential";
+   else if (P->Flags & pkgCache::Flag::Important)
+      return "Important";
+   else if (P->CurrentVer != 0 && P.CurrentVer()->Priority == pkgCache::State::Required)
+      return "Required";
+   else if (userFunc.InRootSet(P))
+      return "Blacklisted [APT::NeverAutoRemove]";
+   else if (not IsModeChangeOk(Cache, pkgDepCache::ModeGarbage, P, 0, false, DebugMarker))
+      return "Hold";
+   return {};
+}
+									/*}}}*/
 // pkgDepCache::MarkRequired - the main mark algorithm			/*{{{*/
 bool pkgDepCache::MarkRequired(InRootSetFunc &userFunc)
 {
    if (_config->Find("APT::Solver", "internal") != "internal")
+   {
+      d->MarkVisited.clear();
       return true;
+   }
 
    // init the states
    auto const PackagesCount = Head().PackageCount;
@@ -2481,6 +2860,7 @@ bool pkgDepCache::MarkRequired(InRootSetFunc &userFunc)
       PkgState[i].Garbage = false;
    }
    std::vector<bool> fullyExplored(PackagesCount, false);
+   d->MarkVisited.assign(PackagesCount, false);
 
    bool const debug_autoremove = _config->FindB("Debug::pkgAutoRemove", false);
    if (debug_autoremove)
@@ -2497,31 +2877,30 @@ bool pkgDepCache::MarkRequired(InRootSetFunc &userFunc)
       if (PkgState[P->ID].Marked || IsPkgInBoringState(P, PkgState))
 	 continue;
 
-      std::string_view reason;
-      if ((PkgState[P->ID].Flags & Flag::Auto) == 0)
-	 reason = "Manual-Installed";
-      else if (P->Flags & Flag::Essential)
-	 reason = "Essential";
-      else if (P->Flags & Flag::Important)
-	 reason = "Important";
-      else if (P->CurrentVer != 0 && P.CurrentVer()->Priority == pkgCache::State::Required)
-	 reason = "Required";
-      else if (userFunc.InRootSet(P))
-	 reason = "Blacklisted [APT::NeverAutoRemove]";
-      else if (not IsModeChangeOk(*this, ModeGarbage, P, 0, false, DebugMarker))
-	 reason = "Hold";
-      else
+      std::string_view const reason = RootSetReason(*this, P, userFunc, DebugMarker);
+      if (reason.empty())
 	 continue;
 
       pkgCache::VerIterator const PV = (PkgState[P->ID].Install()) ? PkgState[P->ID].InstVerIter(*this) : P.CurrentVer();
       if (not MarkPackage(P, PV, follow_recommends, follow_suggests, debug_autoremove,
-			  reason, 0, *Cache, *this, PkgState, fullyExplored,
+			  reason, 0, *Cache, *this, PkgState, fullyExplored, d->MarkVisited,
 			  d->IsAVersionedKernelPackage, d->IsProtectedKernelPackage))
 	 return false;
    }
    return true;
 }
 									/*}}}*/
+static bool IsGarbage(pkgCache::PkgIterator const &p, pkgDepCache::StateCache const &state)/*{{{*/
+{
+   // skip required packages
+   if (!p.CurrentVer().end() &&
+       (p.CurrentVer()->Priority == pkgCache::State::Required))
+      return false;
+
+   // if it is not marked and it is installed, it's garbage
+   return !state.Marked && (!p.CurrentVer().end() || state.Install());
+}
+									/*}}}*/
 bool pkgDepCache::Sweep()						/*{{{*/
 {
    bool debug_autoremove = _config->FindB("Debug::pkgAutoRemove",false);
@@ -2530,14 +2909,7 @@ bool pkgDepCache::Sweep()						/*{{{*/
    for(PkgIterator p=PkgBegin(); !p.end(); ++p)
    {
      StateCache &state=PkgState[p->ID];
-
-     // skip required packages
-     if (!p.CurrentVer().end() && 
-	 (p.CurrentVer()->Priority == pkgCache::State::Required))
-	continue;
-
-     // if it is not marked and it is installed, it's garbage 
-     if(!state.Marked && (!p.CurrentVer().end() || state.Install()))
+     if (IsGarbage(p, state))
      {
 	state.Garbage=true;
 	if(debug_autoremove)
@@ -2551,14 +2923,99 @@ bool pkgDepCache::Sweep()						/*{{{*/
 // DepCache::MarkAndSweep						/*{{{*/
 bool pkgDepCache::MarkAndSweep(InRootSetFunc &rootFunc)
 {
+   d->MarksValid = false;
    return MarkRequired(rootFunc) && Sweep();
 }
 bool pkgDepCache::MarkAndSweep()
 {
    InRootSetFunc *f(GetCachedRootSetFunc());
-   if (f != NULL)
-      return MarkAndSweep(*f);
-   else
+   if (f == NULL)
       return false;
+   bool const Verify = _config->FindB("Debug::pkgDepCache::MarkAndSweep", false);
+   std::vector<std::pair<bool, bool>> Reused;
+   if (ReuseMarks(*f))
+   {
+      if (Verify == false)
+	 return true;
+      Reused.reserve(Head().PackageCount);
+      for (auto I = decltype(Head().PackageCount){0}; I < Head().PackageCount; ++I)
+	 Reused.emplace_back(PkgState[I].Marked, PkgState[I].Garbage);
+   }
+   if (MarkAndSweep(*f) == false)
+      return false;
+
+   // remember what the marks depend on so that the next call can reuse them
+   if (d->MarkVisited.empty() == false)
+   {
+      d->MarkInputs.clear();
+      d->MarkInputs.reserve(Head().PackageCount);
+      for (auto I = decltype(Head().PackageCount){0}; I < Head().PackageCount; ++I)
+	 d->MarkInputs.emplace_back(PkgState[I]);
+      d->MarkConfig = MarkConfigOf(*this);
+      d->MarksValid = true;
+   }
+
+   if (Reused.empty() == false)
+   {
+      size_t Mismatches = 0;
+      for (PkgIterator P = PkgBegin(); P.end() == false; ++P)
+      {
+	 auto const &R = Reused[P->ID];
+	 if (R.first == PkgState[P->ID].Marked && R.second == PkgState[P->ID].Garbage)
+	    continue;
+	 ++Mismatches;
+	 std::clog << "MarkAndSweep: reused marks of " << P.FullName() << " differ: Marked " << R.first
+		   << " vs " << PkgState[P->ID].Marked << ", Garbage " << R.second << " vs " << PkgState[P->ID].Garbage << std::endl;
+      }
+      std::clog << "MarkAndSweep: reused marks verified with " << Mismatches << " mismatches" << std::endl;
+   }
+   return true;
+}
+									/*}}}*/
+// DepCache::ReuseMarks - update the marks of changed packages only	/*{{{*/
+/* The marks only depend on the states of the packages MarkRequired looked
+   at while following dependencies and on which packages are in the root
+   set. If the state of none of those changed since the last run and no
+   changed package joined the root set, the marks are still the same and
+   only the Garbage flag of the changed packages has to be updated. */
+bool pkgDepCache::ReuseMarks(InRootSetFunc &rootFunc)
+{
+   if (d->MarksValid == false || _config->FindB("APT::AutoRemove::Incremental", true) == false ||
+       _config->FindB("Debug::pkgAutoRemove", false) == true ||
+       _config->Find("APT::Solver", "internal") != "internal" ||
+       d->MarkConfig != MarkConfigOf(*this))
+      return false;
+
+   auto const PackagesCount = Head().PackageCount;
+   std::vector<bool> Changed(PackagesCount, false);
+   bool AnyChanged = false;
+   for (auto I = decltype(PackagesCount){0}; I < PackagesCount; ++I)
+   {
+      if (MarkInput(PkgState[I]) != d->MarkInputs[I])
+      {
+	 if (d->MarkVisited[I])
+	    return false;
+	 Changed[I] = AnyChanged = true;
+      }
+   }
+   if (AnyChanged == false)
+      return true;
+
+   std::vector<PkgIterator> ChangedPkgs;
+   for (PkgIterator P = PkgBegin(); P.end() == false; ++P)
+   {
+      if (Changed[P->ID] == false)
+	 continue;
+      if (IsPkgInBoringState(P, PkgState) == false && RootSetReason(*this, P, rootFunc, DebugMarker).empty() == false)
+	 return false;
+      ChangedPkgs.push_back(P);
+   }
+   for (auto const &P : ChangedPkgs)
+   {
+      StateCache &State = PkgState[P->ID];
+      State.Garbage = IsGarbage(P, State);
+      d->MarkInputs[P->ID] = MarkInput(State);
+   }
+   return true;
 }
 									/*}}}*/
@@ -261,6 +261,9 @@ class APT_PUBLIC pkgDepCache : protected pkgCache::Namespace
 
       virtual ~Policy() {};
 
+      /** \brief Describes everything #IsImportantDep depends on */
+      APT_HIDDEN std::string Fingerprint() const;
+
       private:
       bool InstallRecommends;
       bool InstallSuggests;
@@ -499,11 +502,22 @@ class APT_PUBLIC pkgDepCache : protected pkgCache::Namespace
    private:
    struct Private;
    Private *const d;
+   struct StateCounters;
 
    APT_HIDDEN bool MarkInstall_StateChange(PkgIterator const &Pkg, bool AutoInst, bool FromUser);
    APT_HIDDEN bool MarkInstall_DiscardInstall(PkgIterator const &Pkg);
+   APT_HIDDEN bool ReuseMarks(InRootSetFunc &rootFunc);
 
    APT_HIDDEN void PerformDependencyPass(OpProgress * const Prog);
+   APT_HIDDEN void PerformDependencyPass(PkgIterator const &Pkg, StateCounters &Counters);
+   APT_HIDDEN void AddSizes(PkgIterator const &Pkg, bool const Invert, StateCounters &Counters);
+   APT_HIDDEN void AddStates(PkgIterator const &Pkg, bool const Invert, StateCounters &Counters) const;
+   APT_HIDDEN void AddCounters(StateCounters const &Counters);
+
+   APT_HIDDEN std::string StateSnapshotFile() const;
+   APT_HIDDEN uint64_t StateSnapshotEnvironment() const;
+   APT_HIDDEN bool LoadStateSnapshot(std::string const &FileName, uint64_t const Environment, OpProgress * const Prog);
+   APT_HIDDEN bool WriteStateSnapshot(std::string const &FileName, uint64_t const Environment) const;
 };
 
 #endif
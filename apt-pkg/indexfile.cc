@@ -252,6 +252,10 @@ IndexTarget pkgDebianIndexTargetFile::GetIndexTarget() const
 {
    return Target;
 }
+std::string pkgDebianIndexTargetFile::GetIndexFileName() const
+{
+   return IndexFileName();
+}
 
 pkgDebianIndexRealFile::pkgDebianIndexRealFile(std::string const &pFile, bool const Trusted) :/*{{{*/
    pkgDebianIndexFile(Trusted), d(NULL)
@@ -339,6 +343,7 @@ bool pkgDebianIndexFile::Merge(pkgCacheGenerator &Gen,OpProgress * const Prog)
    if (Prog != NULL)
       Prog->SubProgress(0, GetProgressDescription());
 
+   Gen.UsePrefetched(PackageFile, *Parser);
    if (Gen.SelectFile(PackageFile, *this, GetArchitecture(), GetComponent(), GetIndexFlags()) == false)
       return _error->Error("Problem with SelectFile %s",PackageFile.c_str());
 
@@ -188,6 +188,7 @@ public:
    virtual bool Exists() const APT_OVERRIDE;
    virtual unsigned long Size() const APT_OVERRIDE;
    IndexTarget GetIndexTarget() const APT_HIDDEN;
+   std::string GetIndexFileName() const APT_HIDDEN;
 
    pkgDebianIndexTargetFile(IndexTarget const &Target, bool const Trusted);
    virtual ~pkgDebianIndexTargetFile();
@@ -143,6 +143,8 @@ bool pkgInitConfig(Configuration &Cnf)
    Cnf.CndSet("Dir::Cache::archives","archives/");
    Cnf.CndSet("Dir::Cache::srcpkgcache","srcpkgcache.bin");
    Cnf.CndSet("Dir::Cache::pkgcache","pkgcache.bin");
+   Cnf.CndSet("Dir::Cache::searchindex","searchindex.bin");
+   Cnf.CndSet("Dir::Cache::depcache","depcache.bin");
 
    // Configuration
    Cnf.CndSet("Dir::Etc", &CONF_DIR[1]);
@@ -72,6 +72,7 @@
 
 #include <algorithm>
 #include <iostream>
+#include <vector>
 #include <stdlib.h>
 #include <string.h>
 									/*}}}*/
@@ -293,6 +294,49 @@ bool pkgOrderList::OrderConfigure()
    return DoRun();
 }
 									/*}}}*/
+// OrderList::Layers - Split an order into independent layers		/*{{{*/
+// ---------------------------------------------------------------------
+/* A package goes into the layer after the last one holding a package it
+   has any dependency relation with, in either direction and including
+   provides, so the packages of a layer could be handled in any order.
+   Returns the layer, starting at 0, of each package of the range. */
+std::vector<unsigned int> pkgOrderList::Layers(iterator const Begin, iterator const End)
+{
+   // layer + 1 of the packages seen so far, 0 for all others
+   std::vector<unsigned int> Seen(Cache.Head().PackageCount, 0);
+   std::vector<unsigned int> Result;
+   Result.reserve(End - Begin);
+   for (iterator I = Begin; I != End; ++I)
+   {
+      PkgIterator const Pkg(Cache, *I);
+      unsigned int Layer = 0;
+      auto const Related = [&](PkgIterator const &Other) {
+	 Layer = std::max(Layer, Seen[Other->ID]);
+      };
+
+      VerIterator const Ver = Cache[Pkg].InstVerIter(Cache);
+      if (Ver.end() == false)
+      {
+	 for (DepIterator D = Ver.DependsList(); D.end() == false; ++D)
+	 {
+	    PkgIterator const Target = D.TargetPkg();
+	    Related(Target);
+	    for (PrvIterator P = Target.ProvidesList(); P.end() == false; ++P)
+	       Related(P.OwnerPkg());
+	 }
+	 for (PrvIterator P = Ver.ProvidesList(); P.end() == false; ++P)
+	    for (DepIterator D = P.ParentPkg().RevDependsList(); D.end() == false; ++D)
+	       Related(D.ParentPkg());
+      }
+      for (DepIterator D = Pkg.RevDependsList(); D.end() == false; ++D)
+	 Related(D.ParentPkg());
+
+      Seen[Pkg->ID] = Layer + 1;
+      Result.push_back(Layer);
+   }
+   return Result;
+}
+									/*}}}*/
 // OrderList::Score - Score the package for sorting			/*{{{*/
 // ---------------------------------------------------------------------
 /* Higher scores order earlier */
@@ -19,6 +19,7 @@
 #include <apt-pkg/pkgcache.h>
 
 #include <string>
+#include <vector>
 
 class pkgDepCache;
 class APT_PUBLIC pkgOrderList : protected pkgCache::Namespace
@@ -117,6 +118,9 @@ class APT_PUBLIC pkgOrderList : protected pkgCache::Namespace
    bool OrderUnpack(std::string *FileList = 0);
    bool OrderConfigure();
 
+   // Layer of each package in an order, packages in the same layer are independent
+   std::vector<unsigned int> Layers(iterator const Begin, iterator const End);
+
    int Score(PkgIterator Pkg);
 
    explicit pkgOrderList(pkgDepCache *Cache);
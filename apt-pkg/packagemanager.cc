@@ -20,6 +20,7 @@
 #include <apt-pkg/depcache.h>
 #include <apt-pkg/edsp.h>
 #include <apt-pkg/error.h>
+#include <apt-pkg/fileutl.h>
 #include <apt-pkg/install-progress.h>
 #include <apt-pkg/macros.h>
 #include <apt-pkg/orderlist.h>
@@ -29,6 +30,7 @@
 #include <apt-pkg/strutl.h>
 #include <apt-pkg/version.h>
 
+#include <functional>
 #include <iostream>
 #include <list>
 #include <string>
@@ -40,11 +42,17 @@ using namespace std;
 
 bool pkgPackageManager::SigINTStop = false;
 
+class pkgPackageManagerPrivate
+{
+public:
+   std::function<bool(std::string &File, bool const Wait)> ArchiveReady;
+};
+
 // PM::PackageManager - Constructor					/*{{{*/
 // ---------------------------------------------------------------------
 /* */
 pkgPackageManager::pkgPackageManager(pkgDepCache *pCache) : Cache(*pCache),
-							    List(NULL), Res(Incomplete), d(NULL)
+							    List(NULL), Res(Incomplete), d(new pkgPackageManagerPrivate())
 {
    FileNames = new string[Cache.Head().PackageCount];
    Debug = _config->FindB("Debug::pkgPackageManager",false);
@@ -59,6 +67,7 @@ pkgPackageManager::~pkgPackageManager()
 {
    delete List;
    delete [] FileNames;
+   delete d;
 }
 									/*}}}*/
 // PM::GetArchives - Queue the archives for download			/*{{{*/
@@ -101,6 +110,30 @@ bool pkgPackageManager::GetArchives(pkgAcquire *Owner,pkgSourceList *Sources,
    return true;
 }
 									/*}}}*/
+// PM::StreamArchives - Install the archives as they are fetched	/*{{{*/
+// ---------------------------------------------------------------------
+/* Archives which are still to be fetched are only known by their name so
+   far, but the ordering and the installer need to know where they will be
+   stored once they are complete. */
+void pkgPackageManager::StreamArchives(std::function<bool(std::string &File, bool const Wait)> Ready)
+{
+   d->ArchiveReady = std::move(Ready);
+   if (d->ArchiveReady == nullptr)
+      return;
+   std::string const Archives = _config->FindDir("Dir::Cache::Archives");
+   for (auto I = 0u; I < Cache.Head().PackageCount; ++I)
+      if (FileNames[I].empty() == false && FileNames[I][0] != '/')
+	 FileNames[I] = Archives + flNotDir(FileNames[I]);
+}
+									/*}}}*/
+// PM::ArchiveReady - Wait for an archive which is fetched		/*{{{*/
+bool pkgPackageManager::ArchiveReady(std::string &File, bool const Wait)
+{
+   if (d->ArchiveReady == nullptr)
+      return true;
+   return d->ArchiveReady(File, Wait);
+}
+									/*}}}*/
 // PM::FixMissing - Keep all missing packages				/*{{{*/
 // ---------------------------------------------------------------------
 /* This is called to correct the installation when packages could not
@@ -27,6 +27,7 @@
 #include <apt-pkg/macros.h>
 #include <apt-pkg/pkgcache.h>
 
+#include <functional>
 #include <set>
 #include <string>
 
@@ -38,6 +39,7 @@ class pkgOrderList;
 class pkgRecords;
 class OpProgress;
 class pkgPackageManager;
+class pkgPackageManagerPrivate;
 namespace APT {
    namespace Progress {
       class PackageManager;
@@ -91,6 +93,13 @@ class APT_PUBLIC pkgPackageManager : protected pkgCache::Namespace
 
    virtual void Reset() {};
 
+   /** \brief waits for an archive if it is still being fetched
+
+       \param[in,out] File the archive is queued as, set to where it can be found
+       \param Wait if \b false the archive is only checked instead of waited for
+       \return \b false if the archive isn't complete (yet) */
+   bool ArchiveReady(std::string &File, bool const Wait);
+
    // the result of the operation
    OrderResult Res;
 
@@ -103,6 +112,19 @@ class APT_PUBLIC pkgPackageManager : protected pkgCache::Namespace
    // Do the installation
    OrderResult DoInstall(APT::Progress::PackageManager *progress);
 
+   /** \brief install the archives while they are still being fetched
+
+       Normally all archives queued by #GetArchives have to be complete
+       before the installation starts. With \b Ready set the archives only
+       need to be queued, the installation calls \b Ready for each archive
+       right before it is needed and continues once it returns \b true.
+       It has to be called after #GetArchives and before #DoInstall.
+
+       \param Ready implements #ArchiveReady, it is called from several
+       threads and while the order is computed the archives have to stay
+       where they are queued */
+   void StreamArchives(std::function<bool(std::string &File, bool const Wait)> Ready);
+
    friend bool EIPP::OrderInstall(char const * const planner, pkgPackageManager * const PM,
 	 unsigned int const version, OpProgress * const Progress);
    friend bool EIPP::ReadResponse(int const input, pkgPackageManager * const PM,
@@ -128,7 +150,7 @@ class APT_PUBLIC pkgPackageManager : protected pkgCache::Namespace
    virtual ~pkgPackageManager();
 
    private:
-   void * const d;
+   pkgPackageManagerPrivate * const d;
    enum APT_HIDDEN SmartAction { UNPACK_IMMEDIATE, UNPACK, CONFIGURE };
    APT_HIDDEN bool NonLoopingSmart(SmartAction const action, pkgCache::PkgIterator &Pkg,
       pkgCache::PkgIterator DepPkg, int const Depth, bool const PkgLoop,
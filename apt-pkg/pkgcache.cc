@@ -23,6 +23,7 @@
 
 #include <apt-pkg/aptconfiguration.h>
 #include <apt-pkg/configuration.h>
+#include <apt-pkg/debversion.h>
 #include <apt-pkg/error.h>
 #include <apt-pkg/macros.h>
 #include <apt-pkg/mmap.h>
@@ -57,7 +58,7 @@ pkgCache::Header::Header()
 
    /* Whenever the structures change the major version should be bumped,
       whenever the generator changes the minor version should be bumped. */
-   APT_HEADER_SET(MajorVersion, 16);
+   APT_HEADER_SET(MajorVersion, 17);
    APT_HEADER_SET(MinorVersion, 0);
    APT_HEADER_SET(Dirty, false);
 
@@ -98,6 +99,7 @@ pkgCache::Header::Header()
    memset(Pools,0,sizeof(Pools));
 
    CacheFileSize = 0;
+   std::fill(std::begin(StringTables), std::end(StringTables), StringTable{});
 }
 									/*}}}*/
 // Cache::Header::CheckSizes - Check if the two headers have same *sz	/*{{{*/
@@ -202,6 +204,54 @@ bool pkgCache::ReMap(bool const &Errorchecks)
    return true;
 }
 									/*}}}*/
+// Cache::VersionSortKey - Sort key stored behind a version string	/*{{{*/
+// ---------------------------------------------------------------------
+/* The generator stores the debVersioningSystem::SortKey behind each
+   version string, separated by the \0 ending the string. */
+char const *pkgCache::VersionSortKey(map_stringitem_t const idx) const
+{
+   if (VS != &debVS || idx == 0)
+      return nullptr;
+   auto const Ver = ViewString(idx);
+   return Ver.data() + Ver.length() + 1;
+}
+									/*}}}*/
+// Cache::CmpVersion - Compare two version strings of the cache		/*{{{*/
+int pkgCache::CmpVersion(map_stringitem_t const A, map_stringitem_t const B) const
+{
+   if (A == B)
+      return 0;
+   char const * const KeyA = VersionSortKey(A);
+   char const * const KeyB = VersionSortKey(B);
+   if (KeyA != nullptr && KeyB != nullptr)
+      return strcmp(KeyA, KeyB);
+   return VS->CmpVersion(StrP + A, StrP + B);
+}
+									/*}}}*/
+// Cache::CheckDep - Check a dependency on versions of the cache		/*{{{*/
+bool pkgCache::CheckDep(map_stringitem_t const PkgVer, int const Op, map_stringitem_t const DepVer) const
+{
+   if (VS != &debVS)
+      return VS->CheckDep(PkgVer == 0 ? nullptr : StrP + PkgVer, Op, DepVer == 0 ? nullptr : StrP + DepVer);
+
+   if (DepVer == 0 || *(StrP + DepVer) == '\0')
+      return true;
+   if (PkgVer == 0 || *(StrP + PkgVer) == '\0')
+      return false;
+
+   int const Res = CmpVersion(PkgVer, DepVer);
+   switch (Op & 0x0F)
+   {
+      case Dep::LessEq: return Res <= 0;
+      case Dep::GreaterEq: return Res >= 0;
+      case Dep::Less: return Res < 0;
+      case Dep::Greater: return Res > 0;
+      case Dep::Equals: return Res == 0;
+      case Dep::NotEquals: return Res != 0;
+   }
+   return false;
+}
+									/*}}}*/
 // Cache::Hash - Hash a string						/*{{{*/
 // ---------------------------------------------------------------------
 /* This is used to generate the hash entries for the HashTable. With my
@@ -751,11 +801,11 @@ bool pkgCache::DepIterator::IsIgnorable(PrvIterator const &Prv) const
 // DepIterator::IsSatisfied - check if a version satisfied the dependency /*{{{*/
 bool pkgCache::DepIterator::IsSatisfied(VerIterator const &Ver) const
 {
-   return Owner->VS->CheckDep(Ver.VerStr(),S2->CompareOp,TargetVer());
+   return Owner->CheckDep(Ver->VerStr, S2->CompareOp, S2->Version);
 }
 bool pkgCache::DepIterator::IsSatisfied(PrvIterator const &Prv) const
 {
-   return Owner->VS->CheckDep(Prv.ProvideVersion(),S2->CompareOp,TargetVer());
+   return Owner->CheckDep(Prv->ProvideVersion, S2->CompareOp, S2->Version);
 }
 									/*}}}*/
 // DepIterator::IsImplicit - added by the cache generation		/*{{{*/
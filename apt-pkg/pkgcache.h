@@ -257,6 +257,15 @@ class APT_PUBLIC pkgCache								/*{{{*/
       uint16_t len = *reinterpret_cast<const uint16_t*>(name - sizeof(uint16_t));
       return APT::StringView(name, len);
    }
+   /** \brief compare two version strings stored in the cache
+
+       If the versioning system provides sort keys they are stored behind
+       the version strings, so the comparison is a single strcmp. */
+   APT_HIDDEN int CmpVersion(map_stringitem_t A, map_stringitem_t B) const;
+   /** \brief like pkgVersioningSystem::CheckDep for versions stored in the cache */
+   APT_HIDDEN bool CheckDep(map_stringitem_t PkgVer, int Op, map_stringitem_t DepVer) const;
+   /** \return sort key of a version string or \b nullptr if there is none */
+   APT_HIDDEN char const *VersionSortKey(map_stringitem_t idx) const;
 
    Header &Head() {return *HeaderP;}
    inline GrpIterator GrpBegin();
@@ -396,6 +405,31 @@ struct pkgCache::Header
    /** \brief Hash of the file (TODO: Rename) */
    map_filesize_small_t CacheFileSize;
 
+   /** \brief tables deduplicating the strings stored by the generator
+
+       There is one open addressing table for each pkgCacheGenerator::StringType.
+       They are part of the cache, so that a cache loaded back from disk to add
+       more files to it deduplicates against the strings it already contains. */
+   struct StringTable
+   {
+      struct Slot
+      {
+	 uint32_t Hash;
+	 map_stringitem_t String;
+      };
+      /** \brief Slots of the table, a free one has no String */
+      map_pointer<Slot> Slots;
+      /** \brief Number of slots, always a power of two */
+      map_id_t Size;
+      /** \brief Number of strings in the table */
+      map_id_t Used;
+      /** \brief How often a string was stored and how often it was found in the table */
+      map_id_t Lookups;
+      map_id_t Hits;
+      /** \brief Bytes which were not written again thanks to the hits */
+      map_filesize_t BytesSaved;
+   } StringTables[3];
+
    bool CheckSizes(Header &Against) const APT_PURE;
    Header();
 };
@@ -11,7 +11,9 @@
 // Include Files							/*{{{*/
 #include <config.h>
 
+#include <apt-pkg/aptconfiguration.h>
 #include <apt-pkg/configuration.h>
+#include <apt-pkg/debversion.h>
 #include <apt-pkg/error.h>
 #include <apt-pkg/fileutl.h>
 #include <apt-pkg/indexfile.h>
@@ -26,14 +28,20 @@
 #include <apt-pkg/version.h>
 
 #include <algorithm>
+#include <condition_variable>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_set>
 #include <vector>
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <xxhash.h>
 
 #include <apti18n.h>
 									/*}}}*/
@@ -67,7 +75,7 @@ static inline uint32_t NarrowOffset(T ptr)
 /* We set the dirty flag and make sure that is written to the disk */
 pkgCacheGenerator::pkgCacheGenerator(DynamicMMap *pMap,OpProgress *Prog) :
 		    Map(*pMap), Cache(pMap,false), Progress(Prog),
-		     CurrentRlsFile(nullptr), CurrentFile(nullptr), d(nullptr)
+		     CurrentRlsFile(nullptr), CurrentFile(nullptr), d(nullptr), Prefetcher(nullptr), NewVersions(false)
 {
 }
 bool pkgCacheGenerator::Start()
@@ -223,6 +231,21 @@ map_stringitem_t pkgCacheGenerator::WriteStringInMap(const char *String) {
    return index;
 }
 									/*}}}*/
+// CacheGenerator::WriteVersionInMap					/*{{{*/
+/* The sort key is stored behind the \0 ending the version string, so
+   that pkgCache::CmpVersion can compare versions without parsing them. */
+map_stringitem_t pkgCacheGenerator::WriteVersionInMap(const char *String,
+					unsigned long const Len) {
+   std::string Both(String, Len);
+   Both.push_back('\0');
+   Both.append(debVersioningSystem::SortKey(String, String + Len));
+   map_stringitem_t const index = WriteStringInMap(Both.data(), Both.length());
+   // the length in front of the string only covers the version itself
+   if (index != 0)
+      *reinterpret_cast<uint16_t *>(static_cast<char *>(Map.Data()) + index - sizeof(uint16_t)) = Len;
+   return index;
+}
+									/*}}}*/
 uint32_t pkgCacheGenerator::AllocateInMap(const unsigned long &size) {/*{{{*/
    size_t oldSize = Map.Size();
    void const * const oldMap = Map.Data();
@@ -348,6 +371,17 @@ bool pkgCacheGenerator::MergeListPackage(ListParser &List, pkgCache::PkgIterator
       if (VerDesc.end() == true || Cache.ViewString(VerDesc->md5sum) != CurMd5)
 	 continue;
 
+      if (RemovedFiles.empty() == false)
+      {
+	 // a complete rebuild wouldn't have seen versions of later files yet
+	 if (CurrentFile != nullptr && Ver.FileList().end() == false &&
+	       Ver.FileList().File()->ID > CurrentFile->ID)
+	    continue;
+	 if (ReuseRemovedDescriptions(List, Ver, CurMd5, availDesc) == false)
+	    return false;
+	 VerDesc = Ver.DescriptionList();
+      }
+
       map_stringitem_t md5idx = VerDesc->md5sum;
       for (std::vector<std::string>::const_iterator CurLang = availDesc.begin(); CurLang != availDesc.end(); ++CurLang)
       {
@@ -381,11 +415,19 @@ bool pkgCacheGenerator::MergeListVersion(ListParser &List, pkgCache::PkgIterator
       /* We know the list is sorted so we use that fact in the search.
          Insertion of new versions is done with correct sorting */
       int Res = 1;
+      std::string VersionKey;
+      if (Cache.VS == &debVS)
+	 VersionKey = debVersioningSystem::SortKey(Version.data(), Version.data() + Version.length());
       for (; Ver.end() == false; LastVer = &Ver->NextVer, ++Ver)
       {
-	 char const * const VerStr = Ver.VerStr();
-	 Res = Cache.VS->DoCmpVersion(Version.data(), Version.data() + Version.length(),
-	       VerStr, VerStr + strlen(VerStr));
+	 if (VersionKey.empty() == false)
+	    Res = strcmp(VersionKey.c_str(), Cache.VersionSortKey(Ver->VerStr));
+	 else
+	 {
+	    char const * const VerStr = Ver.VerStr();
+	    Res = Cache.VS->DoCmpVersion(Version.data(), Version.data() + Version.length(),
+		  VerStr, VerStr + strlen(VerStr));
+	 }
 	 // Version is higher as current version - insert here
 	 if (Res > 0)
 	    break;
@@ -394,6 +436,10 @@ bool pkgCacheGenerator::MergeListVersion(ListParser &List, pkgCache::PkgIterator
 	 {
 	    if (List.SameVersion(Hash, Ver) == true)
 	       break;
+	    // merging a removed file again: sort in as a complete rebuild would
+	    if (RemovedFiles.empty() == false && CurrentFile != nullptr &&
+		  Ver.FileList().end() == false && Ver.FileList().File()->ID > CurrentFile->ID)
+	       break;
 	    // sort (volatile) sources above not-sources like the status file
 	    if (CurrentFile == nullptr || (CurrentFile->Flags & pkgCache::Flag::NotSource) == 0)
 	    {
@@ -420,6 +466,11 @@ bool pkgCacheGenerator::MergeListVersion(ListParser &List, pkgCache::PkgIterator
 	    return _error->Error(_("Error occurred while processing %s (%s%d)"),
 				 Pkg.Name(), "NewFileVer", 1);
 
+	 if (RemovedFiles.empty() == false &&
+	       ReuseRemovedDescriptions(List, Ver, List.Description_md5(), List.AvailableDescriptionLanguages()) == false)
+	    return _error->Error(_("Error occurred while processing %s (%s%d)"),
+				 Pkg.Name(), "ReuseRemovedDescriptions", 1);
+
 	 // Read only a single record and return
 	 if (OutVer != 0)
 	 {
@@ -436,6 +487,7 @@ bool pkgCacheGenerator::MergeListVersion(ListParser &List, pkgCache::PkgIterator
    if (unlikely(verindex == 0))
       return _error->Error(_("Error occurred while processing %s (%s%d)"),
 			   Pkg.Name(), "NewVersion", 1);
+   NewVersions = true;
 
    if (oldMap != Map.Data())
 	 LastVer = static_cast<map_pointer<pkgCache::Version> *>(Map.Data()) + (LastVer - static_cast<map_pointer<pkgCache::Version> const *>(oldMap));
@@ -540,6 +592,30 @@ bool pkgCacheGenerator::AddNewDescription(ListParser &List, pkgCache::VerIterato
    return true;
 }
 									/*}}}*/
+// CacheGenerator::ReuseRemovedDescriptions				/*{{{*/
+// ---------------------------------------------------------------------
+/* RemoveFiles leaves the descriptions of a removed file behind without
+   any file, so a version seen again in that file picks them up again */
+bool pkgCacheGenerator::ReuseRemovedDescriptions(ListParser &List, pkgCache::VerIterator &Ver,
+      APT::StringView CurMd5, std::vector<std::string> const &Langs)
+{
+   pkgCache::DescIterator Desc = Ver.DescriptionList();
+   if (Desc.end() == true || Cache.ViewString(Desc->md5sum) != CurMd5)
+      return true;
+   Dynamic<pkgCache::DescIterator> DynDesc(Desc);
+   for (auto const &Lang : Langs)
+   {
+      for (Desc = Ver.DescriptionList(); Desc.end() == false; ++Desc)
+	 if (Desc.LanguageCode() == Lang)
+	    break;
+      if (Desc.end() == true || Desc->FileList != 0)
+	 continue;
+      if (NewFileDesc(Desc, List) == false)
+	 return _error->Error(_("Error occurred while processing %s (%s%d)"),
+	       Ver.ParentPkg().Name(), "NewFileDesc", 2);
+   }
+   return true;
+}
 									/*}}}*/
 // CacheGenerator::NewGroup - Add a new group				/*{{{*/
 // ---------------------------------------------------------------------
@@ -826,9 +902,9 @@ bool pkgCacheGenerator::NewFileVer(pkgCache::VerIterator &Ver,
    pkgCache::VerFileIterator VF(Cache,Cache.VerFileP + VerFile);
    VF->File = map_pointer<pkgCache::PackageFile>{NarrowOffset(CurrentFile - Cache.PkgFileP)};
    
-   // Link it to the end of the list
+   // Link it behind the files merged before this one
    map_pointer<pkgCache::VerFile> *Last = &Ver->FileList;
-   for (pkgCache::VerFileIterator V = Ver.FileList(); V.end() == false; ++V)
+   for (pkgCache::VerFileIterator V = Ver.FileList(); V.end() == false && V.File()->ID < CurrentFile->ID; ++V)
       Last = &V->NextFile;
    VF->NextFile = *Last;
    *Last = VF.MapPointer();
@@ -916,9 +992,9 @@ bool pkgCacheGenerator::NewFileDesc(pkgCache::DescIterator &Desc,
    pkgCache::DescFileIterator DF(Cache,Cache.DescFileP + DescFile);
    DF->File = map_pointer<pkgCache::PackageFile>{NarrowOffset(CurrentFile - Cache.PkgFileP)};
 
-   // Link it to the end of the list
+   // Link it behind the files merged before this one
    map_pointer<pkgCache::DescFile> *Last = &Desc->FileList;
-   for (pkgCache::DescFileIterator D = Desc.FileList(); D.end() == false; ++D)
+   for (pkgCache::DescFileIterator D = Desc.FileList(); D.end() == false && D.File()->ID < CurrentFile->ID; ++D)
       Last = &D->NextFile;
 
    DF->NextFile = *Last;
@@ -1252,6 +1328,30 @@ bool pkgCacheGenerator::SelectReleaseFile(const string &File,const string &Site,
    if (File.empty() && Site.empty())
       return true;
 
+   // a file merged again reuses its old structure
+   if (RemovedFiles.empty() == false)
+   {
+      for (pkgCache::RlsFileIterator R = Cache.RlsFileBegin(); R.end() == false; ++R)
+      {
+	 if (R->FileName == 0 || File != R.FileName())
+	    continue;
+	 map_pointer<pkgCache::ReleaseFile> const idxFile = R.MapPointer();
+	 map_stringitem_t const idxSite = StoreString(MIXED, Site);
+	 if (unlikely(idxSite == 0))
+	    return false;
+	 CurrentRlsFile = Cache.RlsFileP + idxFile;
+	 CurrentRlsFile->Site = idxSite;
+	 CurrentRlsFile->Archive = CurrentRlsFile->Codename = 0;
+	 CurrentRlsFile->Version = CurrentRlsFile->Origin = CurrentRlsFile->Label = 0;
+	 CurrentRlsFile->Size = 0;
+	 CurrentRlsFile->mtime = 0;
+	 CurrentRlsFile->Flags = Flags;
+	 RlsFileName = File;
+	 return true;
+      }
+      return _error->Error("Release file %s isn't in the cache", File.c_str());
+   }
+
    // Get some space for the structure
    auto const idxFile = AllocateInMap<pkgCache::ReleaseFile>();
    if (unlikely(idxFile == 0))
@@ -1286,19 +1386,35 @@ bool pkgCacheGenerator::SelectFile(std::string const &File,
 				   unsigned long const Flags)
 {
    CurrentFile = nullptr;
-   // Get some space for the structure
-   auto const idxFile = AllocateInMap<pkgCache::PackageFile>();
-   if (unlikely(idxFile == 0))
-      return false;
-   CurrentFile = Cache.PkgFileP + idxFile;
+   bool const reuse = RemovedFiles.empty() == false;
+   if (reuse)
+   {
+      // a file merged again reuses its old structure
+      for (pkgCache::PkgFileIterator F = Cache.FileBegin(); F.end() == false; ++F)
+	 if (F->FileName != 0 && File == F.FileName())
+	 {
+	    CurrentFile = Cache.PkgFileP + F.MapPointer();
+	    break;
+	 }
+      if (CurrentFile == nullptr)
+	 return _error->Error("Package file %s isn't in the cache", File.c_str());
+   }
+   else
+   {
+      // Get some space for the structure
+      auto const idxFile = AllocateInMap<pkgCache::PackageFile>();
+      if (unlikely(idxFile == 0))
+	 return false;
+      CurrentFile = Cache.PkgFileP + idxFile;
 
-   // Fill it in
-   map_stringitem_t const idxFileName = WriteStringInMap(File);
-   if (unlikely(idxFileName == 0))
-      return false;
-   CurrentFile->FileName = idxFileName;
-   CurrentFile->NextFile = Cache.HeaderP->FileList;
-   CurrentFile->ID = Cache.HeaderP->PackageFileCount;
+      // Fill it in
+      map_stringitem_t const idxFileName = WriteStringInMap(File);
+      if (unlikely(idxFileName == 0))
+	 return false;
+      CurrentFile->FileName = idxFileName;
+      CurrentFile->NextFile = Cache.HeaderP->FileList;
+      CurrentFile->ID = Cache.HeaderP->PackageFileCount;
+   }
    map_stringitem_t const idxIndexType = StoreString(MIXED, Index.GetType()->Label);
    if (unlikely(idxIndexType == 0))
       return false;
@@ -1317,13 +1433,16 @@ bool pkgCacheGenerator::SelectFile(std::string const &File,
       return false;
    CurrentFile->Component = component;
    CurrentFile->Flags = Flags;
-   if (CurrentRlsFile != nullptr)
-      CurrentFile->Release = map_pointer<pkgCache::ReleaseFile>{NarrowOffset(CurrentRlsFile - Cache.RlsFileP)};
-   else
-      CurrentFile->Release = 0;
    PkgFileName = File;
-   Cache.HeaderP->FileList = map_pointer<pkgCache::PackageFile>{NarrowOffset(CurrentFile - Cache.PkgFileP)};
-   Cache.HeaderP->PackageFileCount++;
+   if (reuse == false)
+   {
+      if (CurrentRlsFile != nullptr)
+	 CurrentFile->Release = map_pointer<pkgCache::ReleaseFile>{NarrowOffset(CurrentRlsFile - Cache.RlsFileP)};
+      else
+	 CurrentFile->Release = 0;
+      Cache.HeaderP->FileList = map_pointer<pkgCache::PackageFile>{NarrowOffset(CurrentFile - Cache.PkgFileP)};
+      Cache.HeaderP->PackageFileCount++;
+   }
 
    if (Progress != 0)
       Progress->SubProgress(Index.Size());
@@ -1333,27 +1452,523 @@ bool pkgCacheGenerator::SelectFile(std::string const &File,
 // CacheGenerator::WriteUniqueString - Insert a unique string		/*{{{*/
 // ---------------------------------------------------------------------
 /* This is used to create handles to strings. Given the same text it
-   always returns the same number */
+   always returns the same number. The strings are found via open
+   addressing tables in the map, so a cache loaded back from disk
+   deduplicates against the strings it already contains. */
 map_stringitem_t pkgCacheGenerator::StoreString(enum StringType const type, const char *S,
 						 unsigned int Size)
 {
-   auto strings = &strMixed;
    switch(type) {
-      case MIXED: strings = &strMixed; break;
-      case VERSIONNUMBER: strings = &strVersions; break;
-      case SECTION: strings = &strSections; break;
+      case MIXED: case VERSIONNUMBER: case SECTION: break;
       default: _error->Fatal("Unknown enum type used for string storage of '%.*s'", Size, S); return 0;
    }
 
-   auto const item = strings->find({S, Size, nullptr, 0});
-   if (item != strings->end())
-      return item->item;
+   // keep the table at most half full, so that probe sequences stay short
+   if (Cache.HeaderP->StringTables[type].Used * 2 >= Cache.HeaderP->StringTables[type].Size &&
+       GrowStringTable(type) == false)
+      return 0;
 
-   map_stringitem_t const idxString = WriteStringInMap(S,Size);
-   strings->insert({nullptr, Size, this, idxString});
+   auto Table = &Cache.HeaderP->StringTables[type];
+   ++Table->Lookups;
+   uint32_t const Hash = XXH3_64bits(S, Size) & 0xFFFFFFFF;
+   uint32_t const Mask = Table->Size - 1;
+   uint32_t Slot = Hash & Mask;
+   for (auto Slots = static_cast<pkgCache::Header::StringTable::Slot *>(Map.Data()) + Table->Slots;
+	Slots[Slot].String != 0; Slot = (Slot + 1) & Mask)
+   {
+      if (Slots[Slot].Hash != Hash)
+	 continue;
+      auto const Str = Cache.ViewString(Slots[Slot].String);
+      if (Str.length() != Size || memcmp(Str.data(), S, Size) != 0)
+	 continue;
+      ++Table->Hits;
+      Table->BytesSaved += sizeof(uint16_t) + Size + 1;
+      if (type == VERSIONNUMBER)
+	 if (char const * const Key = Cache.VersionSortKey(Slots[Slot].String); Key != nullptr)
+	    Table->BytesSaved += strlen(Key) + 1;
+      return Slots[Slot].String;
+   }
+
+   map_stringitem_t const idxString = (type == VERSIONNUMBER && Cache.VS == &debVS) ?
+      WriteVersionInMap(S, Size) : WriteStringInMap(S, Size);
+   if (unlikely(idxString == 0))
+      return 0;
+   // writing the string might have moved the map
+   Table = &Cache.HeaderP->StringTables[type];
+   auto const Slots = static_cast<pkgCache::Header::StringTable::Slot *>(Map.Data()) + Table->Slots;
+   Slots[Slot].Hash = Hash;
+   Slots[Slot].String = idxString;
+   ++Table->Used;
    return idxString;
 }
 									/*}}}*/
+// CacheGenerator::GrowStringTable - Double the slots of a string table	/*{{{*/
+// ---------------------------------------------------------------------
+/* The old slots stay behind in the map as unused space. */
+bool pkgCacheGenerator::GrowStringTable(StringType const type)
+{
+   static map_id_t const InitialSize[] = { 1024, 4096, 256 };
+   map_id_t const OldSize = Cache.HeaderP->StringTables[type].Size;
+   map_id_t const Size = OldSize == 0 ? InitialSize[type] : OldSize * 2;
+   if (unlikely(Size < OldSize))
+      return _error->Error("String table of type %d is full", type);
+
+   using Slot = pkgCache::Header::StringTable::Slot;
+   size_t const oldSize = Map.Size();
+   void const * const oldMap = Map.Data();
+   _error->PushToStack();
+   // aligned to the slot size, so the table can be addressed in slots
+   uint32_t const idxSlots = NarrowOffset(Map.RawAllocate(Size * sizeof(Slot), sizeof(Slot)) / sizeof(Slot));
+   bool const newError = _error->PendingError();
+   _error->MergeWithStack();
+   if (idxSlots == 0 || newError)
+      return false;
+   ReMap(oldMap, Map.Data(), oldSize);
+
+   auto &Table = Cache.HeaderP->StringTables[type];
+   Slot * const Slots = static_cast<Slot *>(Map.Data()) + idxSlots;
+   std::fill_n(Slots, Size, Slot{});
+   if (OldSize != 0)
+   {
+      Slot const * const OldSlots = static_cast<Slot *>(Map.Data()) + Table.Slots;
+      for (Slot const *Old = OldSlots; Old != OldSlots + OldSize; ++Old)
+      {
+	 if (Old->String == 0)
+	    continue;
+	 uint32_t S = Old->Hash & (Size - 1);
+	 while (Slots[S].String != 0)
+	    S = (S + 1) & (Size - 1);
+	 Slots[S] = *Old;
+      }
+   }
+   Table.Slots = map_pointer<Slot>{idxSlots};
+   Table.Size = Size;
+   return true;
+}
+									/*}}}*/
+// CacheGenerator::IndexPrefetcher - Read index files ahead		/*{{{*/
+// ---------------------------------------------------------------------
+/* Reading (and decompressing) an index file doesn't depend on the cache,
+   so worker threads read the files which are merged next completely into
+   memory while the generator is still busy merging the previous ones.
+   The merge itself stays serial as it modifies the map. To limit the
+   memory usage only a few files are read ahead of the current one. */
+class APT_HIDDEN pkgCacheGenerator::IndexPrefetcher
+{
+   struct File
+   {
+      std::string const Name;
+      char *Buffer;
+      unsigned long long Size;
+      bool Done;
+      bool Failed;
+
+      explicit File(std::string const &Name) : Name(Name), Buffer(nullptr), Size(0), Done(false), Failed(false) {}
+      File(File const &) = delete;
+      void operator=(File const &) = delete;
+      ~File() { free(Buffer); }
+   };
+
+   pkgCacheGenerator &Gen;
+   std::vector<std::unique_ptr<File>> Files;
+   std::vector<std::thread> Workers;
+   std::mutex Lock;
+   std::condition_variable Changed;
+   size_t NextToRead;
+   size_t NextToMerge;
+   size_t const Window;
+   bool Stopping;
+
+   static bool Read(File &F)
+   {
+      FileFd Fd;
+      if (Fd.Open(F.Name, FileFd::ReadOnly, FileFd::Extension) == false)
+	 return false;
+      // the file size is only a hint for compressed files
+      unsigned long long Allocated = std::max<unsigned long long>(Fd.FileSize(), 32 * 1024) + 4;
+      F.Buffer = static_cast<char *>(malloc(Allocated));
+      if (F.Buffer == nullptr)
+	 return false;
+      while (true)
+      {
+	 // keep two bytes around for the newlines appended below
+	 if (Allocated - F.Size <= 2)
+	 {
+	    char * const newBuffer = static_cast<char *>(realloc(F.Buffer, Allocated * 2));
+	    if (newBuffer == nullptr)
+	       return false;
+	    F.Buffer = newBuffer;
+	    Allocated *= 2;
+	 }
+	 unsigned long long Actual = 0;
+	 if (Fd.Read(F.Buffer + F.Size, Allocated - F.Size - 2, &Actual) == false)
+	    return false;
+	 if (Actual == 0)
+	    break;
+	 F.Size += Actual;
+      }
+      if (F.Size == 0)
+	 return true;
+      // pkgTagFile expects the last stanza to be terminated by an empty line
+      unsigned int LineCount = 0;
+      for (char const *E = F.Buffer + F.Size - 1; E >= F.Buffer && (*E == '\n' || *E == '\r'); --E)
+	 if (*E == '\n')
+	    ++LineCount;
+      for (; LineCount < 2; ++LineCount)
+	 F.Buffer[F.Size++] = '\n';
+      return true;
+   }
+
+   void Worker()
+   {
+      std::unique_lock<std::mutex> Guard(Lock);
+      while (true)
+      {
+	 Changed.wait(Guard, [&]() {
+	    return Stopping || NextToRead >= Files.size() || NextToRead < NextToMerge + Window;
+	 });
+	 if (Stopping || NextToRead >= Files.size())
+	    return;
+	 File &F = *Files[NextToRead++];
+	 Guard.unlock();
+	 bool const okay = Read(F);
+	 // errors are reported again by the merge reading the file itself
+	 _error->Discard();
+	 Guard.lock();
+	 F.Done = true;
+	 F.Failed = (okay == false);
+	 Changed.notify_all();
+      }
+   }
+
+   public:
+   /** \brief the prefetched file if it is next to be merged
+    *
+    * Files before the returned one are skipped (e.g. as they are duplicates)
+    * and the file returned previously is considered merged, so their memory
+    * is freed and the workers are allowed to read further ahead.
+    */
+   File *Take(std::string const &Name)
+   {
+      std::unique_lock<std::mutex> Guard(Lock);
+      auto const F = std::find_if(Files.begin() + NextToMerge, Files.end(),
+				  [&](std::unique_ptr<File> const &P) { return P->Name == Name; });
+      if (F == Files.end())
+	 return nullptr;
+      for (auto I = Files.begin() + NextToMerge; I != F; ++I)
+	 if ((*I)->Done)
+	 {
+	    free((*I)->Buffer);
+	    (*I)->Buffer = nullptr;
+	 }
+      NextToMerge = F - Files.begin();
+      Changed.notify_all();
+      Changed.wait(Guard, [&]() { return (*F)->Done; });
+      if ((*F)->Failed)
+	 return nullptr;
+      return F->get();
+   }
+
+   IndexPrefetcher(pkgCacheGenerator &Gen, std::vector<std::string> const &Names, unsigned int const Threads) :
+      Gen(Gen), NextToRead(0), NextToMerge(0), Window(2 * Threads), Stopping(false)
+   {
+      for (auto const &Name : Names)
+	 Files.emplace_back(new File(Name));
+      // ensure the compressor list is cached before the workers need it
+      APT::Configuration::getCompressors();
+      for (unsigned int i = 0; i < Threads && i < Files.size(); ++i)
+	 Workers.emplace_back(&IndexPrefetcher::Worker, this);
+      Gen.Prefetcher = this;
+   }
+   ~IndexPrefetcher()
+   {
+      Gen.Prefetcher = nullptr;
+      {
+	 std::lock_guard<std::mutex> Guard(Lock);
+	 Stopping = true;
+      }
+      Changed.notify_all();
+      for (auto &W : Workers)
+	 W.join();
+   }
+};
+bool pkgCacheGenerator::UsePrefetched(std::string const &File, ListParser &List)
+{
+   if (Prefetcher == nullptr)
+      return false;
+   auto const F = Prefetcher->Take(File);
+   if (F == nullptr)
+      return false;
+   if (_config->FindB("Debug::pkgCacheGen", false))
+      std::clog << "Use prefetched content of " << File << std::endl;
+   return List.UseBuffer(F->Buffer, F->Size);
+}
+									/*}}}*/
+// CacheGenerator::RemoveFiles - Unlink all a file added to the cache	/*{{{*/
+// ---------------------------------------------------------------------
+/* Versions only coming from the removed files are unlinked from their
+   packages together with their dependencies and provides, the removed
+   files are dropped from the file lists of all other versions and
+   descriptions. The structures itself stay in the map as garbage, which
+   is why we refuse if this would leave more garbage than data behind. */
+bool pkgCacheGenerator::RemoveFiles(std::vector<map_fileid_t> const &Files)
+{
+   RemovedFiles.assign(Cache.HeaderP->PackageFileCount, false);
+   for (auto const F : Files)
+      RemovedFiles[F] = true;
+   auto const isRemoved = [&](map_pointer<pkgCache::PackageFile> const File) {
+      return RemovedFiles[(Cache.PkgFileP + File)->ID] == true;
+   };
+
+   map_fileid_t Live = 0;
+   map_fileid_t Removed = 0;
+   for (pkgCache::PkgIterator P = Cache.PkgBegin(); P.end() == false; ++P)
+      for (pkgCache::VerIterator V = P.VersionList(); V.end() == false; ++V)
+	 for (pkgCache::VerFileIterator VF = V.FileList(); VF.end() == false; ++VF)
+	    if (isRemoved(VF->File))
+	       ++Removed;
+	    else
+	       ++Live;
+   map_fileid_t const Garbage = Cache.HeaderP->VerFileCount - Live;
+   if (Removed > Live || Garbage > Live + Removed)
+   {
+      if (_config->FindB("Debug::pkgCacheGen", false))
+	 std::clog << "Removing " << Removed << " of " << (Live + Removed) << " version files would leave "
+	    << Garbage << " unused ones behind" << std::endl;
+      RemovedFiles.clear();
+      return false;
+   }
+   NewVersions = false;
+
+   // unlink the versions only the removed files have
+   std::vector<bool> RemovedVer(Cache.HeaderP->VersionCount, false);
+   std::vector<bool> EmptiedPkg(Cache.HeaderP->PackageCount, false);
+   std::vector<bool> ChangedPkg(Cache.HeaderP->PackageCount, false);
+   for (pkgCache::PkgIterator P = Cache.PkgBegin(); P.end() == false; ++P)
+   {
+      if (P->VersionList == 0)
+	 continue;
+      map_pointer<pkgCache::Version> *LastVer = &P->VersionList;
+      while (*LastVer != 0)
+      {
+	 pkgCache::Version * const V = Cache.VerP + *LastVer;
+	 map_pointer<pkgCache::VerFile> *LastVF = &V->FileList;
+	 while (*LastVF != 0)
+	 {
+	    pkgCache::VerFile * const VF = Cache.VerFileP + *LastVF;
+	    if (isRemoved(VF->File))
+	       *LastVF = VF->NextFile;
+	    else
+	       LastVF = &VF->NextFile;
+	 }
+	 if (V->FileList == 0)
+	 {
+	    RemovedVer[V->ID] = true;
+	    ChangedPkg[P->ID] = true;
+	    *LastVer = V->NextVer;
+	 }
+	 else
+	    LastVer = &V->NextVer;
+      }
+      if (P->VersionList == 0)
+	 EmptiedPkg[P->ID] = true;
+   }
+
+   /* a package without versions has no implicit multi-arch dependencies
+      on it, they are added again if it gets a version */
+   auto const isRemovedDep = [&](pkgCache::Dependency const * const D) {
+      if (RemovedVer[(Cache.VerP + D->ParentVer)->ID])
+	 return true;
+      pkgCache::DependencyData const * const Data = Cache.DepDataP + D->DependencyData;
+      return (Data->CompareOp & pkgCache::Dep::MultiArchImplicit) != 0 &&
+	 EmptiedPkg[(Cache.PkgP + Data->Package)->ID];
+   };
+   std::unordered_set<uint32_t> UsedData;
+   for (pkgCache::PkgIterator P = Cache.PkgBegin(); P.end() == false; ++P)
+   {
+      for (pkgCache::VerIterator V = P.VersionList(); V.end() == false; ++V)
+      {
+	 // descriptions are kept even without a file for ReuseRemovedDescriptions
+	 for (pkgCache::DescIterator D = V.DescriptionList(); D.end() == false; ++D)
+	 {
+	    map_pointer<pkgCache::DescFile> *LastDF = &D->FileList;
+	    while (*LastDF != 0)
+	    {
+	       pkgCache::DescFile * const DF = Cache.DescFileP + *LastDF;
+	       if (isRemoved(DF->File))
+		  *LastDF = DF->NextFile;
+	       else
+		  LastDF = &DF->NextFile;
+	    }
+	 }
+
+	 map_pointer<pkgCache::Dependency> *LastDep = &V->DependsList;
+	 while (*LastDep != 0)
+	 {
+	    pkgCache::Dependency * const D = Cache.DepP + *LastDep;
+	    if (isRemovedDep(D))
+	       *LastDep = D->NextDepends;
+	    else
+	       LastDep = &D->NextDepends;
+	 }
+      }
+
+      map_pointer<pkgCache::Provides> *LastPrv = &P->ProvidesList;
+      while (*LastPrv != 0)
+      {
+	 pkgCache::Provides * const Prv = Cache.ProvideP + *LastPrv;
+	 if (RemovedVer[(Cache.VerP + Prv->Version)->ID])
+	 {
+	    *LastPrv = Prv->NextProvides;
+	    ChangedPkg[P->ID] = true;
+	 }
+	 else
+	    LastPrv = &Prv->NextProvides;
+      }
+
+      if (P->RevDepends == 0)
+	 continue;
+      map_pointer<pkgCache::DependencyData> FirstData = (Cache.DepP + P->RevDepends)->DependencyData;
+      bool Changed = false;
+      map_pointer<pkgCache::Dependency> *LastDep = &P->RevDepends;
+      while (*LastDep != 0)
+      {
+	 pkgCache::Dependency * const D = Cache.DepP + *LastDep;
+	 if (isRemovedDep(D))
+	 {
+	    *LastDep = D->NextRevDepends;
+	    Changed = true;
+	    ChangedPkg[P->ID] = true;
+	 }
+	 else
+	    LastDep = &D->NextRevDepends;
+      }
+      if (Changed == false || P->RevDepends == 0)
+	 continue;
+
+      /* NewDepends expects the first reverse dependency to point to the
+	 start of the list of all dependency data on this package */
+      UsedData.clear();
+      for (map_pointer<pkgCache::Dependency> D = P->RevDepends; D != 0; D = (Cache.DepP + D)->NextRevDepends)
+	 UsedData.insert(static_cast<uint32_t>((Cache.DepP + D)->DependencyData));
+      map_pointer<pkgCache::DependencyData> *LastData = &FirstData;
+      while (*LastData != 0)
+      {
+	 pkgCache::DependencyData * const Data = Cache.DepDataP + *LastData;
+	 if (UsedData.find(static_cast<uint32_t>(*LastData)) == UsedData.end())
+	    *LastData = Data->NextData;
+	 else
+	    LastData = &Data->NextData;
+      }
+      for (LastDep = &P->RevDepends; (Cache.DepP + *LastDep)->DependencyData != FirstData;
+	    LastDep = &(Cache.DepP + *LastDep)->NextRevDepends);
+      if (LastDep != &P->RevDepends)
+      {
+	 map_pointer<pkgCache::Dependency> const First = *LastDep;
+	 *LastDep = (Cache.DepP + First)->NextRevDepends;
+	 (Cache.DepP + First)->NextRevDepends = P->RevDepends;
+	 P->RevDepends = First;
+      }
+   }
+
+   // packages and groups nothing refers to anymore wouldn't exist in a rebuild
+   std::vector<map_pointer<pkgCache::Package>> UnusedPkgs;
+   for (pkgCache::PkgIterator P = Cache.PkgBegin(); P.end() == false; ++P)
+      if (ChangedPkg[P->ID] && P->VersionList == 0 && P->RevDepends == 0 && P->ProvidesList == 0)
+	 UnusedPkgs.push_back(P.MapPointer());
+   std::vector<map_pointer<pkgCache::Group>> ChangedGrps;
+   for (auto const Pkg : UnusedPkgs)
+   {
+      pkgCache::Package * const P = Cache.PkgP + Pkg;
+      pkgCache::Group * const G = Cache.GrpP + P->Group;
+      map_pointer<pkgCache::Package> Prev = 0;
+      map_pointer<pkgCache::Package> *LastPkg = &Cache.HeaderP->PkgHashTableP()[Cache.Hash(Cache.ViewString(G->Name))];
+      for (; *LastPkg != Pkg; LastPkg = &(Cache.PkgP + *LastPkg)->NextPackage)
+	 Prev = *LastPkg;
+      *LastPkg = P->NextPackage;
+      if (G->FirstPackage == Pkg)
+	 G->FirstPackage = (P->NextPackage != 0 && (Cache.PkgP + P->NextPackage)->Group == P->Group) ? P->NextPackage : 0;
+      if (G->LastPackage == Pkg)
+	 G->LastPackage = (Prev != 0 && (Cache.PkgP + Prev)->Group == P->Group) ? Prev : 0;
+      ChangedGrps.push_back(P->Group);
+   }
+   for (pkgCache::GrpIterator G = Cache.GrpBegin(); G.end() == false; ++G)
+   {
+      map_pointer<pkgCache::Version> *LastVer = &G->VersionsInSource;
+      while (*LastVer != 0)
+      {
+	 pkgCache::Version * const V = Cache.VerP + *LastVer;
+	 if (RemovedVer[V->ID])
+	 {
+	    *LastVer = V->NextInSource;
+	    ChangedGrps.push_back(G.MapPointer());
+	 }
+	 else
+	    LastVer = &V->NextInSource;
+      }
+   }
+   std::sort(ChangedGrps.begin(), ChangedGrps.end());
+   ChangedGrps.erase(std::unique(ChangedGrps.begin(), ChangedGrps.end()), ChangedGrps.end());
+   for (auto const Grp : ChangedGrps)
+   {
+      pkgCache::Group * const G = Cache.GrpP + Grp;
+      if (G->FirstPackage != 0 || G->VersionsInSource != 0)
+	 continue;
+      map_pointer<pkgCache::Group> *LastGrp = &Cache.HeaderP->GrpHashTableP()[Cache.Hash(Cache.ViewString(G->Name))];
+      for (; *LastGrp != Grp; LastGrp = &(Cache.GrpP + *LastGrp)->Next);
+      *LastGrp = G->Next;
+   }
+   return true;
+}
+									/*}}}*/
+// CacheGenerator::FinishRemoveFiles - Drop descriptions left behind	/*{{{*/
+// ---------------------------------------------------------------------
+/* Descriptions still without a file after merging the removed files
+   again are unlinked, but only if another description in the same
+   language remains: A version another file still has would otherwise
+   lose the description only the removed file had provided for it. */
+bool pkgCacheGenerator::FinishRemoveFiles()
+{
+   RemovedFiles.clear();
+   auto const isLeftBehind = [&](map_pointer<pkgCache::Description> const D) {
+      return (Cache.DescP + D)->FileList == 0;
+   };
+   for (pkgCache::PkgIterator P = Cache.PkgBegin(); P.end() == false; ++P)
+      for (pkgCache::VerIterator V = P.VersionList(); V.end() == false; ++V)
+      {
+	 for (pkgCache::DescIterator D = V.DescriptionList(); D.end() == false; ++D)
+	 {
+	    if (isLeftBehind(D.MapPointer()) == false)
+	       continue;
+	    pkgCache::DescIterator O = V.DescriptionList();
+	    for (; O.end() == false; ++O)
+	       if (isLeftBehind(O.MapPointer()) == false && D->language_code == O->language_code)
+		  break;
+	    if (O.end() == true)
+	       for (O = V.DescriptionList(); O.end() == false; ++O)
+		  if (isLeftBehind(O.MapPointer()) == false && strcmp(D.LanguageCode(), O.LanguageCode()) == 0)
+		     break;
+	    if (O.end() == true)
+	    {
+	       if (_config->FindB("Debug::pkgCacheGen", false))
+		  std::clog << "No description in language '" << D.LanguageCode() << "' left for "
+		     << P.FullName() << " " << V.VerStr() << std::endl;
+	       return false;
+	    }
+	 }
+
+	 map_pointer<pkgCache::Description> *LastDesc = &V->DescriptionList;
+	 while (*LastDesc != 0)
+	 {
+	    if (isLeftBehind(*LastDesc))
+	       *LastDesc = (Cache.DescP + *LastDesc)->NextDesc;
+	    else
+	       LastDesc = &(Cache.DescP + *LastDesc)->NextDesc;
+	 }
+      }
+   return true;
+}
+									/*}}}*/
 // CheckValidity - Check that a cache is up-to-date			/*{{{*/
 // ---------------------------------------------------------------------
 /* This just verifies that each file in the list of index files exists,
@@ -1365,12 +1980,23 @@ public:
    ~ScopedErrorRevert() { _error->RevertToStack(); }
 };
 
+/* Files in the cache which can be merged again with their new content
+   instead of building the cache from scratch */
+struct APT_HIDDEN OutdatedFiles
+{
+   std::vector<metaIndex *> Releases;
+   std::vector<std::pair<pkgIndexFile *, map_fileid_t>> Indexes;
+   // files which add only to the packages of the files merged before them
+   std::vector<std::pair<pkgIndexFile *, map_fileid_t>> Additions;
+};
+
 static bool CheckValidity(FileFd &CacheFile, std::string const &CacheFileName,
                           pkgSourceList &List,
                           FileIterator const Start,
                           FileIterator const End,
                           MMap **OutMap = 0,
-			  pkgCache **OutCache = 0)
+			  pkgCache **OutCache = 0,
+			  OutdatedFiles * const Outdated = nullptr)
 {
    if (CacheFileName.empty())
       return false;
@@ -1412,6 +2038,7 @@ static bool CheckValidity(FileFd &CacheFile, std::string const &CacheFileName,
       return false;
    }
 
+   OutdatedFiles Old;
    std::unique_ptr<bool[]> RlsVisited(new bool[Cache.HeaderP->ReleaseFileCount]);
    memset(RlsVisited.get(),0,sizeof(RlsVisited[0])*Cache.HeaderP->ReleaseFileCount);
    std::vector<pkgIndexFile *> Files;
@@ -1419,7 +2046,17 @@ static bool CheckValidity(FileFd &CacheFile, std::string const &CacheFileName,
    {
       if (Debug == true)
 	 std::clog << "Checking RlsFile " << (*i)->Describe() << ": ";
-      pkgCache::RlsFileIterator const RlsFile = (*i)->FindInCache(Cache, true);
+      pkgCache::RlsFileIterator RlsFile = (*i)->FindInCache(Cache, true);
+      if (RlsFile.end() == true && Outdated != nullptr)
+      {
+	 RlsFile = (*i)->FindInCache(Cache, false);
+	 if (RlsFile.end() == false)
+	 {
+	    if (Debug == true)
+	       std::clog << "is outdated, ";
+	    Old.Releases.push_back(*i);
+	 }
+      }
       if (RlsFile.end() == true)
       {
 	 if (Debug == true)
@@ -1462,6 +2099,22 @@ static bool CheckValidity(FileFd &CacheFile, std::string const &CacheFileName,
 
       // FindInCache is also expected to do an IMS check.
       pkgCache::PkgFileIterator File = (*PkgFile)->FindInCache(Cache);
+      auto const Target = dynamic_cast<pkgDebianIndexTargetFile const *>(*PkgFile);
+      if (File.end() == true && Outdated != nullptr && Target != nullptr)
+      {
+	 std::string const FileName = Target->GetIndexFileName();
+	 for (File = Cache.FileBegin(); File.end() == false; ++File)
+	    if (File->FileName != 0 && FileName == File.FileName())
+	       break;
+	 if (File.end() == false)
+	 {
+	    if (Debug == true)
+	       std::clog << "is outdated, ";
+	    Old.Indexes.emplace_back(*PkgFile, File->ID);
+	 }
+      }
+      else if (File.end() == false && File.Flagged(pkgCache::Flag::NoPackages))
+	 Old.Additions.emplace_back(*PkgFile, File->ID);
       if (File.end() == true)
       {
 	 if (Debug == true)
@@ -1492,6 +2145,25 @@ static bool CheckValidity(FileFd &CacheFile, std::string const &CacheFileName,
       return false;
    }
 
+   if (Old.Releases.empty() == false || Old.Indexes.empty() == false)
+   {
+      auto const byID = [](std::pair<pkgIndexFile *, map_fileid_t> const &a, std::pair<pkgIndexFile *, map_fileid_t> const &b) {
+	 return a.second < b.second;
+      };
+      auto const sameID = [](std::pair<pkgIndexFile *, map_fileid_t> const &a, std::pair<pkgIndexFile *, map_fileid_t> const &b) {
+	 return a.second == b.second;
+      };
+      std::sort(Old.Indexes.begin(), Old.Indexes.end(), byID);
+      Old.Indexes.erase(std::unique(Old.Indexes.begin(), Old.Indexes.end(), sameID), Old.Indexes.end());
+      std::sort(Old.Additions.begin(), Old.Additions.end(), byID);
+      Old.Additions.erase(std::unique(Old.Additions.begin(), Old.Additions.end(), sameID), Old.Additions.end());
+      if (Debug == true)
+	 std::clog << CacheFileName << " has " << Old.Releases.size() << " outdated release and "
+	    << Old.Indexes.size() << " outdated index files" << std::endl;
+      *Outdated = std::move(Old);
+      return false;
+   }
+
    if (OutMap != 0)
       *OutMap = Map.release();
    if (OutCache != 0)
@@ -1535,6 +2207,29 @@ static bool BuildCache(pkgCacheGenerator &Gen,
 {
    bool mergeFailure = false;
 
+   // read the index files ahead on other threads if requested
+   std::unique_ptr<pkgCacheGenerator::IndexPrefetcher> Prefetcher;
+   int const Threads = _config->FindI("APT::Cache-Threads", 0);
+   if (Threads > 0)
+   {
+      std::vector<std::string> Prefetch;
+      auto const addPrefetch = [&](pkgIndexFile const * const I) {
+	 auto const T = dynamic_cast<pkgDebianIndexTargetFile const *>(I);
+	 if (T != nullptr && T->HasPackages() && T->Exists())
+	    Prefetch.push_back(T->GetIndexFileName());
+      };
+      if (List != NULL)
+	 for (pkgSourceList::const_iterator i = List->begin(); i != List->end(); ++i)
+	 {
+	    std::vector <pkgIndexFile *> const * const Indexes = (*i)->GetIndexFiles();
+	    if (Indexes != NULL)
+	       std::for_each(Indexes->begin(), Indexes->end(), addPrefetch);
+	 }
+      std::for_each(Start, End, addPrefetch);
+      if (Prefetch.empty() == false)
+	 Prefetcher.reset(new pkgCacheGenerator::IndexPrefetcher(Gen, Prefetch, Threads));
+   }
+
    auto const indexFileMerge = [&](pkgIndexFile * const I) {
       if (I->HasPackages() == false || mergeFailure)
 	 return;
@@ -1590,6 +2285,50 @@ static bool BuildCache(pkgCacheGenerator &Gen,
    return true;
 }
 									/*}}}*/
+// UpdateCache - Merge outdated index files again into the cache	/*{{{*/
+// ---------------------------------------------------------------------
+/* Only the outdated files are removed from the cache and merged again,
+   which is a lot faster than merging all files if only a few changed.
+   If this fails the cache has to be built from scratch. */
+static bool UpdateCache(pkgCacheGenerator &Gen,
+			OpProgress * const Progress,
+			map_filesize_t &CurrentSize,map_filesize_t TotalSize,
+			OutdatedFiles const &Outdated)
+{
+   if (Gen.GetCache().HeaderP->PackageFileCount == 0)
+      return false;
+   std::vector<map_fileid_t> Remove;
+   for (auto const &I : Outdated.Indexes)
+      Remove.push_back(I.second);
+   if (Gen.RemoveFiles(Remove) == false)
+      return false;
+
+   for (auto const R : Outdated.Releases)
+      if (R->Merge(Gen, Progress) == false)
+	 return false;
+
+   auto const indexFileMerge = [&](pkgIndexFile * const I) {
+      map_filesize_t const Size = I->Size();
+      if (Progress != NULL)
+	 Progress->OverallProgress(CurrentSize, TotalSize, Size, _("Reading package lists"));
+      CurrentSize += Size;
+      return I->Merge(Gen, Progress);
+   };
+   for (auto const &I : Outdated.Indexes)
+      if (indexFileMerge(I.first) == false)
+	 return false;
+
+   // new versions can get descriptions from Translation files merged after them
+   if (Gen.CreatedVersions() && Outdated.Indexes.empty() == false)
+   {
+      map_fileid_t const First = Outdated.Indexes.front().second;
+      for (auto const &I : Outdated.Additions)
+	 if (I.second > First && indexFileMerge(I.first) == false)
+	    return false;
+   }
+   return Gen.FinishRemoveFiles();
+}
+									/*}}}*/
 // CacheGenerator::MakeStatusCache - Construct the status cache		/*{{{*/
 // ---------------------------------------------------------------------
 /* This makes sure that the status cache (the cache that has all 
@@ -1701,9 +2440,12 @@ bool pkgCacheGenerator::MakeStatusCache(pkgSourceList &List,OpProgress *Progress
    }
 
    FileFd SrcCacheFile;
+   OutdatedFiles Outdated;
    if (pkgcache_fine == false)
    {
-      if (CheckValidity(SrcCacheFile, SrcCacheFileName, List, Files.end(), Files.end()) == true)
+      bool const Incremental = _config->FindB("APT::Cache-Incremental", true);
+      if (CheckValidity(SrcCacheFile, SrcCacheFileName, List, Files.end(), Files.end(),
+	       nullptr, nullptr, Incremental ? &Outdated : nullptr) == true)
       {
 	 if (Debug == true)
 	    std::clog << "srcpkgcache.bin is valid - it can be reused" << std::endl;
@@ -1752,16 +2494,53 @@ bool pkgCacheGenerator::MakeStatusCache(pkgSourceList &List,OpProgress *Progress
    }
    else if (srcpkgcache_fine == false)
    {
-      if (Debug == true)
-	 std::clog << "srcpkgcache.bin is NOT valid - rebuild" << std::endl;
-      Gen.reset(new pkgCacheGenerator(Map.get(),Progress));
-      if (Gen->Start() == false)
-	 return false;
+      bool Updated = false;
+      if (Outdated.Releases.empty() == false || Outdated.Indexes.empty() == false)
+      {
+	 if (Debug == true)
+	    std::clog << "srcpkgcache.bin is outdated - update it" << std::endl;
+	 _error->PushToStack();
+	 if (loadBackMMapFromFile(Gen, Map, Progress, SrcCacheFile) == true)
+	 {
+	    map_filesize_t OutdatedSize = TotalSize;
+	    for (auto const &I : Outdated.Indexes)
+	       OutdatedSize += I.first->Size();
+	    OutdatedSize += ComputeSize(NULL, Files.begin(), Files.end());
+	    Updated = UpdateCache(*Gen, Progress, CurrentSize, OutdatedSize, Outdated);
+	    if (Updated)
+	       TotalSize = OutdatedSize;
+	 }
+	 if (Updated == false)
+	 {
+	    if (Debug == true)
+	    {
+	       std::clog << "Updating srcpkgcache.bin failed - rebuild" << std::endl;
+	       _error->DumpErrors(std::clog, GlobalError::DEBUG, false);
+	    }
+	    _error->RevertToStack();
+	    Gen.reset();
+	    Map.reset(CreateDynamicMMap(NULL, 0));
+	    if (unlikely(Map->validData()) == false)
+	       return false;
+	    CurrentSize = 0;
+	 }
+	 else
+	    _error->MergeWithStack();
+      }
 
-      TotalSize += ComputeSize(&List, Files.begin(),Files.end());
-      if (BuildCache(*Gen, Progress, CurrentSize, TotalSize, &List,
-	       Files.end(),Files.end()) == false)
-	 return false;
+      if (Updated == false)
+      {
+	 if (Debug == true)
+	    std::clog << "srcpkgcache.bin is NOT valid - rebuild" << std::endl;
+	 Gen.reset(new pkgCacheGenerator(Map.get(),Progress));
+	 if (Gen->Start() == false)
+	    return false;
+
+	 TotalSize += ComputeSize(&List, Files.begin(),Files.end());
+	 if (BuildCache(*Gen, Progress, CurrentSize, TotalSize, &List,
+		  Files.end(),Files.end()) == false)
+	    return false;
+      }
 
       if (Writeable == true && SrcCacheFileName.empty() == false)
 	 if (writeBackMMapToFile(Gen.get(), Map.get(), SrcCacheFileName) == false)
@@ -29,10 +29,6 @@
 #endif
 #include <apt-pkg/string_view.h>
 
-#ifdef APT_COMPILING_APT
-#include <xxhash.h>
-#endif
-
 class FileFd;
 class pkgSourceList;
 class OpProgress;
@@ -44,38 +40,12 @@ class APT_HIDDEN pkgCacheGenerator					/*{{{*/
    APT_HIDDEN map_stringitem_t WriteStringInMap(APT::StringView String) { return WriteStringInMap(String.data(), String.size()); };
    APT_HIDDEN map_stringitem_t WriteStringInMap(const char *String);
    APT_HIDDEN map_stringitem_t WriteStringInMap(const char *String, const unsigned long &Len);
+   APT_HIDDEN map_stringitem_t WriteVersionInMap(const char *String, unsigned long const Len);
    APT_HIDDEN uint32_t AllocateInMap(const unsigned long &size);
    template<typename T> map_pointer<T> AllocateInMap() {
       return map_pointer<T>{AllocateInMap(sizeof(T))};
    }
 
-   // Dirty hack for public users that do not use C++11 yet
-#if __cplusplus >= 201103L && defined(APT_COMPILING_APT)
-   struct string_pointer {
-      const char *data_;
-      size_t size;
-      pkgCacheGenerator *generator;
-      map_stringitem_t item;
-
-      const char *data() const {
-	 return data_ != nullptr ? data_ : static_cast<char*>(generator->Map.Data()) + item;
-      }
-
-      bool operator ==(string_pointer const &other) const {
-	 return size == other.size && memcmp(data(), other.data(), size) == 0;
-      }
-   };
-   struct hash {
-      uint32_t operator()(string_pointer const &that) const {
-	 return XXH3_64bits(that.data(), that.size) & 0xFFFFFFFF;
-      }
-   };
-
-   std::unordered_set<string_pointer, hash> strMixed;
-   std::unordered_set<string_pointer, hash> strVersions;
-   std::unordered_set<string_pointer, hash> strSections;
-#endif
-
    friend class pkgCacheListParser;
    typedef pkgCacheListParser ListParser;
 
@@ -125,6 +95,10 @@ class APT_HIDDEN pkgCacheGenerator					/*{{{*/
 
    public:
 
+   /** \brief kinds of strings, each deduplicated in a table of its own
+    *
+    * The values index pkgCache::Header::StringTables.
+    */
    enum StringType { MIXED, VERSIONNUMBER, SECTION };
    map_stringitem_t StoreString(StringType const type, const char * S, unsigned int const Size);
 
@@ -140,6 +114,31 @@ class APT_HIDDEN pkgCacheGenerator					/*{{{*/
    inline pkgCache::RlsFileIterator GetCurRlsFile()
          {return pkgCache::RlsFileIterator(Cache,CurrentRlsFile);};
 
+   class IndexPrefetcher;
+   /** \brief hand the content of File to the parser if it was read ahead
+    *
+    * \return \b true if the parser will use the prefetched content,
+    *  \b false if it has to read the file on its own.
+    */
+   bool UsePrefetched(std::string const &File, ListParser &List);
+
+   /** \brief unlink everything the given package files contributed
+    *
+    * The files stay in the cache, so that they can be merged again with
+    * their new content into their old PackageFile structures.
+    * \return \b false if this would leave too much garbage in the map,
+    *  in which case the cache is not modified.
+    */
+   bool RemoveFiles(std::vector<map_fileid_t> const &Files);
+   /** \brief clean up after the files removed by RemoveFiles were merged again
+    *
+    * \return \b false if the merge could not restore all descriptions,
+    *  in which case the cache should be built from scratch instead.
+    */
+   bool FinishRemoveFiles();
+   /** \return \b true if merging the removed files created new versions */
+   bool CreatedVersions() const { return NewVersions; }
+
    APT_PUBLIC static bool MakeStatusCache(pkgSourceList &List,OpProgress *Progress,
 			MMap **OutMap = 0,bool AllowMem = false);
    APT_HIDDEN static bool MakeStatusCache(pkgSourceList &List,OpProgress *Progress,
@@ -154,6 +153,10 @@ class APT_HIDDEN pkgCacheGenerator					/*{{{*/
 
    private:
    void * const d;
+   IndexPrefetcher *Prefetcher;
+   std::vector<bool> RemovedFiles;
+   bool NewVersions;
+   APT_HIDDEN bool GrowStringTable(StringType const type);
    APT_HIDDEN bool MergeListGroup(ListParser &List, std::string const &GrpName);
    APT_HIDDEN bool MergeListPackage(ListParser &List, pkgCache::PkgIterator &Pkg);
    APT_HIDDEN bool MergeListVersion(ListParser &List, pkgCache::PkgIterator &Pkg,
@@ -165,6 +168,8 @@ class APT_HIDDEN pkgCacheGenerator					/*{{{*/
 
    APT_HIDDEN bool AddNewDescription(ListParser &List, pkgCache::VerIterator &Ver,
 	 std::string const &lang, APT::StringView CurMd5, map_stringitem_t &md5idx);
+   APT_HIDDEN bool ReuseRemovedDescriptions(ListParser &List, pkgCache::VerIterator &Ver,
+	 APT::StringView CurMd5, std::vector<std::string> const &Langs);
 };
 									/*}}}*/
 // This is the abstract package list parser class.			/*{{{*/
@@ -186,6 +191,11 @@ class APT_HIDDEN pkgCacheListParser
    inline map_stringitem_t WriteString(APT::StringView S) {return Owner->WriteStringInMap(S.data(), S.size());};
 
    inline map_stringitem_t WriteString(const char *S,unsigned int Size) {return Owner->WriteStringInMap(S,Size);};
+   /** \brief parse the complete file content in Buffer instead of reading the file
+    *
+    * \return \b false if the parser doesn't support this and reads the file itself
+    */
+   virtual bool UseBuffer(char * const /*Buffer*/, unsigned long long const /*Size*/) {return false;};
    bool NewDepends(pkgCache::VerIterator &Ver,APT::StringView Package, APT::StringView Arch,
 		   APT::StringView Version,uint8_t const Op,
 		   uint8_t const Type);
@@ -137,6 +137,39 @@ bool pkgPolicy::InitDefaults()
    return true;
 }
 									/*}}}*/
+// Policy::Fingerprint - Describe the pins and the phasing state	/*{{{*/
+// ---------------------------------------------------------------------
+/* Two policies with the same fingerprint pick the same candidates on
+   the same cache. Only pins which made it into the priority tables are
+   relevant, the pin files themselves are not. */
+std::string pkgPolicy::Fingerprint() const
+{
+   std::string Print = pkgDepCache::Policy::Fingerprint();
+   for (pkgCache::PkgFileIterator F = Cache->FileBegin(); F != Cache->FileEnd(); ++F)
+      Print.append(std::to_string(F->ID)).append(":").append(std::to_string(PFPriority[F->ID])).append(",");
+   Print.append(";");
+   auto VersionCount = Cache->Head().VersionCount;
+   for (decltype(VersionCount) I = 0; I != VersionCount; ++I)
+      if (VerPins[I].Type != pkgVersionMatch::None)
+	 Print.append(std::to_string(I)).append(":").append(std::to_string(VerPins[I].Priority)).append(",");
+   Print.append(";");
+
+   // the same decisions as in ExcludePhased, avoiding isChroot if possible
+   if (not _config->FindB("APT::Get::Phase-Policy", false) ||
+       _config->FindB("APT::Get::Always-Include-Phased-Updates",
+		      _config->FindB("Update-Manager::Always-Include-Phased-Updates", false)))
+      Print.append("phased:include");
+   else if (_config->FindB("APT::Get::Never-Include-Phased-Updates",
+			   _config->FindB("Update-Manager::Never-Include-Phased-Updates", false)))
+      Print.append("phased:exclude");
+   else if (d->machineID.empty() || getenv("SOURCE_DATE_EPOCH") != nullptr ||
+	    APT::Configuration::isChroot())
+      Print.append("phased:include");
+   else
+      Print.append("phased:").append(d->machineID);
+   return Print;
+}
+									/*}}}*/
 // Policy::GetCandidateVer - Get the candidate install version		/*{{{*/
 // ---------------------------------------------------------------------
 /* Evaluate the package pins and the default list to determine what the
@@ -146,7 +179,6 @@ pkgCache::VerIterator pkgPolicy::GetCandidateVer(pkgCache::PkgIterator const &Pk
    pkgCache::VerIterator cand;
    pkgCache::VerIterator cur = Pkg.CurrentVer();
    int candPriority = -1;
-   pkgVersioningSystem *vs = Cache->VS;
 
    for (pkgCache::VerIterator ver = Pkg.VersionList(); ver.end() == false; ++ver) {
       int priority = GetPriority(ver, true);
@@ -156,7 +188,7 @@ pkgCache::VerIterator pkgPolicy::GetCandidateVer(pkgCache::PkgIterator const &Pk
 
       // TODO: Maybe optimize to not compare versions
       if (!cur.end() && priority < 1000
-	  && (vs->CmpVersion(ver.VerStr(), cur.VerStr()) < 0))
+	  && (Cache->CmpVersion(ver->VerStr, cur->VerStr) < 0))
 	 continue;
 
       candPriority = priority;
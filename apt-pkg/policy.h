@@ -79,6 +79,9 @@ class APT_PUBLIC pkgPolicy : public pkgDepCache::Policy
    void SetPriority(pkgCache::VerIterator const &Ver, signed short Priority);
    void SetPriority(pkgCache::PkgFileIterator const &File, signed short Priority);
    bool InitDefaults();
+
+   /** \brief Describes everything #GetCandidateVer depends on */
+   APT_HIDDEN std::string Fingerprint() const;
    
    explicit pkgPolicy(pkgCache *Owner);
    virtual ~pkgPolicy();
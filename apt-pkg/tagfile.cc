@@ -14,18 +14,26 @@
 
 #include <apt-pkg/error.h>
 #include <apt-pkg/fileutl.h>
+#include <apt-pkg/mmap.h>
 #include <apt-pkg/string_view.h>
 #include <apt-pkg/strutl.h>
 #include <apt-pkg/tagfile-keys.h>
 #include <apt-pkg/tagfile.h>
 
 #include <list>
+#include <memory>
 
 #include <string>
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define APT_TAGFILE_SSE2
+#include <immintrin.h>
+#endif
 
 #include <apti18n.h>
 									/*}}}*/
@@ -38,9 +46,10 @@ class APT_HIDDEN pkgTagFilePrivate					/*{{{*/
 public:
    void Reset(FileFd * const pFd, unsigned long long const pSize, pkgTagFile::Flags const pFlags)
    {
-      if (Buffer != NULL)
+      if (Buffer != NULL && isExternalBuffer == false)
 	 free(Buffer);
       Buffer = NULL;
+      isExternalBuffer = false;
       Fd = pFd;
       Flags = pFlags;
       Start = NULL;
@@ -50,15 +59,19 @@ public:
       Size = pSize;
       isCommentedLine = false;
       chunks.clear();
+      Map.reset();
+      Tail.clear();
    }
 
-   pkgTagFilePrivate(FileFd * const pFd, unsigned long long const Size, pkgTagFile::Flags const pFlags) : Buffer(NULL)
+   pkgTagFilePrivate(FileFd * const pFd, unsigned long long const Size, pkgTagFile::Flags const pFlags) : Buffer(NULL), isExternalBuffer(false)
    {
       Reset(pFd, Size, pFlags);
    }
    FileFd * Fd;
    pkgTagFile::Flags Flags;
    char *Buffer;
+   // the Buffer holds the complete file and is owned by someone else
+   bool isExternalBuffer;
    char *Start;
    char *End;
    bool Done;
@@ -72,10 +85,14 @@ public:
       FileChunk(bool const pgood, size_t const plength) noexcept : good(pgood), length(plength) {}
    };
    std::list<FileChunk> chunks;
+   // the Buffer is a read-only mapping of the file
+   std::unique_ptr<MMap> Map;
+   // copy of the last stanza of the mapping with the missing empty line added
+   std::string Tail;
 
    ~pkgTagFilePrivate()
    {
-      if (Buffer != NULL)
+      if (Buffer != NULL && isExternalBuffer == false)
 	 free(Buffer);
    }
 };
@@ -114,6 +131,123 @@ static unsigned long BetaHash(const char *Text, size_t Length)		/*{{{*/
 }
 									/*}}}*/
 
+// FindFieldEnd - Find the newline ending the current field		/*{{{*/
+/* A field ends at the first newline which isn't followed by a blank
+   starting a continuation line. Multiline fields like Description make up
+   most of an index file, so instead of looking at each of their lines on
+   its own we check a whole block of bytes for such newlines at once. */
+static char const *FindFieldEndScalar(char const *Stop, char const *End)
+{
+   while ((Stop = static_cast<char const *>(memchr(Stop, '\n', End - Stop))) != nullptr)
+   {
+      if (Stop + 1 == End || (Stop[1] != ' ' && Stop[1] != '\t'))
+	 return Stop;
+      ++Stop;
+   }
+   return nullptr;
+}
+#ifdef APT_TAGFILE_SSE2
+static char const *FindFieldEndSSE2(char const *Stop, char const *End)
+{
+   __m128i const Newline = _mm_set1_epi8('\n');
+   __m128i const Space = _mm_set1_epi8(' ');
+   __m128i const Tab = _mm_set1_epi8('\t');
+   // the byte after the block is looked at, too
+   for (; End - Stop > 16; Stop += 16)
+   {
+      __m128i const Cur = _mm_loadu_si128(reinterpret_cast<__m128i const *>(Stop));
+      __m128i const Next = _mm_loadu_si128(reinterpret_cast<__m128i const *>(Stop + 1));
+      __m128i const Blank = _mm_or_si128(_mm_cmpeq_epi8(Next, Space), _mm_cmpeq_epi8(Next, Tab));
+      unsigned int const Found = _mm_movemask_epi8(_mm_andnot_si128(Blank, _mm_cmpeq_epi8(Cur, Newline)));
+      if (Found != 0)
+	 return Stop + __builtin_ctz(Found);
+   }
+   return FindFieldEndScalar(Stop, End);
+}
+__attribute__((target("avx2"))) static char const *FindFieldEndAVX2(char const *Stop, char const *End)
+{
+   __m256i const Newline = _mm256_set1_epi8('\n');
+   __m256i const Space = _mm256_set1_epi8(' ');
+   __m256i const Tab = _mm256_set1_epi8('\t');
+   for (; End - Stop > 32; Stop += 32)
+   {
+      __m256i const Cur = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(Stop));
+      __m256i const Next = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(Stop + 1));
+      __m256i const Blank = _mm256_or_si256(_mm256_cmpeq_epi8(Next, Space), _mm256_cmpeq_epi8(Next, Tab));
+      unsigned int const Found = _mm256_movemask_epi8(_mm256_andnot_si256(Blank, _mm256_cmpeq_epi8(Cur, Newline)));
+      if (Found != 0)
+	 return Stop + __builtin_ctz(Found);
+   }
+   return FindFieldEndSSE2(Stop, End);
+}
+#endif
+static char const *FindFieldEnd(char const *Stop, char const *End)
+{
+#ifdef APT_TAGFILE_SSE2
+   static auto const Impl = __builtin_cpu_supports("avx2") ? FindFieldEndAVX2 : FindFieldEndSSE2;
+   return Impl(Stop, End);
+#else
+   return FindFieldEndScalar(Stop, End);
+#endif
+}
+									/*}}}*/
+
+// MapFile - Use a mapping of an uncompressed file as buffer		/*{{{*/
+/* Reading a plain file chunk by chunk copies all of it and moves the rest
+   of each chunk around, so such files are mapped instead and the sections
+   point directly into the mapping. Comments have to be removed from the
+   buffer, so files supporting them are still read. */
+static bool MapFile(pkgTagFilePrivate * const d)
+{
+   if ((d->Flags & pkgTagFile::SUPPORT_COMMENTS) != 0 || d->Fd->IsCompressed() == true)
+      return false;
+   struct stat Buf;
+   if (fstat(d->Fd->Fd(), &Buf) != 0 || S_ISREG(Buf.st_mode) == false || Buf.st_size == 0)
+      return false;
+   // the caller might have read a part of the file already
+   if (d->Fd->Tell() != 0)
+      return false;
+
+   _error->PushToStack();
+   std::unique_ptr<MMap> Map(new MMap(*d->Fd, MMap::ReadOnly));
+   if (Map->validData() == false || Map->Size() == 0 || _error->PendingError() == true)
+   {
+      _error->RevertToStack();
+      return d->Fd->Seek(0);
+   }
+   _error->MergeWithStack();
+
+   d->Map = std::move(Map);
+   d->Buffer = static_cast<char *>(d->Map->Data());
+   d->isExternalBuffer = true;
+   d->Size = d->Map->Size();
+   d->Start = d->Buffer;
+   d->End = d->Buffer + d->Size;
+   d->Done = true;
+   return true;
+}
+									/*}}}*/
+// UseTail - Scan a copy of the last stanza of a mapping		/*{{{*/
+/* The newlines pkgTagSection expects at the end of the last stanza can't
+   be appended to a read-only mapping, so if they are missing the rest of
+   the file is copied into a small buffer which gets them instead. */
+static bool UseTail(pkgTagFilePrivate * const d)
+{
+   if (d->Map == nullptr || d->End != d->Buffer + d->Size)
+      return false;
+   unsigned int LineCount = 0;
+   for (const char *E = d->End - 1; E >= d->Start && (*E == '\n' || *E == '\r'); --E)
+      if (*E == '\n')
+	 ++LineCount;
+   if (LineCount >= 2)
+      return false;
+   d->Tail.assign(d->Start, d->End - d->Start);
+   d->Tail.append(2 - LineCount, '\n');
+   d->Start = &d->Tail[0];
+   d->End = d->Start + d->Tail.length();
+   return true;
+}
+									/*}}}*/
 // TagFile::pkgTagFile - Constructor					/*{{{*/
 pkgTagFile::pkgTagFile(FileFd * const pFd,pkgTagFile::Flags const pFlags, unsigned long long const Size)
    : d(new pkgTagFilePrivate(pFd, Size + 4, pFlags))
@@ -133,6 +267,8 @@ void pkgTagFile::Init(FileFd * const pFd, pkgTagFile::Flags const pFlags, unsign
    Size += 4;
    d->Reset(pFd, Size, pFlags);
 
+   if (d->Fd->IsOpen() == true && MapFile(d) == true)
+      return;
    if (d->Fd->IsOpen() == false)
       d->Start = d->End = d->Buffer = 0;
    else
@@ -151,6 +287,15 @@ void pkgTagFile::Init(FileFd * const pFd, pkgTagFile::Flags const pFlags, unsign
 void pkgTagFile::Init(FileFd * const pFd,unsigned long long Size)
 {
    Init(pFd, pkgTagFile::STRICT, Size);
+}
+void pkgTagFile::InitFromBuffer(char * const Buffer, unsigned long long const Size)
+{
+   d->Reset(d->Fd, Size, pkgTagFile::STRICT);
+   d->Buffer = Buffer;
+   d->isExternalBuffer = true;
+   d->Start = d->Buffer;
+   d->End = d->Buffer + Size;
+   d->Done = true;
 }
 									/*}}}*/
 // TagFile::~pkgTagFile - Destructor					/*{{{*/
@@ -205,19 +350,31 @@ bool pkgTagFile::Step(pkgTagSection &Tag)
 {
    if(Tag.Scan(d->Start,d->End - d->Start) == false)
    {
-      do
+      // we have the complete file already, so there is nothing to refill
+      if (d->isExternalBuffer == true)
       {
-	 if (Fill() == false)
+	 if (d->End - d->Start <= 3)
 	    return false;
-
-	 if(Tag.Scan(d->Start,d->End - d->Start, false))
-	    break;
-
-	 if (Resize() == false)
+	 if (UseTail(d) == false || Tag.Scan(d->Start, d->End - d->Start) == false)
 	    return _error->Error(_("Unable to parse package file %s (%d)"),
 		  d->Fd->Name().c_str(), 1);
+      }
+      else
+      {
+	 do
+	 {
+	    if (Fill() == false)
+	       return false;
+
+	    if(Tag.Scan(d->Start,d->End - d->Start, false))
+	       break;
+
+	    if (Resize() == false)
+	       return _error->Error(_("Unable to parse package file %s (%d)"),
+		     d->Fd->Name().c_str(), 1);
 
-      } while (Tag.Scan(d->Start,d->End - d->Start, false) == false);
+	 } while (Tag.Scan(d->Start,d->End - d->Start, false) == false);
+      }
    }
 
    size_t tagSize = Tag.size();
@@ -431,6 +588,18 @@ bool pkgTagFile::Fill()
    that is there */
 bool pkgTagFile::Jump(pkgTagSection &Tag,unsigned long long Offset)
 {
+   if (d->isExternalBuffer == true)
+   {
+      if (Offset >= d->Size)
+	 return false;
+      d->Start = d->Buffer + Offset;
+      d->End = d->Buffer + d->Size;
+      d->iOffset = Offset;
+      if (Tag.Scan(d->Start, d->End - d->Start) == true)
+	 return true;
+      return UseTail(d) == true && Tag.Scan(d->Start, d->End - d->Start) == true;
+   }
+
    if ((d->Flags & pkgTagFile::SUPPORT_COMMENTS) == 0 &&
    // We are within a buffer space of the next hit..
 	 Offset >= d->iOffset && d->iOffset + (d->End - d->Start) > Offset)
@@ -566,7 +735,8 @@ bool pkgTagSection::Scan(const char *Start,unsigned long MaxLength, bool const R
 	 lastTagData.StartValue = Stop - Section;
       }
 
-      Stop = (const char *)memchr(Stop,'\n',End - Stop);
+      // skips over all continuation lines of the field
+      Stop = FindFieldEnd(Stop, End);
 
       if (Stop == 0)
 	 return false;
@@ -195,6 +195,16 @@ public:
 
    void Init(FileFd * const F, pkgTagFile::Flags const Flags, unsigned long long Size = 32*1024);
    void Init(FileFd * const F,unsigned long long const Size = 32*1024);
+   /** \brief continue with the complete content of the file already in memory
+    *
+    * The Buffer is not copied, so it has to outlive this pkgTagFile and must
+    * contain the complete file ending in an empty line. Only supported for
+    * STRICT files as no comments are stripped from the buffer.
+    *
+    * @param Buffer holding the content of the file opened previously
+    * @param Size of the content in the Buffer
+    */
+   APT_HIDDEN void InitFromBuffer(char * const Buffer, unsigned long long const Size);
 
    pkgTagFile(FileFd * const F, pkgTagFile::Flags const Flags, unsigned long long Size = 32*1024);
    pkgTagFile(FileFd * const F,unsigned long long Size = 32*1024);
@@ -54,6 +54,8 @@ static bool addArgumentsAPTCache(std::vector<CommandLine::Args> &Args, char cons
       addArg(0, "enhances", "APT::Cache::ShowEnhances", 0);
       addArg(0, "recurse", "APT::Cache::RecurseDepends", 0);
       addArg(0, "implicit", "APT::Cache::ShowImplicit", 0);
+      if (CmdMatches("rdepends"))
+	 addArg(0, "closure", "APT::Cache::Closure", 0);
    }
    else if (CmdMatches("search"))
    {
@@ -273,6 +275,7 @@ static bool addArgumentsAPTGet(std::vector<CommandLine::Args> &Args, char const
    addArg('S', "snapshot", "APT::Snapshot", CommandLine::HasArg);
    addArg(0,"download","APT::Get::Download",0);
    addArg(0,"fix-missing","APT::Get::Fix-Missing",0);
+   addArg(0,"streaming-install","APT::Get::Streaming-Install",0);
    addArg(0,"ignore-hold","APT::Ignore-Hold",0);
    addArg(0,"upgrade","APT::Get::upgrade",0);
    addArg(0,"only-upgrade","APT::Get::Only-Upgrade",0);
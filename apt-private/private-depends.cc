@@ -11,6 +11,7 @@
 
 #include <apt-private/private-cacheset.h>
 #include <apt-private/private-depends.h>
+#include <apt-private/private-reverseindex.h>
 
 #include <iostream>
 #include <string>
@@ -51,6 +52,43 @@ static bool ShowDepends(CommandLine &CmdL, bool const RevDepends)
    bool const ShowOnlyFirstOr = _config->FindB("APT::Cache::ShowOnlyFirstOr", false);
    bool const ShowImplicit = _config->FindB("APT::Cache::ShowImplicit", false);
 
+   auto const ShowType = [&](unsigned char const Type) {
+      switch (Type) {
+	 case pkgCache::Dep::PreDepends: return ShowPreDepends;
+	 case pkgCache::Dep::Depends: return ShowDepends;
+	 case pkgCache::Dep::Recommends: return ShowRecommends;
+	 case pkgCache::Dep::Suggests: return ShowSuggests;
+	 case pkgCache::Dep::Replaces: return ShowReplaces;
+	 case pkgCache::Dep::Conflicts: return ShowConflicts;
+	 case pkgCache::Dep::DpkgBreaks: return ShowBreaks;
+	 case pkgCache::Dep::Enhances: return ShowEnhances;
+      }
+      return true;
+   };
+
+   if (RevDepends == true && _config->FindB("APT::Cache::Closure", false) == true)
+   {
+      std::vector<map_id_t> Seeds;
+      for (auto const &Ver : verset)
+	 Seeds.push_back(Ver.ParentPkg()->ID);
+      for (auto const &Pkg : helper.virtualPkgs)
+	 Seeds.push_back(Pkg->ID);
+      ReverseDependencyIndex const Index(*Cache);
+      auto const Reached = Index.Closure(Seeds, [&](ReverseDependencyIndex::Edge const &E) {
+	 if (ShowType(E.Type) == false || (ShowImplicit == false && E.Implicit))
+	    return false;
+	 return Installed == false || Index.Package(E.Parent)->CurrentVer != 0;
+      });
+      for (auto const &Ver : verset)
+	 std::cout << Ver.ParentPkg().FullName(true) << '\n';
+      for (auto const &Pkg : helper.virtualPkgs)
+	 std::cout << '<' << Pkg.FullName(true) << ">\n";
+      std::cout << "Reverse Depends:\n";
+      for (auto const ID : Reached)
+	 std::cout << "  " << Index.Package(ID).FullName(true) << '\n';
+      return true;
+   }
+
    while (verset.empty() != true)
    {
       pkgCache::VerIterator Ver = *verset.begin();
@@ -58,23 +96,15 @@ static bool ShowDepends(CommandLine &CmdL, bool const RevDepends)
       pkgCache::PkgIterator Pkg = Ver.ParentPkg();
       Shown[Pkg->ID] = true;
 
-      std::cout << Pkg.FullName(true) << std::endl;
+      std::cout << Pkg.FullName(true) << '\n';
 
       if (RevDepends == true)
-	 std::cout << "Reverse Depends:" << std::endl;
+	 std::cout << "Reverse Depends:\n";
       for (pkgCache::DepIterator D = RevDepends ? Pkg.RevDependsList() : Ver.DependsList();
 	    D.end() == false; ++D)
       {
-	 switch (D->Type) {
-	    case pkgCache::Dep::PreDepends: if (!ShowPreDepends) continue; break;
-	    case pkgCache::Dep::Depends: if (!ShowDepends) continue; break;
-	    case pkgCache::Dep::Recommends: if (!ShowRecommends) continue; break;
-	    case pkgCache::Dep::Suggests: if (!ShowSuggests) continue; break;
-	    case pkgCache::Dep::Replaces: if (!ShowReplaces) continue; break;
-	    case pkgCache::Dep::Conflicts: if (!ShowConflicts) continue; break;
-	    case pkgCache::Dep::DpkgBreaks: if (!ShowBreaks) continue; break;
-	    case pkgCache::Dep::Enhances: if (!ShowEnhances) continue; break;
-	 }
+	 if (ShowType(D->Type) == false)
+	    continue;
 	 if (ShowImplicit == false && D.IsImplicit())
 	    continue;
 
@@ -97,7 +127,7 @@ static bool ShowDepends(CommandLine &CmdL, bool const RevDepends)
 	       std::cout << Trg.FullName(true);
 	    if (ShowVersion == true && D->Version != 0)
 	       std::cout << " (" << pkgCache::CompTypeDeb(D->CompareOp) << ' ' << D.TargetVer() << ')';
-	    std::cout << std::endl;
+	    std::cout << '\n';
 
 	    if (Recurse == true && Shown[Trg->ID] == false)
 	    {
@@ -114,7 +144,7 @@ static bool ShowDepends(CommandLine &CmdL, bool const RevDepends)
 	       if (V != Cache->VerP + V.ParentPkg()->VersionList ||
 		   V->ParentPkg == D->Package)
 		  continue;
-	       std::cout << "    " << V.ParentPkg().FullName(true) << std::endl;
+	       std::cout << "    " << V.ParentPkg().FullName(true) << '\n';
 
 	       if (Recurse == true && Shown[V.ParentPkg()->ID] == false)
 	       {
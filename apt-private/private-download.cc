@@ -96,6 +96,11 @@ bool AcquireRun(pkgAcquire &Fetcher, int const PulseInterval, bool * const Failu
    if (res == pkgAcquire::Failed)
       return false;
 
+   return AcquireCheck(Fetcher, Failure, TransientNetworkFailure);
+}
+									/*}}}*/
+bool AcquireCheck(pkgAcquire &Fetcher, bool * const Failure, bool * const TransientNetworkFailure)/*{{{*/
+{
    for (pkgAcquire::ItemIterator I = Fetcher.ItemsBegin();
 	I != Fetcher.ItemsEnd(); ++I)
    {
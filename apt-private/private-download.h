@@ -17,6 +17,8 @@ bool CheckAuth(pkgAcquire& Fetcher, bool const PromptUser);
 bool AuthPrompt(std::vector<std::string> const &UntrustedList, bool const PromptUser);
 
 APT_PUBLIC bool AcquireRun(pkgAcquire &Fetcher, int const PulseInterval, bool * const Failure, bool * const TransientNetworkFailure);
+// Report the items of a fetcher which has run already which aren't complete
+bool AcquireCheck(pkgAcquire &Fetcher, bool * const Failure, bool * const TransientNetworkFailure);
 
 bool CheckFreeSpaceBeforeDownload(std::string const &Dir, unsigned long long FetchBytes);
 
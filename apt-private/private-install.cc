@@ -22,9 +22,13 @@
 #include <apt-pkg/upgrade.h>
 
 #include <algorithm>
+#include <condition_variable>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <set>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include <stdlib.h>
 #include <string.h>
@@ -111,6 +115,150 @@ static void RemoveDownloadNeedingItemsFromFetcher(pkgAcquire &Fetcher, bool &Tra
       I = Fetcher.ItemsBegin();
    }
 }
+// ArchiveStream - Fetch the archives while they are installed		/*{{{*/
+/* The fetcher runs on a thread of its own while the package manager waits
+   for each archive right before it hands it to dpkg. As dpkg shares the
+   terminal only the line based progress messages are shown. */
+class APT_HIDDEN ArchiveStream : public AcqTextStatus
+{
+   pkgAcquire &Fetcher;
+   struct Archive
+   {
+      std::string File;
+      bool Done = false;
+   };
+   // keyed by the filename the archive will be stored as
+   std::unordered_map<std::string, Archive> Archives;
+   std::unordered_map<pkgAcquire::Item const *, Archive *> Items;
+   std::mutex Lock;
+   std::condition_variable Changed;
+   bool Started = false;
+   bool Finished = false;
+   bool Cancelled = false;
+   pkgAcquire::RunResult Result = pkgAcquire::Continue;
+   // messages of the fetcher thread
+   std::vector<std::pair<bool, std::string>> Messages;
+   std::thread Runner;
+
+   void Run()
+   {
+      auto const Res = Fetcher.Run();
+      std::vector<std::pair<bool, std::string>> Msgs;
+      std::string Msg;
+      while (_error->empty() == false)
+      {
+	 bool const Error = _error->PopMessage(Msg);
+	 Msgs.emplace_back(Error, Msg);
+      }
+      std::lock_guard<std::mutex> Guard(Lock);
+      Result = Res;
+      Messages = std::move(Msgs);
+      Finished = true;
+      Changed.notify_all();
+   }
+
+   public:
+   void Start() override
+   {
+      AcqTextStatus::Start();
+      std::lock_guard<std::mutex> Guard(Lock);
+      Started = true;
+      Changed.notify_all();
+   }
+   void Done(pkgAcquire::ItemDesc &Itm) override
+   {
+      AcqTextStatus::Done(Itm);
+      auto const A = Items.find(Itm.Owner);
+      if (A == Items.end())
+	 return;
+      std::lock_guard<std::mutex> Guard(Lock);
+      A->second->File = Itm.Owner->DestFile;
+      A->second->Done = true;
+      Changed.notify_all();
+   }
+   bool Pulse(pkgAcquire *Owner) override
+   {
+      if (AcqTextStatus::Pulse(Owner) == false)
+	 return false;
+      std::lock_guard<std::mutex> Guard(Lock);
+      return Cancelled == false;
+   }
+
+   bool Ready(std::string &File, bool const Wait)
+   {
+      auto const A = Archives.find(File);
+      if (A == Archives.end())
+	 return true;
+      std::unique_lock<std::mutex> Guard(Lock);
+      if (Wait == true)
+	 Changed.wait(Guard, [&] { return A->second.Done || Finished; });
+      if (A->second.Done == false)
+	 return false;
+      File = A->second.File;
+      return true;
+   }
+
+   // starts fetching, the archives have to stay where they are queued until then
+   bool Begin()
+   {
+      for (auto I = Fetcher.ItemsBegin(); I != Fetcher.ItemsEnd(); ++I)
+      {
+	 if (dynamic_cast<pkgAcqArchive *>(*I) == nullptr ||
+	     ((*I)->Status == pkgAcquire::Item::StatDone && (*I)->Complete == true))
+	    continue;
+	 Items[*I] = &Archives[flCombine(_config->FindDir("Dir::Cache::Archives"), flNotDir((*I)->DestFile))];
+      }
+      Fetcher.SetLog(this);
+      Runner = std::thread(&ArchiveStream::Run, this);
+      std::unique_lock<std::mutex> Guard(Lock);
+      // the fetcher changes the privileges of the process while it starts up
+      Changed.wait(Guard, [&] { return Started || Finished; });
+      return true;
+   }
+   // waits for the fetcher, which gives up on the remaining archives if Cancel is set
+   bool End(bool const Cancel)
+   {
+      {
+	 std::lock_guard<std::mutex> Guard(Lock);
+	 Cancelled = Cancel;
+      }
+      Runner.join();
+      for (auto const &M : Messages)
+	 _error->Insert(M.first ? GlobalError::ERROR : GlobalError::WARNING, "%s", M.second.c_str());
+      if (Result == pkgAcquire::Failed)
+	 return false;
+      bool Failed = false, Transient = false;
+      return AcquireCheck(Fetcher, &Failed, &Transient) && Failed == false;
+   }
+
+   explicit ArchiveStream(pkgAcquire &Fetcher)
+      : AcqTextStatus(std::cout, ::ScreenWidth, std::max(1, _config->FindI("quiet", 0))), Fetcher(Fetcher) {}
+   ~ArchiveStream()
+   {
+      if (Runner.joinable())
+	 End(true);
+   }
+};
+static pkgPackageManager::OrderResult InstallWhileFetching(ArchiveStream &Stream, pkgPackageManager &PM)
+{
+   PM.StreamArchives([&Stream](std::string &File, bool const Wait) { return Stream.Ready(File, Wait); });
+   // the order is computed before the fetcher starts changing where the archives are
+   auto Res = PM.DoInstallPreFork();
+   if (Res == pkgPackageManager::Failed || Stream.Begin() == false)
+      return pkgPackageManager::Failed;
+
+   auto const progress = APT::Progress::PackageManagerProgressFactory();
+   _system->UnLockInner();
+   Res = PM.DoInstallPostFork(progress);
+   delete progress;
+
+   bool const Fetched = Stream.End(Res == pkgPackageManager::Failed);
+   PM.StreamArchives(nullptr);
+   if (Fetched == false)
+      return pkgPackageManager::Failed;
+   return Res;
+}
+									/*}}}*/
 bool InstallPackages(CacheFile &Cache, APT::PackageVector &HeldBackPackages, bool ShwKept, bool Ask, bool Safety, std::string const &Hook, CommandLine const &CmdL)
 {
    if (not RunScripts("APT::Install::Pre-Invoke"))
@@ -337,7 +485,25 @@ bool InstallPackages(CacheFile &Cache, APT::PackageVector &HeldBackPackages, boo
 
    // Run it
    bool Failed = false;
-   while (1)
+   auto Res = pkgPackageManager::Incomplete;
+   std::unique_ptr<ArchiveStream> Stream;
+   if (_config->FindB("APT::Get::Streaming-Install", false) == true && FetchBytes != 0 &&
+       _config->FindB("APT::Get::Download-Only", false) == false &&
+       _config->FindB("APT::Get::Fix-Missing", false) == false)
+   {
+      Stream.reset(new ArchiveStream(Fetcher));
+      Res = InstallWhileFetching(*Stream, *PM);
+      if (Res == pkgPackageManager::Failed || _error->PendingError() == true)
+	 return false;
+      if (Res != pkgPackageManager::Completed)
+      {
+	 _system->LockInner();
+	 Fetcher.Shutdown();
+	 if (PM->GetArchives(&Fetcher,List,&Recs) == false)
+	    return false;
+      }
+   }
+   while (Res != pkgPackageManager::Completed)
    {
       bool Transient = false;
       if (AcquireRun(Fetcher, 0, &Failed, &Transient) == false)
@@ -366,7 +532,7 @@ bool InstallPackages(CacheFile &Cache, APT::PackageVector &HeldBackPackages, boo
 
       auto const progress = APT::Progress::PackageManagerProgressFactory();
       _system->UnLockInner();
-      pkgPackageManager::OrderResult const Res = PM->DoInstall(progress);
+      Res = PM->DoInstall(progress);
       delete progress;
 
       if (Res == pkgPackageManager::Failed || _error->PendingError() == true)
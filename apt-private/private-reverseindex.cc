@@ -0,0 +1,74 @@
+// Includes								/*{{{*/
+#include <config.h>
+
+#include <apt-pkg/pkgcache.h>
+
+#include <apt-private/private-reverseindex.h>
+
+#include <functional>
+#include <vector>
+
+#include <stdint.h>
+									/*}}}*/
+
+ReverseDependencyIndex::ReverseDependencyIndex(pkgCache &Cache) : Cache(Cache)/*{{{*/
+{
+   auto const PackageCount = Cache.Head().PackageCount;
+   Packages.resize(PackageCount);
+   for (auto Pkg = Cache.PkgBegin(); Pkg.end() == false; ++Pkg)
+      Packages[Pkg->ID] = Pkg.MapPointer();
+
+   EdgeOffsets.reserve(PackageCount + 1);
+   Edges.reserve(Cache.Head().DependsCount);
+   ProvideOffsets.reserve(PackageCount + 1);
+   Provides.reserve(Cache.Head().ProvidesCount);
+   for (map_id_t ID = 0; ID < PackageCount; ++ID)
+   {
+      EdgeOffsets.push_back(Edges.size());
+      ProvideOffsets.push_back(Provides.size());
+      auto const Pkg = Package(ID);
+      for (auto D = Pkg.RevDependsList(); D.end() == false; ++D)
+	 Edges.push_back({D.MapPointer(), D.ParentPkg()->ID, D->Type, D.IsImplicit()});
+      for (auto Ver = Pkg.VersionList(); Ver.end() == false; ++Ver)
+	 for (auto Prv = Ver.ProvidesList(); Prv.end() == false; ++Prv)
+	    Provides.push_back(Prv.ParentPkg()->ID);
+   }
+   EdgeOffsets.push_back(Edges.size());
+   ProvideOffsets.push_back(Provides.size());
+}
+									/*}}}*/
+// ReverseDependencyIndex::Closure - breadth-first over the index	/*{{{*/
+std::vector<map_id_t> ReverseDependencyIndex::Closure(std::vector<map_id_t> const &Seeds,
+						      std::function<bool(Edge const &)> const &Follow) const
+{
+   std::vector<bool> Reached(Packages.size());
+   std::vector<map_id_t> Queue;
+   for (auto const ID : Seeds)
+      if (Reached[ID] == false)
+      {
+	 Reached[ID] = true;
+	 Queue.push_back(ID);
+      }
+   size_t const SeedCount = Queue.size();
+
+   auto const Visit = [&](map_id_t const Target) {
+      for (auto const &E : ReverseDepends(Target))
+      {
+	 if (Reached[E.Parent] || Follow(E) == false)
+	    continue;
+	 Reached[E.Parent] = true;
+	 Queue.push_back(E.Parent);
+      }
+   };
+   // the queue grows while we walk it
+   for (size_t I = 0; I < Queue.size(); ++I)
+   {
+      map_id_t const ID = Queue[I];
+      Visit(ID);
+      for (auto const Name : ProvidedNames(ID))
+	 Visit(Name);
+   }
+   Queue.erase(Queue.begin(), Queue.begin() + SeedCount);
+   return Queue;
+}
+									/*}}}*/
@@ -0,0 +1,80 @@
+#ifndef APT_PRIVATE_REVERSEINDEX_H
+#define APT_PRIVATE_REVERSEINDEX_H
+
+#include <apt-pkg/pkgcache.h>
+
+#include <functional>
+#include <vector>
+
+#include <stdint.h>
+
+/* The reverse dependencies of all packages of the cache in one array,
+   grouped by the package they target (in the order of its RevDependsList)
+   and addressed by package ID like a compressed sparse row matrix. Next to
+   it the names provided by the versions of each package are stored the
+   same way, so that transitive queries read consecutive memory instead of
+   chasing the lists through the cache. The index is built in one pass
+   over the cache the first time a command needs it. */
+class ReverseDependencyIndex
+{
+   public:
+   struct Edge
+   {
+      map_pointer<pkgCache::Dependency> Dep;
+      // ID of the package the dependency belongs to
+      map_id_t Parent;
+      uint8_t Type;
+      bool Implicit;
+   };
+   template <typename T>
+   struct Range
+   {
+      T const *Begin;
+      T const *End;
+      T const *begin() const { return Begin; }
+      T const *end() const { return End; }
+   };
+
+   private:
+   pkgCache &Cache;
+   std::vector<map_pointer<pkgCache::Package>> Packages;
+   std::vector<uint32_t> EdgeOffsets;
+   std::vector<Edge> Edges;
+   std::vector<uint32_t> ProvideOffsets;
+   std::vector<map_id_t> Provides;
+
+   public:
+   pkgCache::PkgIterator Package(map_id_t const ID) const
+   {
+      return pkgCache::PkgIterator(Cache, Cache.PkgP + Packages[ID]);
+   }
+   pkgCache::DepIterator Dependency(Edge const &E) const
+   {
+      return pkgCache::DepIterator(Cache, Cache.DepP + E.Dep);
+   }
+   /** \brief the dependencies targeting the package with the given ID */
+   Range<Edge> ReverseDepends(map_id_t const ID) const
+   {
+      return {Edges.data() + EdgeOffsets[ID], Edges.data() + EdgeOffsets[ID + 1]};
+   }
+   /** \brief IDs of the names provided by any version of the package */
+   Range<map_id_t> ProvidedNames(map_id_t const ID) const
+   {
+      return {Provides.data() + ProvideOffsets[ID], Provides.data() + ProvideOffsets[ID + 1]};
+   }
+
+   /** \brief packages depending on the seeds directly or transitively
+    *
+    * A package is reached if one of its dependencies accepted by \b Follow
+    * targets the seeds, a package reached before or a name provided by
+    * one of those. The IDs are returned in the order they were reached
+    * in, without the seeds.
+    */
+   std::vector<map_id_t> Closure(std::vector<map_id_t> const &Seeds, std::function<bool(Edge const &)> const &Follow) const;
+
+   explicit ReverseDependencyIndex(pkgCache &Cache);
+   ReverseDependencyIndex(ReverseDependencyIndex const &) = delete;
+   ReverseDependencyIndex &operator=(ReverseDependencyIndex const &) = delete;
+};
+
+#endif
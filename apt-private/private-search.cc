@@ -18,6 +18,7 @@
 #include <apt-private/private-json-hooks.h>
 #include <apt-private/private-output.h>
 #include <apt-private/private-search.h>
+#include <apt-private/private-searchindex.h>
 #include <apt-private/private-show.h>
 
 #include <iostream>
@@ -82,6 +83,12 @@ static bool FullTextSearch(CommandLine &CmdL)				/*{{{*/
       Patterns.push_back(pattern);
    }
 
+   bool const NamesOnly = _config->FindB("APT::Cache::NamesOnly", false);
+   SearchIndex Index;
+   if (NamesOnly == false && Index.Open(CacheFile))
+      for (unsigned int I = 0; I != NumPatterns; ++I)
+	 Index.AddPattern(CmdL.FileList[I + 1]);
+
    std::map<std::string, std::string> output_map;
 
    LocalitySortedVersionSet bag;
@@ -100,7 +107,6 @@ static bool FullTextSearch(CommandLine &CmdL)				/*{{{*/
    else
       format += "  ${LongDescription}\n";
 
-   bool const NamesOnly = _config->FindB("APT::Cache::NamesOnly", false);
    int Done = 0;
    std::vector<bool> PkgsDone(Cache->Head().PackageCount, false);
    for ( ;V != bag.end(); ++V)
@@ -114,10 +120,19 @@ static bool FullTextSearch(CommandLine &CmdL)				/*{{{*/
       if (PkgsDone[P->ID] == true)
 	 continue;
 
+      char const * const PkgName = P.Name();
       std::vector<std::string> PkgDescriptions;
       if (not NamesOnly)
       {
-         for (auto &Desc: TranslatedDescriptionsList(V))
+         auto const Descriptions = TranslatedDescriptionsList(V);
+         // skip reading the descriptions if the index rules out a match
+         bool possible = true;
+         for (size_t I = 0; possible && I < Patterns.size(); ++I)
+            possible = Index.MayMatch(I, Descriptions) || regexec(&Patterns[I], PkgName, 0, 0, 0) == 0;
+         if (not possible)
+            continue;
+
+         for (auto &Desc: Descriptions)
          {
             pkgRecords::Parser &parser = records.Lookup(Desc.FileList());
             PkgDescriptions.push_back(parser.LongDesc());
@@ -126,7 +141,6 @@ static bool FullTextSearch(CommandLine &CmdL)				/*{{{*/
 
       bool all_found = true;
 
-      char const * const PkgName = P.Name();
       std::vector<bool> SkipDescription(PkgDescriptions.size(), false);
       for (std::vector<regex_t>::const_iterator pattern = Patterns.begin();
            pattern != Patterns.end(); ++pattern)
@@ -254,6 +268,12 @@ static bool Search(CommandLine &CmdL)
       return false;
    }
    
+   bool const NamesOnly = _config->FindB("APT::Cache::NamesOnly",false);
+   SearchIndex Index;
+   if (NamesOnly == false && Index.Open(CacheFile))
+      for (unsigned I = 0; I != NumPatterns; ++I)
+	 Index.AddPattern(CmdL.FileList[I + 1]);
+
    size_t const descCount = Cache->HeaderP->GroupCount + 1;
    ExDescFile *DFList = new ExDescFile[descCount];
 
@@ -261,7 +281,6 @@ static bool Search(CommandLine &CmdL)
    memset(PatternMatch,false,sizeof(*PatternMatch) * descCount * NumPatterns);
 
    // Map versions that we want to write out onto the VerList array.
-   bool const NamesOnly = _config->FindB("APT::Cache::NamesOnly",false);
    for (pkgCache::GrpIterator G = Cache->GrpBegin(); G.end() == false; ++G)
    {
       size_t const PatternOffset = G->ID * NumPatterns;
@@ -335,8 +354,16 @@ static bool Search(CommandLine &CmdL)
       size_t const PatternOffset = J->ID * NumPatterns;
       if (not NamesOnly)
       {
+         auto const Descriptions = TranslatedDescriptionsList(J->V);
+         // skip reading the descriptions if the index rules out a match
+         bool possible = true;
+         for (unsigned I = 0; possible && I < NumPatterns; ++I)
+            possible = PatternMatch[PatternOffset + I] || Index.MayMatch(I, Descriptions);
+         if (not possible)
+            continue;
+
          std::vector<std::string> PkgDescriptions;
-         for (auto &Desc: TranslatedDescriptionsList(J->V))
+         for (auto &Desc: Descriptions)
          {
             pkgRecords::Parser &parser = Recs.Lookup(Desc.FileList());
             PkgDescriptions.push_back(parser.LongDesc());
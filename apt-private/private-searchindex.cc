@@ -0,0 +1,415 @@
+// Includes								/*{{{*/
+#include <config.h>
+
+#include <apt-pkg/aptconfiguration.h>
+#include <apt-pkg/cachefile.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/pkgcache.h>
+#include <apt-pkg/pkgrecords.h>
+#include <apt-pkg/strutl.h>
+
+#include <apt-private/private-searchindex.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <langinfo.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <apti18n.h>
+									/*}}}*/
+
+/* The file consists of the header, WordCount + 1 offsets into the
+   postings, the sorted words each terminated by \0 and the postings: for
+   each word the IDs of the descriptions containing it, delta encoded as
+   variable length integers. A word is a run of ASCII letters and digits
+   in lowercase, so a pattern can only match a description if every such
+   run it requires is part of a word of the description. */
+struct SearchIndexHeader
+{
+   char Signature[8];
+   uint32_t Version;
+   uint32_t CacheHash;
+   uint32_t DescriptionCount;
+   uint32_t Environment;
+   uint32_t WordCount;
+   uint32_t WordsSize;
+   uint32_t PostingsSize;
+   uint32_t Padding;
+};
+static char const SearchIndexSignature[8] = "APTSRCH";
+static uint32_t const SearchIndexVersion = 1;
+
+static std::string IndexFileName()					/*{{{*/
+{
+   if (_config->FindB("APT::Cache::Search::Index", true) == false ||
+       _config->FindFile("Dir::Cache::pkgcache").empty())
+      return "";
+   return _config->FindFile("Dir::Cache::searchindex");
+}
+									/*}}}*/
+static uint32_t HashString(uint32_t Hash, std::string const &Str)	/*{{{*/
+{
+   for (auto const C : Str)
+      Hash = 33 * Hash + static_cast<unsigned char>(C);
+   return Hash;
+}
+									/*}}}*/
+// Environment - the long descriptions depend on languages and codeset	/*{{{*/
+static uint32_t Environment()
+{
+   std::string Env = nl_langinfo(CODESET);
+   for (auto const &Lang : APT::Configuration::getLanguages())
+      Env.append(",").append(Lang);
+   return HashString(5381, Env);
+}
+									/*}}}*/
+// CacheHash - identify the cache by the files it was built from	/*{{{*/
+static uint32_t CacheHash(pkgCache &Cache)
+{
+   uint32_t Hash = HashString(5381, std::to_string(Cache.HeaderP->CacheFileSize));
+   for (auto File = Cache.FileBegin(); File.end() == false; ++File)
+   {
+      if (File.FileName() != nullptr)
+	 Hash = HashString(Hash, File.FileName());
+      Hash = HashString(Hash, std::to_string(File->Size) + ':' + std::to_string(File->mtime));
+   }
+   return Hash;
+}
+									/*}}}*/
+static bool IsWordChar(char const C)					/*{{{*/
+{
+   return isalpha_ascii(C) || (C >= '0' && C <= '9');
+}
+									/*}}}*/
+// RequiredWords - word parts every match of the regex has to contain	/*{{{*/
+// ---------------------------------------------------------------------
+/* This is deliberately conservative: everything in groups or brackets
+   and characters made optional by a quantifier are ignored and if the
+   pattern has alternatives on the top level nothing is required. */
+static char const *SkipBracket(char const *P)
+{
+   ++P;
+   if (*P == '^')
+      ++P;
+   if (*P == ']')
+      ++P;
+   for (; *P != '\0' && *P != ']'; ++P)
+      if (*P == '[' && (P[1] == ':' || P[1] == '.' || P[1] == '='))
+      {
+	 char const End = P[1];
+	 for (P += 2; *P != '\0' && (*P != End || P[1] != ']'); ++P)
+	    ;
+	 if (*P == '\0')
+	    break;
+	 ++P;
+      }
+   return *P == '\0' ? P - 1 : P;
+}
+static char const *SkipGroup(char const *P)
+{
+   int Depth = 0;
+   for (; *P != '\0'; ++P)
+   {
+      if (*P == '\\')
+      {
+	 if (P[1] == '\0')
+	    break;
+	 ++P;
+      }
+      else if (*P == '[')
+	 P = SkipBracket(P);
+      else if (*P == '(')
+	 ++Depth;
+      else if (*P == ')' && --Depth == 0)
+	 return P;
+   }
+   return P - 1;
+}
+static std::vector<std::string> RequiredWords(char const *Pattern)
+{
+   std::vector<std::string> Words;
+   std::string Word;
+   auto const Flush = [&]() {
+      if (Word.empty() == false)
+	 Words.push_back(Word);
+      Word.clear();
+   };
+   for (char const *P = Pattern; *P != '\0'; ++P)
+   {
+      switch (*P)
+      {
+      case '|':
+	 return {};
+      case '+':
+	 // the character before may be repeated
+	 Flush();
+	 break;
+      case '*':
+      case '?':
+      case '{':
+	 // the character before is optional
+	 if (Word.empty() == false)
+	    Word.pop_back();
+	 Flush();
+	 if (*P == '{')
+	 {
+	    for (; *P != '\0' && *P != '}'; ++P)
+	       ;
+	    if (*P == '\0')
+	       --P;
+	 }
+	 break;
+      case '(':
+	 Flush();
+	 P = SkipGroup(P);
+	 break;
+      case '[':
+	 Flush();
+	 P = SkipBracket(P);
+	 break;
+      case '\\':
+	 Flush();
+	 if (P[1] != '\0')
+	    ++P;
+	 break;
+      default:
+	 if (IsWordChar(*P))
+	    Word.push_back(tolower_ascii(*P));
+	 else
+	    Flush();
+      }
+   }
+   Flush();
+   std::sort(Words.begin(), Words.end());
+   Words.erase(std::unique(Words.begin(), Words.end()), Words.end());
+   return Words;
+}
+									/*}}}*/
+// SearchIndex::Build - index the long descriptions of the cache	/*{{{*/
+bool SearchIndex::Build(pkgCacheFile &CacheFile)
+{
+   std::string const FileName = IndexFileName();
+   if (FileName.empty())
+      return true;
+   pkgCache * const Cache = CacheFile.GetPkgCache();
+   if (Cache == nullptr)
+      return false;
+   bool const Debug = _config->FindB("Debug::SearchIndex", false);
+
+   // read the descriptions in the order they are in the files
+   std::vector<std::pair<pkgCache::DescFile *, map_id_t>> Descs;
+   std::vector<bool> Seen(Cache->HeaderP->DescriptionCount, false);
+   for (auto Pkg = Cache->PkgBegin(); Pkg.end() == false; ++Pkg)
+      for (auto Ver = Pkg.VersionList(); Ver.end() == false; ++Ver)
+	 for (auto Desc = Ver.DescriptionList(); Desc.end() == false; ++Desc)
+	 {
+	    if (Seen[Desc->ID] || Desc.FileList().end())
+	       continue;
+	    Seen[Desc->ID] = true;
+	    Descs.emplace_back(Desc.FileList(), Desc->ID);
+	 }
+   std::sort(Descs.begin(), Descs.end(), [](auto const &A, auto const &B) {
+      if (A.first->File != B.first->File)
+	 return A.first->File < B.first->File;
+      return A.first->Offset < B.first->Offset;
+   });
+
+   pkgRecords Recs(*Cache);
+   std::unordered_map<std::string, std::vector<uint32_t>> Postings;
+   std::vector<std::string> DescWords;
+   for (auto const &D : Descs)
+   {
+      std::string const Text = Recs.Lookup(pkgCache::DescFileIterator(*Cache, D.first)).LongDesc();
+      DescWords.clear();
+      for (auto I = Text.begin(); I != Text.end();)
+      {
+	 auto const Start = std::find_if(I, Text.end(), IsWordChar);
+	 I = std::find_if_not(Start, Text.end(), IsWordChar);
+	 if (Start == I)
+	    continue;
+	 DescWords.emplace_back(Start, I);
+	 std::transform(DescWords.back().begin(), DescWords.back().end(), DescWords.back().begin(), tolower_ascii_unsafe);
+      }
+      std::sort(DescWords.begin(), DescWords.end());
+      DescWords.erase(std::unique(DescWords.begin(), DescWords.end()), DescWords.end());
+      for (auto const &W : DescWords)
+	 Postings[W].push_back(D.second);
+   }
+   if (_error->PendingError())
+      return false;
+
+   std::vector<std::pair<std::string, std::vector<uint32_t>>> Words(std::make_move_iterator(Postings.begin()), std::make_move_iterator(Postings.end()));
+   Postings.clear();
+   std::sort(Words.begin(), Words.end());
+   std::vector<uint32_t> Offsets;
+   Offsets.reserve(Words.size() + 1);
+   std::string WordList, PostingList;
+   for (auto &W : Words)
+   {
+      WordList.append(W.first).append(1, '\0');
+      Offsets.push_back(PostingList.size());
+      std::sort(W.second.begin(), W.second.end());
+      uint32_t Last = 0;
+      for (auto const ID : W.second)
+      {
+	 for (uint32_t Delta = ID - Last; true; Delta >>= 7)
+	 {
+	    if (Delta < 0x80)
+	    {
+	       PostingList.push_back(Delta);
+	       break;
+	    }
+	    PostingList.push_back((Delta & 0x7f) | 0x80);
+	 }
+	 Last = ID;
+      }
+   }
+   Offsets.push_back(PostingList.size());
+
+   SearchIndexHeader Header;
+   memset(&Header, 0, sizeof(Header));
+   memcpy(Header.Signature, SearchIndexSignature, sizeof(Header.Signature));
+   Header.Version = SearchIndexVersion;
+   Header.CacheHash = CacheHash(*Cache);
+   Header.DescriptionCount = Cache->HeaderP->DescriptionCount;
+   Header.Environment = Environment();
+   Header.WordCount = Words.size();
+   Header.WordsSize = WordList.size();
+   Header.PostingsSize = PostingList.size();
+
+   FileFd Fd(FileName, FileFd::WriteAtomic, 0644);
+   if (Fd.IsOpen() == false ||
+       Fd.Write(&Header, sizeof(Header)) == false ||
+       Fd.Write(Offsets.data(), Offsets.size() * sizeof(Offsets[0])) == false ||
+       Fd.Write(WordList.data(), WordList.size()) == false ||
+       Fd.Write(PostingList.data(), PostingList.size()) == false ||
+       Fd.Close() == false)
+      return false;
+   if (Debug)
+      std::clog << "Built search index " << FileName << " with " << Words.size() << " words for "
+		<< Descs.size() << " descriptions" << std::endl;
+   return true;
+}
+									/*}}}*/
+// SearchIndex::Load - map the index if it is valid for the cache	/*{{{*/
+bool SearchIndex::Load(pkgCacheFile &CacheFile, std::string const &FileName)
+{
+   pkgCache * const Cache = CacheFile.GetPkgCache();
+   if (Cache == nullptr || RealFileExists(FileName) == false)
+      return false;
+   FileFd File(FileName, FileFd::ReadOnly);
+   if (File.IsOpen() == false || File.Size() < sizeof(SearchIndexHeader))
+      return false;
+   size_t const Size = File.Size();
+   void * const Mapped = mmap(nullptr, Size, PROT_READ, MAP_SHARED, File.Fd(), 0);
+   if (Mapped == MAP_FAILED)
+      return _error->Errno("mmap", _("Couldn't make mmap of %llu bytes"), static_cast<unsigned long long>(Size));
+   auto const Header = static_cast<SearchIndexHeader const *>(Mapped);
+   if (memcmp(Header->Signature, SearchIndexSignature, sizeof(Header->Signature)) != 0 ||
+       Header->Version != SearchIndexVersion ||
+       Header->CacheHash != CacheHash(*Cache) ||
+       Header->DescriptionCount != Cache->HeaderP->DescriptionCount ||
+       Header->Environment != Environment() ||
+       Size != sizeof(*Header) + (Header->WordCount + 1ull) * sizeof(uint32_t) + Header->WordsSize + Header->PostingsSize)
+   {
+      munmap(Mapped, Size);
+      return false;
+   }
+   Map = Mapped;
+   MapSize = Size;
+   return true;
+}
+									/*}}}*/
+// SearchIndex::Open - use the index, building it if it is outdated	/*{{{*/
+bool SearchIndex::Open(pkgCacheFile &CacheFile)
+{
+   std::string const FileName = IndexFileName();
+   if (FileName.empty())
+      return false;
+   _error->PushToStack();
+   bool Okay = Load(CacheFile, FileName);
+   if (Okay == false && access(flNotFile(FileName).c_str(), W_OK) == 0)
+      Okay = Build(CacheFile) && Load(CacheFile, FileName);
+   if (_config->FindB("Debug::SearchIndex", false))
+   {
+      if (Okay == false)
+	 std::clog << "Search index " << FileName << " is not usable" << std::endl;
+      _error->DumpErrors(std::clog, GlobalError::DEBUG, false);
+   }
+   _error->RevertToStack();
+   return Okay;
+}
+									/*}}}*/
+// SearchIndex::AddPattern - find the candidates for a pattern		/*{{{*/
+void SearchIndex::AddPattern(char const *Pattern)
+{
+   Candidates.emplace_back();
+   if (IsOpen() == false)
+      return;
+   auto const Header = static_cast<SearchIndexHeader const *>(Map);
+   auto const Offsets = reinterpret_cast<uint32_t const *>(Header + 1);
+   auto const WordList = reinterpret_cast<char const *>(Offsets + Header->WordCount + 1);
+   auto const PostingList = reinterpret_cast<unsigned char const *>(WordList + Header->WordsSize);
+
+   auto &Matches = Candidates.back();
+   for (auto const &Required : RequiredWords(Pattern))
+   {
+      std::vector<bool> WordMatches(Header->DescriptionCount, false);
+      char const *W = WordList;
+      for (uint32_t I = 0; I < Header->WordCount; ++I)
+      {
+	 size_t const Length = strlen(W);
+	 if (Length >= Required.length() && memmem(W, Length, Required.data(), Required.length()) != nullptr)
+	 {
+	    uint32_t ID = 0;
+	    for (auto P = PostingList + Offsets[I]; P < PostingList + Offsets[I + 1];)
+	    {
+	       uint32_t Delta = 0;
+	       for (unsigned int Shift = 0; P < PostingList + Offsets[I + 1]; Shift += 7)
+	       {
+		  Delta |= static_cast<uint32_t>(*P & 0x7f) << Shift;
+		  if ((*P++ & 0x80) == 0)
+		     break;
+	       }
+	       ID += Delta;
+	       if (ID < WordMatches.size())
+		  WordMatches[ID] = true;
+	    }
+	 }
+	 W += Length + 1;
+      }
+      if (Matches.empty())
+	 Matches.swap(WordMatches);
+      else
+	 for (size_t I = 0; I < Matches.size(); ++I)
+	    Matches[I] = Matches[I] && WordMatches[I];
+   }
+}
+									/*}}}*/
+// SearchIndex::MayMatch - check the candidates of a pattern		/*{{{*/
+bool SearchIndex::MayMatch(size_t const Pattern, std::vector<pkgCache::DescIterator> const &Descriptions) const
+{
+   if (Pattern >= Candidates.size() || Candidates[Pattern].empty())
+      return true;
+   auto const &Matches = Candidates[Pattern];
+   return std::any_of(Descriptions.begin(), Descriptions.end(), [&](auto const &Desc) {
+      return Desc->ID >= Matches.size() || Matches[Desc->ID];
+   });
+}
+									/*}}}*/
+SearchIndex::SearchIndex() = default;
+SearchIndex::~SearchIndex()
+{
+   if (Map != nullptr)
+      munmap(Map, MapSize);
+}
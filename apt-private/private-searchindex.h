@@ -0,0 +1,43 @@
+#ifndef APT_PRIVATE_SEARCHINDEX_H
+#define APT_PRIVATE_SEARCHINDEX_H
+
+#include <apt-pkg/pkgcache.h>
+
+#include <string>
+#include <vector>
+
+class pkgCacheFile;
+
+/* Word index over the long descriptions of the cache, stored next to the
+   pkgcache.bin it was built for. Searches use it to skip reading the
+   descriptions of packages which can not match a pattern; the regex
+   is still run on all remaining candidates. */
+class SearchIndex
+{
+   void *Map = nullptr;
+   size_t MapSize = 0;
+   // for each added pattern the descriptions which may match it
+   std::vector<std::vector<bool>> Candidates;
+
+   bool Load(pkgCacheFile &CacheFile, std::string const &FileName);
+
+   public:
+   /** \brief (re)builds the index for the cache if it is enabled */
+   static bool Build(pkgCacheFile &CacheFile);
+
+   /** \brief opens a valid index, building it first if possible */
+   bool Open(pkgCacheFile &CacheFile);
+   bool IsOpen() const { return Map != nullptr; }
+
+   /** \brief adds the next pattern to check against, see #MayMatch */
+   void AddPattern(char const *Pattern);
+   /** \brief if one of the descriptions may match the pattern added as \b Pattern */
+   bool MayMatch(size_t Pattern, std::vector<pkgCache::DescIterator> const &Descriptions) const;
+
+   SearchIndex();
+   SearchIndex(SearchIndex const &) = delete;
+   SearchIndex &operator=(SearchIndex const &) = delete;
+   ~SearchIndex();
+};
+
+#endif
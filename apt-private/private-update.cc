@@ -17,6 +17,7 @@
 #include <apt-private/private-cachefile.h>
 #include <apt-private/private-download.h>
 #include <apt-private/private-output.h>
+#include <apt-private/private-searchindex.h>
 #include <apt-private/private-update.h>
 
 #include <ostream>
@@ -99,11 +100,23 @@ bool DoUpdate()
    if (_config->FindB("pkgCacheFile::Generate", true) == false)
       return true;
 
-   // Rebuild the cache.
-   pkgCacheFile::RemoveCaches();
+   // Rebuild the cache, if possible by updating the existing source cache
+   if (_config->FindB("APT::Cache-Incremental", true) == false)
+      pkgCacheFile::RemoveCaches();
+   else
+   {
+      std::string const pkgcache = _config->FindFile("Dir::cache::pkgcache");
+      if (pkgcache.empty() == false)
+	 RemoveFile("DoUpdate", pkgcache);
+   }
    if (Cache.BuildCaches(false) == false)
       return false;
 
+   // the search index is only an optimization, so failing to build it is fine
+   _error->PushToStack();
+   SearchIndex::Build(Cache);
+   _error->RevertToStack();
+
    bool const SLWarnings = _config->FindB("APT::Get::Update::SourceListWarnings", true);
    if (SLWarnings)
       List = Cache.GetSourceList();
@@ -308,6 +308,19 @@ static bool Stats(CommandLine &CmdL)
    cout << _("Total globbed strings: ") << stritems.size() << " (" << SizeToStr(Size) << ')' << endl;
    stritems.clear();
 
+   unsigned long StringTables = 0;
+   char const * const StringTypes[] = { _("Mixed strings: "), _("Version strings: "), _("Section strings: ") };
+   static_assert(APT_ARRAY_SIZE(StringTypes) == APT_ARRAY_SIZE(Cache->Head().StringTables), "Every string table needs a name");
+   for (size_t I = 0; I != APT_ARRAY_SIZE(StringTypes); ++I)
+   {
+      auto const &Table = Cache->Head().StringTables[I];
+      StringTables += Table.Size * sizeof(pkgCache::Header::StringTable::Slot);
+      double const HitRate = Table.Lookups == 0 ? 0 : 100.0 * Table.Hits / Table.Lookups;
+      ioprintf(cout, _("%s%u unique of %u stored, %.1f%% deduplicated (%sB saved)"),
+	       StringTypes[I], Table.Used, Table.Lookups, HitRate, SizeToStr(Table.BytesSaved).c_str());
+      cout << endl;
+   }
+
    unsigned long Slack = 0;
    for (int I = 0; I != 7; I++)
       Slack += Cache->Head().Pools[I].ItemSize*Cache->Head().Pools[I].Count;
@@ -327,7 +340,8 @@ static bool Stats(CommandLine &CmdL)
       APT_CACHESIZE(VerFileCount, VerFileSz) +
       APT_CACHESIZE(DescFileCount, DescFileSz) +
       APT_CACHESIZE(ProvidesCount, ProvidesSz) +
-      (2 * Cache->Head().GetHashTableSize() * sizeof(map_id_t));
+      (2 * Cache->Head().GetHashTableSize() * sizeof(map_id_t)) +
+      StringTables;
    cout << _("Total space accounted for: ") << SizeToStr(Total) << endl;
 #undef APT_CACHESIZE
 
@@ -27,6 +27,7 @@
 #include <climits>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 #include <locale.h>
@@ -40,6 +41,7 @@
 #include "cachedb.h"
 #include "multicompress.h"
 #include "override.h"
+#include "pdiff.h"
 #include "writer.h"
 
 #include <apti18n.h>
@@ -110,6 +112,10 @@ struct PackageMap
    string PathPrefix;
    unsigned int DeLinkLimit;
    mode_t Permissions;
+
+   // Patch history for Packages and Sources
+   bool PDiffs;
+   unsigned long PDiffMaxPatches;
    
    bool ContentsDone;
    bool PkgDone;
@@ -143,7 +149,8 @@ struct PackageMap
 		    unsigned long &Left);
    
    PackageMap() : IncludeArchAll(true), LongDesc(true), TransWriter(NULL),
-		  DeLinkLimit(0), Permissions(1), ContentsDone(false),
+		  DeLinkLimit(0), Permissions(1), PDiffs(false),
+		  PDiffMaxPatches(0), ContentsDone(false),
 		  PkgDone(false), SrcDone(false), ContentsMTime(0) {};
 };
 									/*}}}*/
@@ -174,6 +181,10 @@ void PackageMap::GetGeneral(Configuration &Setup,Configuration &Block)
    
    Permissions = Setup.FindI("Default::FileMode",0644);
 
+   PDiffs = Block.FindB("PDiffs", Setup.FindB("Default::PDiffs", false));
+   PDiffMaxPatches = Block.FindI("PDiffs::MaxPatches",
+				 Setup.FindI("Default::PDiffs::MaxPatches", 56));
+
    if (FLFile.empty() == false)
       FLFile = flCombine(Setup.Find("Dir::FileListDir"),FLFile);
    
@@ -197,6 +208,12 @@ bool PackageMap::GenPackages(Configuration &Setup,struct CacheDB::Stats &Stats)
 
    PkgDone = true;
    
+   // Save the old file to diff against before it is replaced
+   std::unique_ptr<PDiffWriter> PDiff;
+   if (PDiffs == true)
+      PDiff.reset(new PDiffWriter(flCombine(ArchiveDir,PkgFile),
+				  PkgCompress,PDiffMaxPatches,Permissions));
+
    // Create a package writer object.
    MultiCompress Comp(flCombine(ArchiveDir,PkgFile),
 		      PkgCompress,Permissions);
@@ -244,6 +261,11 @@ bool PackageMap::GenPackages(Configuration &Setup,struct CacheDB::Stats &Stats)
       c0out << endl;
       return _error->Error(_("Error processing directory %s"),BaseDir.c_str());
    }
+   if (PDiff != nullptr && PDiff->Finish() == false)
+   {
+      c0out << endl;
+      return _error->Error(_("Error processing directory %s"),BaseDir.c_str());
+   }
    
    if (Size != 0)
       c0out << " New "
@@ -281,6 +303,12 @@ bool PackageMap::GenSources(Configuration &Setup,struct CacheDB::Stats &Stats)
    struct timeval StartTime = GetTimevalFromSteadyClock();
    SrcDone = true;
    
+   // Save the old file to diff against before it is replaced
+   std::unique_ptr<PDiffWriter> PDiff;
+   if (PDiffs == true)
+      PDiff.reset(new PDiffWriter(flCombine(ArchiveDir,SrcFile),
+				  SrcCompress,PDiffMaxPatches,Permissions));
+
    // Create a package writer object.
    MultiCompress Comp(flCombine(ArchiveDir,SrcFile),
 		      SrcCompress,Permissions);
@@ -325,6 +353,11 @@ bool PackageMap::GenSources(Configuration &Setup,struct CacheDB::Stats &Stats)
       c0out << endl;
       return _error->Error(_("Error processing directory %s"),BaseDir.c_str());
    }
+   if (PDiff != nullptr && PDiff->Finish() == false)
+   {
+      c0out << endl;
+      return _error->Error(_("Error processing directory %s"),BaseDir.c_str());
+   }
       
    if (Size != 0)
       c0out << " New "
@@ -488,6 +521,8 @@ static void LoadTree(vector<PackageMap> &PkgList, std::vector<TranslationWriter*
    bool const LongDescription = Setup.FindB("Default::LongDescription",
 					_config->FindB("APT::FTPArchive::LongDescription", true));
    string const TranslationCompress = Setup.Find("Default::Translation::Compress",". gzip").c_str();
+   bool const PDiffs = Setup.FindB("Default::PDiffs", false);
+   unsigned long const PDiffMaxPatches = Setup.FindI("Default::PDiffs::MaxPatches", 56);
    bool const ConfIncludeArchAllExists = _config->Exists("APT::FTPArchive::IncludeArchitectureAll");
    bool const ConfIncludeArchAll = _config->FindB("APT::FTPArchive::IncludeArchitectureAll", true);
 
@@ -553,7 +588,8 @@ static void LoadTree(vector<PackageMap> &PkgList, std::vector<TranslationWriter*
 		  string const TranslationFile = flCombine(Setup.FindDir("Dir::ArchiveDir"),
 			SubstVar(Block.Find("Translation", DTrans.c_str()), Vars));
 		  string const TransCompress = Block.Find("Translation::Compress", TranslationCompress);
-		  TransWriter = new TranslationWriter(TranslationFile, TransCompress, Perms);
+		  TransWriter = new TranslationWriter(TranslationFile, TransCompress, Perms,
+			Block.FindB("PDiffs", PDiffs), Block.FindI("PDiffs::MaxPatches", PDiffMaxPatches));
 		  TransList.push_back(TransWriter);
 	       }
 	       Itm.TransWriter = TransWriter;
@@ -967,8 +1003,9 @@ static bool Generate(CommandLine &CmdL)
    c1out << "Done. " << SizeToStr(Stats.Bytes) << "B in " << Stats.Packages
          << " archives. Took " << TimeToStr(GetTimeDeltaSince(StartTime)) << endl;
 
+   // writes the Translation files and their patch history
    UnloadTree(TransList);
-   return true;
+   return _error->PendingError() == false;
 }
 
                                                                         /*}}}*/
@@ -31,7 +31,7 @@
 									/*}}}*/
 
 CacheDB::CacheDB(std::string const &DB)
-   : Dbp(0), Fd(NULL), DebFile(0)
+   : Fd(NULL), DebFile(0), Inspected(NULL)
 {
    TmpKey[0]='\0';
    ReadyDB(DB);
@@ -49,55 +49,29 @@ CacheDB::~CacheDB()
 /* This opens the DB2 file for caching package information */
 bool CacheDB::ReadyDB(std::string const &DB)
 {
-   int err;
-
    ReadOnly = _config->FindB("APT::FTPArchive::ReadOnlyDB",false);
    
    // Close the old DB
-   if (Dbp != 0) 
-      Dbp->close(Dbp,0);
+   bool const Failed = DBFailed();
+   Store.reset();
    
    /* Check if the DB was disabled while running and deal with a 
       corrupted DB */
-   if (DBFailed() == true)
+   if (Failed == true)
    {
       _error->Warning(_("DB was corrupted, file renamed to %s.old"),DBFile.c_str());
       rename(DBFile.c_str(),(DBFile+".old").c_str());
    }
    
    DBLoaded = false;
-   Dbp = 0;
    DBFile = std::string();
    
    if (DB.empty())
       return true;
 
-   db_create(&Dbp, NULL, 0);
-   if ((err = Dbp->open(Dbp, NULL, DB.c_str(), NULL, DB_BTREE,
-                        (ReadOnly?DB_RDONLY:DB_CREATE),
-                        0644)) != 0)
-   {
-      if (err == DB_OLD_VERSION)
-      {
-          _error->Warning(_("DB is old, attempting to upgrade %s"),DBFile.c_str());
-	  err = Dbp->upgrade(Dbp, DB.c_str(), 0);
-	  if (!err)
-	     err = Dbp->open(Dbp, NULL, DB.c_str(), NULL, DB_HASH,
-                            (ReadOnly?DB_RDONLY:DB_CREATE), 0644);
-
-      }
-      // the database format has changed from DB_HASH to DB_BTREE in 
-      // apt 0.6.44
-      if (err == EINVAL)
-      {
-	 _error->Error(_("DB format is invalid. If you upgraded from an older version of apt, please remove and re-create the database."));
-      }
-      if (err)
-      {
-          Dbp = 0;
-          return _error->Error(_("Unable to open DB file %s: %s"),DB.c_str(), db_strerror(err));
-      }
-   }
+   Store.reset(CacheStore::Open(DB, ReadOnly));
+   if (Store == nullptr)
+      return false;
 
    DBFile = DB;
    DBLoaded = true;
@@ -168,6 +142,14 @@ bool CacheDB::GetFileStat(bool const &doStat)
    if ((CurStat.Flags & FlSize) == FlSize && doStat == false)
       return true;
 
+   if (Inspected != NULL)
+   {
+      CurStat.FileSize = Inspected->FileSize;
+      CurStat.mtime = htonl(Inspected->mtime);
+      CurStat.Flags |= FlSize;
+      return true;
+   }
+
    /* Get it from the file. */
    if (OpenFile() == false)
       return false;
@@ -193,13 +175,11 @@ bool CacheDB::GetFileStat(bool const &doStat)
 bool CacheDB::GetCurStatCompatOldFormat()
 {
    InitQueryStats();
-   Data.data = &CurStatOldFormat;
-   Data.flags = DB_DBT_USERMEM;
-   Data.ulen = sizeof(CurStatOldFormat);
-   if (Get() == false)
+   if (Get() == false || Data.size() != sizeof(CurStatOldFormat))
    {
       CurStat.Flags = 0;
    } else {
+      memcpy(&CurStatOldFormat, Data.data(), sizeof(CurStatOldFormat));
       CurStat.Flags = CurStatOldFormat.Flags;
       CurStat.mtime = CurStatOldFormat.mtime;
       CurStat.FileSize = CurStatOldFormat.FileSize;
@@ -216,13 +196,12 @@ bool CacheDB::GetCurStatCompatOldFormat()
 bool CacheDB::GetCurStatCompatNewFormat()
 {
    InitQueryStats();
-   Data.data = &CurStat;
-   Data.flags = DB_DBT_USERMEM;
-   Data.ulen = sizeof(CurStat);
-   if (Get() == false)
+   if (Get() == false || Data.size() != sizeof(CurStat))
    {
       CurStat.Flags = 0;
    }
+   else
+      memcpy(&CurStat, Data.data(), sizeof(CurStat));
    return true;
 }
 									/*}}}*/
@@ -238,25 +217,22 @@ bool CacheDB::GetCurStat()
    {
       // do a first query to just get the size of the data on disk
       InitQueryStats();
-      Data.data = &CurStat;
-      Data.flags = DB_DBT_USERMEM;
-      Data.ulen = 0;
       Get();
 
-      if (Data.size == 0)
+      if (Data.size() == 0)
       {
          // nothing needs to be done, we just have not data for this deb
       }
       // check if the record is written in the old format (32bit filesize)
-      else if(Data.size == sizeof(CurStatOldFormat))
+      else if(Data.size() == sizeof(CurStatOldFormat))
       {
          GetCurStatCompatOldFormat();
       }
-      else if(Data.size == sizeof(CurStat))
+      else if(Data.size() == sizeof(CurStat))
       {
          GetCurStatCompatNewFormat();
       } else {
-         return _error->Error("Cache record size mismatch (%ul)", Data.size);
+         return _error->Error("Cache record size mismatch (%zu)", Data.size());
       }
 
       CurStat.Flags = ntohl(CurStat.Flags);
@@ -272,6 +248,10 @@ bool CacheDB::GetFileInfo(std::string const &FileName, bool const &DoControl, bo
                           bool const &checkMtime)
 {
    this->FileName = FileName;
+   if (Inspected != NULL && (Inspected->FileName != FileName || Inspected->Done == false ||
+			     Inspected->Failed == true || (Inspected->DoControl == false &&
+			     Inspected->DoContents == false && Inspected->DoHashes == 0)))
+      Inspected = NULL;
 
    if (GetCurStat() == false)
       return false;
@@ -306,7 +286,7 @@ bool CacheDB::LoadSource()						/*{{{*/
    {
       // Lookup the control information
       InitQuerySource();
-      if (Get() == true && Dsc.TakeDsc(Data.data, Data.size) == true)
+      if (Get() == true && Dsc.TakeDsc(Data.data(), Data.size()) == true)
       {
 	    return true;
       }
@@ -340,20 +320,31 @@ bool CacheDB::LoadControl()
    {
       // Lookup the control information
       InitQueryControl();
-      if (Get() == true && Control.TakeControl(Data.data,Data.size) == true)
+      if (Get() == true && Control.TakeControl(Data.data(),Data.size()) == true)
 	    return true;
       CurStat.Flags &= ~FlControl;
    }
    
-   if(OpenDebFile() == false)
-      return false;
-   
-   Stats.Misses++;
-   if (Control.Read(*DebFile) == false)
-      return false;
+   if (Inspected != NULL && Inspected->DoControl == true)
+   {
+      Stats.Misses++;
+      if (Inspected->Control.Control == 0)
+	 return _error->Error(_("Archive has no control record"));
+      if (Control.TakeControl(Inspected->Control.Control, Inspected->Control.Length) == false)
+	 return false;
+   }
+   else
+   {
+      if(OpenDebFile() == false)
+	 return false;
+
+      Stats.Misses++;
+      if (Control.Read(*DebFile) == false)
+	 return false;
 
-   if (Control.Control == 0)
-      return _error->Error(_("Archive has no control record"));
+      if (Control.Control == 0)
+	 return _error->Error(_("Archive has no control record"));
+   }
    
    // Write back the control information
    InitQueryControl();
@@ -377,19 +368,28 @@ bool CacheDB::LoadContents(bool const &GenOnly)
       InitQueryContent();
       if (Get() == true)
       {
-	 if (Contents.TakeContents(Data.data,Data.size) == true)
+	 if (Contents.TakeContents(Data.data(),Data.size()) == true)
 	    return true;
       }
       
       CurStat.Flags &= ~FlContents;
    }
    
-   if(OpenDebFile() == false)
-      return false;
+   if (Inspected != NULL && Inspected->DoContents == true)
+   {
+      Stats.Misses++;
+      if (Contents.TakeContents(Inspected->Contents.Data, Inspected->Contents.CurSize) == false)
+	 return false;
+   }
+   else
+   {
+      if(OpenDebFile() == false)
+	 return false;
 
-   Stats.Misses++;
-   if (Contents.Read(*DebFile) == false)
-      return false;	    
+      Stats.Misses++;
+      if (Contents.Read(*DebFile) == false)
+	 return false;
+   }
    
    // Write back the control information
    InitQueryContent();
@@ -452,14 +452,19 @@ bool CacheDB::GetHashes(bool const GenOnly, unsigned int const DoHashes)
 
    if (FlHashes != 0)
    {
-      if (OpenFile() == false)
-	 return false;
-
-      Hashes hashes(FlHashes);
-      if (Fd->Seek(0) == false || hashes.AddFD(*Fd, CurStat.FileSize) == false)
-	 return false;
+      HashStringList hl;
+      if (Inspected != NULL && (FlHashes & ~Inspected->DoHashes) == 0)
+	 hl = Inspected->HashesList;
+      else
+      {
+	 if (OpenFile() == false)
+	    return false;
 
-      HashStringList hl = hashes.GetHashStringList();
+	 Hashes hashes(FlHashes);
+	 if (Fd->Seek(0) == false || hashes.AddFD(*Fd, CurStat.FileSize) == false)
+	    return false;
+	 hl = hashes.GetHashStringList();
+      }
       for (HashStringList::const_iterator hs = hl.begin(); hs != hl.end(); ++hs)
       {
 	 HashesList.push_back(*hs);
@@ -509,6 +514,79 @@ bool CacheDB::GetHashes(bool const GenOnly, unsigned int const DoHashes)
    return ret;
 }
 									/*}}}*/
+// CacheDB::PlanInspection - Find out what GetFileInfo has to read	/*{{{*/
+// ---------------------------------------------------------------------
+/* This does the same checks as GetFileInfo, but instead of reading the
+   missing bits from the file it just notes them for Inspect. */
+bool CacheDB::PlanInspection(std::string const &FileName, bool const DoControl,
+			     bool const DoContents, unsigned int const DoHashes,
+			     bool const checkMtime, Inspection &I)
+{
+   this->FileName = FileName;
+   I.FileName = FileName;
+
+   if (GetCurStat() == false)
+      return false;
+
+   if (checkMtime == true && (CurStat.Flags & FlSize) == FlSize)
+   {
+      struct stat St;
+      if (stat(FileName.c_str(), &St) != 0 || htonl(St.st_mtime) != CurStat.mtime)
+	 CurStat.Flags = 0;
+   }
+
+   unsigned int CachedHashes = 0;
+   if ((CurStat.Flags & FlMD5) == FlMD5)
+      CachedHashes |= Hashes::MD5SUM;
+   if ((CurStat.Flags & FlSHA1) == FlSHA1)
+      CachedHashes |= Hashes::SHA1SUM;
+   if ((CurStat.Flags & FlSHA256) == FlSHA256)
+      CachedHashes |= Hashes::SHA256SUM;
+   if ((CurStat.Flags & FlSHA512) == FlSHA512)
+      CachedHashes |= Hashes::SHA512SUM;
+
+   I.DoControl = DoControl && (CurStat.Flags & FlControl) != FlControl;
+   I.DoContents = DoContents && (CurStat.Flags & FlContents) != FlContents;
+   I.DoHashes = DoHashes & ~CachedHashes;
+   return true;
+}
+									/*}}}*/
+// CacheDB::Inspect - Read what is missing in the DB from the file	/*{{{*/
+// ---------------------------------------------------------------------
+/* This doesn't touch the DB, so it can run on another thread. */
+bool CacheDB::Inspect(Inspection &I)
+{
+   FileFd File(I.FileName, FileFd::ReadOnly);
+   if (File.IsOpen() == false)
+      return false;
+
+   struct stat St;
+   if (fstat(File.Fd(), &St) != 0)
+      return _error->Errno("fstat", _("Failed to stat %s"), I.FileName.c_str());
+   I.FileSize = St.st_size;
+   I.mtime = St.st_mtime;
+
+   if (I.DoControl == true || I.DoContents == true)
+   {
+      debDebFile Deb(File);
+      if (_error->PendingError() == true)
+	 return false;
+      if (I.DoControl == true && I.Control.Read(Deb) == false)
+	 return false;
+      if (I.DoContents == true && I.Contents.Read(Deb) == false)
+	 return false;
+   }
+
+   if (I.DoHashes != 0)
+   {
+      Hashes hashes(I.DoHashes);
+      if (File.Seek(0) == false || hashes.AddFD(File, I.FileSize) == false)
+	 return false;
+      I.HashesList = hashes.GetHashStringList();
+   }
+   return true;
+}
+									/*}}}*/
 // CacheDB::Finish - Write back the cache structure			/*{{{*/
 // ---------------------------------------------------------------------
 /* */
@@ -538,42 +616,14 @@ bool CacheDB::Clean()
    if (DBLoaded == false)
       return true;
 
-   /* I'm not sure what VERSION_MINOR should be here.. 2.4.14 certainly
-      needs the lower one and 2.7.7 needs the upper.. */
-   DBC *Cursor;
-   if ((errno = Dbp->cursor(Dbp, NULL, &Cursor, 0)) != 0)
-      return _error->Error(_("Unable to get a cursor"));
-   
-   DBT Key;
-   DBT Data;
-   memset(&Key,0,sizeof(Key));
-   memset(&Data,0,sizeof(Data));
-   while ((errno = Cursor->c_get(Cursor,&Key,&Data,DB_NEXT)) == 0)
-   {
-      const char *Colon = (char*)memrchr(Key.data, ':', Key.size);
-      if (Colon)
-      {
-         if (stringcmp(Colon + 1, (char *)Key.data+Key.size,"st") == 0 ||
-             stringcmp(Colon + 1, (char *)Key.data+Key.size,"cl") == 0 ||
-             stringcmp(Colon + 1, (char *)Key.data+Key.size,"cs") == 0 ||
-             stringcmp(Colon + 1, (char *)Key.data+Key.size,"cn") == 0)
-	 {
-            std::string FileName = std::string((const char *)Key.data,Colon);
-            if (FileExists(FileName) == true) {
-		continue;
-            }
-	 }
-      }
-      Cursor->c_del(Cursor,0);
-   }
-   int res = Dbp->compact(Dbp, NULL, NULL, NULL, NULL, DB_FREE_SPACE, NULL);
-   if (res < 0)
-      _error->Warning("compact failed with result %i", res);
-
-   if(_config->FindB("Debug::APT::FTPArchive::Clean", false) == true)
-      Dbp->stat_print(Dbp, 0);
-
-
-   return true;
+   return Store->Clean([](std::string_view const Key) {
+      auto const Colon = Key.rfind(':');
+      if (Colon == std::string_view::npos)
+	 return false;
+      auto const Type = Key.substr(Colon + 1);
+      if (Type != "st" && Type != "cl" && Type != "cs" && Type != "cn")
+	 return false;
+      return FileExists(std::string(Key.substr(0, Colon)));
+   });
 }
 									/*}}}*/
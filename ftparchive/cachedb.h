@@ -14,13 +14,16 @@
 #include <apt-pkg/debfile.h>
 #include <apt-pkg/hashes.h>
 
-#include <db.h>
+#include <algorithm>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "cachestore.h"
 #include "contents.h"
 #include "sources.h"
 
@@ -29,13 +32,39 @@ class FileFd;
 
 class CacheDB
 {
+   public:
+
+   /* The parts of GetFileInfo which need to read the file itself, planned
+      by PlanInspection on the thread owning the DB, done by Inspect on any
+      thread and handed to GetFileInfo via UseInspection. */
+   struct Inspection
+   {
+      std::string FileName;
+
+      // What is missing in the DB and has to be taken from the file
+      bool DoControl;
+      bool DoContents;
+      unsigned int DoHashes;
+
+      bool Done;
+      bool Failed;
+      uint64_t FileSize;
+      uint32_t mtime;
+      debDebFile::MemControlExtract Control;
+      ContentsExtract Contents;
+      HashStringList HashesList;
+
+      Inspection() : DoControl(false), DoContents(false), DoHashes(0),
+		     Done(false), Failed(false), FileSize(0), mtime(0) {};
+   };
+
    protected:
       
    // Database state/access
-   DBT Key;
-   DBT Data;
+   std::string_view Key;
+   std::string_view Data;
    char TmpKey[600];
-   DB *Dbp;
+   std::unique_ptr<CacheStore> Store;
    bool DBLoaded;
    bool ReadOnly;
    std::string DBFile;
@@ -43,10 +72,9 @@ class CacheDB
    // Generate a key for the DB of a given type
    void _InitQuery(const char *Type)
    {
-      memset(&Key,0,sizeof(Key));
-      memset(&Data,0,sizeof(Data));
-      Key.data = TmpKey;
-      Key.size = snprintf(TmpKey,sizeof(TmpKey),"%s:%s",FileName.c_str(), Type);
+      Data = std::string_view();
+      int const Size = snprintf(TmpKey,sizeof(TmpKey),"%s:%s",FileName.c_str(), Type);
+      Key = std::string_view(TmpKey, std::min<size_t>(Size, sizeof(TmpKey) - 1));
    }
    
    void InitQueryStats() {
@@ -64,15 +92,13 @@ class CacheDB
 
    inline bool Get() 
    {
-      return Dbp->get(Dbp,0,&Key,&Data,0) == 0;
+      return Store->Get(Key, Data);
    };
    inline bool Put(const void *In,unsigned long const &Length) 
    {
       if (ReadOnly == true)
 	 return true;
-      Data.size = Length;
-      Data.data = (void *)In;
-      if (DBLoaded == true && (errno = Dbp->put(Dbp,0,&Key,&Data,0)) != 0)
+      if (DBLoaded == true && Store->Put(Key, std::string_view(static_cast<char const *>(In), Length)) == false)
       {
 	 DBLoaded = false;
 	 return false;
@@ -132,6 +158,7 @@ class CacheDB
    std::string FileName;
    FileFd *Fd;
    debDebFile *DebFile;
+   Inspection const *Inspected;
    
    public:
 
@@ -168,7 +195,7 @@ class CacheDB
    } Stats;
    
    bool ReadyDB(std::string const &DB = "");
-   inline bool DBFailed() {return Dbp != 0 && DBLoaded == false;};
+   inline bool DBFailed() {return Store != nullptr && DBLoaded == false;};
    inline bool Loaded() {return DBLoaded == true;};
    
    inline unsigned long long GetFileSize(void) {return CurStat.FileSize;}
@@ -184,6 +211,15 @@ class CacheDB
 	 unsigned int const DoHashes,
 	 bool const &checkMtime = false);
 
+   bool PlanInspection(std::string const &FileName,
+	 bool const DoControl,
+	 bool const DoContents,
+	 unsigned int const DoHashes,
+	 bool const checkMtime,
+	 Inspection &I);
+   static bool Inspect(Inspection &I);
+   inline void UseInspection(Inspection const * const I) {Inspected = I;};
+
    bool Finish();   
    
    bool Clean();
@@ -0,0 +1,627 @@
+// -*- mode: cpp; mode: fold -*-
+// Description								/*{{{*/
+/* ######################################################################
+
+   CacheStore
+
+   Key/value stores the CacheDB can keep its records in.
+
+   The log store starts with a LogHeader followed by the records, each a
+   LogRecord followed by key and data padded to 8 bytes. Records are only
+   ever appended: a newer record for a key shadows the older ones until
+   Clean writes the live records into a fresh log. Writers append under an
+   exclusive lock on the log, so several processes can share one, while
+   lookups only touch the memory-mapped log and an open-addressing hash
+   table of the offsets of the latest record per key. The table is saved
+   next to the log, so opening only has to scan what was appended since.
+
+   ##################################################################### */
+									/*}}}*/
+// Include Files							/*{{{*/
+#include <config.h>
+
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/macros.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef HAVE_BDB
+#include <db.h>
+#endif
+
+#include "cachestore.h"
+
+#include <apti18n.h>
+									/*}}}*/
+
+#ifdef HAVE_BDB
+// BerkeleyStore - The classic Berkeley DB btree			/*{{{*/
+class BerkeleyStore : public CacheStore
+{
+   DB *Dbp;
+
+   explicit BerkeleyStore(DB * const Dbp) : Dbp(Dbp) {};
+
+   public:
+
+   virtual bool Get(std::string_view const Key, std::string_view &Data) APT_OVERRIDE
+   {
+      DBT K, D;
+      memset(&K, 0, sizeof(K));
+      memset(&D, 0, sizeof(D));
+      K.data = const_cast<char *>(Key.data());
+      K.size = Key.size();
+      if (Dbp->get(Dbp, 0, &K, &D, 0) != 0)
+	 return false;
+      Data = std::string_view(static_cast<char const *>(D.data), D.size);
+      return true;
+   }
+
+   virtual bool Put(std::string_view const Key, std::string_view const Data) APT_OVERRIDE
+   {
+      DBT K, D;
+      memset(&K, 0, sizeof(K));
+      memset(&D, 0, sizeof(D));
+      K.data = const_cast<char *>(Key.data());
+      K.size = Key.size();
+      D.data = const_cast<char *>(Data.data());
+      D.size = Data.size();
+      return (errno = Dbp->put(Dbp, 0, &K, &D, 0)) == 0;
+   }
+
+   virtual bool Clean(std::function<bool(std::string_view)> const &Keep) APT_OVERRIDE
+   {
+      /* I'm not sure what VERSION_MINOR should be here.. 2.4.14 certainly
+	 needs the lower one and 2.7.7 needs the upper.. */
+      DBC *Cursor;
+      if ((errno = Dbp->cursor(Dbp, NULL, &Cursor, 0)) != 0)
+	 return _error->Error(_("Unable to get a cursor"));
+
+      DBT Key;
+      DBT Data;
+      memset(&Key,0,sizeof(Key));
+      memset(&Data,0,sizeof(Data));
+      while ((errno = Cursor->c_get(Cursor,&Key,&Data,DB_NEXT)) == 0)
+      {
+	 if (Keep(std::string_view(static_cast<char const *>(Key.data), Key.size)) == false)
+	    Cursor->c_del(Cursor,0);
+      }
+      Cursor->c_close(Cursor);
+
+      int res = Dbp->compact(Dbp, NULL, NULL, NULL, NULL, DB_FREE_SPACE, NULL);
+      if (res < 0)
+	 _error->Warning("compact failed with result %i", res);
+
+      if(_config->FindB("Debug::APT::FTPArchive::Clean", false) == true)
+	 Dbp->stat_print(Dbp, 0);
+      return true;
+   }
+
+   static BerkeleyStore *Open(std::string const &File, bool const ReadOnly)
+   {
+      DB *Dbp;
+      int err;
+      db_create(&Dbp, NULL, 0);
+      if ((err = Dbp->open(Dbp, NULL, File.c_str(), NULL, DB_BTREE,
+			   (ReadOnly?DB_RDONLY:DB_CREATE),
+			   0644)) != 0)
+      {
+	 if (err == DB_OLD_VERSION)
+	 {
+	    _error->Warning(_("DB is old, attempting to upgrade %s"),File.c_str());
+	    err = Dbp->upgrade(Dbp, File.c_str(), 0);
+	    if (!err)
+	       err = Dbp->open(Dbp, NULL, File.c_str(), NULL, DB_HASH,
+			       (ReadOnly?DB_RDONLY:DB_CREATE), 0644);
+
+	 }
+	 // the database format has changed from DB_HASH to DB_BTREE in
+	 // apt 0.6.44
+	 if (err == EINVAL)
+	 {
+	    _error->Error(_("DB format is invalid. If you upgraded from an older version of apt, please remove and re-create the database."));
+	 }
+	 if (err)
+	 {
+	    Dbp->close(Dbp, 0);
+	    _error->Error(_("Unable to open DB file %s: %s"),File.c_str(), db_strerror(err));
+	    return nullptr;
+	 }
+      }
+      return new BerkeleyStore(Dbp);
+   }
+
+   virtual ~BerkeleyStore()
+   {
+      Dbp->close(Dbp,0);
+   }
+};
+									/*}}}*/
+#endif
+
+// LogStore - An append-only log with a hash index			/*{{{*/
+namespace
+{
+struct LogHeader
+{
+   char Magic[8];
+   uint32_t Version;
+   uint32_t ByteOrder;
+   uint64_t LogId;
+};
+struct LogRecord
+{
+   uint32_t KeyLength;
+   uint32_t DataLength;
+   uint32_t Checksum;
+   uint32_t Reserved;
+};
+struct LogIndexHeader
+{
+   char Magic[8];
+   uint64_t LogId;
+   uint64_t Length;
+   uint64_t SlotCount;
+   uint64_t Used;
+   uint64_t Checksum;
+};
+char const LogMagic[8] = {'A', 'P', 'T', 'L', 'O', 'G', 'D', 'B'};
+char const LogIndexMagic[8] = {'A', 'P', 'T', 'L', 'O', 'G', 'I', 'X'};
+uint32_t const LogVersion = 1;
+uint32_t const LogByteOrder = 0x01020304;
+
+// FNV-1a, good enough to spread file names and to spot torn records
+uint64_t HashBytes(void const * const Data, size_t const Size, uint64_t Hash = 14695981039346656037ull)
+{
+   auto const Bytes = static_cast<unsigned char const *>(Data);
+   for (size_t I = 0; I < Size; ++I)
+      Hash = (Hash ^ Bytes[I]) * 1099511628211ull;
+   return Hash;
+}
+uint32_t RecordChecksum(LogRecord const &R, char const * const Payload)
+{
+   uint64_t Hash = HashBytes(&R.KeyLength, sizeof(R.KeyLength));
+   Hash = HashBytes(&R.DataLength, sizeof(R.DataLength), Hash);
+   Hash = HashBytes(Payload, static_cast<size_t>(R.KeyLength) + R.DataLength, Hash);
+   return Hash ^ (Hash >> 32);
+}
+uint64_t RecordSize(uint64_t const KeyLength, uint64_t const DataLength)
+{
+   return (sizeof(LogRecord) + KeyLength + DataLength + 7) & ~static_cast<uint64_t>(7);
+}
+uint64_t NewLogId()
+{
+   return static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count()) ^
+	  (static_cast<uint64_t>(getpid()) << 40);
+}
+bool WriteAt(int const Fd, char const *Data, size_t Size, off_t Offset)
+{
+   while (Size != 0)
+   {
+      ssize_t const Res = pwrite(Fd, Data, Size, Offset);
+      if (Res < 0 && errno == EINTR)
+	 continue;
+      if (Res <= 0)
+	 return false;
+      Data += Res;
+      Size -= Res;
+      Offset += Res;
+   }
+   return true;
+}
+}
+
+class LogStore : public CacheStore
+{
+   std::string const File;
+   bool const ReadOnly;
+   int Fd;
+   char *Map;
+   uint64_t MapSize;
+   uint64_t LogId;
+   // End of the last record in the index and how much the index file covers
+   uint64_t Length;
+   uint64_t SavedLength;
+   std::vector<uint64_t> Slots;
+   uint64_t Used;
+
+   LogStore(std::string const &File, bool const ReadOnly) : File(File), ReadOnly(ReadOnly),
+      Fd(-1), Map(nullptr), MapSize(0), LogId(0), Length(0), SavedLength(0), Used(0) {};
+
+   std::string_view KeyAt(uint64_t const Offset) const
+   {
+      auto const R = reinterpret_cast<LogRecord const *>(Map + Offset);
+      return std::string_view(Map + Offset + sizeof(LogRecord), R->KeyLength);
+   }
+   uint64_t Find(std::string_view const Key) const
+   {
+      if (Slots.empty() == true)
+	 return 0;
+      size_t const Mask = Slots.size() - 1;
+      for (size_t I = HashBytes(Key.data(), Key.size()) & Mask;; I = (I + 1) & Mask)
+	 if (Slots[I] == 0 || KeyAt(Slots[I]) == Key)
+	    return Slots[I];
+   }
+   void Insert(uint64_t const Offset)
+   {
+      if ((Used + 1) * 3 > Slots.size() * 2)
+      {
+	 std::vector<uint64_t> Old(std::max<size_t>(1024, Slots.size() * 2), 0);
+	 std::swap(Old, Slots);
+	 size_t const Mask = Slots.size() - 1;
+	 for (auto const O : Old)
+	 {
+	    if (O == 0)
+	       continue;
+	    std::string_view const Key = KeyAt(O);
+	    size_t I = HashBytes(Key.data(), Key.size()) & Mask;
+	    while (Slots[I] != 0)
+	       I = (I + 1) & Mask;
+	    Slots[I] = O;
+	 }
+      }
+      std::string_view const Key = KeyAt(Offset);
+      size_t const Mask = Slots.size() - 1;
+      for (size_t I = HashBytes(Key.data(), Key.size()) & Mask;; I = (I + 1) & Mask)
+      {
+	 if (Slots[I] == 0)
+	    ++Used;
+	 else if (KeyAt(Slots[I]) != Key)
+	    continue;
+	 Slots[I] = Offset;
+	 return;
+      }
+   }
+
+   bool MapLog(uint64_t const Size)
+   {
+      if (Size <= MapSize)
+	 return true;
+      if (Map != nullptr)
+	 munmap(Map, MapSize);
+      // leave room to grow, pages beyond the end of the file are never touched
+      uint64_t const NewSize = Size + std::max<uint64_t>(Size / 2, 1 << 20);
+      void * const M = mmap(nullptr, NewSize, PROT_READ, MAP_SHARED, Fd, 0);
+      if (M == MAP_FAILED)
+      {
+	 Map = nullptr;
+	 MapSize = 0;
+	 return _error->Errno("mmap", _("Couldn't make mmap of %llu bytes"), static_cast<unsigned long long>(NewSize));
+      }
+      Map = static_cast<char *>(M);
+      MapSize = NewSize;
+      return true;
+   }
+   /* Indexes the records appended after Length. The caller holds a lock,
+      so an invalid record is the remains of a crashed writer which is cut
+      off if we hold the exclusive one. */
+   bool ReadTail(uint64_t const End, bool const Repair)
+   {
+      if (MapLog(End) == false)
+	 return false;
+      while (Length < End)
+      {
+	 auto const R = reinterpret_cast<LogRecord const *>(Map + Length);
+	 if (End - Length < sizeof(LogRecord) ||
+	     RecordSize(R->KeyLength, R->DataLength) > End - Length ||
+	     R->Checksum != RecordChecksum(*R, Map + Length + sizeof(LogRecord)))
+	    break;
+	 Insert(Length);
+	 Length += RecordSize(R->KeyLength, R->DataLength);
+      }
+      if (Length == End || Repair == false)
+	 return true;
+      _error->Warning(_("Dropping incomplete records at the end of %s"), File.c_str());
+      if (ftruncate(Fd, Length) != 0)
+	 return _error->Errno("ftruncate", _("Failed to truncate file %s"), File.c_str());
+      return true;
+   }
+   // Picks up what other processes appended since we last looked
+   bool Refresh()
+   {
+      struct stat St;
+      if (fstat(Fd, &St) != 0)
+	 return _error->Errno("fstat", _("Failed to stat %s"), File.c_str());
+      if (static_cast<uint64_t>(St.st_size) <= Length)
+	 return true;
+      if (flock(Fd, LOCK_SH) != 0)
+	 return _error->Errno("flock", _("Failed to lock %s"), File.c_str());
+      bool const Okay = fstat(Fd, &St) == 0 && ReadTail(St.st_size, false);
+      flock(Fd, LOCK_UN);
+      return Okay;
+   }
+   // Takes the exclusive lock on the log the path currently refers to
+   bool LockForWrite()
+   {
+      struct stat St;
+      while (true)
+      {
+	 if (flock(Fd, LOCK_EX) != 0)
+	    return _error->Errno("flock", _("Failed to lock %s"), File.c_str());
+	 if (fstat(Fd, &St) != 0)
+	 {
+	    flock(Fd, LOCK_UN);
+	    return _error->Errno("fstat", _("Failed to stat %s"), File.c_str());
+	 }
+	 struct stat Path;
+	 if (stat(File.c_str(), &Path) != 0 || (Path.st_ino == St.st_ino && Path.st_dev == St.st_dev))
+	    break;
+	 // the log was replaced by a compacted one
+	 flock(Fd, LOCK_UN);
+	 CloseLog();
+	 if (OpenLog() == false)
+	    return false;
+      }
+      if (ReadTail(St.st_size, true) == false)
+      {
+	 flock(Fd, LOCK_UN);
+	 return false;
+      }
+      return true;
+   }
+
+   bool LoadIndex(uint64_t const FileSize)
+   {
+      if (FileExists(File + ".idx") == false)
+	 return false;
+      _error->PushToStack();
+      FileFd In(File + ".idx", FileFd::ReadOnly);
+      LogIndexHeader H;
+      bool Okay = In.Read(&H, sizeof(H)) == true &&
+		  memcmp(H.Magic, LogIndexMagic, sizeof(H.Magic)) == 0 &&
+		  H.LogId == LogId && H.Length <= FileSize &&
+		  H.SlotCount != 0 && (H.SlotCount & (H.SlotCount - 1)) == 0 &&
+		  H.Used * 3 <= H.SlotCount * 2;
+      if (Okay == true)
+      {
+	 Slots.resize(H.SlotCount);
+	 Okay = In.Read(Slots.data(), Slots.size() * sizeof(Slots[0])) == true &&
+		HashBytes(Slots.data(), Slots.size() * sizeof(Slots[0])) == H.Checksum &&
+		std::all_of(Slots.begin(), Slots.end(), [&](uint64_t const O) {
+		   return O == 0 || (O >= sizeof(LogHeader) && O < H.Length && O % 8 == 0);
+		});
+      }
+      _error->RevertToStack();
+      if (Okay == false)
+      {
+	 Slots.clear();
+	 return false;
+      }
+      Used = H.Used;
+      Length = SavedLength = H.Length;
+      return true;
+   }
+   void SaveIndex()
+   {
+      if (ReadOnly == true || Length <= SavedLength || Slots.empty() == true)
+	 return;
+      LogIndexHeader H;
+      memcpy(H.Magic, LogIndexMagic, sizeof(H.Magic));
+      H.LogId = LogId;
+      H.Length = Length;
+      H.SlotCount = Slots.size();
+      H.Used = Used;
+      H.Checksum = HashBytes(Slots.data(), Slots.size() * sizeof(Slots[0]));
+      // the index is only a shortcut, the log is fine without it
+      _error->PushToStack();
+      FileFd Out(File + ".idx", FileFd::WriteAtomic, 0644);
+      if (Out.Write(&H, sizeof(H)) == true &&
+	  Out.Write(Slots.data(), Slots.size() * sizeof(Slots[0])) == true &&
+	  Out.Close() == true)
+	 SavedLength = Length;
+      _error->RevertToStack();
+   }
+
+   bool OpenLog()
+   {
+      Fd = open(File.c_str(), (ReadOnly ? O_RDONLY : O_RDWR | O_CREAT) | O_CLOEXEC, 0644);
+      if (Fd == -1)
+	 return _error->Errno("open", _("Could not open file %s"), File.c_str());
+      // a new log gets its header under the lock, so only one process writes it
+      if (flock(Fd, ReadOnly ? LOCK_SH : LOCK_EX) != 0)
+	 return _error->Errno("flock", _("Failed to lock %s"), File.c_str());
+      struct stat St;
+      LogHeader Header;
+      bool Okay = fstat(Fd, &St) == 0;
+      if (Okay == true && St.st_size == 0 && ReadOnly == false)
+      {
+	 memcpy(Header.Magic, LogMagic, sizeof(Header.Magic));
+	 Header.Version = LogVersion;
+	 Header.ByteOrder = LogByteOrder;
+	 Header.LogId = NewLogId();
+	 Okay = WriteAt(Fd, reinterpret_cast<char const *>(&Header), sizeof(Header), 0) == true &&
+		fstat(Fd, &St) == 0;
+	 if (Okay == false)
+	    _error->Errno("write", _("Write error"));
+      }
+      else if (Okay == false || pread(Fd, &Header, sizeof(Header), 0) != sizeof(Header) ||
+	       memcmp(Header.Magic, LogMagic, sizeof(Header.Magic)) != 0 ||
+	       Header.Version != LogVersion || Header.ByteOrder != LogByteOrder)
+      {
+	 _error->Error(_("%s is not a valid cache log"), File.c_str());
+	 Okay = false;
+      }
+      if (Okay == true)
+      {
+	 LogId = Header.LogId;
+	 Length = SavedLength = sizeof(LogHeader);
+	 Slots.clear();
+	 Used = 0;
+	 LoadIndex(St.st_size);
+	 Okay = ReadTail(St.st_size, ReadOnly == false);
+      }
+      flock(Fd, LOCK_UN);
+      return Okay;
+   }
+   void CloseLog()
+   {
+      SaveIndex();
+      if (Map != nullptr)
+	 munmap(Map, MapSize);
+      Map = nullptr;
+      MapSize = 0;
+      if (Fd != -1)
+	 close(Fd);
+      Fd = -1;
+   }
+
+   public:
+
+   virtual bool Get(std::string_view const Key, std::string_view &Data) APT_OVERRIDE
+   {
+      uint64_t Offset = Find(Key);
+      if (Offset == 0)
+      {
+	 if (Refresh() == false || (Offset = Find(Key)) == 0)
+	    return false;
+      }
+      auto const R = reinterpret_cast<LogRecord const *>(Map + Offset);
+      Data = std::string_view(Map + Offset + sizeof(LogRecord) + R->KeyLength, R->DataLength);
+      return true;
+   }
+
+   virtual bool Put(std::string_view const Key, std::string_view const Data) APT_OVERRIDE
+   {
+      if (ReadOnly == true)
+	 return true;
+      if (Key.size() > UINT32_MAX || Data.size() > UINT32_MAX)
+      {
+	 errno = EFBIG;
+	 return false;
+      }
+      LogRecord R;
+      R.KeyLength = Key.size();
+      R.DataLength = Data.size();
+      R.Reserved = 0;
+      std::string Record(RecordSize(Key.size(), Data.size()), '\0');
+      memcpy(&Record[sizeof(R)], Key.data(), Key.size());
+      memcpy(&Record[sizeof(R) + Key.size()], Data.data(), Data.size());
+      R.Checksum = RecordChecksum(R, Record.data() + sizeof(R));
+      memcpy(&Record[0], &R, sizeof(R));
+
+      if (LockForWrite() == false)
+	 return false;
+      uint64_t const Offset = Length;
+      bool Okay = WriteAt(Fd, Record.data(), Record.size(), Offset);
+      int const Err = errno;
+      if (Okay == true)
+      {
+	 Length += Record.size();
+	 Okay = MapLog(Length);
+	 if (Okay == true)
+	    Insert(Offset);
+      }
+      flock(Fd, LOCK_UN);
+      errno = Err;
+      return Okay;
+   }
+
+   virtual bool Clean(std::function<bool(std::string_view)> const &Keep) APT_OVERRIDE
+   {
+      if (ReadOnly == true)
+	 return true;
+      if (LockForWrite() == false)
+	 return false;
+
+      // keep the live records in the order they were written
+      std::vector<uint64_t> Live;
+      for (auto const Offset : Slots)
+	 if (Offset != 0 && Keep(KeyAt(Offset)) == true)
+	    Live.push_back(Offset);
+      std::sort(Live.begin(), Live.end());
+
+      LogHeader Header;
+      memcpy(Header.Magic, LogMagic, sizeof(Header.Magic));
+      Header.Version = LogVersion;
+      Header.ByteOrder = LogByteOrder;
+      Header.LogId = LogId + 1;
+      uint64_t NewLength = sizeof(Header);
+      FileFd Out(File, FileFd::WriteAtomic, 0644);
+      bool Okay = Out.Write(&Header, sizeof(Header));
+      for (auto const Offset : Live)
+      {
+	 if (Okay == false)
+	    break;
+	 auto const R = reinterpret_cast<LogRecord const *>(Map + Offset);
+	 uint64_t const Size = RecordSize(R->KeyLength, R->DataLength);
+	 Okay = Out.Write(Map + Offset, Size);
+	 NewLength += Size;
+      }
+      // other writers notice the new log once they got the lock on the old
+      Okay = Out.Close() && Okay;
+      if (Okay == true && _config->FindB("Debug::APT::FTPArchive::Clean", false) == true)
+	 std::clog << File << ": kept " << Live.size() << " of " << Used << " records, "
+		   << Length << " bytes compacted to " << NewLength << std::endl;
+      flock(Fd, LOCK_UN);
+      if (Okay == false)
+	 return false;
+
+      // the index of the old log is of no use for the new one
+      SavedLength = Length;
+      CloseLog();
+      return OpenLog();
+   }
+
+   static LogStore *Open(std::string const &File, bool const ReadOnly)
+   {
+      auto const Store = new LogStore(File, ReadOnly);
+      if (Store->OpenLog() == false)
+      {
+	 delete Store;
+	 return nullptr;
+      }
+      return Store;
+   }
+
+   virtual ~LogStore()
+   {
+      CloseLog();
+   }
+};
+									/*}}}*/
+// CacheStore::Open - Open a cache database file			/*{{{*/
+CacheStore *CacheStore::Open(std::string const &File, bool const ReadOnly)
+{
+#ifdef HAVE_BDB
+   std::string Format = _config->Find("APT::FTPArchive::CacheDB::Format", "berkeley");
+#else
+   std::string Format = _config->Find("APT::FTPArchive::CacheDB::Format", "log");
+#endif
+
+   // an existing file stays in the format it was written in
+   int const Fd = open(File.c_str(), O_RDONLY | O_CLOEXEC);
+   if (Fd != -1)
+   {
+      char Magic[sizeof(LogMagic)];
+      ssize_t const Got = read(Fd, Magic, sizeof(Magic));
+      close(Fd);
+      if (Got == sizeof(Magic) && memcmp(Magic, LogMagic, sizeof(Magic)) == 0)
+	 Format = "log";
+      else if (Got > 0)
+	 Format = "berkeley";
+   }
+
+   if (Format == "log")
+      return LogStore::Open(File, ReadOnly);
+#ifdef HAVE_BDB
+   if (Format == "berkeley")
+      return BerkeleyStore::Open(File, ReadOnly);
+#endif
+   _error->Error(_("Cache database format '%s' of %s is not supported"), Format.c_str(), File.c_str());
+   return nullptr;
+}
+									/*}}}*/
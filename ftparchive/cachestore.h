@@ -0,0 +1,39 @@
+// -*- mode: cpp; mode: fold -*-
+// Description								/*{{{*/
+/* ######################################################################
+
+   CacheStore
+
+   Key/value stores the CacheDB can keep its records in: the classic
+   Berkeley DB file and an append-only log which is memory-mapped for
+   reading and can be shared by several writing processes.
+
+   ##################################################################### */
+									/*}}}*/
+#ifndef CACHESTORE_H
+#define CACHESTORE_H
+
+#include <functional>
+#include <string>
+#include <string_view>
+
+class CacheStore
+{
+   public:
+
+   /* Looks up the record stored for Key. Data points into memory owned by
+      the store and stays valid until the next call on the store. */
+   virtual bool Get(std::string_view const Key, std::string_view &Data) = 0;
+   // Stores Data for Key, on failure errno is set
+   virtual bool Put(std::string_view const Key, std::string_view const Data) = 0;
+   // Removes all records Keep does not accept and gives the space back
+   virtual bool Clean(std::function<bool(std::string_view)> const &Keep) = 0;
+
+   /* Opens File with the backend its content was written by, a new file is
+      created in the format selected by APT::FTPArchive::CacheDB::Format */
+   static CacheStore *Open(std::string const &File, bool const ReadOnly);
+
+   virtual ~CacheStore() {};
+};
+
+#endif
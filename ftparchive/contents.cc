@@ -6,29 +6,20 @@
    
    The GenContents class is a back end for an archive contents generator. 
    It takes a list of per-deb file name and merges it into a memory 
-   database of all previous output. This database is stored as a set
-   of binary trees linked across directories to form a tree of all files+dirs
-   given to it. The tree will also be sorted as it is built up thus 
-   removing the massive sort time overhead.
-   
-   By breaking all the pathnames into components and storing them 
-   separately a space saving is realized by not duplicating the string
-   over and over again. Ultimately this saving is sacrificed to storage of
-   the tree structure itself but the tree structure yields a speed gain
-   in the sorting and processing. Ultimately it takes about 5 seconds to
-   do 141000 nodes and about 5 meg of ram.
+   database of all previous output, which is sorted and printed at the
+   end.
+
+   The database is an array of small fixed size entries, one per file
+   and package, pointing into big blocks of strings. Directories are
+   stored only once and referenced by number, as most files share them
+   with many others. Entries carry the first bytes of their name, so
+   sorting rarely has to look at the strings themselves.
+
+   The output is sorted by the full path, which is the order the files
+   of each directory interleaved with the directories below it: after
+   sorting the directories and the entries by directory and name, these
+   are merged while walking the directories in order.
 
-   The tree looks something like:
-   
-     usr/
-      / \             / libslang
-   bin/ lib/ --> libc6
-        /   \         \ libfoo
-   games/  sbin/
-   
-   The ---> is the DirDown link
-   
-   
    ##################################################################### */
 									/*}}}*/
 // Include Files							/*{{{*/
@@ -39,9 +30,15 @@
 #include <apt-pkg/error.h>
 #include <apt-pkg/fileutl.h>
 
+#include <algorithm>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #include "contents.h"
 
@@ -50,189 +47,89 @@
 
 // GenContents::~GenContents - Free allocated memory			/*{{{*/
 // ---------------------------------------------------------------------
-/* Since all our allocations are static big-block allocations all that is 
-   needed is to free all of them. */
+/* The string blocks are freed along with the list. */
 GenContents::~GenContents()
 {
-   while (BlockList != 0)
-   {
-      BigBlock *Old = BlockList;
-      BlockList = Old->Next;
-      free(Old->Block);
-      delete Old;
-   }   
 }
 									/*}}}*/
 // GenContents::Mystrdup - Custom strdup				/*{{{*/
 // ---------------------------------------------------------------------
 /* This strdup also uses a large block allocator to eliminate glibc
    overhead */
-char *GenContents::Mystrdup(const char *From)
+const char *GenContents::Mystrdup(const char *From, size_t const Len)
 {
-   unsigned int Len = strlen(From) + 1;
    if (StrLeft <= Len)
    {
-      StrLeft = 4096*10;
-      StrPool = (char *)malloc(StrLeft);
-      
-      BigBlock *Block = new BigBlock;
-      Block->Block = StrPool;
-      Block->Next = BlockList;
-      BlockList = Block;
+      // strings bigger than a block get one of their own
+      size_t const Size = std::max<size_t>(1024*1024, Len + 1);
+      BlockList.emplace_back(new char[Size]);
+      StrPool = BlockList.back().get();
+      StrLeft = Size;
    }
-   
+
    memcpy(StrPool,From,Len);
-   StrLeft -= Len;
-   
+   StrPool[Len] = 0;
+   StrLeft -= Len + 1;
+
    char *Res = StrPool;
-   StrPool += Len;
+   StrPool += Len + 1;
    return Res;
 }
 									/*}}}*/
-// GenContents::Node::operator new - Big block allocator		/*{{{*/
-// ---------------------------------------------------------------------
-/* This eliminates glibc's malloc overhead by allocating large blocks and
-   having a continuous set of Nodes. This takes about 8 bytes off each nodes
-   space needs. Freeing is not supported. */
-void *GenContents::Node::operator new(size_t Amount,GenContents *Owner)
+// GenContents::GrabDir - Number of the directory, adding it if needed	/*{{{*/
+uint32_t GenContents::GrabDir(const char *Dir, size_t const Len)
 {
-   if (Owner->NodeLeft == 0)
-   {
-      Owner->NodeLeft = 10000;
-      Owner->NodePool = static_cast<Node *>(malloc(Amount*Owner->NodeLeft));
-      BigBlock *Block = new BigBlock;
-      Block->Block = Owner->NodePool;
-      Block->Next = Owner->BlockList;
-      Owner->BlockList = Block;
-   }
-   
-   Owner->NodeLeft--;
-   return Owner->NodePool++;
+   std::string_view const Name(Dir, Len);
+   // the files of a package tend to come in directory order
+   if (Entries.empty() == false && Dirs[Entries.back().Dir] == Name)
+      return Entries.back().Dir;
+   auto const Known = DirIndex.find(Name);
+   if (Known != DirIndex.end())
+      return Known->second;
+   Dirs.emplace_back(Mystrdup(Dir, Len), Len);
+   DirIndex.emplace(Dirs.back(), Dirs.size() - 1);
+   return Dirs.size() - 1;
 }
 									/*}}}*/
-// GenContents::Grab - Grab a new node representing Name under Top	/*{{{*/
+// GenContents::AddPackage - Register a package owning files		/*{{{*/
 // ---------------------------------------------------------------------
-/* This grabs a new node representing the pathname component Name under
-   the node Top. The node is given the name Package. It is assumed that Name
-   is inside of top. If a duplicate already entered name is found then 
-   a note is made on the Dup list and the previous in-tree node is returned. */
-GenContents::Node *GenContents::Grab(GenContents::Node *Top,const char *Name,
-			const char *Package)
+/* Packages are numbered in the order they are added, which is also the
+   order they are listed in for a file. */
+uint32_t GenContents::AddPackage(std::string const &Package)
 {
-   /* We drop down to the next dir level each call. This simplifies
-      the calling routine */
-   if (Top->DirDown == 0)
-   {
-      Node *Item = new(this) Node;
-      Item->Path = Mystrdup(Name);
-      Item->Package = Package;
-      Top->DirDown = Item;
-      return Item;
-   }
-   Top = Top->DirDown;
-   
-   int Res;
-   while (1)
-   {
-      Res = strcmp(Name,Top->Path);
-      
-      // Collision!
-      if (Res == 0)
-      {
-	 // See if this is the same package (multi-version dup)
-	 if (Top->Package == Package ||
-	     strcasecmp(Top->Package,Package) == 0)
-	    return Top;
-	 
-	 // Look for an already existing Dup
-	 for (Node *I = Top->Dups; I != 0; I = I->Dups)
-	    if (I->Package == Package || 
-		strcasecmp(I->Package,Package) == 0)
-	       return Top;
-
-	 // Add the dup in
-	 Node *Item = new(this) Node;
-	 Item->Path = Top->Path;
-	 Item->Package = Package;
-	 Item->Dups = Top->Dups;
-	 Top->Dups = Item;
-	 return Top;
-      }
-      
-      // Continue to traverse the tree
-      if (Res < 0)
-      {
-	 if (Top->BTreeLeft == 0)
-	    break;
-	 Top = Top->BTreeLeft;
-      }      
-      else
-      {
-	 if (Top->BTreeRight == 0)
-	    break;
-	 Top = Top->BTreeRight;
-      }      
-   }
-
-   // The item was not found in the tree
-   Node *Item = new(this) Node;
-   Item->Path = Mystrdup(Name);
-   Item->Package = Package;
-   
-   // Link it into the tree
-   if (Res < 0)
-   {
-      Item->BTreeLeft = Top->BTreeLeft;
-      Top->BTreeLeft = Item;
-   }
-   else
-   {
-      Item->BTreeRight = Top->BTreeRight;
-      Top->BTreeRight = Item;
-   }
-   
-   return Item;
+   Packages.push_back(Mystrdup(Package.c_str(), Package.length()));
+   return Packages.size() - 1;
 }
 									/*}}}*/
-// GenContents::Add - Add a path to the tree				/*{{{*/
+// GenContents::Add - Add a path to the list				/*{{{*/
 // ---------------------------------------------------------------------
-/* This takes a full pathname and adds it into the tree. We split the
-   pathname into directory fragments adding each one as we go. Technically
-   in output from tar this should result in hitting previous items. */
-void GenContents::Add(const char *Dir,const char *Package)
+/* This takes a full pathname and splits it into the directory and the
+   name. Directories themselves are never shown, so they are not added. */
+void GenContents::Add(const char *Dir, uint32_t const Package)
 {
-   Node *Root = &this->Root;
-   
    // Drop leading slashes
    while (*Dir == '/')
       Dir++;
-   
-   // Run over the string and grab out each bit up to and including a /
-   const char *Start = Dir;
-   const char *I = Dir;
-   while (*I != 0)
+
+   size_t const Len = strlen(Dir);
+   if (Len == 0 || Dir[Len - 1] == '/')
+      return;
+
+   const char *Slash = strrchr(Dir, '/');
+   size_t const DirLen = Slash == nullptr ? 0 : Slash - Dir + 1;
+
+   Entry E;
+   E.Name = Mystrdup(Dir + DirLen, Len - DirLen);
+   E.Key = 0;
+   for (size_t I = 0; I < sizeof(E.Key); ++I)
    {
-      if (*I != '/' || I - Start <= 1)
-      {
-	 I++;
-	 continue;
-      }      
-      I++;
-      
-      // Copy the path fragment over
-      char Tmp[1024];
-      strncpy(Tmp,Start,I - Start);
-      Tmp[I - Start] = 0;
-      
-      // Grab a node for it
-      Root = Grab(Root,Tmp,Package);
-      
-      Start = I;
+      E.Key <<= 8;
+      if (DirLen + I < Len)
+	 E.Key |= static_cast<unsigned char>(Dir[DirLen + I]);
    }
-   
-   // The final component if it does not have a trailing /
-   if (I - Start >= 1)
-      Grab(Root,Start,Package);
+   E.Dir = GrabDir(Dir, DirLen);
+   E.Package = Package;
+   Entries.push_back(E);
 }
 									/*}}}*/
 // GenContents::WriteSpace - Write a given number of white space chars	/*{{{*/
@@ -253,54 +150,127 @@ void GenContents::WriteSpace(std::string &out, size_t Current, size_t Target)
       out.append(" ");
 }
 									/*}}}*/
-// GenContents::Print - Display the tree				/*{{{*/
+// GenContents::Print - Display the list				/*{{{*/
 // ---------------------------------------------------------------------
-/* This is the final result function. It takes the tree and recursively
-   calls itself and runs over each section of the tree printing out
-   the pathname and the hit packages. We use Buf to build the pathname
-   summed over all the directory parents of this node. */
+/* This is the final result function. It sorts the directories and the
+   entries and prints them out in the order of the full pathnames. Lines
+   are collected in Buf and written in big chunks. */
 void GenContents::Print(FileFd &Out)
 {
-   char Buffer[1024];
-   Buffer[0] = 0;
-   DoPrint(Out,&Root,Buffer);
-}
-void GenContents::DoPrint(FileFd &Out,GenContents::Node *Top, char *Buf)
-{
-   if (Top == 0)
-      return;
+   // Renumber the directories in sorted order
+   std::vector<uint32_t> Order(Dirs.size());
+   std::iota(Order.begin(), Order.end(), 0);
+   std::sort(Order.begin(), Order.end(), [&](uint32_t const A, uint32_t const B) {
+      return Dirs[A] < Dirs[B];
+   });
+   std::vector<uint32_t> Rank(Dirs.size());
+   std::vector<std::string_view> Sorted(Dirs.size());
+   for (size_t I = 0; I < Order.size(); ++I)
+   {
+      Rank[Order[I]] = I;
+      Sorted[I] = Dirs[Order[I]];
+   }
+   for (auto &E : Entries)
+      E.Dir = Rank[E.Dir];
+   Dirs.swap(Sorted);
+   DirIndex.clear();
 
-   // Go left
-   DoPrint(Out,Top->BTreeLeft,Buf);
+   std::sort(Entries.begin(), Entries.end(), [](Entry const &A, Entry const &B) {
+      if (A.Dir != B.Dir)
+	 return A.Dir < B.Dir;
+      if (A.Key != B.Key)
+	 return A.Key < B.Key;
+      if (A.Name != B.Name)
+	 if (int const Res = strcmp(A.Name, B.Name); Res != 0)
+	    return Res < 0;
+      return A.Package < B.Package;
+   });
 
-   // Print the current dir location and then descend to lower dirs
-   char *OldEnd = Buf + strlen(Buf);
-   if (Top->Path != 0)
+   std::string Buf;
+   size_t Next = 0;
+   size_t RootEnd = 0;
+   // Files without a directory come first in the top level
+   if (Dirs.empty() == false && Dirs.front().empty() == true)
    {
-      strcat(Buf,Top->Path);
-
-      // Do not show the item if it is a directory with dups
-      if (Top->Path[strlen(Top->Path)-1] != '/' /*|| Top->Dups == 0*/)
+      ++Next;
+      while (RootEnd < Entries.size() && Entries[RootEnd].Dir == 0)
+	 ++RootEnd;
+   }
+   DoPrint(Out, Buf, Next, std::string_view(), 0, RootEnd);
+   Out.Write(Buf.data(), Buf.length());
+}
+									/*}}}*/
+// GenContents::DoPrint - Print a directory and all below it		/*{{{*/
+// ---------------------------------------------------------------------
+/* Next is the first directory not yet printed, all directories starting
+   with Dir follow it and are printed in between the files of Dir (from
+   Begin to End) where they belong. A file comes before a directory if
+   its name sorts before the rest of the directory path. */
+void GenContents::DoPrint(FileFd &Out, std::string &Buf, size_t &Next,
+			  std::string_view const Dir, size_t Begin, size_t const End)
+{
+   while (Next < Dirs.size() && Dirs[Next].substr(0, Dir.length()) == Dir)
+   {
+      // the strings are zero terminated in the pool
+      const char * const Rest = Dirs[Next].data() + Dir.length();
+      while (Begin != End && strcmp(Entries[Begin].Name, Rest) < 0)
       {
-	 std::string out = Buf;
-	 WriteSpace(out, out.length(), 60);
-	 for (Node *I = Top; I != 0; I = I->Dups)
-	 {
-	    if (I != Top)
-	       out.append(",");
-	    out.append(I->Package);
-	 }
-         out.append("\n");
-	 Out.Write(out.c_str(), out.length());
+	 size_t const Last = Begin;
+	 while (++Begin != End && strcmp(Entries[Last].Name, Entries[Begin].Name) == 0);
+	 PrintFile(Out, Buf, Dir, Last, Begin);
       }
+
+      size_t const Sub = Next++;
+      auto const First = std::lower_bound(Entries.begin(), Entries.end(), Sub,
+	    [](Entry const &E, size_t const D) { return E.Dir < D; });
+      auto const Last = std::upper_bound(First, Entries.end(), Sub,
+	    [](size_t const D, Entry const &E) { return D < E.Dir; });
+      DoPrint(Out, Buf, Next, Dirs[Sub], First - Entries.begin(), Last - Entries.begin());
    }
 
-   // Go along the directory link
-   DoPrint(Out,Top->DirDown,Buf);
-   *OldEnd = 0;
+   while (Begin != End)
+   {
+      size_t const Last = Begin;
+      while (++Begin != End && strcmp(Entries[Last].Name, Entries[Begin].Name) == 0);
+      PrintFile(Out, Buf, Dir, Last, Begin);
+   }
+}
+									/*}}}*/
+// GenContents::PrintFile - Print a file with all packages containing it/*{{{*/
+// ---------------------------------------------------------------------
+/* The packages are listed in the order they were added in, except that
+   the first is followed by the others in reverse and that versions of a
+   package already listed are skipped. */
+void GenContents::PrintFile(FileFd &Out, std::string &Buf, std::string_view const Dir,
+			    size_t const Begin, size_t const End)
+{
+   size_t const Start = Buf.length();
+   Buf.append(Dir).append(Entries[Begin].Name);
+   WriteSpace(Buf, Buf.length() - Start, 60);
 
-   // Go right
-   DoPrint(Out,Top->BTreeRight,Buf);  
+   std::vector<const char *> Owners;
+   for (size_t I = Begin; I != End; ++I)
+   {
+      const char * const Package = Packages[Entries[I].Package];
+      if (std::none_of(Owners.begin(), Owners.end(), [&](const char *const O) {
+	     return O == Package || strcasecmp(O, Package) == 0;
+	  }))
+	 Owners.push_back(Package);
+   }
+   std::reverse(Owners.begin() + 1, Owners.end());
+   for (size_t I = 0; I < Owners.size(); ++I)
+   {
+      if (I != 0)
+	 Buf.append(",");
+      Buf.append(Owners[I]);
+   }
+   Buf.append("\n");
+
+   if (Buf.length() >= 64*1024)
+   {
+      Out.Write(Buf.data(), Buf.length());
+      Buf.clear();
+   }
 }
 									/*}}}*/
 // ContentsExtract Constructor						/*{{{*/
@@ -396,7 +366,7 @@ bool ContentsExtract::TakeContents(const void *NewData,unsigned long long Length
 void ContentsExtract::Add(GenContents &Contents,std::string const &Package)
 {
    const char *Start = Data;
-   char *Pkg = Contents.Mystrdup(Package.c_str());
+   uint32_t const Pkg = Contents.AddPackage(Package);
    for (const char *I = Data; I < Data + CurSize; I++)
    {
       if (*I == 0)
@@ -11,8 +11,13 @@
 
 #include <apt-pkg/dirstream.h>
 
+#include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
 class debDebFile;
@@ -20,51 +25,41 @@ class FileFd;
 
 class GenContents
 {
-   struct Node
+   // A file of a package, the directory it is in is stored only once
+   struct Entry
    {
-      // Binary Tree links
-      Node *BTreeLeft;
-      Node *BTreeRight;
-      Node *DirDown;
-      Node *Dups;
-      const char *Path;
-      const char *Package;
-      
-      void *operator new(size_t Amount,GenContents *Owner);
-      void operator delete(void *) {};
-      
-      Node() : BTreeLeft(0), BTreeRight(0), DirDown(0), Dups(0), 
-               Path(0), Package(0) {};
+      // the first bytes of the name, to compare without looking at it
+      uint64_t Key;
+      const char *Name;
+      uint32_t Dir;
+      uint32_t Package;
    };
-   friend struct Node;
-   
-   struct BigBlock
-   {
-      void *Block;
-      BigBlock *Next;
-   };
-   
-   Node Root;
-   
-   // Big block allocation pools
-   BigBlock *BlockList;   
+
+   // Big block allocation pool for the strings
+   std::vector<std::unique_ptr<char[]>> BlockList;
    char *StrPool;
-   unsigned long StrLeft;
-   Node *NodePool;
-   unsigned long NodeLeft;
-   
-   Node *Grab(Node *Top,const char *Name,const char *Package);
+   size_t StrLeft;
+
+   std::vector<Entry> Entries;
+   std::vector<std::string_view> Dirs;
+   std::unordered_map<std::string_view, uint32_t> DirIndex;
+   std::vector<const char *> Packages;
+
+   const char *Mystrdup(const char *From, size_t Len);
+   uint32_t GrabDir(const char *Dir, size_t Len);
    void WriteSpace(std::string &out, size_t Current, size_t Target);
-   void DoPrint(FileFd &Out,Node *Top, char *Buf);
-   
+   void PrintFile(FileFd &Out, std::string &Buf, std::string_view const Dir,
+		  size_t const Begin, size_t const End);
+   void DoPrint(FileFd &Out, std::string &Buf, size_t &Next, std::string_view const Dir,
+		size_t Begin, size_t const End);
+
    public:
-   
-   char *Mystrdup(const char *From);
-   void Add(const char *Dir,const char *Package);   
+
+   uint32_t AddPackage(std::string const &Package);
+   void Add(const char *Path, uint32_t const Package);
    void Print(FileFd &Out);
 
-   GenContents() : BlockList(0), StrPool(0), StrLeft(0), 
-                   NodePool(0), NodeLeft(0) {};
+   GenContents() : StrPool(nullptr), StrLeft(0) {};
    ~GenContents();
 };
 
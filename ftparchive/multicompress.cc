@@ -9,6 +9,10 @@
    different from the old set. It spawns off compressors in parallel
    to maximize compression throughput and has a separate task managing
    the data going into the compressors.
+
+   Alternatively the data is collected in a tempfile and compressed by
+   one thread per output directly from a shared mapping of it, which
+   avoids the processes and the copying through pipes.
    
    ##################################################################### */
 									/*}}}*/
@@ -16,18 +20,23 @@
 #include <config.h>
 
 #include <apt-pkg/aptconfiguration.h>
+#include <apt-pkg/configuration.h>
 #include <apt-pkg/error.h>
 #include <apt-pkg/fileutl.h>
 #include <apt-pkg/hashes.h>
 #include <apt-pkg/strutl.h>
 
 #include <ctype.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include <algorithm>
+#include <string>
+#include <system_error>
+#include <thread>
 #include <vector>
 
 #include "multicompress.h"
@@ -56,7 +65,8 @@ static std::vector<APT::Configuration::Compressor>::const_iterator findMatchingC
 // ---------------------------------------------------------------------
 /* Setup the file outputs, compression modes and fork the writer child */
 MultiCompress::MultiCompress(string const &Output, string const &Compress,
-			     mode_t const &Permissions, bool const &Write) : Outputter{-1}, Permissions(Permissions)
+			     mode_t const &Permissions, bool const &Write) : Outputter{-1}, Permissions(Permissions),
+   InProcess(_config->FindB("APT::FTPArchive::Compress::InProcess", false))
 {
    Outputs = 0;
    UpdateMTime = 0;
@@ -144,9 +154,13 @@ bool MultiCompress::GetStat(string const &Output,string const &Compress,struct s
 									/*}}}*/
 // MultiCompress::Start - Start up the writer child			/*{{{*/
 // ---------------------------------------------------------------------
-/* Fork a child and setup the communication pipe. */
+/* Fork a child and setup the communication pipe or for the in-process
+   compression just open the tempfile collecting the data. */
 bool MultiCompress::Start()
 {
+   if (InProcess == true)
+      return GetTempFile("apt-ftparchive-compress", true, &Input) != nullptr;
+
    // Create a data pipe
    int Pipe[2] = {-1,-1};
    if (pipe(Pipe) != 0)
@@ -185,6 +199,13 @@ bool MultiCompress::Die()
    if (Input.IsOpen() == false)
       return true;
 
+   if (InProcess == true)
+   {
+      bool const Res = CompressInProcess();
+      Input.Close();
+      return Res;
+   }
+
    Input.Close();
    bool Res = ExecWait(Outputter,_("Compress child"),false);
    Outputter = -1;
@@ -290,59 +311,68 @@ bool MultiCompress::Child(int const &FD)
 
    if (_error->PendingError() == true)
       return false;
-   
-   /* Now we have to copy the files over, or erase them if they
-      have not changed. First find the cheapest decompressor */
-   bool Missing = false;
+
+   bool Same = false;
+   if (CompareOld(MD5.GetHashString(Hashes::MD5SUM).HashValue(), FileSize, Same) == false)
+      return false;
+   if (Same == true)
+      return RemoveNew();
+   return RenameNew();
+}
+									/*}}}*/
+// MultiCompress::CompareOld - Check if the old output has the same data/*{{{*/
+// ---------------------------------------------------------------------
+/* The MD5 and size of the data are compared with the content of the
+   cheapest to decompress old file. If any of the old files is missing
+   they are never the same as all of them have to be written. */
+bool MultiCompress::CompareOld(std::string const &MD5, unsigned long long const FileSize, bool &Same)
+{
+   Same = false;
    for (Files *I = Outputs; I != 0; I = I->Next)
-   {
       if (I->OldMTime == 0)
-      {
-	 Missing = true;
-	 break;
-      }            
+	 return true;
+
+   FileFd CompFd;
+   if (OpenOld(CompFd) == false)
+   {
+      _error->Discard();
+      return true;
    }
-   
-   // Check the MD5 of the lowest cost entity.
-   while (Missing == false)
+
+   // Compute the hash
+   unsigned char Buffer[32*1024];
+   Hashes OldMD5(Hashes::MD5SUM);
+   unsigned long long OldFileSize = 0;
+   while (1)
    {
-      FileFd CompFd;
-      if (OpenOld(CompFd) == false)
-      {
-	 _error->Discard();
+      unsigned long long Res = 0;
+      if (CompFd.Read(Buffer,sizeof(Buffer), &Res) == false)
+	 return _error->Errno("read",_("Failed to read while computing MD5"));
+      if (Res == 0)
 	 break;
-      }
-
-      // Compute the hash
-      Hashes OldMD5(Hashes::MD5SUM);
-      unsigned long long NewFileSize = 0;
-      while (1)
-      {
-	 unsigned long long Res = 0;
-	 if (CompFd.Read(Buffer,sizeof(Buffer), &Res) == false)
-	    return _error->Errno("read",_("Failed to read while computing MD5"));
-	 if (Res == 0)
-	    break;
-	 NewFileSize += Res;
-	 OldMD5.Add(Buffer,Res);
-      }
-      CompFd.Close();
-
-      // Check the hash
-      if (OldMD5.GetHashString(Hashes::MD5SUM) == MD5.GetHashString(Hashes::MD5SUM) &&
-	  FileSize == NewFileSize)
-      {
-	 for (Files *I = Outputs; I != 0; I = I->Next)
-	 {
-	    I->TmpFile.Close();
-	    RemoveFile("MultiCompress::Child", I->TmpFile.Name());
-	 }
-	 return !_error->PendingError();
-      }      
-      break;
+      OldFileSize += Res;
+      OldMD5.Add(Buffer,Res);
    }
+   CompFd.Close();
 
-   // Finalize
+   Same = OldMD5.GetHashString(Hashes::MD5SUM).HashValue() == MD5 && FileSize == OldFileSize;
+   return true;
+}
+									/*}}}*/
+// MultiCompress::RemoveNew - Erase the new files			/*{{{*/
+bool MultiCompress::RemoveNew()
+{
+   for (Files *I = Outputs; I != 0; I = I->Next)
+   {
+      I->TmpFile.Close();
+      RemoveFile("MultiCompress::RemoveNew", I->TmpFile.Name());
+   }
+   return !_error->PendingError();
+}
+									/*}}}*/
+// MultiCompress::RenameNew - Replace the old files by the new ones	/*{{{*/
+bool MultiCompress::RenameNew()
+{
    for (Files *I = Outputs; I != 0; I = I->Next)
    {
       // Set the correct file modes
@@ -357,4 +387,84 @@ bool MultiCompress::Child(int const &FD)
    return !_error->PendingError();
 }
 									/*}}}*/
+// MultiCompress::CompressInProcess - Compress the tempfile in threads	/*{{{*/
+// ---------------------------------------------------------------------
+/* All compressors read from the same mapping of the collected data, each
+   in its own thread, so the slowest one determines how long it takes
+   rather than the sum of all of them. Nothing is compressed at all if
+   the data is the same as before. */
+bool MultiCompress::CompressInProcess()
+{
+   unsigned long long const FileSize = Input.Tell();
+   if (Input.Failed() == true)
+      return false;
+   void *Data = nullptr;
+   if (FileSize != 0)
+   {
+      Data = mmap(nullptr, FileSize, PROT_READ, MAP_SHARED, Input.Fd(), 0);
+      if (Data == MAP_FAILED)
+	 return _error->Errno("mmap", _("Couldn't make mmap of %llu bytes"), FileSize);
+   }
+
+   Hashes MD5(Hashes::MD5SUM);
+   MD5.Add(static_cast<unsigned char const *>(Data), FileSize);
+   bool Same = false;
+   bool Res = CompareOld(MD5.GetHashString(Hashes::MD5SUM).HashValue(), FileSize, Same);
+   if (Res == true && Same == true)
+   {
+      if (Data != nullptr)
+	 munmap(Data, FileSize);
+      return RemoveNew();
+   }
 
+   // the errors of each thread are reported here by the caller
+   std::vector<Files *> Compressors;
+   for (Files *I = Outputs; I != 0; I = I->Next)
+      Compressors.push_back(I);
+   std::vector<std::vector<std::pair<bool, std::string>>> Messages(Compressors.size());
+   auto const Compress = [&](size_t const Idx) {
+      FileFd &Out = Compressors[Idx]->TmpFile;
+      if ((FileSize == 0 || Out.Write(Data, FileSize) == true) && Out.Close() == true)
+	 return;
+      std::string Msg;
+      while (_error->empty() == false)
+      {
+	 bool const Error = _error->PopMessage(Msg);
+	 Messages[Idx].emplace_back(Error, Msg);
+      }
+      Messages[Idx].emplace_back(true, "");
+   };
+   std::vector<std::thread> Workers;
+   for (size_t Idx = 0; Res == true && Idx < Compressors.size(); ++Idx)
+   {
+      try
+      {
+	 Workers.emplace_back(Compress, Idx);
+      }
+      catch (std::system_error const &)
+      {
+	 // no more threads for us, so continue serially
+	 Compress(Idx);
+      }
+   }
+   for (auto &W : Workers)
+      W.join();
+   if (Data != nullptr)
+      munmap(Data, FileSize);
+
+   for (auto const &M : Messages)
+      for (auto const &Msg : M)
+      {
+	 if (Msg.second.empty() == false)
+	    _error->Insert(Msg.first ? GlobalError::ERROR : GlobalError::WARNING, "%s", Msg.second.c_str());
+	 if (Msg.first == true)
+	    Res = false;
+      }
+   if (Res == false)
+   {
+      RemoveNew();
+      return false;
+   }
+   return RenameNew();
+}
+									/*}}}*/
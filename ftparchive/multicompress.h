@@ -39,8 +39,14 @@ class MultiCompress
    Files *Outputs;
    pid_t Outputter;
    mode_t Permissions;
+   // Input is a tempfile compressed by threads instead of a pipe to a child
+   bool InProcess;
 
    bool Child(int const &Fd);
+   bool CompressInProcess();
+   bool CompareOld(std::string const &MD5, unsigned long long const FileSize, bool &Same);
+   bool RenameNew();
+   bool RemoveNew();
    bool Start();
    bool Die();
    
@@ -0,0 +1,309 @@
+// -*- mode: cpp; mode: fold -*-
+// Description								/*{{{*/
+/* ######################################################################
+
+   PDiff - Maintain the pdiff history of an index file
+
+   The patches are ed scripts as produced by 'diff --ed' which transform
+   the previous version of the index into the next one. They are stored
+   gzip compressed in $(FILE).diff/ and listed in $(FILE).diff/Index
+   together with the hash of the file they apply to, so that clients can
+   chain them from whatever version they have to the current one.
+
+   ##################################################################### */
+									/*}}}*/
+// Include Files							/*{{{*/
+#include <config.h>
+
+#include <apt-pkg/error.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/hashes.h>
+#include <apt-pkg/strutl.h>
+#include <apt-pkg/tagfile.h>
+
+#include <locale>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "multicompress.h"
+#include "pdiff.h"
+
+#include <apti18n.h>
+									/*}}}*/
+
+namespace {
+struct PatchInfo
+{
+   std::string Name;
+   // the file the patch applies to
+   std::string ResultHash;
+   unsigned long long ResultSize;
+   // the uncompressed patch
+   std::string PatchHash;
+   unsigned long long PatchSize;
+   // the patch as stored in the archive
+   std::string DownloadHash;
+   unsigned long long DownloadSize;
+};
+}
+
+// HashFile - SHA256 and size of an open file				/*{{{*/
+static bool HashFile(FileFd &Fd, std::string &Hash, unsigned long long &Size)
+{
+   if (Fd.Seek(0) == false)
+      return false;
+   Hashes Hash256(Hashes::SHA256SUM);
+   if (Hash256.AddFD(Fd) == false)
+      return _error->Errno("read", _("Unable to read %s"), Fd.Name().c_str());
+   Hash = Hash256.GetHashString(Hashes::SHA256SUM).HashValue();
+   Size = Fd.Size();
+   return Fd.Seek(0);
+}
+									/*}}}*/
+// CopyUncompressed - Store the current content of an index in a tmpfile/*{{{*/
+static bool CopyUncompressed(std::string const &Output, std::string const &Compress,
+			     mode_t const Permissions, FileFd &To)
+{
+   MultiCompress Comp(Output, Compress, Permissions, false);
+   FileFd From;
+   if (Comp.OpenOld(From) == false)
+      return false;
+   if (GetTempFile("apt-ftparchive-pdiff", false, &To) == nullptr)
+      return false;
+   return CopyFile(From, To);
+}
+									/*}}}*/
+// RemoveTempFile - Close and delete a file from GetTempFile		/*{{{*/
+static void RemoveTempFile(FileFd &Fd)
+{
+   if (Fd.IsOpen() == false)
+      return;
+   std::string const Name = Fd.Name();
+   Fd.Close();
+   RemoveFile("PDiffWriter", Name);
+}
+									/*}}}*/
+// ParseIndex - Read the patch history of an existing Index		/*{{{*/
+static bool ParseIndex(std::string const &IndexFile, std::string &Current,
+		       std::vector<PatchInfo> &Patches)
+{
+   FileFd Fd(IndexFile, FileFd::ReadOnly);
+   pkgTagFile TF(&Fd);
+   if (Fd.IsOpen() == false || Fd.Failed())
+      return false;
+   pkgTagSection Tags;
+   if (TF.Step(Tags) == false)
+      return _error->Error(_("Unable to parse %s"), IndexFile.c_str());
+
+   auto const &posix = std::locale::classic();
+   {
+      std::istringstream ss(Tags.FindS("SHA256-Current"));
+      ss.imbue(posix);
+      ss >> Current;
+   }
+   std::string Hash, Name;
+   unsigned long long Size;
+   std::istringstream History(Tags.FindS("SHA256-History"));
+   History.imbue(posix);
+   while (History >> Hash >> Size >> Name)
+      Patches.push_back({Name, Hash, Size, "", 0, "", 0});
+
+   auto const FindPatch = [&](std::string const &Name) {
+      for (auto &P : Patches)
+	 if (P.Name == Name)
+	    return &P;
+      return static_cast<PatchInfo *>(nullptr);
+   };
+   std::istringstream Patch(Tags.FindS("SHA256-Patches"));
+   Patch.imbue(posix);
+   while (Patch >> Hash >> Size >> Name)
+      if (auto P = FindPatch(Name); P != nullptr)
+      {
+	 P->PatchHash = Hash;
+	 P->PatchSize = Size;
+      }
+   std::istringstream Download(Tags.FindS("SHA256-Download"));
+   Download.imbue(posix);
+   while (Download >> Hash >> Size >> Name)
+      if (APT::String::Endswith(Name, ".gz") == true)
+	 if (auto P = FindPatch(Name.substr(0, Name.length() - 3)); P != nullptr)
+	 {
+	    P->DownloadHash = Hash;
+	    P->DownloadSize = Size;
+	 }
+   return true;
+}
+									/*}}}*/
+// RunDiff - Write the ed script transforming Old into New to Patch	/*{{{*/
+static bool RunDiff(FileFd &Old, FileFd &New, FileFd &Patch)
+{
+   pid_t const Process = ExecFork();
+   if (Process == 0)
+   {
+      dup2(Patch.Fd(), STDOUT_FILENO);
+      execlp("diff", "diff", "--ed", Old.Name().c_str(), New.Name().c_str(), nullptr);
+      _exit(100);
+   }
+
+   int Status;
+   while (waitpid(Process, &Status, 0) != Process)
+   {
+      if (errno == EINTR)
+	 continue;
+      return _error->Errno("waitpid", _("Waited for %s but it wasn't there"), "diff");
+   }
+   // diff exits with 1 if the files differ and 2 on trouble
+   if (WIFEXITED(Status) == false || WEXITSTATUS(Status) > 1)
+      return _error->Error(_("Sub-process %s returned an error code (%u)"), "diff",
+			   WIFEXITED(Status) ? WEXITSTATUS(Status) : 255u);
+   return true;
+}
+									/*}}}*/
+
+// PDiffWriter::PDiffWriter - Constructor				/*{{{*/
+// ---------------------------------------------------------------------
+/* This has to happen before the index is regenerated as we need a copy
+   of the old content to diff against. */
+PDiffWriter::PDiffWriter(std::string const &Output, std::string const &Compress,
+			 unsigned long const MaxPatches, mode_t const Permissions) :
+   Output(Output), Compress(Compress), MaxPatches(MaxPatches),
+   Permissions(Permissions), OldSize(0)
+{
+   struct stat St;
+   if (MultiCompress::GetStat(Output, Compress, St) == false)
+      return;
+
+   if (CopyUncompressed(Output, Compress, Permissions, OldFile) == false ||
+       HashFile(OldFile, OldHash, OldSize) == false)
+      RemoveTempFile(OldFile);
+}
+									/*}}}*/
+// PDiffWriter::Finish - Add a patch to the new index to the history	/*{{{*/
+// ---------------------------------------------------------------------
+/* If the index hasn't changed nothing is done, otherwise the history is
+   continued if the Index still describes the old file or restarted from
+   scratch if not. */
+bool PDiffWriter::Finish()
+{
+   FileFd NewFile;
+   std::string NewHash;
+   unsigned long long NewSize;
+   if (CopyUncompressed(Output, Compress, Permissions, NewFile) == false ||
+       HashFile(NewFile, NewHash, NewSize) == false)
+   {
+      RemoveTempFile(NewFile);
+      return false;
+   }
+   std::string const DiffDir = Output + ".diff";
+   std::string const IndexFile = flCombine(DiffDir, "Index");
+   if (OldFile.IsOpen() == true && OldHash == NewHash && FileExists(IndexFile) == true)
+   {
+      RemoveTempFile(NewFile);
+      return true;
+   }
+   if (DirectoryExists(DiffDir) == false &&
+       CreateDirectory(flNotFile(Output), DiffDir) == false)
+   {
+      RemoveTempFile(NewFile);
+      return false;
+   }
+
+   std::string Current;
+   std::vector<PatchInfo> Patches;
+   if (FileExists(IndexFile) == true && ParseIndex(IndexFile, Current, Patches) == false)
+   {
+      RemoveTempFile(NewFile);
+      return false;
+   }
+   // the history doesn't lead to our old file (anymore), so it is useless
+   if (OldFile.IsOpen() == false || Current != OldHash)
+   {
+      for (auto const &P : Patches)
+	 RemoveFile("PDiffWriter", flCombine(DiffDir, P.Name + ".gz"));
+      Patches.clear();
+   }
+
+   if (OldFile.IsOpen() == true && OldHash != NewHash && MaxPatches != 0)
+   {
+      PatchInfo P;
+      P.ResultHash = OldHash;
+      P.ResultSize = OldSize;
+
+      // patches are named after the time they were created in
+      char Name[100];
+      time_t const Now = time(nullptr);
+      struct tm Tm;
+      strftime(Name, sizeof(Name), "%Y-%m-%d-%H%M.%S", gmtime_r(&Now, &Tm));
+      P.Name = Name;
+      for (unsigned int I = 1; FileExists(flCombine(DiffDir, P.Name + ".gz")) == true; ++I)
+	 strprintf(P.Name, "%s.%u", Name, I);
+      std::string const PatchFile = flCombine(DiffDir, P.Name + ".gz");
+
+      FileFd Patch;
+      bool Res = GetTempFile("apt-ftparchive-pdiff", false, &Patch) != nullptr &&
+		 RunDiff(OldFile, NewFile, Patch) == true &&
+		 HashFile(Patch, P.PatchHash, P.PatchSize) == true;
+      if (Res == true)
+      {
+	 FileFd Download(PatchFile, FileFd::WriteOnly | FileFd::Create | FileFd::Empty,
+			 FileFd::Gzip, Permissions);
+	 Res = CopyFile(Patch, Download) == true && Download.Close() == true;
+	 if (Res == true)
+	 {
+	    Download.Open(PatchFile, FileFd::ReadOnly);
+	    Res = HashFile(Download, P.DownloadHash, P.DownloadSize);
+	 }
+	 if (Res == false)
+	    RemoveFile("PDiffWriter", PatchFile);
+      }
+      RemoveTempFile(Patch);
+      if (Res == false)
+      {
+	 RemoveTempFile(NewFile);
+	 return false;
+      }
+      Patches.push_back(P);
+   }
+   RemoveTempFile(NewFile);
+
+   while (Patches.size() > MaxPatches)
+   {
+      RemoveFile("PDiffWriter", flCombine(DiffDir, Patches.front().Name + ".gz"));
+      Patches.erase(Patches.begin());
+   }
+
+   std::ostringstream Index;
+   Index.imbue(std::locale::classic());
+   Index << "SHA256-Current: " << NewHash << ' ' << NewSize << '\n';
+   Index << "SHA256-History:\n";
+   for (auto const &P : Patches)
+      Index << ' ' << P.ResultHash << ' ' << P.ResultSize << ' ' << P.Name << '\n';
+   Index << "SHA256-Patches:\n";
+   for (auto const &P : Patches)
+      Index << ' ' << P.PatchHash << ' ' << P.PatchSize << ' ' << P.Name << '\n';
+   Index << "SHA256-Download:\n";
+   for (auto const &P : Patches)
+      Index << ' ' << P.DownloadHash << ' ' << P.DownloadSize << ' ' << P.Name << ".gz\n";
+
+   std::string const Content = Index.str();
+   FileFd Out(IndexFile, FileFd::WriteAtomic, Permissions);
+   if (Out.Write(Content.data(), Content.length()) == false)
+   {
+      Out.OpFail();
+      return false;
+   }
+   return Out.Close();
+}
+									/*}}}*/
+// PDiffWriter::~PDiffWriter - Destructor				/*{{{*/
+PDiffWriter::~PDiffWriter()
+{
+   RemoveTempFile(OldFile);
+}
+									/*}}}*/
@@ -0,0 +1,43 @@
+// -*- mode: cpp; mode: fold -*-
+// Description								/*{{{*/
+/* ######################################################################
+
+   PDiff - Maintain the pdiff history of an index file
+
+   Snapshots an index file before it is regenerated and afterwards adds
+   an ed-style patch from the old to the new content to the Index in the
+   $(FILE).diff directory next to it, as understood by apt's pdiff code.
+
+   ##################################################################### */
+									/*}}}*/
+#ifndef PDIFF_H
+#define PDIFF_H
+
+#include <apt-pkg/fileutl.h>
+
+#include <string>
+#include <sys/types.h>
+
+class PDiffWriter
+{
+   std::string Output;
+   std::string Compress;
+   unsigned long MaxPatches;
+   mode_t Permissions;
+
+   // uncompressed copy of the index before it was regenerated
+   FileFd OldFile;
+   std::string OldHash;
+   unsigned long long OldSize;
+
+   public:
+
+   // Call once the new index is in place
+   bool Finish();
+
+   PDiffWriter(std::string const &Output, std::string const &Compress,
+	       unsigned long const MaxPatches, mode_t const Permissions);
+   ~PDiffWriter();
+};
+
+#endif
@@ -12,6 +12,7 @@
 // Include Files							/*{{{*/
 #include <config.h>
 
+#include <apt-pkg/aptconfiguration.h>
 #include <apt-pkg/configuration.h>
 #include <apt-pkg/debfile.h>
 #include <apt-pkg/deblistparser.h>
@@ -25,11 +26,14 @@
 #include <apt-pkg/tagfile.h>
 
 #include <algorithm>
+#include <condition_variable>
 #include <ctime>
 #include <iomanip>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <sstream>
+#include <thread>
 #include <utility>
 #include <ctype.h>
 #include <fnmatch.h>
@@ -44,6 +48,7 @@
 #include "byhash.h"
 #include "cachedb.h"
 #include "multicompress.h"
+#include "pdiff.h"
 #include "writer.h"
 
 #include <apti18n.h>
@@ -70,7 +75,7 @@ static void ConfigToDoHashes(unsigned int &DoHashes, std::string const &Conf)
 
 // FTWScanner::FTWScanner - Constructor					/*{{{*/
 FTWScanner::FTWScanner(FileFd * const GivenOutput, string const &Arch, bool const IncludeArchAll)
-   : Arch(Arch), IncludeArchAll(IncludeArchAll), DoHashes(~0)
+   : Arch(Arch), IncludeArchAll(IncludeArchAll), Inspected(nullptr), DoHashes(~0)
 {
    if (GivenOutput == NULL)
    {
@@ -137,23 +142,29 @@ int FTWScanner::ScannerFile(const char *const File, bool const ReadLink) /*{{{*/
    return 0;
 }
 									/*}}}*/
-int FTWScanner::ProcessFile(const char *const File, bool const ReadLink) /*{{{*/
+static std::string ResolveLink(const char *const File, bool const ReadLink) /*{{{*/
 {
-   /* Process it. If the file is a link then resolve it into an absolute
-      name.. This works best if the directory components the scanner are
-      given are not links themselves. */
+   /* If the file is a link then resolve it into an absolute name.. This
+      works best if the directory components the scanner are given are not
+      links themselves. */
    char Jnk[2];
    char *RealPath = NULL;
-   Owner->OriginalPath = File;
    if (ReadLink &&
        readlink(File,Jnk,sizeof(Jnk)) != -1 &&
        (RealPath = realpath(File,NULL)) != 0)
    {
-      Owner->DoPackage(RealPath);
+      std::string const Resolved = RealPath;
       free(RealPath);
+      return Resolved;
    }
-   else
-      Owner->DoPackage(File);
+   return File;
+}
+									/*}}}*/
+int FTWScanner::ProcessFile(const char *const File, bool const ReadLink) /*{{{*/
+{
+   // Process it.
+   Owner->OriginalPath = File;
+   Owner->DoPackage(ResolveLink(File, ReadLink));
    
    if (_error->empty() == false)
    {
@@ -214,12 +225,147 @@ bool FTWScanner::RecursiveScan(string const &Dir)
    std::sort(FilesToProcess.begin(), FilesToProcess.end(), [](PairType a, PairType b) {
       return a.first < b.first;
    });
-   if (not std::all_of(FilesToProcess.cbegin(), FilesToProcess.cend(), [](auto &&it) { return ProcessFile(it.first.c_str(), it.second) == 0; }))
-      return false;
+   return ProcessFiles();
+}
+									/*}}}*/
+// FTWScanner::ProcessFiles - Process the collected files in order	/*{{{*/
+bool FTWScanner::ProcessFiles()
+{
+   int const Threads = _config->FindI("APT::FTPArchive::Threads", 0);
+   bool Res;
+   if (Threads > 0 && FilesToProcess.size() > 1)
+      Res = ProcessFilesParallel(Threads);
+   else
+      Res = std::all_of(FilesToProcess.cbegin(), FilesToProcess.cend(), [](auto &&it) { return ProcessFile(it.first.c_str(), it.second) == 0; });
    FilesToProcess.clear();
+   return Res;
+}
+									/*}}}*/
+// FileInspector - Inspect files ahead of the scanner			/*{{{*/
+// ---------------------------------------------------------------------
+/* Opening the archives, extracting their control data and contents and
+   hashing them doesn't need the DB, so worker threads do this for the
+   files which are processed next. Everything else, including the DB
+   updates and the output, stays serial and in the original order. */
+namespace {
+class FileInspector
+{
+   std::vector<std::unique_ptr<CacheDB::Inspection>> Items;
+   std::vector<std::thread> Workers;
+   std::mutex Lock;
+   std::condition_variable Changed;
+   size_t NextToInspect;
+   bool Stopping;
+
+   void Worker()
+   {
+      std::unique_lock<std::mutex> Guard(Lock);
+      while (true)
+      {
+	 Changed.wait(Guard, [&]() { return Stopping || NextToInspect < Items.size(); });
+	 if (Stopping)
+	    return;
+	 CacheDB::Inspection * const I = Items[NextToInspect++].get();
+	 if (I == nullptr || I->Done == true)
+	    continue;
+	 Guard.unlock();
+	 bool const okay = CacheDB::Inspect(*I);
+	 // errors are reported again by the scanner reading the file itself
+	 _error->Discard();
+	 Guard.lock();
+	 I->Done = true;
+	 I->Failed = (okay == false);
+	 Changed.notify_all();
+      }
+   }
+
+   public:
+   void Add(std::unique_ptr<CacheDB::Inspection> I)
+   {
+      std::lock_guard<std::mutex> Guard(Lock);
+      Items.push_back(std::move(I));
+      Changed.notify_all();
+   }
+   CacheDB::Inspection const *Wait(size_t const Idx)
+   {
+      std::unique_lock<std::mutex> Guard(Lock);
+      Changed.wait(Guard, [&]() { return Items[Idx]->Done; });
+      return Items[Idx].get();
+   }
+   void Release(size_t const Idx)
+   {
+      std::lock_guard<std::mutex> Guard(Lock);
+      Items[Idx].reset();
+   }
+
+   FileInspector(size_t const Files, unsigned int const Threads) : NextToInspect(0), Stopping(false)
+   {
+      Items.reserve(Files);
+      // ensure the compressor list is cached before the workers need it
+      APT::Configuration::getCompressors();
+      for (unsigned int i = 0; i < Threads; ++i)
+	 Workers.emplace_back(&FileInspector::Worker, this);
+   }
+   ~FileInspector()
+   {
+      {
+	 std::lock_guard<std::mutex> Guard(Lock);
+	 Stopping = true;
+      }
+      Changed.notify_all();
+      for (auto &W : Workers)
+	 W.join();
+   }
+};
+}
+									/*}}}*/
+// FTWScanner::InspectAhead - Process items with inspecting ahead	/*{{{*/
+// ---------------------------------------------------------------------
+/* The items are planned (which needs the DB) a few items ahead of the one
+   which is processed, so the workers are kept busy while the memory used
+   for the inspected but not yet processed files stays bounded. */
+bool FTWScanner::InspectAhead(size_t const Count, unsigned int const Threads,
+			      std::function<bool(size_t, CacheDB::Inspection &)> const &Plan,
+			      std::function<bool(size_t)> const &Process)
+{
+   size_t const Window = 4 * Threads;
+   FileInspector Inspector(Count, Threads);
+   size_t Planned = 0;
+   for (size_t I = 0; I < Count; ++I)
+   {
+      for (; Planned < Count && Planned < I + Window; ++Planned)
+      {
+	 std::unique_ptr<CacheDB::Inspection> Insp(new CacheDB::Inspection);
+	 // errors are reported again by DoPackage
+	 _error->PushToStack();
+	 if (Plan(Planned, *Insp) == false ||
+	     (Insp->DoControl == false && Insp->DoContents == false && Insp->DoHashes == 0))
+	    Insp->Done = true;
+	 _error->RevertToStack();
+	 Inspector.Add(std::move(Insp));
+      }
+
+      Inspected = Inspector.Wait(I);
+      bool const Res = Process(I);
+      Inspected = nullptr;
+      Inspector.Release(I);
+      if (Res == false)
+	 return false;
+   }
    return true;
 }
 									/*}}}*/
+// FTWScanner::ProcessFilesParallel - Process with inspecting ahead	/*{{{*/
+bool FTWScanner::ProcessFilesParallel(unsigned int const Threads)
+{
+   return InspectAhead(FilesToProcess.size(), Threads, [&](size_t const I, CacheDB::Inspection &Insp) {
+	 auto const &File = FilesToProcess[I];
+	 return PlanPackage(ResolveLink(File.first.c_str(), File.second), Insp);
+      }, [&](size_t const I) {
+	 return ProcessFile(FilesToProcess[I].first.c_str(), FilesToProcess[I].second) == 0;
+      });
+}
+									/*}}}*/
 // FTWScanner::LoadFileList - Load the file list from a file		/*{{{*/
 // ---------------------------------------------------------------------
 /* This is an alternative to using FTW to locate files, it reads the list
@@ -273,12 +419,11 @@ bool FTWScanner::LoadFileList(string const &Dir, string const &File)
       if (FileMatchesPatterns(FileName, Patterns) == false)
 	 continue;
 
-      if (ProcessFile(FileName, false) != 0)
-	 break;
+      FilesToProcess.emplace_back(FileName, false);
    }
   
    fclose(List);
-   return true;
+   return ProcessFiles();
 }
 									/*}}}*/
 // FTWScanner::Delink - Delink symlinks					/*{{{*/
@@ -406,15 +551,16 @@ PackagesWriter::PackagesWriter(FileFd * const GivenOutput, TranslationWriter * c
 bool PackagesWriter::DoPackage(string FileName)
 {      
    // Pull all the data we need form the DB
-   if (Db.GetFileInfo(FileName,
+   Db.UseInspection(Inspected);
+   bool const GotInfo = Db.GetFileInfo(FileName,
 	    true, /* DoControl */
 	    DoContents,
 	    true, /* GenContentsOnly */
 	    false, /* DoSource */
-	    DoHashes, DoAlwaysStat) == false)
-   {
+	    DoHashes, DoAlwaysStat);
+   Db.UseInspection(nullptr);
+   if (GotInfo == false)
      return false;
-   }
 
    unsigned long long FileSize = Db.GetFileSize();
    if (Delink(FileName,OriginalPath,Stats.DeLinkBytes,FileSize) == false)
@@ -526,6 +672,15 @@ bool PackagesWriter::DoPackage(string FileName)
    return Db.Finish();
 }
 									/*}}}*/
+// PackagesWriter::PlanPackage - What DoPackage will read from the file	/*{{{*/
+bool PackagesWriter::PlanPackage(string const &FileName, CacheDB::Inspection &I)
+{
+   return Db.PlanInspection(FileName,
+	    true, /* DoControl */
+	    DoContents,
+	    DoHashes, DoAlwaysStat, I);
+}
+									/*}}}*/
 PackagesWriter::~PackagesWriter()					/*{{{*/
 {
 }
@@ -535,11 +690,16 @@ PackagesWriter::~PackagesWriter()					/*{{{*/
 // ---------------------------------------------------------------------
 /* Create a Translation-Master file for this Packages file */
 TranslationWriter::TranslationWriter(string const &File, string const &TransCompress,
-					mode_t const &Permissions) : Comp(NULL), Output(NULL)
+					mode_t const &Permissions, bool const PDiffs,
+					unsigned long const MaxPatches) :
+   Comp(NULL), PDiff(NULL), Output(NULL)
 {
    if (File.empty() == true)
       return;
 
+   // the old file has to be saved before the compressor starts replacing it
+   if (PDiffs == true)
+      PDiff = new PDiffWriter(File, TransCompress, MaxPatches, Permissions);
    Comp = new MultiCompress(File, TransCompress, Permissions);
    Output = &Comp->Input;
 }
@@ -576,6 +736,12 @@ TranslationWriter::~TranslationWriter()
 {
    if (Comp != NULL)
       delete Comp;
+   if (PDiff != NULL)
+   {
+      if (_error->PendingError() == false)
+	 PDiff->Finish();
+      delete PDiff;
+   }
 }
 									/*}}}*/
 
@@ -895,16 +1061,17 @@ ContentsWriter::ContentsWriter(FileFd * const GivenOutput, string const &DB,
    determine what the package name is. */
 bool ContentsWriter::DoPackage(string FileName, string Package)
 {
-   if (!Db.GetFileInfo(FileName,
+   Db.UseInspection(Inspected);
+   bool const GotInfo = Db.GetFileInfo(FileName,
 	    Package.empty(), /* DoControl */
 	    true, /* DoContents */
 	    false, /* GenContentsOnly */
 	    false, /* DoSource */
 	    0, /* DoHashes */
-	    false /* checkMtime */))
-   {
+	    false /* checkMtime */);
+   Db.UseInspection(nullptr);
+   if (GotInfo == false)
       return false;
-   }
 
    // Parse the package name
    if (Package.empty() == true)
@@ -917,6 +1084,17 @@ bool ContentsWriter::DoPackage(string FileName, string Package)
    return Db.Finish();
 }
 									/*}}}*/
+// ContentsWriter::PlanPackage - What DoPackage will read from the file	/*{{{*/
+bool ContentsWriter::PlanPackage(string const &FileName, CacheDB::Inspection &I)
+{
+   return Db.PlanInspection(FileName,
+	    true, /* DoControl */
+	    true, /* DoContents */
+	    0, /* DoHashes */
+	    false, /* checkMtime */
+	    I);
+}
+									/*}}}*/
 // ContentsWriter::ReadFromPkgs - Read from a packages file		/*{{{*/
 // ---------------------------------------------------------------------
 /* */
@@ -937,21 +1115,38 @@ bool ContentsWriter::ReadFromPkgs(string const &PkgFile,string const &PkgCompres
 
    // Parse.
    pkgTagSection Section;
+   std::vector<std::pair<string, string>> Files;
    while (Tags.Step(Section) == true)
    {
       auto File = flCombine(Prefix, Section.Find(pkgTagSection::Key::Filename).to_string());
       auto Package = flCombine(Section.Find(pkgTagSection::Key::Section).to_string(), Section.Find(pkgTagSection::Key::Package).to_string());
-      DoPackage(std::move(File), std::move(Package));
-      if (_error->empty() == false)
-      {
-	 _error->Error("Errors apply to file '%s'",File.c_str());
-	 _error->DumpErrors();
-      }
+      Files.emplace_back(std::move(File), std::move(Package));
    }
 
    // Tidy the compressor
    Fd.Close();
 
+   auto const Process = [&](size_t const I) {
+      DoPackage(Files[I].first, Files[I].second);
+      if (_error->empty() == false)
+      {
+	 _error->Error("Errors apply to file '%s'",Files[I].first.c_str());
+	 _error->DumpErrors();
+      }
+      return true;
+   };
+   int const Threads = _config->FindI("APT::FTPArchive::Threads", 0);
+   if (Threads > 0 && Files.size() > 1)
+      return InspectAhead(Files.size(), Threads, [&](size_t const I, CacheDB::Inspection &Insp) {
+	    return Db.PlanInspection(Files[I].first,
+		  false, /* DoControl */
+		  true, /* DoContents */
+		  0, /* DoHashes */
+		  false, /* checkMtime */
+		  Insp);
+	 }, Process);
+   for (size_t I = 0; I < Files.size(); ++I)
+      Process(I);
    return true;
 }
 
@@ -14,6 +14,7 @@
 
 #include <apt-pkg/hashes.h>
 
+#include <functional>
 #include <iostream>
 #include <map>
 #include <set>
@@ -52,6 +53,15 @@ class FTWScanner
    static int ScannerFTW(const char *File,const struct stat *sb,int Flag);
    static int ScannerFile(const char *const File, bool const ReadLink);
    static int ProcessFile(const char *const File, bool const ReadLink);
+   bool ProcessFiles();
+   bool ProcessFilesParallel(unsigned int const Threads);
+   bool InspectAhead(size_t const Count, unsigned int const Threads,
+		     std::function<bool(size_t, CacheDB::Inspection &)> const &Plan,
+		     std::function<bool(size_t)> const &Process);
+
+   // What DoPackage will read from the file, so it can be done ahead
+   virtual bool PlanPackage(string const &/*FileName*/, CacheDB::Inspection &/*I*/) {return false;};
+   CacheDB::Inspection const *Inspected;
 
    bool Delink(string &FileName,const char *OriginalPath,
 	       unsigned long long &Bytes,unsigned long long const &FileSize);
@@ -87,17 +97,20 @@ class FTWScanner
 };
 
 class MultiCompress;
+class PDiffWriter;
 
 class TranslationWriter
 {
    MultiCompress *Comp;
+   PDiffWriter *PDiff;
    std::set<string> Included;
    FileFd *Output;
 
    public:
    bool DoPackage(string const &Pkg, string const &Desc, string const &MD5);
 
-   TranslationWriter(string const &File, string const &TransCompress, mode_t const &Permissions);
+   TranslationWriter(string const &File, string const &TransCompress, mode_t const &Permissions,
+		     bool const PDiffs = false, unsigned long const MaxPatches = 0);
    ~TranslationWriter();
 };
 
@@ -124,6 +137,7 @@ class PackagesWriter : public FTWScanner
    inline bool ReadExtraOverride(string const &File) 
       {return Over.ReadExtraOverride(File);};
    virtual bool DoPackage(string FileName) APT_OVERRIDE;
+   virtual bool PlanPackage(string const &FileName, CacheDB::Inspection &I) APT_OVERRIDE;
 
    PackagesWriter(FileFd * const Output, TranslationWriter * const TransWriter, string const &DB,
                   string const &Overrides,
@@ -148,6 +162,7 @@ class ContentsWriter : public FTWScanner
    bool DoPackage(string FileName,string Package);
    virtual bool DoPackage(string FileName) APT_OVERRIDE 
              {return DoPackage(FileName,string());};
+   virtual bool PlanPackage(string const &FileName, CacheDB::Inspection &I) APT_OVERRIDE;
    bool ReadFromPkgs(string const &PkgFile,string const &PkgCompress);
 
    void Finish() {Gen.Print(*Output);};
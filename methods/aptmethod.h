@@ -175,6 +175,10 @@ protected:
       if (_config->FindB("APT::Sandbox::Seccomp", false) == false)
 	 return true;
 
+      // the sandbox doesn't allow creating threads
+      _config->Set("APT::Hashes::Parallel", false);
+      _config->Set("Rred::Parallel", false);
+
       if (RunningInQemu() == true)
       {
 	 Warning("Running in qemu-user, not using seccomp");
@@ -16,6 +16,7 @@
 #include <apt-pkg/fileutl.h>
 #include <apt-pkg/strutl.h>
 
+#include <algorithm>
 #include <iostream>
 #include <limits>
 #include <map>
@@ -552,6 +553,26 @@ bool BaseHttpMethod::Fetch(FetchItem *)
       if (CurrentDepth != 0 && UsableHashes == false)
 	 break;
 
+      // big files can be downloaded in ranges over multiple connections
+      if (UsableHashes && Server->RangesAllowed && FileExists(QueueBack->DestFile) == false &&
+	    ConfigFindI("Dl-Limit", 0) == 0)
+      {
+	 unsigned long long Ranges = std::max(1, ConfigFindI("Segments", 1));
+	 auto const MinSize = ConfigFindI("MinSegmentSize", 16 * 1024 * 1024);
+	 if (MinSize > 0)
+	    Ranges = std::min(Ranges, QueueBack->ExpectedHashes.FileSize() / MinSize);
+	 if (Ranges > 1)
+	 {
+	    // the ranges are requested on connections of their own before
+	    // the item is requested, so wait for the pipeline to drain first
+	    if (CurrentDepth != 0)
+	       break;
+	    if (FetchRanges(QueueBack, Ranges))
+	       continue;
+	 }
+      }
+
+
       if (UsableHashes && FileExists(QueueBack->DestFile))
       {
 	 FileFd partial(QueueBack->DestFile, FileFd::ReadOnly);
@@ -674,6 +695,9 @@ int BaseHttpMethod::Loop()
 
       // Fill the pipeline.
       Fetch(0);
+      // all items might be done without a request
+      if (Queue == nullptr)
+	 continue;
 
       RequestState Req(this, Server.get());
       // Fetch the next URL header data from the server.
@@ -167,6 +167,11 @@ class BaseHttpMethod : public aptAuthConfMethod
    int Loop();
 
    virtual void SendReq(FetchItem *Itm) = 0;
+   /** \brief Download the item in the given number of ranges in parallel
+    *
+    * \return \b true if the item is done, otherwise it is requested as usual
+    * resuming from what was downloaded already */
+   virtual bool FetchRanges(FetchItem *Itm, unsigned long long Ranges) = 0;
    virtual std::unique_ptr<ServerState> CreateServerState(URI const &uri) = 0;
    virtual void RotateDNS() = 0;
    virtual bool Configuration(std::string Message) APT_OVERRIDE;
@@ -32,6 +32,7 @@
 #include <sstream>
 #include <arpa/inet.h>
 #include <errno.h>
+#include <poll.h>
 #include <signal.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -428,6 +429,7 @@ ResultState HttpServerState::Open()
    In.Reset();
    Out.Reset();
    Persistent = true;
+   Opened = std::chrono::steady_clock::now();
 
    bool tls = (ServerName.Access == "https" || APT::String::Endswith(ServerName.Access, "+https"));
 
@@ -540,9 +542,18 @@ ResultState HttpServerState::Open()
 									/*}}}*/
 // HttpServerState::Close - Close a connection to the server		/*{{{*/
 // ---------------------------------------------------------------------
-/* */
+/* With debugging enabled the throughput of the connection is reported, which
+   helps to judge if more connections per host would be beneficial. */
 bool HttpServerState::Close()
 {
+   if (Owner->Debug == true && ServerFd->Fd() != -1)
+   {
+      std::chrono::duration<double> const Seconds = std::chrono::steady_clock::now() - Opened;
+      auto const Rate = Seconds.count() > 0 ? In.TotalRead() / Seconds.count() : 0;
+      cerr << "Closing connection to " << ServerName.Host << " after receiving "
+	   << SizeToStr(In.TotalRead()) << "B in " << Seconds.count() << "s ("
+	   << SizeToStr(Rate) << "B/s)" << endl;
+   }
    ServerFd->Close();
    return true;
 }
@@ -877,6 +888,12 @@ ResultState HttpServerState::Go(bool ToFile, RequestState &Req)
 // ---------------------------------------------------------------------
 /* This places the http request in the outbound buffer */
 void HttpMethod::SendReq(FetchItem *Itm)
+{
+   SendReq(Itm, Server.get(), "");
+}
+/* The request can be sent over another connection to the same server and
+   be limited to the given range instead of resuming a partial file */
+void HttpMethod::SendReq(FetchItem *Itm, ServerState *Srv, std::string const &Range)
 {
    URI Uri(Itm->Uri);
    {
@@ -898,7 +915,7 @@ void HttpMethod::SendReq(FetchItem *Itm)
       but while its a must for all servers to accept absolute URIs,
       it is assumed clients will sent an absolute path for non-proxies */
    std::string requesturi;
-   if ((Server->Proxy.Access != "http" && Server->Proxy.Access != "https") || APT::String::Endswith(Uri.Access, "https") || Server->Proxy.empty() == true || Server->Proxy.Host.empty())
+   if ((Srv->Proxy.Access != "http" && Srv->Proxy.Access != "https") || APT::String::Endswith(Uri.Access, "https") || Srv->Proxy.empty() == true || Srv->Proxy.Host.empty())
       requesturi = Uri.Path;
    else
       requesturi = Uri;
@@ -940,16 +957,18 @@ void HttpMethod::SendReq(FetchItem *Itm)
 
    // Check for a partial file and send if-queries accordingly
    struct stat SBuf;
-   if (Server->RangesAllowed && stat(Itm->DestFile.c_str(),&SBuf) >= 0 && SBuf.st_size > 0)
+   if (Range.empty() == false)
+      Req << "Range: bytes=" << Range << "\r\n";
+   else if (Srv->RangesAllowed && stat(Itm->DestFile.c_str(),&SBuf) >= 0 && SBuf.st_size > 0)
       Req << "Range: bytes=" << std::to_string(SBuf.st_size) << "-\r\n"
 	 << "If-Range: " << TimeRFC1123(SBuf.st_mtime, false) << "\r\n";
    else if (Itm->LastModified != 0)
       Req << "If-Modified-Since: " << TimeRFC1123(Itm->LastModified, false).c_str() << "\r\n";
 
-   if ((Server->Proxy.Access == "http" || Server->Proxy.Access == "https") &&
-       (Server->Proxy.User.empty() == false || Server->Proxy.Password.empty() == false))
+   if ((Srv->Proxy.Access == "http" || Srv->Proxy.Access == "https") &&
+       (Srv->Proxy.User.empty() == false || Srv->Proxy.Password.empty() == false))
       Req << "Proxy-Authorization: Basic "
-	 << Base64Encode(Server->Proxy.User + ":" + Server->Proxy.Password) << "\r\n";
+	 << Base64Encode(Srv->Proxy.User + ":" + Srv->Proxy.Password) << "\r\n";
 
    MaybeAddAuthTo(Uri);
    if (Uri.User.empty() == false || Uri.Password.empty() == false)
@@ -986,7 +1005,202 @@ void HttpMethod::SendReq(FetchItem *Itm)
    if (Debug == true)
       cerr << Req.str() << endl;
 
-   Server->WriteResponse(Req.str());
+   Srv->WriteResponse(Req.str());
+}
+									/*}}}*/
+// HttpMethod::FetchRanges - Download a file in ranges in parallel	/*{{{*/
+// ---------------------------------------------------------------------
+/* A single connection is often far below the capacity of the link for big
+   files, so each range is requested over a connection of its own and
+   written to its place in the file as it arrives. The assembled file is
+   verified in one pass at the end. If a range fails the file is cut back
+   to the part downloaded completely from the start, so that the usual
+   request resumes from there. */
+bool HttpMethod::FetchRanges(FetchItem *Itm, unsigned long long const Ranges)
+{
+   struct Part
+   {
+      std::unique_ptr<HttpServerState> Server;
+      std::unique_ptr<RequestState> Req;
+      unsigned long long From = 0;
+      unsigned long long Length = 0;
+      bool Done = false;
+   };
+   auto const FileSize = Itm->ExpectedHashes.FileSize();
+   // errors just make us fall back to the usual request which reports its own
+   _error->PushToStack();
+
+   FetchResult Res;
+   Res.Filename = Itm->DestFile;
+   Res.Size = FileSize;
+   URIStart(Res);
+
+   std::vector<Part> Parts(Ranges);
+   for (unsigned long long I = 0; I < Ranges; ++I)
+   {
+      auto &P = Parts[I];
+      P.From = FileSize / Ranges * I;
+      P.Length = (I + 1 == Ranges ? FileSize : FileSize / Ranges * (I + 1)) - P.From;
+      P.Server.reset(new HttpServerState(URI(Itm->Uri), this));
+      P.Server->RangesAllowed = true;
+      P.Req.reset(new RequestState(this, P.Server.get()));
+      if (P.Server->Open() != ResultState::SUCCESSFUL ||
+	    P.Req->File.Open(Itm->DestFile, FileFd::WriteOnly | FileFd::Create) == false ||
+	    P.Req->File.Seek(P.From) == false)
+      {
+	 P.Server->Close();
+	 continue;
+      }
+      SendReq(Itm, P.Server.get(), std::to_string(P.From) + '-' + std::to_string(P.From + P.Length - 1));
+   }
+
+   // all data of a range arrived or its connection is broken
+   auto const Finish = [&](Part &P, bool const Done) {
+      P.Done = Done;
+      P.Server->Close();
+      P.Req->File.Close();
+      if (P.Req->Result == 200 || P.Server->RangesAllowed == false)
+	 Server->RangesAllowed = false;
+   };
+   auto const Transfer = [&](Part &P, short const Events, bool const Pending) {
+      if ((Events & POLLOUT) != 0 && P.Server->Out.Write(P.Server->ServerFd) == false)
+	 return Finish(P, false);
+      bool Closed = false;
+      if (Pending || (Events & (POLLIN | POLLHUP | POLLERR)) != 0)
+	 Closed = P.Server->In.Read(P.Server->ServerFd) == false;
+
+      if (P.Req->State == RequestState::Header)
+      {
+	 std::string Data;
+	 if (P.Server->In.WriteTillEl(Data) == false)
+	 {
+	    if (Closed)
+	       Finish(P, false);
+	    return;
+	 }
+	 if (Debug == true)
+	    clog << "Answer for: " << Itm->Uri << " (" << P.From << "+" << P.Length << ")" << endl << Data;
+	 for (auto I = Data.cbegin(); I < Data.cend(); ++I)
+	 {
+	    auto J = I;
+	    for (; J != Data.cend() && *J != '\n' && *J != '\r'; ++J);
+	    if (P.Req->HeaderLine(std::string(I, J)) == false)
+	       return Finish(P, false);
+	    I = J;
+	 }
+	 if (P.Req->Result != 206 || P.Req->Encoding == RequestState::Chunked ||
+	       P.Req->StartPos != P.From || P.Req->TotalFileSize != FileSize)
+	    return Finish(P, false);
+	 P.Req->State = RequestState::Data;
+	 P.Server->In.Limit(P.Length);
+      }
+
+      while (P.Server->In.WriteSpace() == true && P.Server->In.IsLimit() == false)
+	 if (P.Server->In.Write(MethodFd::FromFd(P.Req->File.Fd())) == false)
+	    return Finish(P, false);
+      if (P.Server->In.IsLimit() == true)
+	 Finish(P, true);
+      else if (Closed)
+	 Finish(P, false);
+   };
+
+   bool const DependOnSTDIN = ConfigFindB("DependOnSTDIN", true);
+   std::vector<struct pollfd> Fds;
+   std::vector<Part *> Active;
+   while (true)
+   {
+      Fds.clear();
+      Active.clear();
+      bool Pending = false;
+      for (auto &P : Parts)
+      {
+	 if (P.Done || P.Server->IsOpen() == false)
+	    continue;
+	 short Events = 0;
+	 if (P.Server->In.ReadSpace() == true)
+	    Events |= POLLIN;
+	 if (P.Server->Out.WriteSpace() == true)
+	    Events |= POLLOUT;
+	 Fds.push_back({P.Server->ServerFd->Fd(), Events, 0});
+	 Active.push_back(&P);
+	 Pending |= P.Server->ServerFd->HasPending();
+      }
+      if (Active.empty())
+	 break;
+      if (DependOnSTDIN)
+	 Fds.push_back({STDIN_FILENO, POLLIN, 0});
+
+      int const Ready = poll(Fds.data(), Fds.size(), Pending ? 0 : Server->TimeOut * 1000);
+      if (Ready < 0)
+      {
+	 if (errno == EINTR)
+	    continue;
+	 _error->Errno("poll", _("Select failed"));
+	 break;
+      }
+      if (Ready == 0 && Pending == false)
+      {
+	 _error->Error(_("Connection timed out"));
+	 break;
+      }
+
+      for (size_t I = 0; I < Active.size(); ++I)
+	 if (Fds[I].revents != 0 || Active[I]->Server->ServerFd->HasPending())
+	    Transfer(*Active[I], Fds[I].revents, Active[I]->Server->ServerFd->HasPending());
+
+      // Handle commands from APT
+      if (DependOnSTDIN && Fds.back().revents != 0 && Run(true) != -1)
+	 exit(100);
+   }
+
+   time_t Date = 0;
+   unsigned long long Complete = 0;
+   for (auto &P : Parts)
+   {
+      if (P.Done == false)
+	 break;
+      Complete += P.Length;
+      Date = P.Req->Date;
+   }
+   for (auto &P : Parts)
+      if (P.Done == false)
+	 Finish(P, false);
+
+   if (Debug == true)
+      _error->DumpErrors(std::cerr, GlobalError::DEBUG, false);
+   _error->RevertToStack();
+
+   if (Complete == FileSize)
+   {
+      Hashes Hash(Itm->ExpectedHashes);
+      FileFd File(Itm->DestFile, FileFd::ReadOnly);
+      if (Hash.AddFD(File) && Hash.GetHashStringList() == Itm->ExpectedHashes)
+      {
+	 struct timeval times[2];
+	 times[0].tv_sec = times[1].tv_sec = Date;
+	 times[0].tv_usec = times[1].tv_usec = 0;
+	 utimes(Itm->DestFile.c_str(), times);
+	 Res.LastModified = Date;
+	 Res.TakeHashes(Hash);
+	 URIDone(Res);
+	 return true;
+      }
+      Complete = 0;
+   }
+
+   if (Complete == 0)
+      RemoveFile("FetchRanges", Itm->DestFile);
+   else if (truncate(Itm->DestFile.c_str(), Complete) == 0)
+   {
+      // the usual request resumes with an If-Range on the modification time
+      struct timeval times[2];
+      times[0].tv_sec = times[1].tv_sec = Date;
+      times[0].tv_usec = times[1].tv_usec = 0;
+      utimes(Itm->DestFile.c_str(), times);
+   }
+   else
+      RemoveFile("FetchRanges", Itm->DestFile);
+   return false;
 }
 									/*}}}*/
 std::unique_ptr<ServerState> HttpMethod::CreateServerState(URI const &uri)/*{{{*/
@@ -65,6 +65,8 @@ class CircleBuf
    Hashes *Hash;
    // total amount of data that got written so far
    unsigned long long TotalWriten;
+   // total amount of data that got read in since the last reset
+   unsigned long long TotalRead() const {return InP;};
 
    // Read data in
    bool Read(std::unique_ptr<MethodFd> const &Fd);
@@ -98,6 +100,9 @@ struct HttpServerState: public ServerState
    std::unique_ptr<MethodFd> ServerFd;
 
    protected:
+   // when the current connection was opened to report its throughput
+   std::chrono::steady_clock::time_point Opened;
+
    virtual bool ReadHeaderLines(std::string &Data) APT_OVERRIDE;
    virtual ResultState LoadNextResponse(bool const ToFile, RequestState &Req) APT_OVERRIDE;
    virtual bool WriteResponse(std::string const &Data) APT_OVERRIDE;
@@ -125,6 +130,7 @@ class HttpMethod : public BaseHttpMethod
 {
    public:
    virtual void SendReq(FetchItem *Itm) APT_OVERRIDE;
+   virtual bool FetchRanges(FetchItem *Itm, unsigned long long Ranges) APT_OVERRIDE;
 
    virtual std::unique_ptr<ServerState> CreateServerState(URI const &uri) APT_OVERRIDE;
    virtual void RotateDNS() APT_OVERRIDE;
@@ -133,6 +139,8 @@ class HttpMethod : public BaseHttpMethod
    protected:
    std::string AutoDetectProxyCmd;
 
+   void SendReq(FetchItem *Itm, ServerState *Srv, std::string const &Range);
+
    public:
    friend struct HttpServerState;
 
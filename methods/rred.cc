@@ -20,14 +20,18 @@
 
 #include <apt-private/private-cmndline.h>
 
+#include <algorithm>
+#include <deque>
+#include <future>
 #include <iostream>
-#include <list>
+#include <iterator>
 #include <string>
 #include <vector>
 #include <stddef.h>
 
 #include <cassert>
 #include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -40,6 +44,7 @@
 #define APT_MEMBLOCK_SIZE (512*1024)
 #endif
 
+#ifndef APT_EXCLUDE_RRED_METHOD_CODE
 static bool ShowHelp(CommandLine &)
 {
    std::cout <<
@@ -66,6 +71,7 @@ static bool ShowHelp(CommandLine &)
       ;
    return true;
 }
+#endif
 
 class MemBlock {
    char *start;
@@ -179,19 +185,73 @@ struct Change {
 };
 
 class FileChanges {
-   std::list<struct Change> changes;
-   std::list<struct Change>::iterator where;
-   size_t pos; // line number is as far left of iterator as possible
+   /* The changes are kept in file order in a treap: a binary tree balanced
+    * by random priorities in which each node knows how many lines it and
+    * its subtree span, so the change for a given line is found in
+    * logarithmic time instead of by walking a list of all changes (which
+    * made merging many patches with many hunks each quadratic). */
+   struct Node {
+      struct Change change;
+      Node *parent = nullptr;
+      Node *left = nullptr;
+      Node *right = nullptr;
+      uint32_t priority = 0;
+      size_t lines = 0; // offset + add_cnt of all changes in this subtree
+
+      explicit Node(Change const &c) : change(c) {}
+   };
+   std::deque<Node> nodes;
+   std::vector<Node *> unused;
+   Node *root = nullptr;
+   Node *where = nullptr; // nullptr is the end
+   size_t pos; // line number is as far left of where as possible
+   uint32_t seed = 2463534242u;
+
+   static size_t width(Node const * const n) { return n->change.offset + n->change.add_cnt; }
+   static size_t lines(Node const * const n) { return n == nullptr ? 0 : n->lines; }
+   static void update(Node * const n) { n->lines = lines(n->left) + width(n) + lines(n->right); }
+   static void update_up(Node *n)
+   {
+      for (; n != nullptr; n = n->parent)
+	 update(n);
+   }
+   static Node *first(Node *n)
+   {
+      while (n->left != nullptr)
+	 n = n->left;
+      return n;
+   }
+   static Node *last(Node *n)
+   {
+      while (n->right != nullptr)
+	 n = n->right;
+      return n;
+   }
+   static Node *next(Node *n)
+   {
+      if (n->right != nullptr)
+	 return first(n->right);
+      while (n->parent != nullptr && n->parent->right == n)
+	 n = n->parent;
+      return n->parent;
+   }
+   static Node *prev(Node *n)
+   {
+      if (n->left != nullptr)
+	 return last(n->left);
+      while (n->parent != nullptr && n->parent->left == n)
+	 n = n->parent;
+      return n->parent;
+   }
 
    bool pos_is_okay(void) const
    {
 #ifdef FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION
       // this isn't unsafe, it is just a moderately expensive check we want to avoid normally
       size_t cpos = 0;
-      std::list<struct Change>::const_iterator x;
-      for (x = changes.begin(); x != where; ++x) {
-	 assert(x != changes.end());
-	 cpos += x->offset + x->add_cnt;
+      for (Node *x = root == nullptr ? nullptr : first(root); x != where; x = next(x)) {
+	 assert(x != nullptr);
+	 cpos += width(x);
       }
       return cpos == pos;
 #else
@@ -200,38 +260,67 @@ class FileChanges {
    }
 
    public:
+   class iterator {
+      FileChanges const *owner;
+      Node *node;
+      friend class FileChanges;
+      iterator(FileChanges const * const owner, Node * const node) : owner(owner), node(node) {}
+
+      public:
+      typedef std::bidirectional_iterator_tag iterator_category;
+      typedef struct Change value_type;
+      typedef std::ptrdiff_t difference_type;
+      typedef struct Change *pointer;
+      typedef struct Change &reference;
+
+      iterator() noexcept : owner(nullptr), node(nullptr) {}
+      reference operator*() const { return node->change; }
+      pointer operator->() const { return &node->change; }
+      iterator &operator++() { node = next(node); return *this; }
+      iterator operator++(int) { iterator tmp(*this); ++*this; return tmp; }
+      iterator &operator--() { node = (node == nullptr) ? last(owner->root) : prev(node); return *this; }
+      iterator operator--(int) { iterator tmp(*this); --*this; return tmp; }
+      bool operator==(iterator const &o) const { return node == o.node; }
+      bool operator!=(iterator const &o) const { return node != o.node; }
+   };
+   typedef std::reverse_iterator<iterator> reverse_iterator;
+
    FileChanges() {
-      where = changes.end();
       pos = 0;
    }
+   FileChanges(FileChanges const &) = delete;
+   FileChanges &operator=(FileChanges const &) = delete;
+
+   iterator begin(void) { return iterator(this, root == nullptr ? nullptr : first(root)); }
+   iterator end(void) { return iterator(this, nullptr); }
 
-   std::list<struct Change>::iterator begin(void) { return changes.begin(); }
-   std::list<struct Change>::iterator end(void) { return changes.end(); }
+   reverse_iterator rbegin(void) { return reverse_iterator(end()); }
+   reverse_iterator rend(void) { return reverse_iterator(begin()); }
 
-   std::list<struct Change>::reverse_iterator rbegin(void) { return changes.rbegin(); }
-   std::list<struct Change>::reverse_iterator rend(void) { return changes.rend(); }
+   size_t size(void) const { return nodes.size() - unused.size(); }
 
    bool add_change(Change c) {
       assert(pos_is_okay());
       if (not go_to_change_for(c.offset) ||
-	  pos + where->offset != c.offset)
+	  pos + where->change.offset != c.offset)
 	 return false;
       if (c.del_cnt > 0)
 	 if (not delete_lines(c.del_cnt))
 	    return false;
-      if (pos + where->offset != c.offset)
+      if (pos + where->change.offset != c.offset)
 	 return false;
       if (c.add_len > 0) {
 	 assert(pos_is_okay());
-	 if (where->add_len > 0)
+	 if (where->change.add_len > 0)
 	    if (not new_change())
 	       return false;
-	 if (where->add_len != 0 || where->add_cnt != 0)
+	 if (where->change.add_len != 0 || where->change.add_cnt != 0)
 	    return false;
 
-	 where->add_len = c.add_len;
-	 where->add_cnt = c.add_cnt;
-	 where->add = c.add;
+	 where->change.add_len = c.add_len;
+	 where->change.add_cnt = c.add_cnt;
+	 where->change.add = c.add;
+	 update_up(where);
       }
       assert(pos_is_okay());
       if (not merge())
@@ -240,27 +329,120 @@ class FileChanges {
    }
 
    private:
+   Node *allocate(Change const &c)
+   {
+      Node *n;
+      if (unused.empty()) {
+	 nodes.emplace_back(c);
+	 n = &nodes.back();
+      } else {
+	 n = unused.back();
+	 unused.pop_back();
+	 *n = Node(c);
+      }
+      // xorshift is good enough to keep the tree balanced
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      n->priority = seed;
+      update(n);
+      return n;
+   }
+
+   void rotate_up(Node * const n)
+   {
+      Node * const p = n->parent;
+      Node * const g = p->parent;
+      if (p->left == n) {
+	 p->left = n->right;
+	 if (n->right != nullptr)
+	    n->right->parent = p;
+	 n->right = p;
+      } else {
+	 p->right = n->left;
+	 if (n->left != nullptr)
+	    n->left->parent = p;
+	 n->left = p;
+      }
+      p->parent = n;
+      n->parent = g;
+      if (g == nullptr)
+	 root = n;
+      else if (g->left == p)
+	 g->left = n;
+      else
+	 g->right = n;
+      update(p);
+      update(n);
+   }
+
+   Node *insert_before(Node * const at, Change const &c)
+   {
+      Node * const n = allocate(c);
+      if (root == nullptr)
+	 root = n;
+      else {
+	 Node *p;
+	 if (at == nullptr) {
+	    p = last(root);
+	    p->right = n;
+	 } else if (at->left == nullptr) {
+	    p = at;
+	    p->left = n;
+	 } else {
+	    p = last(at->left);
+	    p->right = n;
+	 }
+	 n->parent = p;
+	 update_up(p);
+	 while (n->parent != nullptr && n->parent->priority < n->priority)
+	    rotate_up(n);
+      }
+      return n;
+   }
+
+   Node *erase(Node * const n)
+   {
+      Node * const following = next(n);
+      while (n->left != nullptr || n->right != nullptr) {
+	 if (n->right == nullptr || (n->left != nullptr && n->left->priority > n->right->priority))
+	    rotate_up(n->left);
+	 else
+	    rotate_up(n->right);
+      }
+      Node * const p = n->parent;
+      if (p == nullptr)
+	 root = nullptr;
+      else if (p->left == n)
+	 p->left = nullptr;
+      else
+	 p->right = nullptr;
+      update_up(p);
+      unused.push_back(n);
+      return following;
+   }
+
    bool merge(void)
    {
-      while (where->offset == 0 && where != changes.begin()) {
+      while (where->change.offset == 0 && prev(where) != nullptr) {
 	 if (not left())
 	    return false;
       }
-      std::list<struct Change>::iterator next = where;
-      ++next;
-
-      while (next != changes.end() && next->offset == 0) {
-	 where->del_cnt += next->del_cnt;
-	 next->del_cnt = 0;
-	 if (next->add == NULL) {
-	    next = changes.erase(next);
-	 } else if (where->add == NULL) {
-	    where->add = next->add;
-	    where->add_len = next->add_len;
-	    where->add_cnt = next->add_cnt;
-	    next = changes.erase(next);
+      Node *n = next(where);
+
+      while (n != nullptr && n->change.offset == 0) {
+	 where->change.del_cnt += n->change.del_cnt;
+	 n->change.del_cnt = 0;
+	 if (n->change.add == NULL) {
+	    n = erase(n);
+	 } else if (where->change.add == NULL) {
+	    where->change.add = n->change.add;
+	    where->change.add_len = n->change.add_len;
+	    where->change.add_cnt = n->change.add_cnt;
+	    update_up(where);
+	    n = erase(n);
 	 } else {
-	    ++next;
+	    n = next(n);
 	 }
       }
       return true;
@@ -268,93 +450,98 @@ class FileChanges {
 
    bool go_to_change_for(size_t line)
    {
-      while(where != changes.end()) {
-	 if (line < pos) {
-	    if (not left())
-	       return false;
-	    continue;
-	 }
-	 if (pos + where->offset + where->add_cnt <= line) {
-	    if (not right())
-	       return false;
-	    continue;
+      // find the first change which ends after the line
+      where = nullptr;
+      pos = lines(root);
+      size_t base = 0;
+      for (Node *n = root; n != nullptr;) {
+	 size_t const start = base + lines(n->left);
+	 if (start + width(n) > line) {
+	    where = n;
+	    pos = start;
+	    n = n->left;
+	 } else {
+	    base = start + width(n);
+	    n = n->right;
 	 }
+      }
+      if (where != nullptr && line >= pos + where->change.offset) {
 	 // line is somewhere in this slot
-	 if (line < pos + where->offset) {
-	    break;
-	 } else if (line == pos + where->offset) {
+	 if (line == pos + where->change.offset)
 	    return true;
-	 } else {
-	    if (not split(line - pos))
-	       return false;
-	    return right();
-	 }
+	 if (not split(line - pos))
+	    return false;
+	 return right();
       }
       /* it goes before this patch */
       return insert(line-pos);
    }
 
-   bool new_change(void) { return insert(where->offset); }
+   bool new_change(void) { return insert(where->change.offset); }
 
    bool insert(size_t offset)
    {
       assert(pos_is_okay());
-      if (where != changes.end() && offset > where->offset)
+      if (where != nullptr && offset > where->change.offset)
 	 return false;
-      if (where != changes.end())
-	 where->offset -= offset;
-      changes.insert(where, Change(offset));
-      --where;
+      if (where != nullptr) {
+	 where->change.offset -= offset;
+	 update_up(where);
+      }
+      where = insert_before(where, Change(offset));
       return pos_is_okay();
    }
 
    bool split(size_t offset)
    {
       assert(pos_is_okay());
-      if (where->offset >= offset || offset >= where->offset + where->add_cnt)
+      Change &c = where->change;
+      if (c.offset >= offset || offset >= c.offset + c.add_cnt)
 	 return false;
 
-      size_t keep_lines = offset - where->offset;
+      size_t keep_lines = offset - c.offset;
 
-      Change before(*where);
+      Change before(c);
 
-      where->del_cnt = 0;
-      where->offset = 0;
-      if (not where->skip_lines(keep_lines))
+      c.del_cnt = 0;
+      c.offset = 0;
+      if (not c.skip_lines(keep_lines))
 	 return false;
+      update_up(where);
 
       before.add_cnt = keep_lines;
-      before.add_len -= where->add_len;
+      before.add_len -= c.add_len;
 
-      changes.insert(where, before);
-      --where;
+      where = insert_before(where, before);
       return pos_is_okay();
    }
 
    bool delete_lines(size_t cnt)
    {
       assert(pos_is_okay());
-      std::list<struct Change>::iterator x = where;
+      Node *x = where;
       while (cnt > 0)
       {
 	 size_t del;
-	 del = x->add_cnt;
+	 del = x->change.add_cnt;
 	 if (del > cnt)
 	    del = cnt;
-	 if (not x->skip_lines(del))
+	 if (not x->change.skip_lines(del))
 	    return false;
+	 update_up(x);
 	 cnt -= del;
 
-	 ++x;
-	 if (x == changes.end()) {
+	 x = next(x);
+	 if (x == nullptr) {
 	    del = cnt;
 	 } else {
-	    del = x->offset;
+	    del = x->change.offset;
 	    if (del > cnt)
 	       del = cnt;
-	    x->offset -= del;
+	    x->change.offset -= del;
+	    update_up(x);
 	 }
-	 where->del_cnt += del;
+	 where->change.del_cnt += del;
 	 cnt -= del;
       }
       return pos_is_okay();
@@ -362,19 +549,87 @@ class FileChanges {
 
    bool left(void) {
       assert(pos_is_okay());
-      --where;
-      pos -= where->offset + where->add_cnt;
+      where = (where == nullptr) ? last(root) : prev(where);
+      pos -= width(where);
       return pos_is_okay();
    }
 
    bool right(void) {
       assert(pos_is_okay());
-      pos += where->offset + where->add_cnt;
-      ++where;
+      pos += width(where);
+      where = next(where);
       return pos_is_okay();
    }
 };
 
+/* A patch read (and decompressed) into memory completely, offering the
+   subset of the FileFd interface Patch::read_diff uses. Loading can happen
+   on another thread, so the errors are collected to be raised later. */
+class PatchInMemory {
+   std::string name;
+   std::string content;
+   size_t offset = 0;
+   HashStringList hashes;
+   std::vector<std::pair<bool, std::string>> errors;
+
+   public:
+   explicit PatchInMemory(std::string const &name) : name(name) {}
+
+   static PatchInMemory Load(std::string const &FileName, FileFd::CompressMode const Mode, HashStringList const &ExpectedHashes)
+   {
+      PatchInMemory patch(FileName);
+      _error->PushToStack();
+      FileFd f;
+      if (f.Open(FileName, FileFd::ReadOnly, Mode))
+      {
+	 char buffer[APT_MEMBLOCK_SIZE];
+	 unsigned long long actual = 0;
+	 while (f.Read(buffer, sizeof(buffer), &actual) && actual != 0)
+	    patch.content.append(buffer, actual);
+	 f.Close();
+      }
+      if (ExpectedHashes.empty() == false)
+      {
+	 Hashes h(ExpectedHashes);
+	 h.Add(reinterpret_cast<unsigned char const *>(patch.content.data()), patch.content.size());
+	 patch.hashes = h.GetHashStringList();
+      }
+      while (_error->empty() == false)
+      {
+	 std::string msg;
+	 bool const fatal = _error->PopMessage(msg);
+	 patch.errors.emplace_back(fatal, msg);
+      }
+      _error->RevertToStack();
+      return patch;
+   }
+
+   /* \brief raises the errors encountered while loading in this thread */
+   bool Loaded() const
+   {
+      for (auto const &e : errors)
+	 _error->Insert(e.first ? GlobalError::ERROR : GlobalError::WARNING, "%s", e.second.c_str());
+      return std::none_of(errors.begin(), errors.end(), [](auto const &e) { return e.first; });
+   }
+   HashStringList const &GetHashStringList() const { return hashes; }
+
+   char *ReadLine(char * const To, unsigned long long const Size)
+   {
+      if (Eof() || Size == 0)
+	 return nullptr;
+      size_t length = std::min<size_t>(Size - 1, content.size() - offset);
+      char const * const newline = static_cast<char const *>(memchr(content.data() + offset, '\n', length));
+      if (newline != nullptr)
+	 length = newline - (content.data() + offset) + 1;
+      memcpy(To, content.data() + offset, length);
+      To[length] = '\0';
+      offset += length;
+      return To;
+   }
+   bool Eof() const { return offset >= content.size(); }
+   std::string const &Name() const { return name; }
+};
+
 class Patch {
    FileChanges filechanges;
    MemBlock add_text;
@@ -435,7 +690,8 @@ class Patch {
 
    public:
 
-   bool read_diff(FileFd &f, Hashes * const h)
+   template<typename Lines>
+   bool read_diff(Lines &f, Hashes * const h)
    {
       char buffer[APT_MEMBLOCK_SIZE];
       bool cmdwanted = true;
@@ -539,13 +795,13 @@ class Patch {
    void write_diff(FileFd &f)
    {
       unsigned long long line = 0;
-      std::list<struct Change>::reverse_iterator ch;
+      FileChanges::reverse_iterator ch;
       for (ch = filechanges.rbegin(); ch != filechanges.rend(); ++ch) {
 	 line += ch->offset + ch->del_cnt;
       }
 
       for (ch = filechanges.rbegin(); ch != filechanges.rend(); ++ch) {
-	 std::list<struct Change>::reverse_iterator mg_i, mg_e = ch;
+	 FileChanges::reverse_iterator mg_i, mg_e = ch;
 	 while (ch->del_cnt == 0 && ch->offset == 0)
 	 {
 	    ++ch;
@@ -564,10 +820,12 @@ class Patch {
 	    }
 	    f.Write(buf.c_str(), buf.length());
 
-	    mg_i = ch;
-	    do {
+	    // stepping before rbegin() is not possible with our iterators
+	    for (mg_i = ch;; --mg_i) {
 	       dump_mem(f, mg_i->add, mg_i->add_len, NULL);
-	    } while (mg_i-- != mg_e);
+	       if (mg_i == mg_e)
+		  break;
+	    }
 
 	    buf = ".\n";
 	    f.Write(buf.c_str(), buf.length());
@@ -585,7 +843,7 @@ class Patch {
    void apply_against_file(FileFd &out, FileFd &in,
 	 Hashes * const start_hash = nullptr, Hashes * const end_hash = nullptr)
    {
-      std::list<struct Change>::iterator ch;
+      FileChanges::iterator ch;
       for (ch = filechanges.begin(); ch != filechanges.end(); ++ch) {
 	 dump_lines(out, in, ch->offset, start_hash, end_hash);
 	 skip_lines(in, ch->del_cnt, start_hash);
@@ -597,18 +855,38 @@ class Patch {
    }
 };
 
+struct PDiffFile {
+   std::string FileName;
+   HashStringList ExpectedHashes;
+   PDiffFile(std::string const &FileName, HashStringList const &ExpectedHashes) :
+      FileName(FileName), ExpectedHashes(ExpectedHashes) {}
+};
+
+/* Hands the patches in order to the callback; with Parallel the next one is
+   decompressed on a thread while the callback parses the current one. */
+template<typename Callback>
+static bool ForEachPatch(std::vector<PDiffFile> const &patches, FileFd::CompressMode const Mode, bool const Parallel, Callback &&callback)
+{
+   auto const load = [&](size_t const i) {
+      return PatchInMemory::Load(patches[i].FileName, Mode, patches[i].ExpectedHashes);
+   };
+   std::future<PatchInMemory> upcoming;
+   for (size_t i = 0; i < patches.size(); ++i)
+   {
+      PatchInMemory current = upcoming.valid() ? upcoming.get() : load(i);
+      if (Parallel && i + 1 < patches.size())
+	 upcoming = std::async(std::launch::async, load, i + 1);
+      if (callback(current) == false)
+	 return false;
+   }
+   return true;
+}
+
 #ifndef APT_EXCLUDE_RRED_METHOD_CODE
 class RredMethod : public aptMethod {
    private:
       bool Debug;
 
-      struct PDiffFile {
-	 std::string FileName;
-	 HashStringList ExpectedHashes;
-	 PDiffFile(std::string const &FileName, HashStringList const &ExpectedHashes) :
-	    FileName(FileName), ExpectedHashes(ExpectedHashes) {}
-      };
-
       HashStringList ReadExpectedHashesForPatch(unsigned int const patch, std::string const &Message)
       {
 	 HashStringList ExpectedHashes;
@@ -682,29 +960,26 @@ class RredMethod : public aptMethod {
 	 }
 
 	 std::string patch_name;
-	 for (std::vector<PDiffFile>::iterator I = patchfiles.begin();
-	       I != patchfiles.end();
-	       ++I)
-	 {
+	 auto I = patchfiles.cbegin();
+	 // all patches are compressed, even if the name doesn't reflect it
+	 bool const Okay = ForEachPatch(patchfiles, FileFd::Gzip, _config->FindB("Rred::Parallel", true), [&](PatchInMemory &p) {
 	    patch_name = I->FileName;
 	    if (Debug == true)
 	       std::clog << "Patching " << Path << " with " << patch_name
 		  << std::endl;
 
-	    FileFd p;
-	    Hashes patch_hash(I->ExpectedHashes);
-	    // all patches are compressed, even if the name doesn't reflect it
-	    if (p.Open(patch_name, FileFd::ReadOnly, FileFd::Gzip) == false ||
-		  patch.read_diff(p, &patch_hash) == false)
+	    if (p.Loaded() == false || patch.read_diff(p, nullptr) == false)
 	    {
 	       _error->DumpErrors(std::cerr, GlobalError::DEBUG, false);
 	       return false;
 	    }
-	    p.Close();
-	    HashStringList const hsl = patch_hash.GetHashStringList();
-	    if (hsl != I->ExpectedHashes)
+	    if (p.GetHashStringList() != I->ExpectedHashes)
 	       return _error->Error("Hash Sum mismatch for uncompressed patch %s", patch_name.c_str());
-	 }
+	    ++I;
+	    return true;
+	 });
+	 if (Okay == false)
+	    return false;
 
 	 if (Debug == true)
 	    std::clog << "Applying patches against " << Path
@@ -857,20 +1132,22 @@ int main(int argc, const char *argv[])
 	 return 101;
    }
 
-   Patch merged_patch;
+   std::vector<PDiffFile> patchfiles;
    for (; argi < argmax; ++argi)
+      patchfiles.emplace_back(CmdL.FileList[argi], HashStringList());
+   Patch merged_patch;
+   int failure = 0;
+   ForEachPatch(patchfiles, FileFd::Extension, _config->FindB("Rred::Parallel", true), [&](PatchInMemory &patch) {
+      if (not patch.Loaded())
+	 failure = 1;
+      else if (not merged_patch.read_diff(patch, nullptr))
+	 failure = 2;
+      return failure == 0;
+   });
+   if (failure != 0)
    {
-      FileFd patch;
-      if (not patch.Open(CmdL.FileList[argi], FileFd::ReadOnly, FileFd::Extension))
-      {
-	 _error->DumpErrors(std::cerr);
-	 return 1;
-      }
-      if (not merged_patch.read_diff(patch, nullptr))
-      {
-	 _error->DumpErrors(std::cerr);
-	 return 2;
-      }
+      _error->DumpErrors(std::cerr);
+      return failure;
    }
 
    if (just_diff)
@@ -6,7 +6,8 @@
    calculate the hashes) in the given destination. The input file will be
    extracted based on its file extension (or with the given compressor if
    called with one of the compatible symlinks) and potentially recompressed
-   based on the file extension of the destination filename.
+   based on the file extension of the destination filename. zstd files are
+   written in frames with a seek table, so that they can be read at random.
 
    ##################################################################### */
 									/*}}}*/
@@ -41,6 +42,8 @@ class StoreMethod : public aptMethod
       SeccompFlags = aptMethod::BASE;
       if (Binary != "store")
 	 methodNames.insert(methodNames.begin(), "store");
+      // lists kept compressed are read with random access via the records
+      _config->CndSet("APT::Compressor::zstd::FrameSize", 64 * 1024);
    }
 };
 
@@ -0,0 +1,363 @@
+#include <config.h>
+
+#include "../../ftparchive/contents.cc"
+
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/strutl.h>
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include <ctype.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Builds a Contents file from the file lists of many packages, once with
+   GenContents and once with the binary tree it used before, which is kept
+   here for comparison, and reports the time and memory each one needs.
+   The lists are either generated randomly for the given number of
+   packages or recovered from an existing Contents file given on the
+   command line. Both outputs have to be the same. */
+
+class TreeContents
+{
+   struct Node
+   {
+      Node *BTreeLeft = nullptr;
+      Node *BTreeRight = nullptr;
+      Node *DirDown = nullptr;
+      Node *Dups = nullptr;
+      const char *Path = nullptr;
+      const char *Package = nullptr;
+   };
+   Node Root;
+   std::vector<void *> Blocks;
+   char *StrPool = nullptr;
+   unsigned long StrLeft = 0;
+   Node *NodePool = nullptr;
+   unsigned long NodeLeft = 0;
+
+   Node *NewNode()
+   {
+      if (NodeLeft == 0)
+      {
+	 NodeLeft = 10000;
+	 NodePool = static_cast<Node *>(malloc(sizeof(Node) * NodeLeft));
+	 Blocks.push_back(NodePool);
+      }
+      --NodeLeft;
+      return new (NodePool++) Node;
+   }
+   Node *Grab(Node *Top, const char *Name, const char *Package)
+   {
+      if (Top->DirDown == nullptr)
+      {
+	 Node *Item = NewNode();
+	 Item->Path = Mystrdup(Name);
+	 Item->Package = Package;
+	 Top->DirDown = Item;
+	 return Item;
+      }
+      Top = Top->DirDown;
+      int Res;
+      while (true)
+      {
+	 Res = strcmp(Name, Top->Path);
+	 if (Res == 0)
+	 {
+	    if (Top->Package == Package || strcasecmp(Top->Package, Package) == 0)
+	       return Top;
+	    for (Node *I = Top->Dups; I != nullptr; I = I->Dups)
+	       if (I->Package == Package || strcasecmp(I->Package, Package) == 0)
+		  return Top;
+	    Node *Item = NewNode();
+	    Item->Path = Top->Path;
+	    Item->Package = Package;
+	    Item->Dups = Top->Dups;
+	    Top->Dups = Item;
+	    return Top;
+	 }
+	 Node *&Next = Res < 0 ? Top->BTreeLeft : Top->BTreeRight;
+	 if (Next == nullptr)
+	    break;
+	 Top = Next;
+      }
+      Node *Item = NewNode();
+      Item->Path = Mystrdup(Name);
+      Item->Package = Package;
+      if (Res < 0)
+      {
+	 Item->BTreeLeft = Top->BTreeLeft;
+	 Top->BTreeLeft = Item;
+      }
+      else
+      {
+	 Item->BTreeRight = Top->BTreeRight;
+	 Top->BTreeRight = Item;
+      }
+      return Item;
+   }
+   void DoPrint(FileFd &Out, Node *Top, char *Buf)
+   {
+      if (Top == nullptr)
+	 return;
+      DoPrint(Out, Top->BTreeLeft, Buf);
+      char *OldEnd = Buf + strlen(Buf);
+      if (Top->Path != nullptr)
+      {
+	 strcat(Buf, Top->Path);
+	 if (Top->Path[strlen(Top->Path) - 1] != '/')
+	 {
+	    std::string out = Buf;
+	    size_t Current = out.length();
+	    size_t const Target = std::max<size_t>(60, Current + 1);
+	    for (; (Current / 8 + 1) * 8 < Target; Current = (Current / 8 + 1) * 8)
+	       out.append("\t");
+	    for (; Current < Target; Current++)
+	       out.append(" ");
+	    for (Node *I = Top; I != nullptr; I = I->Dups)
+	    {
+	       if (I != Top)
+		  out.append(",");
+	       out.append(I->Package);
+	    }
+	    out.append("\n");
+	    Out.Write(out.c_str(), out.length());
+	 }
+      }
+      DoPrint(Out, Top->DirDown, Buf);
+      *OldEnd = 0;
+      DoPrint(Out, Top->BTreeRight, Buf);
+   }
+
+   public:
+   char *Mystrdup(const char *From)
+   {
+      unsigned int Len = strlen(From) + 1;
+      if (StrLeft <= Len)
+      {
+	 StrLeft = 4096 * 10;
+	 StrPool = static_cast<char *>(malloc(StrLeft));
+	 Blocks.push_back(StrPool);
+      }
+      memcpy(StrPool, From, Len);
+      StrLeft -= Len;
+      char *Res = StrPool;
+      StrPool += Len;
+      return Res;
+   }
+   void Add(const char *Dir, const char *Package)
+   {
+      Node *Top = &Root;
+      while (*Dir == '/')
+	 Dir++;
+      const char *Start = Dir;
+      const char *I = Dir;
+      while (*I != 0)
+      {
+	 if (*I != '/' || I - Start <= 1)
+	 {
+	    I++;
+	    continue;
+	 }
+	 I++;
+	 char Tmp[1024];
+	 strncpy(Tmp, Start, I - Start);
+	 Tmp[I - Start] = 0;
+	 Top = Grab(Top, Tmp, Package);
+	 Start = I;
+      }
+      if (I - Start >= 1)
+	 Grab(Top, Start, Package);
+   }
+   void Print(FileFd &Out)
+   {
+      char Buffer[1024];
+      Buffer[0] = 0;
+      DoPrint(Out, &Root, Buffer);
+   }
+   ~TreeContents()
+   {
+      for (auto B : Blocks)
+	 free(B);
+   }
+};
+
+// A package name and its file list as ContentsExtract stores it
+typedef std::pair<std::string, std::string> PackageFiles;
+
+static void Generate(size_t const Count, std::vector<PackageFiles> &Packages)
+{
+   std::mt19937 Rand(42);
+   std::uniform_int_distribution<int> Word(0, 9999);
+   std::vector<std::string> const Prefixes = {"file", "lib", "lib-", "Lib.", "x"};
+   auto const Name = [&]() {
+      return Prefixes[Word(Rand) % Prefixes.size()] + std::to_string(Word(Rand) % 300);
+   };
+   // including some which are prefixes of others or of file names
+   std::vector<std::string> const Shared = {"usr/bin/", "usr/sbin/", "usr/lib/x86_64-linux-gnu/",
+      "usr/share/man/man1/", "usr/share/man/de/man1/", "usr/share/locale/de/LC_MESSAGES/",
+      "etc/", "usr/include/", "usr/lib/python3/dist-packages/", "/lib/", "usr//share/x/", "a/b/",
+      "usr/", "usr/lib/", "usr/lib-x/", "usr/lib+/", "usr/lib/lib/", ""};
+   for (size_t P = 0; P < Count; ++P)
+   {
+      std::string const Package = "misc/pkg" + std::to_string(P);
+      std::string Files;
+      auto const Add = [&](std::string const &F) { Files.append(F).push_back('\0'); };
+      std::string const Own = "usr/share/doc/pkg" + std::to_string(P) + "/";
+      Add(Own);
+      Add(Own + "copyright");
+      Add(Own + "changelog.Debian.gz");
+      int const Files1 = Word(Rand) % 40;
+      for (int F = 0; F < Files1; ++F)
+      {
+	 auto const &Dir = Shared[Word(Rand) % Shared.size()];
+	 if (Word(Rand) % 3 == 0)
+	    Add(Dir + Name() + "/" + Name());
+	 else
+	    Add(Dir + Name());
+      }
+      Packages.emplace_back(Package, Files);
+      // other versions of the package and packages conflicting with it
+      if (P % 10 == 0)
+	 Packages.emplace_back(Package, Files);
+      if (P % 50 == 0)
+	 Packages.emplace_back("MISC/PKG" + std::to_string(P), Files);
+      if (P % 70 == 0)
+	 Packages.emplace_back("misc/other" + std::to_string(P), Files);
+   }
+}
+
+static bool Recover(std::string const &File, std::vector<PackageFiles> &Packages)
+{
+   FileFd Fd(File, FileFd::ReadOnly, FileFd::Extension);
+   if (Fd.IsOpen() == false)
+      return false;
+   std::map<std::string, size_t> Index;
+   char Line[4096];
+   while (Fd.ReadLine(Line, sizeof(Line)) != nullptr)
+   {
+      char *End = Line + strlen(Line);
+      while (End != Line && isspace(End[-1]))
+	 *--End = '\0';
+      char *Sep = strrchr(Line, ' ');
+      char *Tab = strrchr(Line, '\t');
+      if (Sep == nullptr || (Tab != nullptr && Tab > Sep))
+	 Sep = Tab;
+      if (Sep == nullptr)
+	 continue;
+      std::string const Owners = Sep + 1;
+      while (Sep != Line && isspace(Sep[-1]))
+	 --Sep;
+      std::string const Path(Line, Sep);
+      for (auto const &Owner : VectorizeString(Owners, ','))
+      {
+	 auto const I = Index.emplace(Owner, Packages.size());
+	 if (I.second == true)
+	    Packages.emplace_back(Owner, "");
+	 Packages[I.first->second].second.append(Path).push_back('\0');
+      }
+   }
+   return Fd.Failed() == false;
+}
+
+static bool ReadFile(std::string const &Name, std::string &Content)
+{
+   FileFd Fd;
+   if (Fd.Open(Name, FileFd::ReadOnly) == false)
+      return false;
+   char Buffer[64 * 1024];
+   unsigned long long Actual = 0;
+   while (Fd.Read(Buffer, sizeof(Buffer), &Actual) && Actual != 0)
+      Content.append(Buffer, Actual);
+   return Fd.Failed() == false;
+}
+
+static size_t Allocated()
+{
+   struct mallinfo2 const Info = mallinfo2();
+   return Info.uordblks + Info.hblkhd;
+}
+
+template <class Builder>
+static bool Measure(char const *const Name, std::vector<PackageFiles> const &Packages,
+		    std::string const &OutputFile, Builder Build, std::string &Result)
+{
+   size_t const Before = Allocated();
+   auto Start = std::chrono::steady_clock::now();
+   size_t Memory;
+   {
+      FileFd Out(OutputFile, FileFd::WriteOnly | FileFd::Create | FileFd::Empty | FileFd::BufferedWrite);
+      std::chrono::duration<double> AddSeconds;
+      Build(Out, [&]() {
+	 AddSeconds = std::chrono::steady_clock::now() - Start;
+	 Memory = Allocated() - Before;
+	 Start = std::chrono::steady_clock::now();
+      });
+      std::chrono::duration<double> const PrintSeconds = std::chrono::steady_clock::now() - Start;
+      if (Out.Close() == false)
+	 return false;
+      std::cout << Name << ": added in " << AddSeconds.count() * 1000 << " ms, "
+		<< "printed in " << PrintSeconds.count() * 1000 << " ms, "
+		<< "using " << SizeToStr(Memory) << "B" << std::endl;
+   }
+   return ReadFile(OutputFile, Result);
+}
+
+int main(int argc, char *argv[])
+{
+   std::vector<PackageFiles> Packages;
+   if (argc > 1 && isdigit(argv[1][0]) == 0)
+   {
+      if (Recover(argv[1], Packages) == false)
+	 return _error->DumpErrors(), 1;
+   }
+   else
+      Generate(argc > 1 ? atoi(argv[1]) : 5000, Packages);
+   size_t Files = 0;
+   for (auto const &P : Packages)
+      Files += std::count(P.second.begin(), P.second.end(), '\0');
+   std::cout << Packages.size() << " packages with " << Files << " files" << std::endl;
+
+   std::string const OutputFile = GetTempDir() + "/benchmark-contents." + std::to_string(getpid());
+   std::string Tree, Arena;
+   if (Measure("binary tree", Packages, OutputFile, [&](FileFd &Out, auto const &Added) {
+	  TreeContents Gen;
+	  for (auto const &P : Packages)
+	  {
+	     char *const Pkg = Gen.Mystrdup(P.first.c_str());
+	     for (char const *F = P.second.data(); F < P.second.data() + P.second.size(); F += strlen(F) + 1)
+		Gen.Add(F, Pkg);
+	  }
+	  Added();
+	  Gen.Print(Out);
+       }, Tree) == false ||
+       Measure("sorted list", Packages, OutputFile, [&](FileFd &Out, auto const &Added) {
+	  GenContents Gen;
+	  ContentsExtract Extract;
+	  for (auto const &P : Packages)
+	  {
+	     Extract.TakeContents(P.second.data(), P.second.size());
+	     Extract.Add(Gen, P.first);
+	  }
+	  Added();
+	  Gen.Print(Out);
+       }, Arena) == false)
+      return _error->DumpErrors(), 1;
+   RemoveFile("benchmark-contents", OutputFile);
+
+   if (Tree != Arena)
+   {
+      std::cerr << "The Contents files differ" << std::endl;
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,105 @@
+#include <config.h>
+
+#include <apt-pkg/cachefile.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/depcache.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/init.h>
+#include <apt-pkg/pkgcache.h>
+#include <apt-pkg/pkgsystem.h>
+#include <apt-pkg/policy.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <string.h>
+
+/* Builds the depcache of the system cache with APT::Cache-Dependency-Threads
+   set to each of the given thread counts (0 is the serial pass) and reports
+   the best time out of a few runs. Every depcache has to end up with the
+   same dependency states and totals as the serial one. */
+
+struct Result
+{
+   std::vector<unsigned char> PkgStates;
+   std::vector<unsigned char> DepStates;
+   std::vector<long long> Totals;
+};
+
+static Result StateOf(pkgDepCache &DepCache)
+{
+   Result Res;
+   pkgCache &Cache = DepCache.GetCache();
+   Res.PkgStates.resize(Cache.Head().PackageCount);
+   Res.DepStates.resize(Cache.Head().DependsCount);
+   for (auto Pkg = Cache.PkgBegin(); Pkg.end() == false; ++Pkg)
+   {
+      Res.PkgStates[Pkg->ID] = DepCache[Pkg].DepState;
+      for (auto Ver = Pkg.VersionList(); Ver.end() == false; ++Ver)
+	 for (auto D = Ver.DependsList(); D.end() == false; ++D)
+	    Res.DepStates[D->ID] = DepCache[D];
+   }
+   Res.Totals = {DepCache.UsrSize(), static_cast<long long>(DepCache.DebSize()),
+		 static_cast<long long>(DepCache.InstCount()), static_cast<long long>(DepCache.DelCount()),
+		 static_cast<long long>(DepCache.KeepCount()), static_cast<long long>(DepCache.BrokenCount()),
+		 static_cast<long long>(DepCache.PolicyBrokenCount()), static_cast<long long>(DepCache.BadCount())};
+   return Res;
+}
+
+int main(int argc, const char *argv[])
+{
+   if (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0))
+   {
+      std::cout << "Usage: benchmark-depcache [runs] [threads...]\n";
+      return 0;
+   }
+   if (pkgInitConfig(*_config) == false || pkgInitSystem(*_config, _system) == false)
+      return _error->DumpErrors(), 1;
+   // the states are to be computed every time, not loaded
+   _config->Set("Dir::Cache::depcache", "");
+   int const Runs = argc > 1 ? std::max(1, std::stoi(argv[1])) : 5;
+   std::vector<int> Threads;
+   for (int I = 2; I < argc; ++I)
+      Threads.push_back(std::stoi(argv[I]));
+   if (Threads.empty())
+      Threads = {0, 2, 4, 8};
+
+   pkgCacheFile CacheFile;
+   pkgCache *const Cache = CacheFile.GetPkgCache();
+   pkgPolicy *const Policy = CacheFile.GetPolicy();
+   if (Cache == nullptr || Policy == nullptr)
+      return _error->DumpErrors(), 1;
+   std::cout << "packages:     " << Cache->Head().PackageCount << '\n'
+	     << "dependencies: " << Cache->Head().DependsCount << '\n';
+
+   Result Serial;
+   bool Mismatch = false;
+   for (auto const T : Threads)
+   {
+      _config->Set("APT::Cache-Dependency-Threads", T);
+      std::chrono::duration<double> Best = std::chrono::duration<double>::max();
+      Result Res;
+      for (int R = 0; R < Runs; ++R)
+      {
+	 auto const Start = std::chrono::steady_clock::now();
+	 std::unique_ptr<pkgDepCache> DepCache(new pkgDepCache(Cache, Policy));
+	 if (DepCache->Init(nullptr) == false)
+	    return _error->DumpErrors(), 1;
+	 Best = std::min<std::chrono::duration<double>>(Best, std::chrono::steady_clock::now() - Start);
+	 if (R == 0)
+	    Res = StateOf(*DepCache);
+      }
+      if (Serial.PkgStates.empty())
+	 Serial = std::move(Res);
+      else if (Res.PkgStates != Serial.PkgStates || Res.DepStates != Serial.DepStates || Res.Totals != Serial.Totals)
+      {
+	 std::cerr << "States with " << T << " threads differ from the first pass" << std::endl;
+	 Mismatch = true;
+      }
+      std::cout << "threads " << T << ": " << Best.count() * 1000 << " ms per depcache init\n";
+   }
+   return Mismatch ? 1 : 0;
+}
@@ -0,0 +1,86 @@
+#include <config.h>
+
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/hashes.h>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+
+/* Measures the throughput of the hash calculation in GB/s for each
+   algorithm alone and for all of them together, once serial and once in
+   parallel. The data is either random in memory or read from a file. */
+
+static double Measure(unsigned int const Algos, bool const Parallel,
+		      std::string const &Data, std::string const &File, int const Rounds)
+{
+   _config->Set("APT::Hashes::Parallel", Parallel);
+   double Best = 0;
+   for (int R = 0; R < Rounds; ++R)
+   {
+      Hashes Hash(Algos);
+      auto const Start = std::chrono::steady_clock::now();
+      unsigned long long Size = Data.size();
+      if (File.empty())
+	 Hash.Add(Data.data(), Data.size());
+      else
+      {
+	 FileFd Fd(File, FileFd::ReadOnly);
+	 Size = Fd.FileSize();
+	 if (Fd.IsOpen() == false || Hash.AddFD(Fd) == false)
+	    return 0;
+      }
+      Hash.GetHashStringList();
+      std::chrono::duration<double> const Seconds = std::chrono::steady_clock::now() - Start;
+      Best = std::max(Best, Size / Seconds.count() / 1e9);
+   }
+   return Best;
+}
+
+int main(int argc, const char *argv[])
+{
+   if (argc > 1 && (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help"))
+   {
+      std::cout << "Usage: benchmark-hashes [size in MiB|file] [rounds]\n";
+      return 0;
+   }
+   std::string Data, File;
+   if (argc > 1 && FileExists(argv[1]))
+      File = argv[1];
+   else
+   {
+      Data.resize((argc > 1 ? atoi(argv[1]) : 256) * 1024ull * 1024ull);
+      srand(42);
+      for (auto &C : Data)
+	 C = rand();
+   }
+   int const Rounds = argc > 2 ? atoi(argv[2]) : 3;
+
+   struct
+   {
+      char const *Name;
+      unsigned int Algos;
+   } const Tests[] = {
+      {"MD5Sum", Hashes::MD5SUM},
+      {"SHA1", Hashes::SHA1SUM},
+      {"SHA256", Hashes::SHA256SUM},
+      {"SHA512", Hashes::SHA512SUM},
+      {"MD5Sum+SHA256", Hashes::MD5SUM | Hashes::SHA256SUM},
+      {"all", ~0u},
+   };
+   std::cout << std::left << std::setw(16) << "algorithm" << std::right
+	     << std::setw(12) << "serial" << std::setw(12) << "parallel" << std::endl;
+   for (auto const &T : Tests)
+   {
+      auto const Serial = Measure(T.Algos, false, Data, File, Rounds);
+      auto const Parallel = Measure(T.Algos, true, Data, File, Rounds);
+      std::cout << std::left << std::setw(16) << T.Name << std::right << std::fixed << std::setprecision(2)
+		<< std::setw(9) << Serial << " GB/s" << std::setw(7) << Parallel << " GB/s" << std::endl;
+   }
+   return _error->PendingError() ? 1 : 0;
+}
@@ -0,0 +1,203 @@
+#include <config.h>
+
+#define APT_EXCLUDE_RRED_METHOD_CODE
+#include "../../methods/rred.cc"
+
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/init.h>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Replays a sequence of pdiffs the way the rred method does: all patches are
+   merged into one set of changes, which is then applied against the input
+   in one pass. This is done once with the patches decompressed in turn and
+   once with the next patch decompressed while the current one is parsed.
+   The sequence is either given on the command line, e.g. the patches of a
+   Packages.diff/ directory from a mirror or snapshot.debian.org ordered from
+   oldest to newest and the Packages file the first applies to, or generated
+   randomly, in which case the result is compared with the expected one. */
+
+static std::string Line(std::mt19937 &Rand)
+{
+   std::uniform_int_distribution<int> Word(0, 9999);
+   return "Some-Field: value " + std::to_string(Word(Rand)) + " for a line\n";
+}
+
+static bool Generate(std::string const &Dir, size_t const Lines, size_t const Patches, size_t const Hunks,
+		     std::string &Input, std::vector<std::string> &PatchFiles, std::string &Expected)
+{
+   std::mt19937 Rand(42);
+   std::vector<std::string> File;
+   for (size_t I = 0; I < Lines; ++I)
+      File.push_back(Line(Rand));
+   for (auto const &L : File)
+      Input.append(L);
+
+   for (size_t P = 0; P < Patches; ++P)
+   {
+      std::uniform_int_distribution<size_t> Position(0, File.size());
+      std::vector<size_t> Starts;
+      for (size_t H = 0; H < Hunks; ++H)
+	 Starts.push_back(Position(Rand));
+      std::sort(Starts.begin(), Starts.end());
+      Starts.erase(std::unique(Starts.begin(), Starts.end()), Starts.end());
+
+      // hunks are written (and applied) from the end of the file
+      std::string Diff;
+      size_t Limit = File.size();
+      for (auto S = Starts.rbegin(); S != Starts.rend(); ++S)
+      {
+	 size_t const Start = *S;
+	 size_t const Available = std::min<size_t>(3, Limit - Start);
+	 Limit = Start;
+	 int const Kind = std::uniform_int_distribution<int>(0, 2)(Rand);
+	 std::vector<std::string> Added;
+	 size_t const AddCount = std::uniform_int_distribution<size_t>(1, 4)(Rand);
+	 if (Kind == 0 || Available == 0)
+	 {
+	    // append after line Start
+	    for (size_t I = 0; I < AddCount; ++I)
+	       Added.push_back(Line(Rand));
+	    Diff.append(std::to_string(Start)).append("a\n");
+	    for (auto const &A : Added)
+	       Diff.append(A);
+	    Diff.append(".\n");
+	    File.insert(File.begin() + Start, Added.begin(), Added.end());
+	    continue;
+	 }
+	 size_t const Count = std::uniform_int_distribution<size_t>(1, Available)(Rand);
+	 std::string Range = std::to_string(Start + 1);
+	 if (Count != 1)
+	    Range.append(",").append(std::to_string(Start + Count));
+	 File.erase(File.begin() + Start, File.begin() + Start + Count);
+	 if (Kind == 1)
+	    Diff.append(Range).append("d\n");
+	 else
+	 {
+	    for (size_t I = 0; I < AddCount; ++I)
+	       Added.push_back(Line(Rand));
+	    Diff.append(Range).append("c\n");
+	    for (auto const &A : Added)
+	       Diff.append(A);
+	    Diff.append(".\n");
+	    File.insert(File.begin() + Start, Added.begin(), Added.end());
+	 }
+      }
+
+      std::string const Name = Dir + "/patch-" + std::to_string(P) + ".gz";
+      FileFd Out(Name, FileFd::WriteOnly | FileFd::Create | FileFd::Empty, FileFd::Gzip);
+      if (Out.Write(Diff.data(), Diff.size()) == false || Out.Close() == false)
+	 return false;
+      PatchFiles.push_back(Name);
+   }
+   for (auto const &L : File)
+      Expected.append(L);
+   return true;
+}
+
+static bool ReadFile(std::string const &Name, std::string &Content)
+{
+   FileFd Fd;
+   if (Fd.Open(Name, FileFd::ReadOnly, FileFd::Extension) == false)
+      return false;
+   char Buffer[APT_MEMBLOCK_SIZE];
+   unsigned long long Actual = 0;
+   while (Fd.Read(Buffer, sizeof(Buffer), &Actual) && Actual != 0)
+      Content.append(Buffer, Actual);
+   return Fd.Failed() == false;
+}
+
+int main(int argc, char const *argv[])
+{
+   if (argc < 3 || (strcmp(argv[1], "--generate") == 0 && argc != 5))
+   {
+      std::cout << "Usage: benchmark-rred input patch-1 … patch-N\n"
+		<< "       benchmark-rred --generate lines patches hunks-per-patch\n";
+      return argc == 2 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) ? 0 : 1;
+   }
+   pkgInitConfig(*_config);
+
+   std::string Dir = GetTempDir() + "/benchmark-rred.XXXXXX";
+   if (mkdtemp(&Dir[0]) == nullptr)
+      return _error->Errno("mkdtemp", "Creating a temporary directory failed"), _error->DumpErrors(), 1;
+
+   std::string InputFile, Expected;
+   std::vector<PDiffFile> Patches;
+   if (strcmp(argv[1], "--generate") == 0)
+   {
+      std::string Input;
+      std::vector<std::string> Names;
+      if (Generate(Dir, std::stoul(argv[2]), std::stoul(argv[3]), std::stoul(argv[4]), Input, Names, Expected) == false)
+	 return _error->DumpErrors(), 1;
+      InputFile = Dir + "/input";
+      FileFd Out(InputFile, FileFd::WriteOnly | FileFd::Create | FileFd::Empty);
+      if (Out.Write(Input.data(), Input.size()) == false || Out.Close() == false)
+	 return _error->DumpErrors(), 1;
+      for (auto const &N : Names)
+	 Patches.emplace_back(N, HashStringList());
+   }
+   else
+   {
+      InputFile = argv[1];
+      for (int I = 2; I < argc; ++I)
+	 Patches.emplace_back(argv[I], HashStringList());
+   }
+
+   int Result = 0;
+   std::string First;
+   for (bool const Parallel : {false, true})
+   {
+      auto Start = std::chrono::steady_clock::now();
+      Patch Merged;
+      if (ForEachPatch(Patches, FileFd::Extension, Parallel, [&](PatchInMemory &P) {
+	     return P.Loaded() && Merged.read_diff(P, nullptr);
+	  }) == false)
+	 return _error->DumpErrors(), 1;
+      std::chrono::duration<double> const MergeSeconds = std::chrono::steady_clock::now() - Start;
+
+      std::string const OutputFile = Dir + "/output";
+      Start = std::chrono::steady_clock::now();
+      {
+	 FileFd In(InputFile, FileFd::ReadOnly, FileFd::Extension);
+	 FileFd Out(OutputFile, FileFd::WriteOnly | FileFd::Create | FileFd::Empty | FileFd::BufferedWrite);
+	 Merged.apply_against_file(Out, In);
+	 if (Out.Close() == false || _error->PendingError())
+	    return _error->DumpErrors(), 1;
+      }
+      std::chrono::duration<double> const ApplySeconds = std::chrono::steady_clock::now() - Start;
+
+      std::string Output;
+      if (ReadFile(OutputFile, Output) == false)
+	 return _error->DumpErrors(), 1;
+      if (Expected.empty() == false && Output != Expected)
+      {
+	 std::cerr << "Result differs from the expected file" << std::endl;
+	 Result = 1;
+      }
+      if (Parallel == false)
+	 First = std::move(Output);
+      else if (Output != First)
+      {
+	 std::cerr << "Results with and without parallel decompression differ" << std::endl;
+	 Result = 1;
+      }
+      std::cout << (Parallel ? "overlapped: " : "in turn:    ")
+		<< Patches.size() << " patches merged in " << MergeSeconds.count() * 1000 << " ms, "
+		<< "applied in " << ApplySeconds.count() * 1000 << " ms\n";
+   }
+   RemoveFile("benchmark-rred", Dir + "/output");
+   RemoveFile("benchmark-rred", Dir + "/input");
+   for (auto const &P : Patches)
+      if (APT::String::Startswith(P.FileName, Dir))
+	 RemoveFile("benchmark-rred", P.FileName);
+   rmdir(Dir.c_str());
+   return Result;
+}
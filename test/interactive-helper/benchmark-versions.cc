@@ -0,0 +1,136 @@
+#include <config.h>
+
+#include <apt-pkg/cachefile.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/debversion.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/init.h>
+#include <apt-pkg/pkgcache.h>
+#include <apt-pkg/pkgsystem.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <string.h>
+
+/* Compares the versions of a corpus pairwise once with CmpVersion and once
+   with strcmp on their sort keys: The results have to agree for all pairs
+   and the time each needs is reported. The corpus is either a file with one
+   version per line or all versions (including those in dependencies) in the
+   cache of the system. */
+
+static std::vector<std::string> CorpusFromCache()
+{
+   std::unordered_set<std::string> Versions;
+   pkgCacheFile CacheFile;
+   pkgCache *const Cache = CacheFile.GetPkgCache();
+   if (Cache == nullptr)
+      return {};
+   for (auto Pkg = Cache->PkgBegin(); Pkg.end() == false; ++Pkg)
+      for (auto Ver = Pkg.VersionList(); Ver.end() == false; ++Ver)
+      {
+	 Versions.emplace(Ver.VerStr());
+	 for (auto D = Ver.DependsList(); D.end() == false; ++D)
+	    if (D.TargetVer() != nullptr)
+	       Versions.emplace(D.TargetVer());
+      }
+   return {Versions.begin(), Versions.end()};
+}
+
+static int Sign(int const Res)
+{
+   return Res < 0 ? -1 : (Res > 0 ? 1 : 0);
+}
+
+int main(int argc, const char *argv[])
+{
+   if (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0))
+   {
+      std::cout << "Usage: benchmark-versions [file with one version per line] [pairs]\n";
+      return 0;
+   }
+   std::vector<std::string> Versions;
+   if (argc > 1 && strcmp(argv[1], "-") != 0)
+   {
+      std::ifstream In(argv[1]);
+      for (std::string Line; std::getline(In, Line);)
+	 if (Line.empty() == false)
+	    Versions.push_back(Line);
+   }
+   else
+   {
+      if (pkgInitConfig(*_config) == false || pkgInitSystem(*_config, _system) == false)
+	 return _error->DumpErrors(), 1;
+      Versions = CorpusFromCache();
+   }
+   if (Versions.size() < 2)
+   {
+      _error->DumpErrors();
+      std::cerr << "Not enough versions in the corpus" << std::endl;
+      return 1;
+   }
+   size_t const Pairs = argc > 2 ? std::stoul(argv[2]) : 10 * 1000 * 1000;
+
+   auto Start = std::chrono::steady_clock::now();
+   std::vector<std::string> Keys;
+   Keys.reserve(Versions.size());
+   for (auto const &V : Versions)
+      Keys.push_back(debVersioningSystem::SortKey(V.data(), V.data() + V.size()));
+   std::chrono::duration<double> const KeySeconds = std::chrono::steady_clock::now() - Start;
+
+   std::mt19937 Rand(42);
+   std::uniform_int_distribution<size_t> Pick(0, Versions.size() - 1);
+   std::vector<std::pair<size_t, size_t>> Work(Pairs);
+   for (auto &P : Work)
+      P = {Pick(Rand), Pick(Rand)};
+
+   // every version against its neighbours in sort order and the random pairs
+   std::vector<size_t> Sorted(Versions.size());
+   for (size_t I = 0; I < Sorted.size(); ++I)
+      Sorted[I] = I;
+   std::sort(Sorted.begin(), Sorted.end(), [&](size_t const A, size_t const B) {
+      return debVS.CmpVersion(Versions[A], Versions[B]) < 0;
+   });
+   std::vector<std::pair<size_t, size_t>> Check(Work);
+   for (size_t I = 1; I < Sorted.size(); ++I)
+      Check.emplace_back(Sorted[I - 1], Sorted[I]);
+   size_t Mismatches = 0;
+   for (auto const &P : Check)
+   {
+      for (auto const &Q : {P, std::make_pair(P.second, P.first)})
+      {
+	 int const Res = Sign(debVS.CmpVersion(Versions[Q.first], Versions[Q.second]));
+	 int const KeyRes = Sign(strcmp(Keys[Q.first].c_str(), Keys[Q.second].c_str()));
+	 if (Res == KeyRes)
+	    continue;
+	 if (++Mismatches <= 10)
+	    std::cerr << "Mismatch: " << Versions[Q.first] << " vs " << Versions[Q.second]
+		      << ": " << Res << " but key gives " << KeyRes << std::endl;
+      }
+   }
+
+   // make sure the comparisons are not optimized away
+   long Sum = 0;
+   Start = std::chrono::steady_clock::now();
+   for (auto const &P : Work)
+      Sum += Sign(debVS.CmpVersion(Versions[P.first], Versions[P.second]));
+   std::chrono::duration<double> const CmpSeconds = std::chrono::steady_clock::now() - Start;
+   Start = std::chrono::steady_clock::now();
+   for (auto const &P : Work)
+      Sum -= Sign(strcmp(Keys[P.first].c_str(), Keys[P.second].c_str()));
+   std::chrono::duration<double> const KeyCmpSeconds = std::chrono::steady_clock::now() - Start;
+
+   std::cout << "versions:   " << Versions.size() << '\n'
+	     << "pairs:      " << Check.size() * 2 << " checked, " << Mismatches << " mismatches\n"
+	     << "sort keys:  " << KeySeconds.count() * 1e9 / Versions.size() << " ns per version\n"
+	     << "CmpVersion: " << CmpSeconds.count() * 1e9 / Work.size() << " ns per comparison\n"
+	     << "strcmp key: " << KeyCmpSeconds.count() * 1e9 / Work.size() << " ns per comparison\n";
+   if (Sum != 0)
+      std::cerr << "Comparison sums differ: " << Sum << std::endl;
+   return Mismatches == 0 && Sum == 0 ? 0 : 1;
+}
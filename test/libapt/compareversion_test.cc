@@ -25,8 +25,10 @@
 #include <fstream>
 #include <string>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -54,11 +56,21 @@ static bool callDPKG(const char * const val, const char * const ref, char const
 }
 
 
+static int KeyCmp(std::string const &A, std::string const &B)
+{
+   auto const KeyA = debVersioningSystem::SortKey(A.data(), A.data() + A.length());
+   auto const KeyB = debVersioningSystem::SortKey(B.data(), B.data() + B.length());
+   EXPECT_EQ(std::string::npos, KeyA.find('\0'));
+   int const Res = strcmp(KeyA.c_str(), KeyB.c_str());
+   return (Res < 0) ? -1 : ((Res > 0) ? 1 : Res);
+}
+
 #define EXPECT_VERSION_PART(A, compare, B) \
 { \
    int Res = debVS.CmpVersion(A, B); \
    Res = (Res < 0) ? -1 : ( (Res > 0) ? 1 : Res); \
    EXPECT_EQ(compare, Res) << "APT: A: »" << A << "« B: »" << B << "«"; \
+   EXPECT_EQ(compare, KeyCmp(A, B)) << "SortKey: A: »" << A << "« B: »" << B << "«"; \
    EXPECT_PRED3(callDPKG, A, B,  ((compare == 1) ? ">>" : ( (compare == 0) ? "=" : "<<"))); \
 }
 #define EXPECT_VERSION(A, compare, B) \
@@ -180,3 +192,20 @@ TEST(CompareVersionTest,CuptTests)
    EXPECT_VERSION("2.2.4-47978_Debian_lenny", EQUAL, "2.2.4-47978_Debian_lenny"); // and underscore...
    // */
 }
+TEST(CompareVersionTest,SortKey)
+{
+   // versions dpkg refuses, but which we compare nonetheless
+   std::vector<std::string> const versions = {
+      "0", "00", "~", "a", "a0", "a00b", "1-", "1", "1-0", "0:-1",
+      "1:", ":1", "0a:1", "a:1", "1.0-", "1.0--", "1.0-~", "1~~", "1~~a",
+      "1.\xe4", "1.\xe4-1", "1.a", "1.+", "1_2", "2.2.4-47978_Debian_lenny",
+      std::string(300, '9'), std::string(300, '9') + "0", "1" + std::string(260, '0'),
+   };
+   for (auto const &a : versions)
+      for (auto const &b : versions)
+      {
+	 int Res = debVS.CmpVersion(a, b);
+	 Res = (Res < 0) ? -1 : ((Res > 0) ? 1 : Res);
+	 EXPECT_EQ(Res, KeyCmp(a, b)) << "A: »" << a << "« B: »" << b << "«";
+      }
+}
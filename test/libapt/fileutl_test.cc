@@ -397,3 +397,92 @@ TEST(FileUtlTest, FailingAtomic)
    EXPECT_TRUE(f.Close());
    TestFailingAtomicKeepsFile("closed", file.Name());
 }
+#ifdef HAVE_ZSTD
+TEST(FileUtlTest, ZstdSeekable)
+{
+   auto const compressors = APT::Configuration::getCompressors();
+   auto const zstd = std::find_if(compressors.begin(), compressors.end(), [](APT::Configuration::Compressor const &c) { return c.Name == "zstd"; });
+   ASSERT_NE(compressors.end(), zstd);
+
+   std::string content;
+   for (int i = 0; i < 10000; ++i)
+      content.append("Line ").append(std::to_string(i)).append("\n");
+
+   auto const file = createTemporaryFile("zstdseekable");
+   _config->Set("APT::Compressor::zstd::FrameSize", 1000);
+   FileFd f;
+   EXPECT_TRUE(f.Open(file.Name(), FileFd::WriteOnly | FileFd::Create | FileFd::Empty, *zstd));
+   // write in odd pieces to cross the frame boundaries
+   for (size_t i = 0; i < content.size(); i += 777)
+      EXPECT_TRUE(f.Write(content.data() + i, std::min<size_t>(777, content.size() - i)));
+   EXPECT_TRUE(f.Close());
+   _config->Clear("APT::Compressor::zstd::FrameSize");
+
+   {
+      FileFd raw(file.Name(), FileFd::ReadOnly);
+      unsigned char magic[4];
+      EXPECT_TRUE(raw.Seek(raw.FileSize() - sizeof(magic)));
+      EXPECT_TRUE(raw.Read(magic, sizeof(magic)));
+      EXPECT_EQ(0xb1, magic[0]);
+      EXPECT_EQ(0xea, magic[1]);
+      EXPECT_EQ(0x92, magic[2]);
+      EXPECT_EQ(0x8f, magic[3]);
+   }
+
+   EXPECT_TRUE(f.Open(file.Name(), FileFd::ReadOnly, *zstd));
+   EXPECT_EQ(content.size(), f.Size());
+   std::string all(content.size(), '\0');
+   EXPECT_TRUE(f.Read(&all[0], all.size()));
+   EXPECT_EQ(content, all);
+
+   for (unsigned long long const pos : {5000ull, 100ull, 999ull, 1000ull, 1001ull, 1500ull, 0ull, 78000ull, 77000ull, 30000ull, 30020ull})
+   {
+      SCOPED_TRACE(pos);
+      char buffer[21];
+      EXPECT_TRUE(f.Seek(pos));
+      EXPECT_EQ(pos, f.Tell());
+      EXPECT_TRUE(f.Read(buffer, 20));
+      EXPECT_EQ(content.substr(pos, 20), std::string(buffer, 20));
+      EXPECT_EQ(pos + 20, f.Tell());
+      EXPECT_TRUE(f.Seek(pos));
+      EXPECT_NE(nullptr, f.ReadLine(buffer, sizeof(buffer)));
+      EXPECT_EQ(content.substr(pos, content.find('\n', pos) - pos + 1), buffer);
+   }
+   EXPECT_TRUE(f.Seek(content.size()));
+   unsigned long long actual;
+   char buffer[10];
+   EXPECT_TRUE(f.Read(buffer, sizeof(buffer), &actual));
+   EXPECT_EQ(0u, actual);
+   EXPECT_TRUE(f.Eof());
+   EXPECT_TRUE(f.Close());
+}
+#endif
+TEST(FileUtlTest, MultiThreadedCompress)
+{
+   std::string content;
+   for (int i = 0; i < 100000; ++i)
+      content.append("Line ").append(std::to_string(i)).append("\n");
+
+   auto const compressors = APT::Configuration::getCompressors();
+   for (auto const &name : {"xz", "zstd"})
+   {
+      SCOPED_TRACE(name);
+      auto const comp = std::find_if(compressors.begin(), compressors.end(), [&](APT::Configuration::Compressor const &c) { return c.Name == name; });
+      if (comp == compressors.end())
+	 continue;
+      auto const file = createTemporaryFile("mtcompress");
+      std::string const option = std::string("APT::Compressor::") + name + "::Threads";
+      _config->Set(option.c_str(), 3);
+      FileFd f;
+      EXPECT_TRUE(f.Open(file.Name(), FileFd::WriteOnly | FileFd::Create | FileFd::Empty, *comp));
+      EXPECT_TRUE(f.Write(content.data(), content.size()));
+      EXPECT_TRUE(f.Close());
+      _config->Clear(option);
+
+      EXPECT_TRUE(f.Open(file.Name(), FileFd::ReadOnly, *comp));
+      std::string all(content.size(), '\0');
+      EXPECT_TRUE(f.Read(&all[0], all.size()));
+      EXPECT_EQ(content, all);
+      EXPECT_TRUE(f.Close());
+   }
+}
@@ -303,3 +303,64 @@ TEST(HashSumsTest, HashStringList)
 
    _config->Clear("Acquire::ForceHash");
 }
+TEST(HashSumsTest, Parallel)
+{
+   // a bit more than some blocks of the parallel AddFD to test the edges
+   std::string data(3 * 1024 * 1024 + 42, '\0');
+   for (size_t i = 0; i < data.size(); ++i)
+      data[i] = 1 + (i * 7919) % 251;
+
+   FileFd fd;
+   openTemporaryFile("parallelhashes", fd, data.c_str());
+   unsigned long long const size = data.size();
+   EXPECT_EQ(size, fd.FileSize());
+
+   _config->Set("APT::Hashes::Parallel", false);
+   HashStringList expected;
+   {
+      Hashes hashes;
+      for (size_t i = 0; i < data.size(); i += 1000)
+	 hashes.Add(data.c_str() + i, std::min<size_t>(1000, data.size() - i));
+      expected = hashes.GetHashStringList();
+   }
+   EXPECT_EQ(5u, expected.size());
+   {
+      Hashes hashes;
+      EXPECT_TRUE(hashes.AddFD(fd));
+      EXPECT_EQ(expected, hashes.GetHashStringList());
+   }
+
+   _config->Set("APT::Hashes::Parallel", true);
+   {
+      Hashes hashes;
+      hashes.Add(data.c_str(), data.size());
+      EXPECT_EQ(expected, hashes.GetHashStringList());
+   }
+   {
+      Hashes hashes;
+      for (size_t i = 0; i < data.size(); i += 100000)
+	 hashes.Add(data.c_str() + i, std::min<size_t>(100000, data.size() - i));
+      EXPECT_EQ(expected, hashes.GetHashStringList());
+   }
+   fd.Seek(0);
+   {
+      Hashes hashes;
+      EXPECT_TRUE(hashes.AddFD(fd));
+      auto const list = hashes.GetHashStringList();
+      EXPECT_EQ(expected, list);
+      EXPECT_EQ(std::to_string(size), list.find("Checksum-FileSize")->HashValue());
+   }
+   fd.Seek(0);
+   {
+      Hashes hashes(expected);
+      EXPECT_TRUE(hashes.AddFD(fd, size - 42));
+      EXPECT_TRUE(hashes.AddFD(fd, 42));
+      EXPECT_EQ(expected, hashes.GetHashStringList());
+   }
+   fd.Seek(0);
+   {
+      Hashes hashes;
+      EXPECT_FALSE(hashes.AddFD(fd, size + 1));
+   }
+   _config->Clear("APT::Hashes::Parallel");
+}
@@ -343,3 +343,58 @@ TEST(TagFileTest, EmptyTagName)
 
    EXPECT_FALSE(tfile.Step(section));
 }
+
+TEST(TagFileTest, MultilineFields)
+{
+   // continuation lines of all lengths, so that field ends are found at
+   // every position within and across the blocks scanned in one go
+   for (size_t length = 1; length < 70; ++length)
+   {
+      std::string const line(length, 'x');
+      std::string const value = "short\n " + line + "\n\t" + line + "\n .\n " + line + ':';
+      for (std::string const eol : {"\n", "\r\n"})
+      {
+	 std::string content = "Package: pkg" + eol + "Description: " + value;
+	 content.append(eol).append("Tag-" + line + ": yes").append(eol);
+	 content.append(" " + line).append(eol).append(eol);
+
+	 pkgTagSection section;
+	 ASSERT_TRUE(section.Scan(content.c_str(), content.size())) << length;
+	 EXPECT_EQ(3u, section.Count());
+	 EXPECT_EQ("pkg", section.FindS("Package"));
+	 EXPECT_EQ(value, section.FindS("Description"));
+	 EXPECT_EQ("yes" + eol + " " + line, section.FindS("Tag-" + line));
+
+	 // the stanza is not complete without its terminating empty line
+	 EXPECT_FALSE(section.Scan(content.c_str(), content.size() - eol.length()));
+      }
+   }
+}
+
+TEST(TagFileTest, MappedWithoutEmptyLine)
+{
+   for (char const * const end : {"", "\n", "\r\n"})
+   {
+      std::string const content = std::string("Package: pkgA\n\nPackage: pkgB\r\n\r\nPackage: pkgC\nVersion: 1") + end;
+      FileFd fd;
+      openTemporaryFile("mappedwithoutemptyline", fd, content.c_str());
+      pkgTagFile tfile(&fd);
+      pkgTagSection section;
+      ASSERT_TRUE(tfile.Step(section));
+      EXPECT_EQ("pkgA", section.FindS("Package"));
+      ASSERT_TRUE(tfile.Step(section));
+      EXPECT_EQ("pkgB", section.FindS("Package"));
+      unsigned long const offset = tfile.Offset();
+      ASSERT_TRUE(tfile.Step(section));
+      EXPECT_EQ("pkgC", section.FindS("Package"));
+      EXPECT_EQ("1", section.FindS("Version"));
+      EXPECT_FALSE(tfile.Step(section));
+
+      // jumping back works from the copy of the last stanza, too
+      ASSERT_TRUE(tfile.Jump(section, 0));
+      EXPECT_EQ("pkgA", section.FindS("Package"));
+      ASSERT_TRUE(tfile.Jump(section, offset));
+      EXPECT_EQ("pkgC", section.FindS("Package"));
+      EXPECT_EQ("1", section.FindS("Version"));
+   }
+}